@@ -306,6 +306,357 @@ zdb_api_t *zdb_api_set(namespace_t *ns, void *key, size_t ksize, void *payload,
 }
 
 
+//
+// MSET
+//
+// set multiple keys at once, all the payloads are written with a single
+// gathered write on the datafile, all the index entries with a single write
+// on the index file, and sync is checked once, instead of once per key
+//
+// entries are validated before being written, in request order, like if
+// they were set one by one, one reply per entry is set on the replies list
+// (same order), like zdb_api_set would reply
+//
+typedef struct api_mset_item_t {
+    zdb_api_entry_t *source;
+    zdb_api_t **reply;
+    seqid_t seqid;    // generated key, in sequential mode
+
+} api_mset_item_t;
+
+// is the payload the same as the existing one
+static int api_mset_matching(namespace_t *ns, index_entry_t *existing, zdb_api_entry_t *source, uint32_t crc) {
+    if(existing->crc != crc || existing->length != source->payload.size)
+        return 0;
+
+    data_payload_t payload = data_get(ns->data, existing->offset, existing->length, existing->dataid, existing->idlength);
+    if(!payload.buffer)
+        return 0;
+
+    int matching = (memcmp(payload.buffer, source->payload.payload, source->payload.size) == 0);
+    free(payload.buffer);
+
+    return matching;
+}
+
+static size_t api_mset_entry_size(namespace_t *ns, api_mset_item_t *item) {
+    size_t idlength = (ns->index->mode == ZDB_MODE_SEQUENTIAL) ? sizeof(seqid_t) : item->source->key.size;
+    return sizeof(data_entry_header_t) + idlength + item->source->payload.size;
+}
+
+// write a group of entries which fits in the current datafile
+static size_t api_mset_group(namespace_t *ns, api_mset_item_t *items, size_t count) {
+    int sequential = (ns->index->mode == ZDB_MODE_SEQUENTIAL);
+    time_t timestamp = time(NULL);
+    data_request_t *dreqs;
+    index_entry_t **entries;
+    size_t *offsets;
+    size_t written = 0;
+
+    if(!(dreqs = calloc(sizeof(data_request_t), count)))
+        zdb_diep("api: mset: calloc");
+
+    if(!(entries = calloc(sizeof(index_entry_t *), count)))
+        zdb_diep("api: mset: calloc");
+
+    if(!(offsets = calloc(sizeof(size_t), count)))
+        zdb_diep("api: mset: calloc");
+
+    for(size_t i = 0; i < count; i++) {
+        zdb_api_entry_t *source = items[i].source;
+
+        // sequential keys are allocated in order, each
+        // entry inserted increments the next id by one
+        items[i].seqid = index_next_id(ns->index) + i;
+
+        dreqs[i].data = source->payload.payload;
+        dreqs[i].datalength = source->payload.size;
+        dreqs[i].vid = sequential ? (void *) &items[i].seqid : (void *) source->key.payload;
+        dreqs[i].idlength = sequential ? sizeof(seqid_t) : source->key.size;
+        dreqs[i].crc = zdb_crc32(source->payload.payload, source->payload.size);
+        dreqs[i].timestamp = timestamp;
+    }
+
+    if(data_insert_batch(ns->data, dreqs, offsets, count) != count) {
+        for(size_t i = 0; i < count; i++)
+            *items[i].reply = zdb_api_reply_error("Cannot write data right now");
+
+        free(dreqs);
+        free(entries);
+        free(offsets);
+        return 0;
+    }
+
+    index_batch_begin(ns->index);
+
+    for(size_t i = 0; i < count; i++) {
+        index_entry_t *existing = NULL;
+
+        // looking for existing entry now, the same key
+        // could be set by a previous entry of the batch
+        if(!sequential)
+            existing = index_get(ns->index, dreqs[i].vid, dreqs[i].idlength);
+
+        index_entry_t idxreq = {
+            .idlength = dreqs[i].idlength,
+            .offset = offsets[i],
+            .length = dreqs[i].datalength,
+            .crc = dreqs[i].crc,
+            .dataid = ns->data->dataid,
+            .flags = 0,
+            .timestamp = timestamp,
+        };
+
+        index_set_t setter = {
+            .entry = &idxreq,
+            .id = dreqs[i].vid,
+        };
+
+        if(!(entries[i] = index_set(ns->index, &setter, existing))) {
+            *items[i].reply = zdb_api_reply_error("Cannot write index right now");
+            continue;
+        }
+
+        *items[i].reply = zdb_api_reply_buffer(dreqs[i].vid, dreqs[i].idlength);
+        written += 1;
+    }
+
+    // index entries of the batch could not be written, they are dropped
+    // from the index file and from memory, the namespace looks like after
+    // a restart (an updated key was already flagged deleted on disk, it
+    // stays deleted as well)
+    //
+    // in sequential mode, there is no memory entry, key ids are released
+    if(index_batch_commit(ns->index)) {
+        index_batch_rollback(ns->index);
+
+        for(size_t i = 0; i < count; i++) {
+            zdb_api_reply_free(*items[i].reply);
+            *items[i].reply = zdb_api_reply_error("Cannot write index right now");
+
+            if(!entries[i] || sequential)
+                continue;
+
+            // the same key can be set twice on the batch
+            if(index_entry_is_deleted(entries[i])) {
+                entries[i] = NULL;
+                continue;
+            }
+
+            entries[i]->flags |= INDEX_ENTRY_DELETED;
+        }
+
+        for(size_t i = 0; i < count; i++)
+            if(entries[i] && !sequential)
+                index_entry_delete_memory(ns->index, entries[i]);
+
+        written = 0;
+    }
+
+    free(dreqs);
+    free(entries);
+    free(offsets);
+
+    return written;
+}
+
+// write pending accepted entries, by groups fitting into the
+// current datafile, jumping to the next files when needed
+static size_t api_mset_flush(namespace_t *ns, api_mset_item_t *items, size_t accepted) {
+    size_t written = 0;
+    size_t index = 0;
+
+    while(index < accepted) {
+        size_t next = data_next_offset(ns->data);
+        size_t length = api_mset_entry_size(ns, &items[index]);
+        size_t group = 1;
+
+        if(next + length > zdb_rootsettings.datasize) {
+            size_t newid = index_jump_next(ns->index);
+            data_jump_next(ns->data, newid);
+            next = data_next_offset(ns->data);
+        }
+
+        while(index + group < accepted) {
+            size_t entrysize = api_mset_entry_size(ns, &items[index + group]);
+
+            if(next + length + entrysize > zdb_rootsettings.datasize)
+                break;
+
+            length += entrysize;
+            group += 1;
+        }
+
+        zdb_debug("[+] api: mset: writing %lu entries (%lu bytes)\n", group, length);
+
+        written += api_mset_group(ns, items + index, group);
+        index += group;
+    }
+
+    return written;
+}
+
+// find the slot of a key on the pending table (open addressing), the
+// slot contains the accepted item index (plus one) or zero if the key
+// was not accepted yet on this batch
+static size_t *api_mset_pending(size_t *slots, size_t mask, api_mset_item_t *items, zdb_api_buffer_t *key) {
+    size_t slot = zdb_crc32(key->payload, key->size) & mask;
+
+    while(slots[slot]) {
+        zdb_api_buffer_t *previous = &items[slots[slot] - 1].source->key;
+
+        if(previous->size == key->size && memcmp(previous->payload, key->payload, key->size) == 0)
+            return &slots[slot];
+
+        slot = (slot + 1) & mask;
+    }
+
+    return &slots[slot];
+}
+
+size_t zdb_api_mset(namespace_t *ns, zdb_api_entry_t *entries, size_t count, zdb_api_t **replies) {
+    int sequential = (ns->index->mode == ZDB_MODE_SEQUENTIAL);
+    api_mset_item_t *items;
+    size_t *slots = NULL;
+    size_t mask = 0;
+    size_t accepted = 0;
+    size_t written = 0;
+    size_t pending = 0;
+
+    if(!(items = calloc(sizeof(api_mset_item_t), count)))
+        zdb_diep("api: mset: calloc");
+
+    // keys accepted but not written yet, a key can be set more than
+    // once on the same batch, each entry is validated against the
+    // previous one, like if they were sent one by one
+    if(!sequential) {
+        size_t size = 1;
+        while(size < count * 2)
+            size <<= 1;
+
+        if(!(slots = calloc(sizeof(size_t), size)))
+            zdb_diep("api: mset: calloc");
+
+        mask = size - 1;
+    }
+
+    // validating everything first, entries rejected get their reply
+    // now, accepted ones are written afterward, in the same order
+    for(size_t i = 0; i < count; i++) {
+        zdb_api_entry_t *source = &entries[i];
+        index_entry_t *existing = NULL;
+        api_mset_item_t *previous = NULL;
+        size_t *slot = NULL;
+        size_t floating = 0;
+
+        replies[i] = NULL;
+
+        if(source->key.size > MAX_KEY_LENGTH) {
+            replies[i] = zdb_api_reply_error("Key too large");
+            continue;
+        }
+
+        if(!sequential && source->key.size == 0) {
+            replies[i] = zdb_api_reply_error("Invalid argument, key needed");
+            continue;
+        }
+
+        // sequential updates rewrite the original entry in place, they
+        // are not batched, entries accepted before are written first to
+        // keep the request order (the key could be one of them)
+        if(sequential && source->key.size && accepted) {
+            written += api_mset_flush(ns, items, accepted);
+            accepted = 0;
+            pending = 0;
+        }
+
+        if(source->key.size)
+            existing = index_get(ns->index, source->key.payload, source->key.size);
+
+        if(slots) {
+            slot = api_mset_pending(slots, mask, items, &source->key);
+            if(*slot)
+                previous = &items[*slot - 1];
+        }
+
+        // sequential mode only accept update of existing keys
+        if(sequential && source->key.size && !existing) {
+            replies[i] = zdb_api_reply(ZDB_API_INSERT_DENIED, NULL);
+            continue;
+        }
+
+        if(previous) {
+            // key already set by this batch, the previous
+            // entry is the one which will be overwritten
+            zdb_api_buffer_t *payload = &previous->source->payload;
+            floating = payload->size;
+
+            if(ns->worm) {
+                replies[i] = zdb_api_reply_error("Namespace is protected by worm mode");
+                continue;
+            }
+
+            if(payload->size == source->payload.size && memcmp(payload->payload, source->payload.payload, payload->size) == 0) {
+                replies[i] = zdb_api_reply(ZDB_API_UP_TO_DATE, NULL);
+                continue;
+            }
+
+        } else if(existing && !index_entry_is_deleted(existing)) {
+            floating = existing->length;
+
+            if(ns->worm) {
+                replies[i] = zdb_api_reply_error("Namespace is protected by worm mode");
+                continue;
+            }
+
+            uint32_t crc = zdb_crc32(source->payload.payload, source->payload.size);
+
+            if(api_mset_matching(ns, existing, source, crc)) {
+                replies[i] = zdb_api_reply(ZDB_API_UP_TO_DATE, NULL);
+                continue;
+            }
+        }
+
+        // check if namespace limitation is set, taking
+        // previous entries of the batch into account
+        if(ns->maxsize) {
+            if(ns->index->stats.datasize + pending + source->payload.size > ns->maxsize + floating) {
+                replies[i] = zdb_api_reply_error("No space left on this namespace");
+                continue;
+            }
+        }
+
+        if(sequential && existing) {
+            if(data_next_offset(ns->data) + source->payload.size > zdb_rootsettings.datasize) {
+                size_t newid = index_jump_next(ns->index);
+                data_jump_next(ns->data, newid);
+            }
+
+            replies[i] = api_set_handler_sequential(ns, source->key.payload, source->key.size, source->payload.payload, source->payload.size, existing);
+            if(replies[i]->status == ZDB_API_BUFFER)
+                written += 1;
+
+            continue;
+        }
+
+        pending += source->payload.size;
+
+        items[accepted].source = source;
+        items[accepted].reply = &replies[i];
+        accepted += 1;
+
+        if(slot)
+            *slot = accepted;
+    }
+
+    written += api_mset_flush(ns, items, accepted);
+
+    free(slots);
+    free(items);
+
+    return written;
+}
+
 //
 // GET
 //
@@ -342,6 +693,42 @@ zdb_api_t *zdb_api_get(namespace_t *ns, void *key, size_t ksize) {
     return zdb_api_reply_entry(key, ksize, payload.buffer, payload.length);
 }
 
+// read only a part of the payload, starting at 'start' (inside the payload)
+// for maximum 'length' bytes, range is truncated to the payload size
+zdb_api_t *zdb_api_getrange(namespace_t *ns, void *key, size_t ksize, size_t start, size_t length) {
+    index_entry_t *entry = NULL;
+
+    if(!(entry = index_get(ns->index, key, ksize))) {
+        zdb_debug("[-] api: getrange: key not found\n");
+        return zdb_api_reply(ZDB_API_NOT_FOUND, NULL);
+    }
+
+    if(entry->flags & INDEX_ENTRY_DELETED) {
+        zdb_verbose("[-] api: getrange: key deleted\n");
+        return zdb_api_reply(ZDB_API_DELETED, NULL);
+    }
+
+    // range outside of the payload, nothing to read
+    if(start >= entry->length)
+        length = 0;
+
+    if(length > entry->length - start)
+        length = entry->length - start;
+
+    zdb_debug("[+] api: getrange: data file: %d, data offset: %" PRIu32 ", range: %zu+%zu\n", entry->dataid, entry->offset, start, length);
+
+    data_root_t *data = ns->data;
+    data_payload_t payload = data_get_range(data, entry->offset, start, length, entry->dataid, entry->idlength);
+
+    if(!payload.buffer) {
+        zdb_log("[-] api: getrange: cannot read payload\n");
+        return zdb_api_reply(ZDB_API_INTERNAL_ERROR, NULL);
+    }
+
+    // WARNING: buffer is not duplicated when setting payload reply
+    // it wil be free by zdb_api_reply_free later
+    return zdb_api_reply_entry(key, ksize, payload.buffer, payload.length);
+}
 
 //
 // DATASET
@@ -37,7 +37,9 @@
     } zdb_api_entry_t;
 
     zdb_api_t *zdb_api_set(namespace_t *ns, void *key, size_t ksize, void *payload, size_t psize);
+    size_t zdb_api_mset(namespace_t *ns, zdb_api_entry_t *entries, size_t count, zdb_api_t **replies);
     zdb_api_t *zdb_api_get(namespace_t *ns, void *key, size_t ksize);
+    zdb_api_t *zdb_api_getrange(namespace_t *ns, void *key, size_t ksize, size_t start, size_t length);
     zdb_api_t *zdb_api_exists(namespace_t *ns, void *key, size_t ksize);
     zdb_api_t *zdb_api_check(namespace_t *ns, void *key, size_t ksize);
     zdb_api_t *zdb_api_del(namespace_t *ns, void *key, size_t ksize);
@@ -52,6 +52,7 @@ zdb_settings_t *zdb_initialize() {
     s->synctime = 0;
     s->hook = NULL;
     s->maxsize = 0;
+    s->scrubrate = 0;
 
     // initialize stats and init time
     memset(&s->stats, 0x00, sizeof(zdb_stats_t));
@@ -146,6 +147,8 @@ zdb_settings_t *zdb_open(zdb_settings_t *zdb_settings) {
 
 void zdb_close(zdb_settings_t *zdb_settings) {
     zdb_debug("[+] bootstrap: closing database\n");
+    scrub_destroy();
+
     namespaces_destroy(zdb_settings);
 
     // cleanup hook subsystem
@@ -161,3 +164,17 @@ void zdb_close(zdb_settings_t *zdb_settings) {
     close(zdb_settings->datalock);
 }
 
+// reusable buffers used while reading or writing entries are per thread,
+// a thread calling the library (other than the one which opened it) needs
+// to attach itself first, and detach before exiting
+//
+// only namespaces are meant to be used from multiple threads, each namespace
+// by a single thread at a time, anything else (namespaces creation, removal,
+// settings, ...) is expected to be done with other threads paused
+void zdb_thread_attach() {
+    index_internal_allocate_single();
+}
+
+void zdb_thread_detach() {
+    index_destroy_global();
+}
@@ -4,4 +4,7 @@
     zdb_settings_t *zdb_initialize();
     zdb_settings_t *zdb_open(zdb_settings_t *zdb_settings);
     void zdb_close(zdb_settings_t *zdb_settings);
+
+    void zdb_thread_attach();
+    void zdb_thread_detach();
 #endif
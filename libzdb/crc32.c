@@ -81,9 +81,7 @@ static const uint32_t crc32c_table[256] = {
 };
 
 // default crc32c software implementation
-static uint32_t crc32c_software(const uint8_t *data, unsigned int length) {
-    uint32_t crc = 0;
-
+static uint32_t crc32c_software(uint32_t crc, const uint8_t *data, unsigned int length) {
     while(length--)
         crc = crc32c_table[(crc ^ *data++) & 0xFFL] ^ (crc >> 8);
 
@@ -92,9 +90,8 @@ static uint32_t crc32c_software(const uint8_t *data, unsigned int length) {
 
 // x86_64 sse4.2 hardware optimized implementation
 #ifdef __SSE4_2__
-static uint32_t crc32c_sse42(const uint8_t *bytes, size_t len) {
+static uint32_t crc32c_sse42(uint32_t hash, const uint8_t *bytes, size_t len) {
     uint64_t *input = (uint64_t *) bytes;
-    uint32_t hash = 0;
     size_t i = 0;
 
     if(len >= 8) {
@@ -112,9 +109,8 @@ static uint32_t crc32c_sse42(const uint8_t *bytes, size_t len) {
 
 // armv8 hardware optimized implementation
 #ifdef __ARM_FEATURE_CRC32
-static uint32_t crc32c_armv8(const uint8_t *bytes, size_t len) {
+static uint32_t crc32c_armv8(uint32_t hash, const uint8_t *bytes, size_t len) {
     uint64_t *input = (uint64_t *) bytes;
-    uint32_t hash = 0;
     size_t i = 0;
 
     if(len >= 8) {
@@ -142,15 +138,21 @@ char *zdb_crc32_engine_value() {
     return "software";
 }
 
-uint32_t zdb_crc32(const uint8_t *bytes, ssize_t length) {
+// update an existing crc32 with more bytes, this allows to
+// compute the crc32 of a payload received in multiple chunks
+uint32_t zdb_crc32_update(uint32_t crc, const uint8_t *bytes, ssize_t length) {
     #ifdef __SSE4_2__
-    return crc32c_sse42(bytes, length);
+    return crc32c_sse42(crc, bytes, length);
     #endif
 
     #ifdef __ARM_FEATURE_CRC32
-    return crc32c_armv8(bytes, length);
+    return crc32c_armv8(crc, bytes, length);
     #endif
 
-    return crc32c_software(bytes, length);
+    return crc32c_software(crc, bytes, length);
+}
+
+uint32_t zdb_crc32(const uint8_t *bytes, ssize_t length) {
+    return zdb_crc32_update(0, bytes, length);
 }
 
@@ -7,4 +7,7 @@
     // libzdb crc32 with auto-selection of best engine
     uint32_t zdb_crc32(const uint8_t *bytes, ssize_t length);
 
+    // update a crc32 with more bytes (chunked payload)
+    uint32_t zdb_crc32_update(uint32_t crc, const uint8_t *bytes, ssize_t length);
+
 #endif
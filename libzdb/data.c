@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <limits.h>
@@ -75,7 +76,7 @@ static int data_write(int fd, void *buffer, size_t length, int syncer, data_root
 
     if((response = write(fd, buffer, length)) < 0) {
         // update statistics
-        zdb_rootsettings.stats.datawritefailed += 1;
+        zdb_stats_add(datawritefailed, 1);
 
         // update namespace statistics
         root->stats.errors += 1;
@@ -93,7 +94,7 @@ static int data_write(int fd, void *buffer, size_t length, int syncer, data_root
     zdb_debug("[+] data: wrote %lu bytes to fd %d\n", response, fd);
 
     // update statistics
-    zdb_rootsettings.stats.datadiskwrite += length;
+    zdb_stats_add(datadiskwrite, length);
 
     if(syncer)
         data_sync_check(root, fd);
@@ -101,6 +102,81 @@ static int data_write(int fd, void *buffer, size_t length, int syncer, data_root
     return 1;
 }
 
+#ifdef __linux__
+// copy payload from a file descriptor (from offset 0) to the end of the
+// current datafile, inside the kernel, nothing goes through userspace and
+// filesystems supporting it can even share the blocks instead of copying
+//
+// the datafile descriptor is in append mode, which is not supported by
+// copy_file_range, a plain write descriptor is opened for the copy
+//
+// returns amount of bytes copied, which can be less than requested if
+// the copy is not supported (eg: spool on another filesystem)
+static size_t data_copy_range(data_root_t *root, int sourcefd, size_t length) {
+    off_t input = 0;
+    off_t output;
+    int fd;
+
+    if((fd = open(root->datafile, O_WRONLY)) < 0)
+        return 0;
+
+    output = lseek(fd, 0, SEEK_END);
+
+    while(length > 0) {
+        ssize_t copied = copy_file_range(sourcefd, &input, fd, &output, length, 0);
+
+        if(copied <= 0) {
+            if(copied < 0 && errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP)
+                zdb_warnp("data write: copy range");
+
+            break;
+        }
+
+        length -= copied;
+    }
+
+    close(fd);
+
+    return input;
+}
+#endif
+
+// write payload coming from a file descriptor (from offset 0), the copy
+// is done by the kernel when possible, otherwise by chunks, this is used
+// for large payload which are not kept in memory
+static int data_write_from_fd(int fd, int sourcefd, size_t length, data_root_t *root) {
+    char buffer[ZDB_DATA_STREAM_CHUNK];
+    off_t offset = 0;
+
+    #ifdef __linux__
+    if((offset = data_copy_range(root, sourcefd, length)) > 0) {
+        zdb_stats_add(datadiskwrite, offset);
+        length -= offset;
+    }
+    #endif
+
+    // copy not supported, or stopped in the middle,
+    // remaining part is written from here
+    while(length > 0) {
+        size_t chunk = (length > sizeof(buffer)) ? sizeof(buffer) : length;
+
+        if(pread(sourcefd, buffer, chunk, offset) != (ssize_t) chunk) {
+            zdb_warnp("data write: source read");
+            return 0;
+        }
+
+        if(!data_write(fd, buffer, chunk, 0, root))
+            return 0;
+
+        offset += chunk;
+        length -= chunk;
+    }
+
+    data_sync_check(root, fd);
+
+    return 1;
+}
+
 // if one datafile is not found while trying to open it
 // this can call external hook to request that missing file
 //
@@ -208,12 +284,82 @@ data_header_t *data_descriptor_validate(data_header_t *header, data_root_t *root
     return header;
 }
 
+// close a cached reader and release the slot
+static void data_reader_close(data_reader_t *reader) {
+    if(reader->fd > 0)
+        close(reader->fd);
+
+    reader->fd = 0;
+    reader->dataid = 0;
+    reader->used = 0;
+}
+
+// get a read-only file descriptor on a previous datafile, from
+// the readers cache if available, otherwise the file is opened and
+// replace the least recently used reader
+static int data_reader_get(data_root_t *root, fileid_t dataid) {
+    data_reader_t *oldest = &root->readers[0];
+    int fd;
+
+    for(int i = 0; i < ZDB_DATA_READERS; i++) {
+        data_reader_t *reader = &root->readers[i];
+
+        if(reader->fd > 0 && reader->dataid == dataid) {
+            reader->used = time(NULL);
+            return reader->fd;
+        }
+
+        if(reader->used < oldest->used)
+            oldest = reader;
+    }
+
+    zdb_debug("[-] data: switching file: %d, requested: %d\n", root->dataid, dataid);
+
+    if((fd = data_open_id(root, dataid)) < 0)
+        return -1;
+
+    data_reader_close(oldest);
+
+    oldest->fd = fd;
+    oldest->dataid = dataid;
+    oldest->used = time(NULL);
+
+    // reader needs to be expired later
+    namespace_housekeeping(root->namespace);
+
+    return fd;
+}
+
+// close readers not used since a while, this avoid keeping a lot of
+// file descriptors opened with lot of namespaces, and release space
+// of datafiles removed (offloaded) in the meantime
+void data_readers_expire(data_root_t *root) {
+    time_t now = time(NULL);
+
+    for(int i = 0; i < ZDB_DATA_READERS; i++) {
+        data_reader_t *reader = &root->readers[i];
+
+        if(reader->fd > 0 && reader->used + ZDB_DATA_READERS_EXPIRE < now) {
+            zdb_debug("[+] data: closing unused reader: %u\n", reader->dataid);
+            data_reader_close(reader);
+        }
+    }
+}
+
+// returns 1 if any reader is still opened
+int data_readers_opened(data_root_t *root) {
+    for(int i = 0; i < ZDB_DATA_READERS; i++)
+        if(root->readers[i].fd > 0)
+            return 1;
+
+    return 0;
+}
+
 // main function to call when you need to deal with data id
 // this function takes care to open the right file id:
 //  - if you want the current opened file id, you have thid fd
-//  - if the file is not opened yet, you'll receive a new fd
-// you need to call the .... to be consistant about cleaning this
-// file open, if a new one was opened
+//  - otherwise you'll receive a cached read-only fd on that file
+// you need to call data_release_dataid when you're done with the fd
 //
 // if the data id could not be opened, -1 is returned
 static inline int data_grab_dataid(data_root_t *root, fileid_t dataid) {
@@ -221,9 +367,8 @@ static inline int data_grab_dataid(data_root_t *root, fileid_t dataid) {
 
     if(root->dataid != dataid) {
         // the requested datafile is not the current datafile opened
-        // we will re-open the expected datafile temporarily
-        zdb_debug("[-] data: switching file: %d, requested: %d\n", root->dataid, dataid);
-        if((fd = data_open_id(root, dataid)) < 0)
+        // using (or opening) a reader on the expected datafile
+        if((fd = data_reader_get(root, dataid)) < 0)
             return -1;
     }
 
@@ -231,28 +376,18 @@ static inline int data_grab_dataid(data_root_t *root, fileid_t dataid) {
 }
 
 static inline void data_release_dataid(data_root_t *root, fileid_t dataid, int fd) {
-    // if the requested data id (or fd) is not the one
-    // currently in use by the main structure, we close it
-    // since it was temporary
-    if(root->dataid != dataid) {
-        close(fd);
-    }
+    // file descriptor are owned by the main structure or by the
+    // readers cache, nothing to close here, readers are closed
+    // when expired or when the data root is destroyed
+    (void) root;
+    (void) dataid;
+    (void) fd;
 }
 
 //
 // data management
 //
-void data_initialize(char *filename, data_root_t *root) {
-    int fd;
-
-    if((fd = open(filename, O_CREAT | O_RDWR, 0600)) < 0) {
-        // ignoring initializer on read-only filesystem
-        if(errno == EROFS)
-            return;
-
-        zdb_diep(filename);
-    }
-
+static void data_initialize_fd(int fd, char *filename, fileid_t fileid, data_root_t *root) {
     #ifdef __linux__
     // pre-allocate data size to avoid fragmentation, only on Linux
     zdb_settings_t *settings = zdb_settings_get();
@@ -267,10 +402,24 @@ void data_initialize(char *filename, data_root_t *root) {
     header.version = ZDB_DATAFILE_VERSION;
     header.created = 0; // timestamp are not used anymore, this allows
     header.opened = 0;  // checksum comparaison more efficient across replicat
-    header.fileid = root->dataid;
+    header.fileid = fileid;
 
     if(!data_write(fd, &header, sizeof(data_header_t), 1, root))
         zdb_diep(filename);
+}
+
+void data_initialize(char *filename, data_root_t *root) {
+    int fd;
+
+    if((fd = open(filename, O_CREAT | O_RDWR, 0600)) < 0) {
+        // ignoring initializer on read-only filesystem
+        if(errno == EROFS)
+            return;
+
+        zdb_diep(filename);
+    }
+
+    data_initialize_fd(fd, filename, root->dataid, root);
 
     close(fd);
 }
@@ -280,7 +429,33 @@ static void data_set_id(data_root_t *root) {
     sprintf(root->datafile, "%s/d%u", root->datadir, root->dataid);
 }
 
-static void data_open_final(data_root_t *root) {
+// check if the entry at offset looks like a valid entry
+// which fits in the file, returns the offset of the next entry
+// or 0 if the entry is not valid
+static off_t data_entry_next(int fd, off_t offset, off_t filesize) {
+    data_entry_header_t header;
+
+    if(offset < (off_t) sizeof(data_header_t) || offset >= filesize)
+        return 0;
+
+    if(pread(fd, &header, sizeof(data_entry_header_t), offset) != sizeof(data_entry_header_t))
+        return 0;
+
+    off_t next = offset + sizeof(data_entry_header_t) + header.idlength + header.datalength;
+    if(next > filesize)
+        return 0;
+
+    return next;
+}
+
+// open the datafile for appending and find the last entry offset
+//
+// the hint is the offset of an entry known to be in the file (eg: last
+// entry from the index), the file is only read from there, which makes
+// opening a large datafile O(1) in the common case, entries appended
+// after the hint (deletion, entries not indexed before a crash, ...)
+// are still walked, if the hint is not valid, the whole file is read
+static void data_open_final(data_root_t *root, size_t hint) {
     // try to open the datafile in write mode to append new data
     if((root->datafd = open(root->datafile, O_CREAT | O_RDWR | O_APPEND, 0600)) < 0) {
         // maybe we are on a read-only filesystem
@@ -294,24 +469,36 @@ static void data_open_final(data_root_t *root) {
         zdb_debug("[+] data: file opened in read-only mode\n");
     }
 
-    // jumping to the first entry
-    lseek(root->datafd, sizeof(data_header_t), SEEK_SET);
-
-    // reading all indexes to find where is the last one
-    data_entry_header_t header;
+    off_t filesize = lseek(root->datafd, 0, SEEK_END);
+    off_t offset = sizeof(data_header_t);
+    off_t next;
     int entries = 0;
+    int hinted = 0;
 
-    zdb_debug("[+] data: reading file, finding last entry\n");
+    if(hint && data_entry_next(root->datafd, hint, filesize)) {
+        zdb_debug("[+] data: reading file from hint offset: %lu\n", hint);
+        offset = hint;
+        hinted = 1;
 
-    while(read(root->datafd, &header, sizeof(data_entry_header_t)) == sizeof(data_entry_header_t)) {
-        root->previous = lseek(root->datafd, 0, SEEK_CUR) - sizeof(data_entry_header_t);
-        lseek(root->datafd, header.datalength + header.idlength, SEEK_CUR);
+    } else {
+        zdb_debug("[+] data: reading file, finding last entry\n");
+    }
 
+    // reading all entries headers (from offset) to find where is the last one,
+    // a truncated entry at the end (torn write) is still considered as last entry,
+    // like it would be when walking the whole file
+    while(offset + (off_t) sizeof(data_entry_header_t) <= filesize) {
+        root->previous = offset;
         entries += 1;
+
+        if(!(next = data_entry_next(root->datafd, offset, filesize)))
+            break;
+
+        offset = next;
     }
 
     zdb_debug("[+] data: entries read: %d, last offset: %lu\n", entries, root->previous);
-    zdb_verbose("[+] data: active file: %s\n", root->datafile);
+    zdb_verbose("[+] data: active file: %s (%s)\n", root->datafile, hinted ? "index hint" : "full walk");
 }
 
 data_raw_t data_raw_error(data_raw_t raw) {
@@ -348,7 +535,7 @@ data_raw_t data_raw_get_real(int fd, off_t offset) {
         return data_raw_error(raw);
     }
 
-    if(raw.header.datalength > ZDB_DATA_MAX_PAYLOAD) {
+    if(raw.header.datalength > ZDB_DATA_MAX_STREAM_PAYLOAD) {
         zdb_verbose("[-] data: raw: datalength from header too large\n");
         return data_raw_error(raw);
     }
@@ -408,39 +595,163 @@ data_raw_t data_raw_get(data_root_t *root, fileid_t dataid, off_t offset) {
     return raw;
 }
 
-// jumping to the next id close the current data file
-// and open the next id file, it will create the new file
-size_t data_jump_next(data_root_t *root, fileid_t newid) {
-    hook_t *hook = NULL;
+// prepared (next) datafile uses a temporary name, this file
+// is not visible as a datafile until it's swapped in
+static void data_prepared_filename(char *buffer, data_root_t *root, fileid_t id) {
+    sprintf(buffer, "%s/d%u.next", root->datadir, id);
+}
 
-    zdb_verbose("[+] data: jumping to the next file\n");
+// discard the prepared datafile, if any
+static void data_prepared_discard(data_root_t *root) {
+    char filename[ZDB_PATH_MAX];
 
-    if(zdb_rootsettings.hook) {
-        hook = hook_new("jump-data", 3);
-        hook_append(hook, zdb_rootsettings.zdbid);
-        hook_append(hook, root->datafile);
+    if(root->nextfd <= 0)
+        return;
+
+    data_prepared_filename(filename, root, root->nextid);
+    zdb_debug("[+] data: discarding prepared file: %s\n", filename);
+
+    close(root->nextfd);
+    unlink(filename);
+
+    root->nextfd = 0;
+}
+
+// returns 1 when the current datafile is close to be full
+// and the next datafile is not prepared yet
+int data_prepare_needed(data_root_t *root) {
+    zdb_settings_t *settings = zdb_settings_get();
+
+    if(root->nextfd > 0)
+        return 0;
+
+    size_t threshold = (settings->datasize / 100) * ZDB_DATA_PREPARE_RATIO;
+    return (data_next_offset(root) >= threshold);
+}
+
+// flag the namespace for housekeeping when the datafile just
+// reached the prepare ratio (end is the offset after the last write)
+static void data_prepare_check(data_root_t *root, size_t end) {
+    zdb_settings_t *settings = zdb_settings_get();
+
+    if(root->nextfd > 0)
+        return;
+
+    if(end >= (settings->datasize / 100) * ZDB_DATA_PREPARE_RATIO)
+        namespace_housekeeping(root->namespace);
+}
+
+// create, pre-allocate and initialize the next datafile in advance
+// this is expected to be called when nothing else is going on, this way
+// jumping to the next file is only a rename and a file descriptor swap
+int data_prepare_next(data_root_t *root, fileid_t nextid) {
+    char filename[ZDB_PATH_MAX];
+    int fd;
+
+    // already prepared
+    if(root->nextfd > 0 && root->nextid == nextid)
+        return 0;
+
+    data_prepared_discard(root);
+    data_prepared_filename(filename, root, nextid);
+
+    zdb_debug("[+] data: preparing next file: %s\n", filename);
+
+    if((fd = open(filename, O_CREAT | O_TRUNC | O_RDWR | O_APPEND, 0600)) < 0) {
+        zdb_warnp(filename);
+        return -1;
+    }
+
+    data_initialize_fd(fd, filename, nextid, root);
+
+    root->nextfd = fd;
+    root->nextid = nextid;
+
+    return 0;
+}
+
+// swap the prepared datafile as the current one
+// returns 0 if no (valid) prepared file was available
+static int data_prepared_swap(data_root_t *root) {
+    char filename[ZDB_PATH_MAX];
+
+    if(root->nextfd <= 0)
+        return 0;
+
+    if(root->nextid != root->dataid) {
+        data_prepared_discard(root);
+        return 0;
+    }
+
+    data_prepared_filename(filename, root, root->nextid);
+
+    if(rename(filename, root->datafile) < 0) {
+        zdb_warnp(filename);
+        data_prepared_discard(root);
+        return 0;
     }
 
+    root->datafd = root->nextfd;
+    root->nextfd = 0;
+
+    zdb_verbose("[+] data: active file: %s (prepared)\n", root->datafile);
+
+    return 1;
+}
+
+// flush and close the previous datafile, the one which was
+// sealed by the last jump, and notify the hook about the jump
+// (only when file is really on the disk)
+void data_sealed_flush(data_root_t *root) {
+    char filename[ZDB_PATH_MAX];
+
+    if(root->sealedfd <= 0)
+        return;
+
+    sprintf(filename, "%s/d%u", root->datadir, root->sealedid);
+
     // flushing data
     if(root->secure) {
-        zdb_verbose("[+] data: flushing file before closing\n");
-        fsync(root->datafd);
+        zdb_verbose("[+] data: flushing sealed file: %s\n", filename);
+        fsync(root->sealedfd);
     }
 
-    // closing current file descriptor
-    zdb_verbose("[+] data: closing current datafile\n");
-    close(root->datafd);
+    close(root->sealedfd);
+    root->sealedfd = 0;
+
+    if(zdb_rootsettings.hook) {
+        hook_t *hook = hook_new("jump-data", 3);
+        hook_append(hook, zdb_rootsettings.zdbid);
+        hook_append(hook, filename);
+        hook_append(hook, root->datafile);
+        hook_execute(hook);
+    }
+}
+
+// jumping to the next id close the current data file
+// and open the next id file, it will create the new file
+//
+// if the next file was prepared in advance, this is only a swap,
+// the previous file is kept open and will be flushed and closed
+// later by data_sealed_flush, out of the write path
+size_t data_jump_next(data_root_t *root, fileid_t newid) {
+    zdb_verbose("[+] data: jumping to the next file\n");
+
+    // previous jump was not sealed yet, do it now
+    data_sealed_flush(root);
+
+    // keeping current file descriptor for later
+    root->sealedfd = root->datafd;
+    root->sealedid = root->dataid;
+    namespace_housekeeping(root->namespace);
 
     // moving to the next file
     root->dataid = newid;
     data_set_id(root);
 
-    data_initialize(root->datafile, root);
-    data_open_final(root);
-
-    if(zdb_rootsettings.hook) {
-        hook_append(hook, root->datafile);
-        hook_execute(hook);
+    if(!data_prepared_swap(root)) {
+        data_initialize(root->datafile, root);
+        data_open_final(root, 0);
     }
 
     return root->dataid;
@@ -490,7 +801,7 @@ static inline data_payload_t data_get_real(int fd, size_t offset, size_t length,
     payload.length = length;
 
     if(read(fd, payload.buffer, length) != (ssize_t) length) {
-        zdb_rootsettings.stats.datareadfailed += 1;
+        zdb_stats_add(datareadfailed, 1);
         zdb_warnp("data_get: incorrect read length");
 
         free(payload.buffer);
@@ -498,11 +809,118 @@ static inline data_payload_t data_get_real(int fd, size_t offset, size_t length,
     }
 
     // update statistics
-    zdb_rootsettings.stats.datadiskread += length;
+    zdb_stats_add(datadiskread, length);
 
     return payload;
 }
 
+// locate a part of a payload on the datafile without reading it, a dedicated
+// read-only file descriptor is returned (and needs to be closed by the
+// caller), this can then be used to stream (sendfile) the payload
+//
+// start is the offset inside the payload, the caller is responsible
+// to ensure start and length are inside the payload
+//
+// on error, returned fd is -1
+data_stream_t data_get_stream_range(data_root_t *root, size_t offset, size_t start, size_t length, fileid_t dataid, uint8_t idlength) {
+    data_stream_t stream = {
+        .fd = -1,
+        .offset = offset + sizeof(data_entry_header_t) + idlength + start,
+        .length = length,
+    };
+
+    zdb_debug("[+] data: stream data: id %u, offset %lu, start: %lu, length: %lu\n", dataid, offset, start, length);
+
+    if((stream.fd = data_open_id(root, dataid)) < 0)
+        return stream;
+
+    // update statistics
+    zdb_stats_add(datadiskread, length);
+
+    return stream;
+}
+
+// locate a full payload on the datafile (see data_get_stream_range)
+data_stream_t data_get_stream(data_root_t *root, size_t offset, size_t length, fileid_t dataid, uint8_t idlength) {
+    return data_get_stream_range(root, offset, 0, length, dataid, idlength);
+}
+
+// read only a part of a payload, without reading the whole payload
+//
+// start is the offset inside the payload, the caller is responsible
+// to ensure start and length are inside the payload (eg: from index)
+data_payload_t data_get_range(data_root_t *root, size_t offset, size_t start, size_t length, fileid_t dataid, uint8_t idlength) {
+    int fd;
+    data_payload_t payload = {
+        .buffer = NULL,
+        .length = 0
+    };
+
+    zdb_debug("[+] data: request range: id %u, offset %lu, start: %lu, length: %lu\n", dataid, offset, start, length);
+
+    if(!(payload.buffer = malloc(length))) {
+        zdb_warnp("data: range: malloc");
+        return payload;
+    }
+
+    // acquire data id fd
+    if((fd = data_grab_dataid(root, dataid)) < 0) {
+        free(payload.buffer);
+        payload.buffer = NULL;
+        return payload;
+    }
+
+    off_t position = offset + sizeof(data_entry_header_t) + idlength + start;
+    payload.length = length;
+
+    if(pread(fd, payload.buffer, length, position) != (ssize_t) length) {
+        zdb_stats_add(datareadfailed, 1);
+        zdb_warnp("data: range: incorrect read length");
+
+        free(payload.buffer);
+        payload.buffer = NULL;
+    }
+
+    // update statistics
+    zdb_stats_add(datadiskread, length);
+
+    // release dataid
+    data_release_dataid(root, dataid, fd);
+
+    return payload;
+}
+
+// open an anonymous temporary file, on the same filesystem than
+// the datafiles, which can be used to receive a large payload before
+// inserting it (see data_request_t datafd)
+int data_spool_open(data_root_t *root) {
+    return data_spool_open_path(root->datadir);
+}
+
+// same as data_spool_open, on any directory, this doesn't touch the data
+// root and can be called before knowing the namespace (network threads)
+int data_spool_open_path(char *path) {
+    int fd;
+
+    #ifdef O_TMPFILE
+    if((fd = open(path, O_TMPFILE | O_RDWR, 0600)) >= 0)
+        return fd;
+    #endif
+
+    // fallback to a named file, removed directly
+    char filename[ZDB_PATH_MAX];
+    sprintf(filename, "%s/spool-XXXXXX", path);
+
+    if((fd = mkstemp(filename)) < 0) {
+        zdb_warnp(filename);
+        return -1;
+    }
+
+    unlink(filename);
+
+    return fd;
+}
+
 // wrapper for data_get_real, which opens the right dataid
 // allowing to do only what's necessary and this wrapper
 // just prepares the right data id
@@ -527,6 +945,163 @@ data_payload_t data_get(data_root_t *root, size_t offset, size_t length, fileid_
     return payload;
 }
 
+// order batched locations by datafile, then by offset
+static int data_location_compare(const void *a, const void *b) {
+    const data_location_t *la = *(const data_location_t **) a;
+    const data_location_t *lb = *(const data_location_t **) b;
+
+    if(la->dataid != lb->dataid)
+        return (la->dataid < lb->dataid) ? -1 : 1;
+
+    if(la->offset != lb->offset)
+        return (la->offset < lb->offset) ? -1 : 1;
+
+    return 0;
+}
+
+// offset of the payload itself (header and id skipped)
+static inline size_t data_location_payload(data_location_t *location) {
+    return location->offset + sizeof(data_entry_header_t) + location->idlength;
+}
+
+// read a run of sorted locations (same datafile) with a single call,
+// headers and gaps between payloads are read into the discard buffer
+static int data_get_batch_run(int fd, data_location_t **run, size_t length, struct iovec *iov, unsigned char *discard) {
+    size_t start = data_location_payload(run[0]);
+    size_t position = start;
+    int iovcnt = 0;
+
+    for(size_t i = 0; i < length; i++) {
+        size_t payload = data_location_payload(run[i]);
+
+        if(payload > position) {
+            iov[iovcnt].iov_base = discard;
+            iov[iovcnt].iov_len = payload - position;
+            iovcnt += 1;
+        }
+
+        iov[iovcnt].iov_base = run[i]->buffer;
+        iov[iovcnt].iov_len = run[i]->length;
+        iovcnt += 1;
+
+        position = payload + run[i]->length;
+    }
+
+    zdb_debug("[+] data: batch: reading %zu payloads, offset %zu, %zu bytes\n", length, start, position - start);
+
+    if(preadv(fd, iov, iovcnt, start) != (ssize_t) (position - start))
+        return -1;
+
+    return 0;
+}
+
+// read multiple payloads at once, reads are sorted by datafile and offset
+// and close payloads are read with a single call, this keeps disk access
+// near-sequential when lot of keys are requested at once
+//
+// locations are filled in place (order is not changed), buffer is NULL
+// for each payload which could not be read, returns amount of payloads
+// successfully read
+size_t data_get_batch(data_root_t *root, data_location_t *locations, size_t count) {
+    data_location_t **sorted;
+    struct iovec *iov;
+    unsigned char *discard;
+    size_t success = 0;
+    size_t index = 0;
+
+    if(count == 0)
+        return 0;
+
+    if(!(sorted = malloc(sizeof(data_location_t *) * count)))
+        zdb_diep("data_get_batch: malloc");
+
+    if(!(iov = malloc(sizeof(struct iovec) * IOV_MAX)))
+        zdb_diep("data_get_batch: malloc");
+
+    if(!(discard = malloc(ZDB_DATA_BATCH_GAP)))
+        zdb_diep("data_get_batch: malloc");
+
+    for(size_t i = 0; i < count; i++) {
+        locations[i].buffer = NULL;
+        sorted[i] = &locations[i];
+    }
+
+    qsort(sorted, count, sizeof(data_location_t *), data_location_compare);
+
+    while(index < count) {
+        fileid_t dataid = sorted[index]->dataid;
+        int fd;
+
+        zdb_debug("[+] data: batch: request data: id %u\n", dataid);
+
+        if((fd = data_grab_dataid(root, dataid)) < 0) {
+            // datafile not available, skipping all its payloads
+            while(index < count && sorted[index]->dataid == dataid)
+                index += 1;
+
+            continue;
+        }
+
+        while(index < count && sorted[index]->dataid == dataid) {
+            data_location_t **run = &sorted[index];
+            size_t start = data_location_payload(run[0]);
+            size_t end = start + run[0]->length;
+            size_t length = 1;
+            int iovcnt = 2;
+
+            // extending the run while the next payload is close enough,
+            // a key requested twice (same offset) starts a new run
+            while(index + length < count) {
+                data_location_t *next = run[length];
+                size_t payload = data_location_payload(next);
+
+                if(next->dataid != dataid || payload < end)
+                    break;
+
+                if(payload - end > ZDB_DATA_BATCH_GAP || iovcnt + 2 > IOV_MAX)
+                    break;
+
+                if(payload + next->length - start > ZDB_DATA_BATCH_MAX)
+                    break;
+
+                end = payload + next->length;
+                iovcnt += 2;
+                length += 1;
+            }
+
+            for(size_t i = 0; i < length; i++)
+                if(!(run[i]->buffer = malloc(run[i]->length)))
+                    zdb_diep("data_get_batch: malloc");
+
+            if(data_get_batch_run(fd, run, length, iov, discard) < 0) {
+                zdb_stats_add(datareadfailed, 1);
+                zdb_warnp("data_get_batch: incorrect read length");
+
+                for(size_t i = 0; i < length; i++) {
+                    free(run[i]->buffer);
+                    run[i]->buffer = NULL;
+                }
+
+            } else {
+                for(size_t i = 0; i < length; i++)
+                    zdb_stats_add(datadiskread, run[i]->length);
+
+                success += length;
+            }
+
+            index += length;
+        }
+
+        data_release_dataid(root, dataid, fd);
+    }
+
+    free(discard);
+    free(iov);
+    free(sorted);
+
+    return success;
+}
+
 
 // check payload integrity from any datafile
 // real implementation
@@ -550,7 +1125,7 @@ static inline int data_check_real(int fd, size_t offset) {
 
     if(read(fd, buffer, header.datalength) != (ssize_t) header.datalength) {
         // update statistics
-        zdb_rootsettings.stats.datareadfailed += 1;
+        zdb_stats_add(datareadfailed, 1);
 
         zdb_warnp("data: checker: payload read");
         free(buffer);
@@ -558,7 +1133,7 @@ static inline int data_check_real(int fd, size_t offset) {
     }
 
     // update statistics
-    zdb_rootsettings.stats.datadiskread += header.datalength;
+    zdb_stats_add(datadiskread, header.datalength);
 
     // checking integrity of the payload
     uint32_t integrity = zdb_crc32(buffer, header.datalength);
@@ -589,6 +1164,13 @@ int data_check(data_root_t *root, size_t offset, fileid_t dataid) {
 
 
 
+// drop a partially written entry (or batch), the datafile
+// needs to end with a complete entry to be read back
+static void data_rollback(data_root_t *root, size_t offset) {
+    if(ftruncate(root->datafd, offset) < 0)
+        zdb_warnp("data write: truncate");
+}
+
 // insert data to the datafile and return it's offset
 // size_t data_insert(data_root_t *root, unsigned char *data, uint32_t datalength, void *vid, uint8_t idlength, uint8_t flags, uint32_t crc) {
 size_t data_insert(data_root_t *root, data_request_t *source) {
@@ -614,24 +1196,148 @@ size_t data_insert(data_root_t *root, data_request_t *source) {
 
     if(!data_write(root->datafd, header, headerlength, 0, root)) {
         zdb_verbose("[-] data header: write failed\n");
+        data_rollback(root, offset);
         free(header);
         return 0;
     }
 
     free(header);
 
-    if(!data_write(root->datafd, source->data, source->datalength, 1, root)) {
+    // a large payload can fail after a part was already written
+    // (eg: disk full), the header alone would be a corrupted entry
+    if(source->datafd > 0) {
+        if(!data_write_from_fd(root->datafd, source->datafd, source->datalength, root)) {
+            zdb_verbose("[-] data payload: stream write failed\n");
+            data_rollback(root, offset);
+            return 0;
+        }
+
+    } else if(!data_write(root->datafd, source->data, source->datalength, 1, root)) {
         zdb_verbose("[-] data payload: write failed\n");
+        data_rollback(root, offset);
         return 0;
     }
 
     // set this current offset as the latest
     // offset inserted
     root->previous = offset;
+    data_prepare_check(root, offset + headerlength + source->datalength);
 
     return offset;
 }
 
+// insert multiple entries with a single gathered write, headers are
+// built in one buffer and written with the payloads in place (no copy)
+//
+// offset of each entry is set on the offsets list, payloads needs to be
+// in memory (no datafd), returns amount of entries written (all or none)
+size_t data_insert_batch(data_root_t *root, data_request_t *sources, size_t *offsets, size_t count) {
+    size_t start = lseek(root->datafd, 0, SEEK_END);
+    size_t headerslength = 0;
+    size_t offset = start;
+    size_t total = 0;
+    struct iovec *iov;
+    uint8_t *headers;
+
+    if(count == 0)
+        return 0;
+
+    for(size_t i = 0; i < count; i++)
+        headerslength += sizeof(data_entry_header_t) + sources[i].idlength;
+
+    if(!(headers = malloc(headerslength)))
+        zdb_diep("data_insert_batch: malloc");
+
+    if(!(iov = malloc(sizeof(struct iovec) * count * 2)))
+        zdb_diep("data_insert_batch: malloc");
+
+    uint8_t *writer = headers;
+    size_t previous = root->previous;
+
+    for(size_t i = 0; i < count; i++) {
+        data_request_t *source = &sources[i];
+        data_entry_header_t *header = (data_entry_header_t *) writer;
+        size_t headerlength = sizeof(data_entry_header_t) + source->idlength;
+
+        header->idlength = source->idlength;
+        header->datalength = source->datalength;
+        header->previous = previous;
+        header->integrity = source->crc;
+        header->flags = source->flags;
+        header->timestamp = source->timestamp;
+
+        memcpy(header->id, source->vid, source->idlength);
+
+        iov[i * 2].iov_base = header;
+        iov[i * 2].iov_len = headerlength;
+        iov[(i * 2) + 1].iov_base = source->data;
+        iov[(i * 2) + 1].iov_len = source->datalength;
+
+        offsets[i] = offset;
+        previous = offset;
+
+        offset += headerlength + source->datalength;
+        writer += headerlength;
+    }
+
+    total = offset - start;
+
+    // writing everything, by groups of
+    // maximum amount of buffers per call
+    struct iovec *current = iov;
+    size_t remain = count * 2;
+    size_t written = 0;
+
+    while(remain > 0) {
+        int chunk = (remain > IOV_MAX) ? IOV_MAX : remain;
+        ssize_t response;
+
+        if((response = writev(root->datafd, current, chunk)) < 0) {
+            zdb_stats_add(datawritefailed, 1);
+            root->stats.errors += 1;
+            root->stats.lasterr = time(NULL);
+
+            zdb_warnp("data batch write");
+            break;
+        }
+
+        written += response;
+
+        // skip buffers fully written, adjust the partial one
+        while(chunk > 0 && (size_t) response >= current->iov_len) {
+            response -= current->iov_len;
+            current += 1;
+            remain -= 1;
+            chunk -= 1;
+        }
+
+        if(response > 0) {
+            current->iov_base = (uint8_t *) current->iov_base + response;
+            current->iov_len -= response;
+        }
+    }
+
+    free(headers);
+    free(iov);
+
+    if(written != total) {
+        // dropping partial batch, keeping the datafile
+        // ending with a complete entry
+        zdb_logerr("[-] data batch write: partial write, rolling back\n");
+        data_rollback(root, start);
+
+        return 0;
+    }
+
+    zdb_stats_add(datadiskwrite, total);
+    data_sync_check(root, root->datafd);
+
+    root->previous = offsets[count - 1];
+    data_prepare_check(root, offset);
+
+    return count;
+}
+
 // return the offset of the next entry which will be added
 // you probably don't need this, you should get the offset back
 // when data is really inserted, but this could be needed, for
@@ -677,10 +1383,20 @@ fileid_t data_dataid(data_root_t *root) {
 //
 // data constructor and destructor
 //
+// sealed file is only closed, not flushed and not notified, files are
+// removed (flush, delete) or sealed before by the caller (reload, exit)
 void data_destroy(data_root_t *root) {
+    if(root->sealedfd > 0)
+        close(root->sealedfd);
+
+    data_prepared_discard(root);
+
     if(root->datafd > 0)
         close(root->datafd);
 
+    for(int i = 0; i < ZDB_DATA_READERS; i++)
+        data_reader_close(&root->readers[i]);
+
     free(root->datafile);
     free(root);
 }
@@ -697,7 +1413,13 @@ data_root_t *data_init_lazy(zdb_settings_t *settings, char *datapath, fileid_t d
     root->lastsync = 0;
     root->previous = 0;
     root->secure = settings->secure;
+    root->nextfd = 0;
+    root->nextid = 0;
+    root->sealedfd = 0;
+    root->sealedid = 0;
+    root->namespace = NULL;
 
+    memset(&root->readers, 0x00, sizeof(root->readers));
     memset(&root->stats, 0x00, sizeof(data_stats_t));
 
     data_set_id(root);
@@ -705,14 +1427,14 @@ data_root_t *data_init_lazy(zdb_settings_t *settings, char *datapath, fileid_t d
     return root;
 }
 
-data_root_t *data_init(zdb_settings_t *settings, char *datapath, fileid_t dataid) {
+data_root_t *data_init(zdb_settings_t *settings, char *datapath, fileid_t dataid, size_t hint) {
     data_root_t *root = data_init_lazy(settings, datapath, dataid);
 
     // opening the file and creating it if needed
     data_initialize(root->datafile, root);
 
     // opening the final file for appending only
-    data_open_final(root);
+    data_open_final(root, hint);
 
     return root;
 }
@@ -721,6 +1443,9 @@ void data_emergency(data_root_t *root) {
     if(!root)
         return;
 
+    if(root->sealedfd > 0)
+        fsync(root->sealedfd);
+
     fsync(root->datafd);
 }
 
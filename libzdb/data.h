@@ -5,6 +5,32 @@
     #define ZDB_DEFAULT_DATA_MAXSIZE  256 * 1024 * 1024
     #define ZDB_DATA_MAX_PAYLOAD      8 * 1024 * 1024
 
+    // maximum payload size when payload is streamed and not
+    // kept in memory (see data_request_t datafd), this is limited
+    // by the datafile maximum size as well
+    #define ZDB_DATA_MAX_STREAM_PAYLOAD  1024 * 1024 * 1024
+
+    // next datafile is prepared in advance when the current
+    // datafile reach this ratio (percent) of the maximum size
+    #define ZDB_DATA_PREPARE_RATIO    75
+
+    // chunk size used when payload are copied from a file
+    // descriptor and not from memory (streamed payload)
+    #define ZDB_DATA_STREAM_CHUNK     64 * 1024
+
+    // amount of previous datafiles kept opened (read-only) per namespace
+    // to avoid opening and closing a file on each read, unused
+    // readers are closed after some time
+    #define ZDB_DATA_READERS          4
+    #define ZDB_DATA_READERS_EXPIRE   30
+
+    // batched reads (see data_get_batch): payloads separated by less
+    // than this gap (headers, skipped entries) are read with a single
+    // call, the gap is read and discarded, a single call is limited
+    // to this amount of bytes
+    #define ZDB_DATA_BATCH_GAP        16 * 1024
+    #define ZDB_DATA_BATCH_MAX        8 * 1024 * 1024
+
     // data statistics
     typedef struct data_stats_t {
         size_t hits;     // amount of data hit requested (not used yet)
@@ -15,6 +41,14 @@
     } data_stats_t;
 
 
+    // read-only file descriptor cached for a previous datafile
+    typedef struct data_reader_t {
+        int fd;           // file descriptor (0 if not used)
+        fileid_t dataid;  // datafile id of this descriptor
+        time_t used;      // last time this descriptor was used
+
+    } data_reader_t;
+
     // root point of the memory handler
     // used by the data manager
     typedef struct data_root_t {
@@ -29,6 +63,15 @@
         int secure;         // enable some safety (see secure zdb_settings_t)
         data_stats_t stats; // data statistics (session time)
 
+        int nextfd;         // preallocated next datafile, ready to be swapped in
+        fileid_t nextid;    // id of the preallocated next datafile
+        int sealedfd;       // previous datafile, rotated but not flushed/closed yet
+        fileid_t sealedid;  // id of the sealed datafile
+
+        data_reader_t readers[ZDB_DATA_READERS]; // previous datafiles kept opened
+
+        void *namespace;    // see index_root_t, same reason (housekeeping list)
+
     } data_root_t;
 
     // data file header
@@ -117,6 +160,8 @@
     // in order to reduce arguments length
     typedef struct data_request_t {
         unsigned char *data;
+        int datafd;           // if set, payload is read from this file (from offset 0)
+                              // instead of data (large payload not kept in memory)
         uint32_t datalength;
         void *vid;
         uint8_t idlength;
@@ -126,7 +171,27 @@
 
     } data_request_t;
 
-    data_root_t *data_init(zdb_settings_t *settings, char *datapath, fileid_t dataid);
+    // payload location inside a datafile, this can be used
+    // to send a payload without loading it into memory
+    typedef struct data_stream_t {
+        int fd;         // read-only file descriptor, needs to be closed by the caller
+        off_t offset;   // offset of the payload on that file
+        size_t length;  // length of the payload
+
+    } data_stream_t;
+
+    // payload location used for batched reads, buffer is
+    // allocated and filled by data_get_batch (NULL on error)
+    typedef struct data_location_t {
+        fileid_t dataid;
+        size_t offset;
+        size_t length;
+        uint8_t idlength;
+        unsigned char *buffer;
+
+    } data_location_t;
+
+    data_root_t *data_init(zdb_settings_t *settings, char *datapath, fileid_t dataid, size_t hint);
     data_root_t *data_init_lazy(zdb_settings_t *settings, char *datapath, fileid_t dataid);
     int data_open_id_mode(data_root_t *root, fileid_t id, int mode);
 
@@ -135,12 +200,23 @@
 
     void data_destroy(data_root_t *root);
     size_t data_jump_next(data_root_t *root, fileid_t newid);
+    int data_prepare_next(data_root_t *root, fileid_t nextid);
+    void data_sealed_flush(data_root_t *root);
+    int data_prepare_needed(data_root_t *root);
     void data_emergency(data_root_t *root);
+    void data_readers_expire(data_root_t *root);
+    int data_readers_opened(data_root_t *root);
     fileid_t data_dataid(data_root_t *root);
     void data_delete_files(char *datadir);
 
     data_raw_t data_raw_get(data_root_t *root, fileid_t dataid, off_t offset);
     data_payload_t data_get(data_root_t *root, size_t offset, size_t length, fileid_t dataid, uint8_t idlength);
+    data_payload_t data_get_range(data_root_t *root, size_t offset, size_t start, size_t length, fileid_t dataid, uint8_t idlength);
+    data_stream_t data_get_stream(data_root_t *root, size_t offset, size_t length, fileid_t dataid, uint8_t idlength);
+    data_stream_t data_get_stream_range(data_root_t *root, size_t offset, size_t start, size_t length, fileid_t dataid, uint8_t idlength);
+    size_t data_get_batch(data_root_t *root, data_location_t *locations, size_t count);
+    int data_spool_open(data_root_t *root);
+    int data_spool_open_path(char *path);
     int data_check(data_root_t *root, size_t offset, fileid_t dataid);
 
     // size_t data_match(data_root_t *root, void *id, uint8_t idlength, size_t offset, fileid_t dataid);
@@ -149,6 +225,7 @@
 
     // size_t data_insert(data_root_t *root, unsigned char *data, uint32_t datalength, void *vid, uint8_t idlength, uint8_t flags);
     size_t data_insert(data_root_t *root, data_request_t *source);
+    size_t data_insert_batch(data_root_t *root, data_request_t *sources, size_t *offsets, size_t count);
     size_t data_next_offset(data_root_t *root);
 
     data_scan_t data_previous_header(data_root_t *root, fileid_t dataid, size_t offset);
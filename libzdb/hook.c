@@ -9,6 +9,10 @@
 #include "libzdb.h"
 #include "libzdb_private.h"
 
+// hooks can be created by different threads (namespaces served by
+// zdbd workers), the list is locked while updated
+static int hooks_lock = 0;
+
 static void hook_free(hook_t *hook) {
     // freeing all arguments
     for(size_t i = 0; i < hook->argc; i++)
@@ -98,7 +102,11 @@ hook_t *hook_new(char *name, size_t argc) {
     hook->argidx = 2;
 
     // FIXME: should not return the hook, should support error
-    if(!(hooks_append_hook(&zdb_rootsettings.hooks, hook)))
+    zdb_spin_lock(&hooks_lock);
+    hook_t *appended = hooks_append_hook(&zdb_rootsettings.hooks, hook);
+    zdb_spin_unlock(&hooks_lock);
+
+    if(!appended)
         return hook;
 
     return hook;
@@ -128,7 +136,7 @@ pid_t hook_execute(hook_t *hook) {
 
         } else {
             // adding one pending child
-            zdb_rootsettings.stats.childwait += 1;
+            zdb_stats_add(childwait, 1);
         }
 
         hook->pid = pid;
@@ -160,7 +168,7 @@ int hook_execute_wait(hook_t *hook) {
 
     // update stats, since we wait, this won't be handled
     // by recurring scrubber
-    zdb_rootsettings.stats.childwait -= 1;
+    zdb_stats_sub(childwait, 1);
 
     return hook->status;
 }
@@ -211,7 +219,9 @@ void libzdb_hooks_cleanup() {
         // there are some active hooks on the list
         // let's see if any of them expired and needs
         // some cleanup
+        zdb_spin_lock(&hooks_lock);
         hook_expired_cleanup(hooks);
+        zdb_spin_unlock(&hooks_lock);
         return;
     }
 
@@ -222,10 +232,12 @@ void libzdb_hooks_cleanup() {
 
         // one child terminated
         if(WIFEXITED(status) || WIFSIGNALED(status)) {
-            zdb_rootsettings.stats.childwait -= 1;
+            zdb_stats_sub(childwait, 1);
         }
 
         // looking for matching hook
+        zdb_spin_lock(&hooks_lock);
+
         for(size_t i = 0; i < hooks->length; i++) {
             hook_t *hook = hooks->hooks[i];
 
@@ -236,5 +248,7 @@ void libzdb_hooks_cleanup() {
                 break;
             }
         }
+
+        zdb_spin_unlock(&hooks_lock);
     }
 }
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -99,7 +101,7 @@ int index_write(int fd, void *buffer, size_t length, index_root_t *root) {
 
     if((response = write(fd, buffer, length)) < 0) {
         // update statistics
-        zdb_rootsettings.stats.idxwritefailed += 1;
+        zdb_stats_add(idxwritefailed, 1);
 
         // update namespace statistics
         root->stats.errors += 1;
@@ -111,8 +113,10 @@ int index_write(int fd, void *buffer, size_t length, index_root_t *root) {
 
     // flag current indexfile as dirty if we
     // did any write on it
-    if(fd == root->indexfd)
+    if(fd == root->indexfd && !root->updated) {
         root->updated = 1;
+        namespace_changed(root->namespace);
+    }
 
     if(response != (ssize_t) length) {
         zdb_logerr("[-] index write: partial write\n");
@@ -120,7 +124,7 @@ int index_write(int fd, void *buffer, size_t length, index_root_t *root) {
     }
 
     // update statistics
-    zdb_rootsettings.stats.idxdiskwrite += length;
+    zdb_stats_add(idxdiskwrite, length);
 
     // flush disk if needed
     index_sync_check(root, fd);
@@ -133,7 +137,7 @@ static int index_read(int fd, void *buffer, size_t length) {
 
     if((response = read(fd, buffer, length)) < 0) {
         // update statistics
-        zdb_rootsettings.stats.idxreadfailed += 1;
+        zdb_stats_add(idxreadfailed, 1);
 
         zdb_warnp("index read");
         return 0;
@@ -153,7 +157,7 @@ static int index_read(int fd, void *buffer, size_t length) {
     }
 
     // update statistics
-    zdb_rootsettings.stats.idxdiskread += length;
+    zdb_stats_add(idxdiskread, length);
 
     return 1;
 }
@@ -335,46 +339,138 @@ char *index_dirty_list_generate(index_root_t *root) {
     return dirtylist;
 }
 
-// jumping to the next index id file, this needs to be in sync with the
-// data file, we only do this when datafile changes basicly, this is
-// triggered by a datafile too big event
-size_t index_jump_next(index_root_t *root) {
+// prepared (next) index file uses a temporary name, this file
+// is not visible as an index file until it's swapped in
+static void index_prepared_filename(char *buffer, index_root_t *root, fileid_t id) {
+    sprintf(buffer, "%s/i%u.next", root->indexdir, id);
+}
+
+// discard the prepared index file, if any
+void index_prepared_discard(index_root_t *root) {
+    char filename[ZDB_PATH_MAX];
+
+    if(root->nextfd <= 0)
+        return;
+
+    index_prepared_filename(filename, root, root->nextfid);
+    zdb_debug("[+] index: discarding prepared file: %s\n", filename);
+
+    close(root->nextfd);
+    unlink(filename);
+
+    root->nextfd = 0;
+}
+
+// create and initialize the next index file in advance, this is
+// expected to be called when nothing else is going on, this way
+// jumping to the next file is only a rename and a file descriptor swap
+int index_prepare_next(index_root_t *root) {
+    char filename[ZDB_PATH_MAX];
+    fileid_t nextfid = root->indexid + 1;
+    int fd;
+
+    if(root->status & INDEX_READ_ONLY)
+        return -1;
+
+    // already prepared
+    if(root->nextfd > 0 && root->nextfid == nextfid)
+        return 0;
+
+    index_prepared_discard(root);
+    index_prepared_filename(filename, root, nextfid);
+
+    zdb_debug("[+] index: preparing next file: %s\n", filename);
+
+    if((fd = open(filename, O_CREAT | O_TRUNC | O_RDWR | O_APPEND, 0600)) < 0) {
+        zdb_warnp(filename);
+        return -1;
+    }
+
+    #ifdef __linux__
+    // pre-allocate the same size as the current index file, which
+    // is the best guess we have about the next file size
+    off_t expected = lseek(root->indexfd, 0, SEEK_END);
+    if(expected > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, expected) < 0)
+        zdb_warnp(filename);
+    #endif
+
+    // index_initialize reset the updated flag, which is related
+    // to the current index file and not this one
+    int updated = root->updated;
+    index_initialize(fd, nextfid, root);
+    root->updated = updated;
+
+    root->nextfd = fd;
+    root->nextfid = nextfid;
+
+    return 0;
+}
+
+// swap the prepared index file as the current one
+// returns 0 if no (valid) prepared file was available
+static int index_prepared_swap(index_root_t *root) {
+    char filename[ZDB_PATH_MAX];
+
+    if(root->nextfd <= 0)
+        return 0;
+
+    if(root->nextfid != root->indexid) {
+        index_prepared_discard(root);
+        return 0;
+    }
+
+    index_prepared_filename(filename, root, root->nextfid);
+
+    if(rename(filename, root->indexfile) < 0) {
+        zdb_warnp(filename);
+        index_prepared_discard(root);
+        return 0;
+    }
+
+    root->indexfd = root->nextfd;
+    root->nextfd = 0;
+
+    // index just swapped, not dirty
+    root->updated = 0;
+
+    zdb_verbose("[+] index: active file: %s (prepared)\n", root->indexfile);
+
+    return 1;
+}
+
+// flush and close the previous index file, the one which was
+// sealed by the last jump, and call the jump hook
+//
+// dirty list is generated now and not during the jump, this list
+// could contains more entries than the one at jump time, which is
+// fine, but nothing can be lost when resetting it after the hook
+void index_sealed_flush(index_root_t *root) {
+    char filename[ZDB_PATH_MAX];
     hook_t *hook = NULL;
     char *dirtylist = NULL;
 
-    zdb_verbose("[+] index: jumping to the next file [closing %s]\n", root->indexfile);
+    if(root->sealedfd <= 0)
+        return;
+
+    index_set_id_buffer(filename, root->indexdir, root->sealedid);
 
     if(zdb_rootsettings.hook) {
         hook = hook_new("jump-index", 4);
         hook_append(hook, zdb_rootsettings.zdbid);
-        hook_append(hook, root->indexfile);
+        hook_append(hook, filename);
 
         // generate dirty list string
         dirtylist = index_dirty_list_generate(root);
     }
 
-    // flushing current index file
+    // flushing sealed index file
     if(root->secure) {
-        zdb_verbose("[+] index: flushing file before closing\n");
-        fsync(root->indexfd);
+        zdb_verbose("[+] index: flushing sealed file: %s\n", filename);
+        fsync(root->sealedfd);
     }
 
-    // closing current file descriptor
-    zdb_verbose("[+] index: closing current index file\n");
-    index_close(root);
-
-    // moving to the next file
-    uint64_t fileid = root->indexid + 1;
-    root->nextid = 0;
-
-    // do not reset root->previous
-    // since we need it to keep track of previous
-    // entry for RSCAN support
-
-    index_set_id(root, fileid);
-
-    index_open_final(root);
-    index_initialize(root->indexfd, root->indexid, root);
+    close(root->sealedfd);
+    root->sealedfd = 0;
 
     if(zdb_rootsettings.hook) {
         hook_append(hook, root->indexfile);
@@ -388,6 +484,40 @@ size_t index_jump_next(index_root_t *root) {
 
         free(dirtylist);
     }
+}
+
+// jumping to the next index id file, this needs to be in sync with the
+// data file, we only do this when datafile changes basicly, this is
+// triggered by a datafile too big event
+//
+// if the next file was prepared in advance, this is only a swap,
+// the previous file is kept open and will be flushed, closed and
+// notified later by index_sealed_flush, out of the write path
+size_t index_jump_next(index_root_t *root) {
+    zdb_verbose("[+] index: jumping to the next file [closing %s]\n", root->indexfile);
+
+    // previous jump was not sealed yet, do it now
+    index_sealed_flush(root);
+
+    // keeping current file descriptor for later
+    root->sealedfd = root->indexfd;
+    root->sealedid = root->indexid;
+    namespace_housekeeping(root->namespace);
+
+    // moving to the next file
+    uint64_t fileid = root->indexid + 1;
+    root->nextid = 0;
+
+    // do not reset root->previous
+    // since we need it to keep track of previous
+    // entry for RSCAN support
+
+    index_set_id(root, fileid);
+
+    if(!index_prepared_swap(root)) {
+        index_open_final(root);
+        index_initialize(root->indexfd, root->indexid, root);
+    }
 
     if(root->seqid)
         index_seqid_push(root, index_next_id(root), root->indexid);
@@ -423,12 +553,16 @@ uint32_t index_key_hash(unsigned char *id, uint8_t idlength) {
 // main look-up function, used to get an entry from the memory index
 index_entry_t *index_entry_get(index_root_t *root, unsigned char *id, uint8_t idlength) {
     uint32_t branchkey = index_key_hash(id, idlength);
-    index_branch_t *branch = index_branch_get(root->branches, branchkey);
-    index_entry_t *entry;
+    index_branch_t *branch;
+    index_entry_t *entry = NULL;
+
+    index_branch_lock(branchkey);
 
     // branch not exists
-    if(!branch)
+    if(!(branch = index_branch_get(root->branches, branchkey))) {
+        index_branch_unlock(branchkey);
         return NULL;
+    }
 
     for(entry = branch->list; entry; entry = entry->next) {
         if(entry->idlength != idlength)
@@ -438,10 +572,12 @@ index_entry_t *index_entry_get(index_root_t *root, unsigned char *id, uint8_t id
             continue;
 
         if(memcmp(entry->id, id, idlength) == 0)
-            return entry;
+            break;
     }
 
-    return NULL;
+    index_branch_unlock(branchkey);
+
+    return entry;
 }
 
 // read an index entry from disk
@@ -485,8 +621,10 @@ index_item_t *index_item_get_disk(index_root_t *root, fileid_t indexid, size_t o
 // this will be a global item we will allocate only once, to avoid
 // useless reallocation
 // this item will be used to move from an index_entry_t (disk) to index_item_t (memory)
-index_item_t *index_transition = NULL;
-index_entry_t *index_reusable_entry = NULL;
+//
+// each thread using the library have its own (see zdb_thread_attach)
+__thread index_item_t *index_transition = NULL;
+__thread index_entry_t *index_reusable_entry = NULL;
 
 
 // IMPORTANT:
@@ -513,12 +651,16 @@ int index_entry_delete_memory(index_root_t *root, index_entry_t *entry) {
         return 0;
 
     uint32_t branchkey = index_key_hash(entry->id, entry->idlength);
+
+    index_branch_lock(branchkey);
+
     index_branch_t *branch = index_branch_get(root->branches, branchkey);
     index_entry_t *previous = index_branch_get_previous(branch, entry);
 
     zdb_debug("[+] index: delete memory: removing entry from memory\n");
 
     if(previous == entry) {
+        index_branch_unlock(branchkey);
         zdb_danger("[-] index: entry delete memory: something wrong happens");
         zdb_danger("[-] index: entry delete memory: branches seems buggy");
         return 1;
@@ -526,6 +668,7 @@ int index_entry_delete_memory(index_root_t *root, index_entry_t *entry) {
 
     // removing entry from global branch
     index_branch_remove(branch, entry, previous);
+    index_branch_unlock(branchkey);
 
     // cleaning memory object
     free(entry);
@@ -588,11 +731,46 @@ int index_entry_delete_disk(index_root_t *root, index_entry_t *entry) {
     return 0;
 }
 
+// in userkey mode, a deletion also appends a tombstone (a flagged copy
+// of the deleted entry) to the current index file, this keeps the deletion
+// in the index, in write order, like any update, which is needed to stream
+// deletions (see CHANGES), original entry is still flagged in place to keep
+// it skipped by scans
+//
+// when the index is reloaded, the tombstone is replayed like a deleted entry
+static int index_entry_tombstone(index_root_t *root, index_entry_t *entry) {
+    index_entry_t tombstone = *entry;
+
+    tombstone.flags = INDEX_ENTRY_DELETED | INDEX_ENTRY_TOMBSTONE;
+    tombstone.timestamp = time(NULL);
+    tombstone.parentid = entry->indexid;
+    tombstone.parentoff = entry->idxoffset;
+
+    index_set_t setter = {
+        .entry = &tombstone,
+        .id = entry->id,
+    };
+
+    if(index_append_entry_on_disk(root, &setter))
+        return 1;
+
+    // same counters than a replay of this entry
+    root->nextentry += 1;
+    root->nextid += 1;
+
+    return 0;
+}
+
 int index_entry_delete(index_root_t *root, index_entry_t *entry) {
     // first flag disk entry as deleted
     if(index_entry_delete_disk(root, entry))
         return 1;
 
+    if(root->mode == ZDB_MODE_KEY_VALUE && root->branches) {
+        if(index_entry_tombstone(root, entry))
+            return 1;
+    }
+
     // then remove entry from memory
     if(index_entry_delete_memory(root, entry))
         return 1;
@@ -600,6 +778,23 @@ int index_entry_delete(index_root_t *root, index_entry_t *entry) {
     return 0;
 }
 
+// datafile id where the payload of an index item (read from index file
+// 'indexid') lives
+//
+// in userkey mode, index and data files jump together and the item dataid
+// field is not always set, the index file id is the data file id
+//
+// in sequential mode, an update rewrites the original item in place (see
+// index_seq_overwrite) to point into the current datafile, and the history
+// copy appended to the current index points into an older datafile, only
+// the item dataid field is reliable
+fileid_t index_item_dataid(index_root_t *root, index_item_t *item, fileid_t indexid) {
+    if(root->mode == ZDB_MODE_KEY_VALUE)
+        return indexid;
+
+    return item->dataid;
+}
+
 // serialize into binary object a deserializable
 // object identifier
 index_bkey_t index_item_serialize(index_item_t *item, uint32_t idxoffset, fileid_t idxfileid) {
@@ -778,6 +973,9 @@ int index_emergency(index_root_t *root) {
     if(!root || (root->status & INDEX_NOT_LOADED))
         return 0;
 
+    if(root->sealedfd > 0)
+        fsync(root->sealedfd);
+
     fsync(root->indexfd);
     return 1;
 }
@@ -71,6 +71,7 @@
 
     typedef enum index_flags_t {
         INDEX_ENTRY_DELETED = 1,  // we keep entry in memory and flag it as deleted
+        INDEX_ENTRY_TOMBSTONE = 2, // deletion marker appended to the index (userkey mode)
 
     } index_flags_t;
 
@@ -171,6 +172,25 @@
 
     } index_dirty_t;
 
+    // entries appended while a batch is active are kept here
+    // and written on the index file with a single write
+    typedef struct index_batch_t {
+        int active;        // batch in progress
+        int failed;        // a write of this batch failed
+        off_t start;       // index file offset of the first pending entry
+        size_t length;     // amount of bytes pending
+        size_t allocated;  // buffer size
+        uint8_t *buffer;
+
+        // index state when the batch started, restored on rollback
+        off_t origin;
+        size_t previous;
+        uint64_t nextentry;
+        uint32_t nextid;
+        index_stats_t stats;
+
+    } index_batch_t;
+
     //
     // global root memory structure of the index
     //
@@ -210,6 +230,15 @@
         // for 16384 index files, this would consume 2048 bytes
 
         size_t previous;    // keep latest offset inserted to the indexfile
+        size_t datatail;    // data offset of the last entry loaded from the current indexfile
+                            // used as hint to open the datafile (0 if unknown)
+
+        int nextfd;         // preallocated next index file, ready to be swapped in
+        fileid_t nextfid;   // id of the preallocated next index file
+        int sealedfd;       // previous index file, rotated but not flushed/closed yet
+        fileid_t sealedid;  // id of the sealed index file
+
+        index_batch_t batch; // pending entries of a batched insertion
 
     } index_root_t;
 
@@ -264,6 +293,9 @@
     #define MAX_KEY_LENGTH  (1 << 8) - 1
 
     size_t index_jump_next(index_root_t *root);
+    int index_prepare_next(index_root_t *root);
+    void index_sealed_flush(index_root_t *root);
+    void index_prepared_discard(index_root_t *root);
     int index_emergency(index_root_t *root);
 
     uint64_t index_next_id(index_root_t *root);
@@ -284,7 +316,7 @@
 
     int index_clean_namespace(index_root_t *root, void *namespace);
 
-    extern index_entry_t *index_reusable_entry;
+    extern __thread index_entry_t *index_reusable_entry;
 
     // extern but not really public functions
     // used by index_loader
@@ -292,13 +324,14 @@
     void index_set_id(index_root_t *root, fileid_t fileid);
     void index_open_final(index_root_t *root);
 
-    extern index_item_t *index_transition;
-    extern index_entry_t *index_reusable_entry;
+    extern __thread index_item_t *index_transition;
+    extern __thread index_entry_t *index_reusable_entry;
 
     size_t index_next_offset(index_root_t *root);
     size_t index_offset_objectid(uint32_t idobj);
     fileid_t index_indexid(index_root_t *root);
 
+    fileid_t index_item_dataid(index_root_t *root, index_item_t *item, fileid_t indexid);
     index_bkey_t index_item_serialize(index_item_t *item, uint32_t idxoffset, fileid_t idxfileid);
     index_bkey_t index_entry_serialize(index_entry_t *entry);
     index_entry_t *index_entry_deserialize(index_root_t *root, index_bkey_t *key);
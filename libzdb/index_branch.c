@@ -27,6 +27,22 @@
 uint32_t buckets_branches = (1 << 24);
 uint32_t buckets_mask = (1 << 24) - 1;
 
+// branches are shared by all the namespaces, namespaces served by
+// different threads (see zdbd workers) can walk or update the same
+// branch at the same time, a branch is locked while used, locks are
+// striped over the branches to keep the table small
+#define BRANCH_LOCKS  4096
+
+static int branches_locks[BRANCH_LOCKS];
+
+void index_branch_lock(uint32_t branchid) {
+    zdb_spin_lock(&branches_locks[branchid & (BRANCH_LOCKS - 1)]);
+}
+
+void index_branch_unlock(uint32_t branchid) {
+    zdb_spin_unlock(&branches_locks[branchid & (BRANCH_LOCKS - 1)]);
+}
+
 // WARNING: this doesn't resize anything, you should calls this
 //          only before initialization
 int index_set_buckets_bits(uint8_t bits) {
@@ -18,4 +18,8 @@
     index_entry_t *index_branch_append(index_branch_t **branches, uint32_t branchid, index_entry_t *entry);
     index_entry_t *index_branch_remove(index_branch_t *branch, index_entry_t *entry, index_entry_t *previous);
     index_entry_t *index_branch_get_previous(index_branch_t *branch, index_entry_t *entry);
+
+    // locking (shared branches, see index_branch.c)
+    void index_branch_lock(uint32_t branchid);
+    void index_branch_unlock(uint32_t branchid);
 #endif
@@ -27,10 +27,14 @@ static inline void index_dump_entry(index_entry_t *entry) {
 static void index_dump(index_root_t *root, int fulldump) {
     size_t branches = 0;
 
-    zdb_log("[+] index: verifyfing populated keys\n");
+    // branches are shared by all namespaces, walking over all of them
+    // for each namespace loaded makes loading thousands of namespaces
+    // really slow, this is only done when a full dump is requested
+    if(!fulldump)
+        return;
 
-    if(fulldump)
-        zdb_log("[+] ===========================\n");
+    zdb_log("[+] index: verifyfing populated keys\n");
+    zdb_log("[+] ===========================\n");
 
     // iterating over each buckets
     for(uint32_t b = 0; b < buckets_branches; b++) {
@@ -43,20 +47,15 @@ static void index_dump(index_root_t *root, int fulldump) {
         branches += 1;
         index_entry_t *entry = branch->list;
 
-        if(!fulldump)
-            continue;
-
         // iterating over the linked-list
         for(; entry; entry = entry->next)
             index_dump_entry(entry);
     }
 
-    if(fulldump) {
-        if(root->stats.entries == 0)
-            zdb_log("[+] index is empty\n");
+    if(root->stats.entries == 0)
+        zdb_log("[+] index is empty\n");
 
-        zdb_log("[+] ===========================\n");
-    }
+    zdb_log("[+] ===========================\n");
 
     zdb_verbose("[+] index: uses: %lu branches\n", branches);
 
@@ -314,6 +313,9 @@ static size_t index_load_file(index_root_t *root) {
     // this file, starting from zero
     root->nextid = 0;
 
+    // data tail is related to this file only
+    root->datatail = 0;
+
     while(seeker < filebuf + fullsize) {
         index_entry_t *fresh = NULL;
 
@@ -366,6 +368,15 @@ static size_t index_load_file(index_root_t *root) {
         // this is the last one we added
         root->previous = seeker - filebuf;
 
+        // keep track of the datafile offset of entries pointing into the
+        // datafile of this index, furthest one will be used as hint to
+        // open the datafile quickly (see index_item_dataid), tombstones
+        // point to the deleted payload, which can be in an older datafile
+        if(!(entry->flags & INDEX_ENTRY_TOMBSTONE) && index_item_dataid(root, entry, root->indexid) == root->indexid) {
+            if(entry->offset > root->datatail)
+                root->datatail = entry->offset;
+        }
+
         // moving seeker to next entry in the buffer
         seeker += sizeof(index_item_t) + entry->idlength;
     }
@@ -613,13 +624,22 @@ index_root_t *index_init(zdb_settings_t *settings, char *indexdir, void *namespa
 
 // graceful clean everything allocated
 // by this loader
+//
+// sealed file is only closed, the jump hook is not called, the
+// caller seals it first if files are kept (see index_sealed_flush)
 void index_destroy(index_root_t *root) {
+    if(root->sealedfd > 0)
+        close(root->sealedfd);
+
+    index_prepared_discard(root);
+
     if(root->indexfd > 0)
         close(root->indexfd);
 
     // delete root object
     free(root->indexfile);
     free(root->dirty.map);
+    free(root->batch.buffer);
 
     if(root->seqid) {
         free(root->seqid->seqmap);
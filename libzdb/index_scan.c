@@ -223,6 +223,18 @@ index_scan_t index_previous_header(index_root_t *root, fileid_t fileid, size_t o
 }
 
 // SCAN implementation
+// deleted entries are skipped, except tombstones
+// when the scan is requesting them
+static int index_scan_skipped(index_scan_t *scan, index_item_t *source) {
+    if(!(source->flags & INDEX_ENTRY_DELETED))
+        return 0;
+
+    if(scan->tombstones && (source->flags & INDEX_ENTRY_TOMBSTONE))
+        return 0;
+
+    return 1;
+}
+
 static index_scan_t index_next_header_real(index_scan_t scan) {
     index_item_t source;
 
@@ -256,7 +268,7 @@ static index_scan_t index_next_header_real(index_scan_t scan) {
     }
 
     // checking if entry is deleted
-    if(source.flags & INDEX_ENTRY_DELETED) {
+    if(index_scan_skipped(&scan, &source)) {
         zdb_debug("[+] index scan: next-header: offset %lu deleted, going one further\n", scan.target);
 
         // set the 'new' original to this offset
@@ -294,15 +306,8 @@ static index_scan_t index_next_header_real(index_scan_t scan) {
     return scan;
 }
 
-index_scan_t index_next_header(index_root_t *root, fileid_t fileid, size_t offset) {
-    index_scan_t scan = {
-        .fd = 0,
-        .fileid = fileid,
-        .original = offset, // offset of the 'current' key
-        .target = 0,        // offset of the expected next header
-        .header = NULL,     // the new header
-        .status = INDEX_SCAN_UNEXPECTED,
-    };
+static index_scan_t index_next_header_walk(index_root_t *root, index_scan_t scan) {
+    fileid_t fileid = scan.fileid;
 
     while(1) {
         // acquire file id fd
@@ -338,6 +343,35 @@ index_scan_t index_next_header(index_root_t *root, fileid_t fileid, size_t offse
     // never reached
 }
 
+index_scan_t index_next_header(index_root_t *root, fileid_t fileid, size_t offset) {
+    index_scan_t scan = {
+        .fd = 0,
+        .fileid = fileid,
+        .original = offset, // offset of the 'current' key
+        .target = 0,        // offset of the expected next header
+        .header = NULL,     // the new header
+        .status = INDEX_SCAN_UNEXPECTED,
+        .tombstones = 0,
+    };
+
+    return index_next_header_walk(root, scan);
+}
+
+// same as next header, deletion tombstones are returned
+index_scan_t index_next_change(index_root_t *root, fileid_t fileid, size_t offset) {
+    index_scan_t scan = {
+        .fd = 0,
+        .fileid = fileid,
+        .original = offset,
+        .target = 0,
+        .header = NULL,
+        .status = INDEX_SCAN_UNEXPECTED,
+        .tombstones = 1,
+    };
+
+    return index_next_header_walk(root, scan);
+}
+
 static index_scan_t index_first_header_real(index_scan_t scan) {
     index_item_t source;
 
@@ -355,7 +389,7 @@ static index_scan_t index_first_header_real(index_scan_t scan) {
     index_item_header_dump(&source);
 
     // checking if entry is deleted
-    if(source.flags & INDEX_ENTRY_DELETED) {
+    if(index_scan_skipped(&scan, &source)) {
         // zdb_debug("[+] data: first-header: data is deleted, going one further\n");
 
         // jump to the next entry
@@ -387,16 +421,7 @@ static index_scan_t index_first_header_real(index_scan_t scan) {
 }
 
 
-index_scan_t index_first_header(index_root_t *root) {
-    index_scan_t scan = {
-        .fd = 0,
-        .fileid = 0,
-        .original = sizeof(index_header_t), // offset of the first key
-        .target = sizeof(index_header_t),   // again offset of the first key
-        .header = NULL,
-        .status = INDEX_SCAN_UNEXPECTED,
-    };
-
+static index_scan_t index_first_header_walk(index_root_t *root, index_scan_t scan) {
     while(1) {
         // acquire data id fd
         if((scan.fd = index_grab_fileid(root, scan.fileid)) < 0) {
@@ -429,6 +454,35 @@ index_scan_t index_first_header(index_root_t *root) {
     // never reached
 }
 
+index_scan_t index_first_header(index_root_t *root) {
+    index_scan_t scan = {
+        .fd = 0,
+        .fileid = 0,
+        .original = sizeof(index_header_t), // offset of the first key
+        .target = sizeof(index_header_t),   // again offset of the first key
+        .header = NULL,
+        .status = INDEX_SCAN_UNEXPECTED,
+        .tombstones = 0,
+    };
+
+    return index_first_header_walk(root, scan);
+}
+
+// same as first header, deletion tombstones are returned
+index_scan_t index_first_change(index_root_t *root) {
+    index_scan_t scan = {
+        .fd = 0,
+        .fileid = 0,
+        .original = sizeof(index_header_t),
+        .target = sizeof(index_header_t),
+        .header = NULL,
+        .status = INDEX_SCAN_UNEXPECTED,
+        .tombstones = 1,
+    };
+
+    return index_first_header_walk(root, scan);
+}
+
 static index_scan_t index_last_header_real(index_scan_t scan) {
     index_item_t source;
 
@@ -544,4 +598,318 @@ index_scan_t index_last_header(index_root_t *root) {
     // never reached
 }
 
+//
+// buffered iterator
+//
+// walking with the functions above re-open the index file and do
+// small reads for each entry, the iterator keeps the file opened and
+// reads large chunks, entries are parsed from memory
+//
+// the iterator needs to be released (index_iterator_free) before
+// the index is changed (no write can occure while walking)
+//
+
+// position the iterator on an entry, the next call
+// will return entries after (or before) this one
+void index_iterator_init(index_iterator_t *iter, index_root_t *root, fileid_t fileid, size_t offset) {
+    memset(iter, 0, sizeof(index_iterator_t));
+
+    iter->root = root;
+    iter->fileid = fileid;
+    iter->fd = -1;
+    iter->offset = offset;
+    iter->readahead = ZDB_INDEX_ITERATOR_READAHEAD;
+}
+
+// position the iterator before the first entry
+void index_iterator_first(index_iterator_t *iter, index_root_t *root) {
+    index_iterator_init(iter, root, 0, sizeof(index_header_t));
+    iter->pending = 1;
+}
+
+// position the iterator after the last entry
+void index_iterator_last(index_iterator_t *iter, index_root_t *root) {
+    index_iterator_init(iter, root, root->indexid, root->previous);
+    iter->pending = 1;
+}
+
+void index_iterator_free(index_iterator_t *iter) {
+    if(iter->fd >= 0)
+        index_release_fileid(iter->root, iter->fileid, iter->fd);
+
+    free(iter->buffer);
+
+    iter->fd = -1;
+    iter->buffer = NULL;
+    iter->allocated = 0;
+    iter->length = 0;
+}
+
+// switch the iterator to another index file
+static int index_iterator_open(index_iterator_t *iter, fileid_t fileid) {
+    if(iter->fd >= 0)
+        index_release_fileid(iter->root, iter->fileid, iter->fd);
+
+    iter->fileid = fileid;
+    iter->length = 0;
+
+    if((iter->fd = index_grab_fileid(iter->root, fileid)) < 0) {
+        zdb_debug("[-] index iterator: could not open requested file id (%u)\n", fileid);
+        return -1;
+    }
+
+    return 0;
+}
+
+// ensure length bytes at offset are available on the buffer, a new
+// chunk is read if needed, returns NULL if not available (end of file)
+static index_item_t *index_iterator_fetch(index_iterator_t *iter, size_t offset, size_t length) {
+    ssize_t response;
+    size_t start = offset;
+
+    if(offset >= iter->start && offset + length <= iter->start + iter->length)
+        return (index_item_t *) (iter->buffer + (offset - iter->start));
+
+    if(iter->fd < 0 && index_iterator_open(iter, iter->fileid) < 0)
+        return NULL;
+
+    if(iter->allocated < iter->readahead) {
+        if(!(iter->buffer = realloc(iter->buffer, iter->readahead))) {
+            zdb_warnp("index iterator: realloc");
+            iter->allocated = 0;
+            iter->length = 0;
+            return NULL;
+        }
+
+        iter->allocated = iter->readahead;
+    }
+
+    // walking backward, the chunk ends with the requested entry
+    if(iter->backward)
+        start = (offset + length > iter->allocated) ? offset + length - iter->allocated : 0;
+
+    if((response = pread(iter->fd, iter->buffer, iter->allocated, start)) < 0) {
+        zdb_warnp("index iterator: read");
+        iter->length = 0;
+        return NULL;
+    }
+
+    zdb_debug("[+] index iterator: file %u: %zd bytes read from offset %zu\n", iter->fileid, response, start);
+
+    iter->start = start;
+    iter->length = response;
+
+    // update statistics
+    zdb_stats_add(idxdiskread, response);
+
+    if(iter->readahead < ZDB_INDEX_ITERATOR_READAHEAD_MAX)
+        iter->readahead *= 2;
+
+    if(offset + length > iter->start + iter->length)
+        return NULL;
+
+    return (index_item_t *) (iter->buffer + (offset - iter->start));
+}
+
+// copy a buffered entry into a scan result
+static index_scan_t index_iterator_found(index_iterator_t *iter, index_item_t *item) {
+    index_scan_t scan = {
+        .fd = iter->fd,
+        .fileid = iter->fileid,
+        .original = iter->offset,
+        .target = iter->offset,
+        .header = NULL,
+        .status = INDEX_SCAN_SUCCESS,
+    };
+
+    size_t length = sizeof(index_item_t) + item->idlength;
+
+    if(!(scan.header = malloc(length))) {
+        zdb_warnp("index iterator: malloc");
+        return index_scan_error(scan, INDEX_SCAN_UNEXPECTED);
+    }
+
+    memcpy(scan.header, item, length);
+
+    return scan;
+}
+
+// SCAN implementation, returns the next entry not deleted, same
+// behavior than index_next_header
+index_scan_t index_iterator_next(index_iterator_t *iter) {
+    index_scan_t scan = {
+        .fd = -1,
+        .fileid = iter->fileid,
+        .original = iter->offset,
+        .target = 0,
+        .header = NULL,
+        .status = INDEX_SCAN_UNEXPECTED,
+    };
+
+    index_item_t *item;
+    size_t target;
+
+    iter->backward = 0;
+
+    while(1) {
+        target = iter->offset;
+
+        // next entry is at offset + this header + id
+        if(!iter->pending) {
+            if(!(item = index_iterator_fetch(iter, iter->offset, sizeof(index_item_t)))) {
+                zdb_debug("[-] index iterator: next: could not read current entry\n");
+                return index_scan_error(scan, INDEX_SCAN_UNEXPECTED);
+            }
+
+            target += sizeof(index_item_t) + item->idlength;
+        }
+
+        iter->pending = 0;
+
+        if(!(item = index_iterator_fetch(iter, target, sizeof(index_item_t)))) {
+            zdb_debug("[-] index iterator: next: eof reached on file %u\n", iter->fileid);
+
+            // nothing can be after the index file in use
+            if(iter->fileid >= iter->root->indexid)
+                return index_scan_error(scan, INDEX_SCAN_NO_MORE_DATA);
+
+            if(index_iterator_open(iter, iter->fileid + 1) < 0)
+                return index_scan_error(scan, INDEX_SCAN_NO_MORE_DATA);
+
+            // first entry of the next file
+            iter->offset = sizeof(index_header_t);
+            iter->pending = 1;
+            continue;
+        }
+
+        if(!(item = index_iterator_fetch(iter, target, sizeof(index_item_t) + item->idlength))) {
+            zdb_warnp("index iterator: next: could not read id from indexfile");
+            return index_scan_error(scan, INDEX_SCAN_UNEXPECTED);
+        }
+
+        iter->offset = target;
+
+        if(item->flags & INDEX_ENTRY_DELETED) {
+            zdb_debug("[+] index iterator: next: offset %lu deleted, going one further\n", target);
+            continue;
+        }
+
+        return index_iterator_found(iter, item);
+    }
+
+    // never reached
+}
+
+// RSCAN implementation, returns the previous entry not deleted, same
+// behavior than index_previous_header
+index_scan_t index_iterator_previous(index_iterator_t *iter) {
+    index_scan_t scan = {
+        .fd = -1,
+        .fileid = iter->fileid,
+        .original = iter->offset,
+        .target = 0,
+        .header = NULL,
+        .status = INDEX_SCAN_UNEXPECTED,
+    };
+
+    index_item_t *item;
+    size_t target;
+
+    iter->backward = 1;
+
+    while(1) {
+        target = iter->offset;
+
+        if(!iter->pending) {
+            if(!(item = index_iterator_fetch(iter, iter->offset, sizeof(index_item_t)))) {
+                zdb_debug("[-] index iterator: previous: could not read current entry\n");
+                return index_scan_error(scan, INDEX_SCAN_UNEXPECTED);
+            }
+
+            target = item->previous;
+
+            // previous entry is the last one of the previous file
+            if(target >= iter->offset) {
+                zdb_debug("[+] index iterator: previous: offset (%lu) in previous file\n", target);
+
+                if(iter->fileid == 0 || index_iterator_open(iter, iter->fileid - 1) < 0)
+                    return index_scan_error(scan, INDEX_SCAN_NO_MORE_DATA);
+
+                iter->offset = target;
+                iter->pending = 1;
+                continue;
+            }
+
+            // rollback special case when pointing to the first entry
+            if(target == 1)
+                target = sizeof(index_header_t);
+        }
+
+        iter->pending = 0;
+
+        if(target == 0) {
+            zdb_debug("[+] index iterator: previous: zero reached, nothing to rollback\n");
+            return index_scan_error(scan, INDEX_SCAN_NO_MORE_DATA);
+        }
+
+        if(!(item = index_iterator_fetch(iter, target, sizeof(index_item_t)))) {
+            zdb_warnp("index iterator: previous: could not read previous offset indexfile");
+            return index_scan_error(scan, INDEX_SCAN_UNEXPECTED);
+        }
+
+        if(!(item = index_iterator_fetch(iter, target, sizeof(index_item_t) + item->idlength))) {
+            zdb_warnp("index iterator: previous: could not read id from indexfile");
+            return index_scan_error(scan, INDEX_SCAN_UNEXPECTED);
+        }
+
+        iter->offset = target;
+
+        if(item->flags & INDEX_ENTRY_DELETED) {
+            zdb_debug("[+] index iterator: previous: offset %lu deleted, going one before\n", target);
+            continue;
+        }
+
+        return index_iterator_found(iter, item);
+    }
+
+    // never reached
+}
+
+// random access to a single entry, used to follow a history chain
+//
+// the file stays opened until another file is requested and entries
+// close to each other are served from the same buffer, the chunk read
+// ends with the requested entry since chains are walked from the newest
+// entry to the oldest one
+index_item_t *index_iterator_item(index_iterator_t *iter, fileid_t fileid, size_t offset, uint8_t idlength) {
+    size_t length = sizeof(index_item_t) + idlength;
+    index_item_t *item;
+    index_item_t *copy;
+
+    if(iter->fileid != fileid && index_iterator_open(iter, fileid) < 0)
+        return NULL;
+
+    // jumping around doesn't benefit from a growing read-ahead
+    iter->backward = 1;
+    iter->readahead = ZDB_INDEX_ITERATOR_READAHEAD;
+    iter->offset = offset;
+
+    if(!(item = index_iterator_fetch(iter, offset, length))) {
+        zdb_debug("[-] index iterator: item: could not read entry %u:%zu\n", fileid, offset);
+        return NULL;
+    }
+
+    if(item->idlength != idlength) {
+        zdb_debug("[-] index iterator: item: unexpected id length on %u:%zu\n", fileid, offset);
+        return NULL;
+    }
+
+    if(!(copy = malloc(length))) {
+        zdb_warnp("index iterator: item: malloc");
+        return NULL;
+    }
+
+    memcpy(copy, item, length);
 
+    return copy;
+}
@@ -23,11 +23,47 @@
         index_item_t *header;        // target header, set when found
         index_scan_status_t status;  // status code
         fileid_t fileid;             // index file id
+        int tombstones;              // deletion tombstones are returned, not skipped
 
     } index_scan_t;
 
+    // read-ahead used by the index iterator, starting small and
+    // growing on each refill, a long walk ends up reading large
+    // sequential chunks
+    #define ZDB_INDEX_ITERATOR_READAHEAD      16 * 1024
+    #define ZDB_INDEX_ITERATOR_READAHEAD_MAX  1024 * 1024
+
+    // buffered index walker, the index file is kept opened
+    // and entries are parsed from a read-ahead buffer
+    typedef struct index_iterator_t {
+        index_root_t *root;
+        fileid_t fileid;     // index file currently walked
+        int fd;              // file descriptor of this file (-1 if not opened)
+        size_t offset;       // offset of the current entry
+        int pending;         // current entry was not returned yet
+        int backward;        // walking backward (read-ahead before offset)
+
+        uint8_t *buffer;     // read-ahead buffer
+        size_t allocated;    // buffer size
+        size_t readahead;    // amount of bytes read on next refill
+        size_t start;        // file offset of the first byte of the buffer
+        size_t length;       // amount of bytes available on the buffer
+
+    } index_iterator_t;
+
+    void index_iterator_init(index_iterator_t *iter, index_root_t *root, fileid_t fileid, size_t offset);
+    void index_iterator_first(index_iterator_t *iter, index_root_t *root);
+    void index_iterator_last(index_iterator_t *iter, index_root_t *root);
+    index_scan_t index_iterator_next(index_iterator_t *iter);
+    index_scan_t index_iterator_previous(index_iterator_t *iter);
+    index_item_t *index_iterator_item(index_iterator_t *iter, fileid_t fileid, size_t offset, uint8_t idlength);
+    void index_iterator_free(index_iterator_t *iter);
+
     index_scan_t index_previous_header(index_root_t *root, fileid_t fileid, size_t offset);
     index_scan_t index_next_header(index_root_t *root, fileid_t fileid, size_t offset);
     index_scan_t index_first_header(index_root_t *root);
     index_scan_t index_last_header(index_root_t *root);
+
+    index_scan_t index_next_change(index_root_t *root, fileid_t fileid, size_t offset);
+    index_scan_t index_first_change(index_root_t *root);
 #endif
@@ -133,10 +133,142 @@ index_item_t *index_item_from_set(index_root_t *root, index_set_t *set) {
     return index_transition;
 }
 
+//
+// batched insertion
+//
+// while a batch is active, entries appended are copied into a
+// buffer instead of being written one by one, offsets are computed
+// like if they were written, the buffer is written with a single
+// write (and a single sync check) when the batch is flushed
+//
+// entries which need to be updated in place (flagged deleted on
+// overwrite) have to be on disk, the batch needs to be flushed
+// before updating an entry still pending
+//
+void index_batch_begin(index_root_t *root) {
+    root->batch.active = 1;
+    root->batch.failed = 0;
+    root->batch.start = lseek(root->indexfd, 0, SEEK_END);
+    root->batch.length = 0;
+
+    root->batch.origin = root->batch.start;
+    root->batch.previous = root->previous;
+    root->batch.nextentry = root->nextentry;
+    root->batch.nextid = root->nextid;
+    root->batch.stats = root->stats;
+}
+
+static int index_batch_append(index_root_t *root, void *item, size_t length) {
+    index_batch_t *batch = &root->batch;
+
+    if(batch->length + length > batch->allocated) {
+        size_t allocated = (batch->allocated) ? batch->allocated * 2 : 64 * 1024;
+        uint8_t *buffer;
+
+        while(allocated < batch->length + length)
+            allocated *= 2;
+
+        if(!(buffer = realloc(batch->buffer, allocated))) {
+            zdb_warnp("index: batch: realloc");
+            return 1;
+        }
+
+        batch->buffer = buffer;
+        batch->allocated = allocated;
+    }
+
+    memcpy(batch->buffer + batch->length, item, length);
+    batch->length += length;
+
+    return 0;
+}
+
+// write pending entries, batch stays active
+int index_batch_flush(index_root_t *root) {
+    index_batch_t *batch = &root->batch;
+    int value = 0;
+
+    if(batch->length > 0) {
+        zdb_debug("[+] index: batch: writing %lu bytes\n", batch->length);
+
+        if(!index_write(root->indexfd, batch->buffer, batch->length, root)) {
+            batch->failed = 1;
+            value = 1;
+        }
+    }
+
+    batch->start = lseek(root->indexfd, 0, SEEK_END);
+    batch->length = 0;
+
+    return value;
+}
+
+// write pending entries and stop batching, any write
+// failed during the batch makes the commit fail
+int index_batch_commit(index_root_t *root) {
+    int value = index_batch_flush(root) || root->batch.failed;
+    root->batch.active = 0;
+
+    // release large buffers, keep a small one for next batch
+    if(root->batch.allocated > 1024 * 1024) {
+        free(root->batch.buffer);
+        root->batch.buffer = NULL;
+        root->batch.allocated = 0;
+    }
+
+    return value;
+}
+
+// drop everything written by the last batch (after a failed commit), the
+// index file is truncated to where the batch started and the index state
+// is restored, memory entries (userkey mode) set by the batch are not
+// changed, the caller needs to take care of them
+int index_batch_rollback(index_root_t *root) {
+    index_batch_t *batch = &root->batch;
+
+    zdb_verbose("[-] index: batch: rollback to offset %ld\n", batch->origin);
+
+    batch->active = 0;
+    batch->length = 0;
+
+    root->previous = batch->previous;
+    root->nextentry = batch->nextentry;
+    root->nextid = batch->nextid;
+
+    // in sequential mode, statistics only come from the index file
+    if(root->mode == ZDB_MODE_SEQUENTIAL) {
+        root->stats.entries = batch->stats.entries;
+        root->stats.datasize = batch->stats.datasize;
+        root->stats.size = batch->stats.size;
+    }
+
+    if(ftruncate(root->indexfd, batch->origin) < 0) {
+        zdb_warnp("index: batch: rollback truncate");
+        return 1;
+    }
+
+    return 0;
+}
+
+// is this entry not written yet (still on the batch)
+static int index_batch_pending(index_root_t *root, index_entry_t *entry) {
+    if(!root->batch.active || root->batch.length == 0)
+        return 0;
+
+    return (entry->indexid == root->indexid && entry->idxoffset >= root->batch.start);
+}
+
 int index_append_entry_on_disk(index_root_t *root, index_set_t *set) {
     index_entry_t *entry = set->entry;
-    off_t curoffset = lseek(root->indexfd, 0, SEEK_END);
     size_t entrylength = sizeof(index_item_t) + entry->idlength;
+    off_t curoffset;
+
+    // with a batch in progress, the entry will be
+    // written after the pending ones
+    if(root->batch.active)
+        curoffset = root->batch.start + root->batch.length;
+    else
+        curoffset = lseek(root->indexfd, 0, SEEK_END);
 
     zdb_debug("[+] index: writing entry on disk (%lu bytes)\n", entrylength);
 
@@ -150,6 +282,15 @@ int index_append_entry_on_disk(index_root_t *root, index_set_t *set) {
     // updating global previous
     root->previous = curoffset;
 
+    if(root->batch.active) {
+        if(index_batch_append(root, item, entrylength)) {
+            entry->flags |= INDEX_ENTRY_DELETED;
+            return 1;
+        }
+
+        return 0;
+    }
+
     // writing data on the disk
     if(!index_write(root->indexfd, item, entrylength, root)) {
         zdb_verbosep("index_append_entry_on_disk", "cannot write index entry on disk");
@@ -197,7 +338,9 @@ index_entry_t *index_insert_memory_handler_memkey(index_root_t *root, index_set_
     uint32_t branchkey = index_key_hash(entry->id, entry->idlength);
 
     // commit entry into memory
+    index_branch_lock(branchkey);
     index_branch_append(root->branches, branchkey, entry);
+    index_branch_unlock(branchkey);
 
     // update statistics (if the key exists)
     // maybe it doesn't exists if it comes from a replay
@@ -302,6 +445,10 @@ index_entry_t *index_update_memory_handler_sequential(index_root_t *root, index_
 
 // public disk and memory part
 index_entry_t *index_update_entry_memkey(index_root_t *root, index_set_t *set, index_entry_t *previous) {
+    // same key set twice in the same batch
+    if(index_batch_pending(root, previous))
+        index_batch_flush(root);
+
     zdb_debug("[+] index: flagging previous key as deleted, on disk\n");
     index_entry_delete_disk(root, previous);
 
@@ -325,6 +472,11 @@ index_entry_t *index_update_entry_memkey(index_root_t *root, index_set_t *set, i
 index_entry_t *index_update_entry_sequential(index_root_t *root, index_set_t *set, index_entry_t *previous) {
     zdb_debug("[+] index: update on sequential keys, duplicating key flagged\n");
 
+    // original entry is overwritten in place, it needs
+    // to be on disk
+    if(root->batch.active)
+        index_batch_flush(root);
+
     // mark previous as deleted, and writing this object on the index
     // this will add a *new* entry on the index file, and we will use this
     // as reference to update the first one, to keep history and so one
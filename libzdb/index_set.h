@@ -14,4 +14,11 @@
 
     // internal index append functions
     int index_append_entry_on_disk(index_root_t *root, index_set_t *set);
+
+    // batched insertion, entries appended between begin and commit
+    // are written on the index file with a single write
+    void index_batch_begin(index_root_t *root);
+    int index_batch_flush(index_root_t *root);
+    int index_batch_commit(index_root_t *root);
+    int index_batch_rollback(index_root_t *root);
 #endif
@@ -74,6 +74,7 @@
         char *hook;        // external hook script to execute
         size_t datasize;   // maximum datafile size before jumping to next one
         size_t maxsize;    // default namespace maximum datasize
+        size_t scrubrate;  // background integrity check rate (bytes per second, 0 disabled)
         int initialized;   // single instance lock flag
 
         int secure;        // enable some security about data write, but will
@@ -170,6 +171,7 @@
     #include "index_seq.h"
     #include "index_set.h"
     #include "namespace.h"
+    #include "scrub.h"
     #include "settings.h"
     #include "bootstrap.h"
     #include "sha1.h"
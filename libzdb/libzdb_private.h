@@ -16,6 +16,24 @@
 
     extern zdb_settings_t zdb_rootsettings;
 
+    // namespaces can be served by different threads (see zdbd workers),
+    // global statistics are updated atomically and the few structures
+    // shared between namespaces (index branches, changed and housekeeping
+    // lists, hooks) are protected by spinlocks, held only for a few
+    // instructions
+    #define zdb_stats_add(field, value) __atomic_add_fetch(&zdb_rootsettings.stats.field, (value), __ATOMIC_RELAXED)
+    #define zdb_stats_sub(field, value) __atomic_sub_fetch(&zdb_rootsettings.stats.field, (value), __ATOMIC_RELAXED)
+
+    static inline void zdb_spin_lock(int *lock) {
+        while(__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))
+            while(__atomic_load_n(lock, __ATOMIC_RELAXED))
+                ;
+    }
+
+    static inline void zdb_spin_unlock(int *lock) {
+        __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+    }
+
     void zdb_diep(char *str);
     void *zdb_warnp(char *str);
     void zdb_verbosep(char *prefix, char *str);
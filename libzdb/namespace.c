@@ -23,6 +23,11 @@
 // state
 static ns_root_t *nsroot = NULL;
 
+// changed and housekeeping lists are shared by all the namespaces, they
+// are updated by the threads serving them (see zdbd workers), while the
+// lists are walked by the main thread with these threads paused
+static int lists_lock = 0;
+
 //
 // public namespace endpoint
 //
@@ -33,17 +38,11 @@ size_t namespace_length() {
 }
 
 namespace_t *namespace_iter() {
-    return nsroot->namespaces[0];
+    return nsroot->first;
 }
 
 namespace_t *namespace_iter_next(namespace_t *namespace) {
-    for(size_t i = namespace->idlist + 1; i < nsroot->length; i++) {
-        // skipping empty slot
-        if(nsroot->namespaces[i])
-            return nsroot->namespaces[i];
-    }
-
-    return NULL;
+    return namespace->next;
 }
 
 // getters
@@ -54,18 +53,139 @@ namespace_t *namespace_get_default() {
     return nsroot->namespaces[0];
 }
 
+static uint32_t namespace_hash(char *name) {
+    return zdb_crc32((uint8_t *) name, strlen(name));
+}
+
 // get a namespace from its name
 namespace_t *namespace_get(char *name) {
-    namespace_t *ns;
+    uint32_t hash = namespace_hash(name);
+    namespace_t *ns = nsroot->buckets[hash & (nsroot->bucketsize - 1)];
 
-    for(ns = namespace_iter(); ns; ns = namespace_iter_next(ns)) {
-        if(strcmp(ns->name, name) == 0)
+    for(; ns; ns = ns->hashnext) {
+        if(ns->hash == hash && strcmp(ns->name, name) == 0)
             return ns;
     }
 
     return NULL;
 }
 
+// changed namespaces
+//
+// the index flags its current file as updated on the first write
+// after being opened, at that time the namespace is added to the changed
+// list, periodic rotation only needs to walk this list and not every
+// namespaces loaded
+static int namespace_registered(namespace_t *namespace) {
+    if(!nsroot || namespace->idlist >= nsroot->length)
+        return 0;
+
+    return (nsroot->namespaces[namespace->idlist] == namespace);
+}
+
+void namespace_changed(namespace_t *namespace) {
+    // namespace not (yet) loaded by the server (eg: tools or loading
+    // stage), it will be added when registered if needed
+    if(!namespace || namespace->changed || !namespace_registered(namespace))
+        return;
+
+    zdb_debug("[+] namespace: flagged as changed: %s\n", namespace->name);
+
+    zdb_spin_lock(&lists_lock);
+
+    namespace->changed = 1;
+    namespace->changedprev = NULL;
+    namespace->changednext = nsroot->changed;
+
+    if(nsroot->changed)
+        nsroot->changed->changedprev = namespace;
+
+    nsroot->changed = namespace;
+
+    zdb_spin_unlock(&lists_lock);
+}
+
+namespace_t *namespace_changed_iter() {
+    return nsroot->changed;
+}
+
+namespace_t *namespace_changed_next(namespace_t *namespace) {
+    return namespace->changednext;
+}
+
+// remove a namespace from the changed list, it will be
+// added again on the next index update
+void namespace_changed_release(namespace_t *namespace) {
+    if(!namespace->changed)
+        return;
+
+    zdb_spin_lock(&lists_lock);
+
+    if(namespace->changedprev)
+        namespace->changedprev->changednext = namespace->changednext;
+
+    if(namespace->changednext)
+        namespace->changednext->changedprev = namespace->changedprev;
+
+    if(nsroot->changed == namespace)
+        nsroot->changed = namespace->changednext;
+
+    namespace->changed = 0;
+    namespace->changednext = NULL;
+    namespace->changedprev = NULL;
+
+    zdb_spin_unlock(&lists_lock);
+}
+
+// housekeeping namespaces
+//
+// same idea as the changed list, for idle rotation: a namespace is added
+// when a file is sealed by a jump, when a previous datafile reader is
+// opened or when the current datafile reach the prepare ratio, idle
+// rotation only walks this list and release namespaces with nothing
+// left to do
+void namespace_housekeeping(namespace_t *namespace) {
+    if(!namespace || namespace->housekeeping || !namespace_registered(namespace))
+        return;
+
+    zdb_debug("[+] namespace: housekeeping needed: %s\n", namespace->name);
+
+    zdb_spin_lock(&lists_lock);
+
+    namespace->housekeeping = 1;
+    namespace->houseprev = NULL;
+    namespace->housenext = nsroot->housekeeping;
+
+    if(nsroot->housekeeping)
+        nsroot->housekeeping->houseprev = namespace;
+
+    nsroot->housekeeping = namespace;
+
+    zdb_spin_unlock(&lists_lock);
+}
+
+static void namespace_housekeeping_release(namespace_t *namespace) {
+    if(!namespace->housekeeping)
+        return;
+
+    zdb_spin_lock(&lists_lock);
+
+    if(namespace->houseprev)
+        namespace->houseprev->housenext = namespace->housenext;
+
+    if(namespace->housenext)
+        namespace->housenext->houseprev = namespace->houseprev;
+
+    if(nsroot->housekeeping == namespace)
+        nsroot->housekeeping = namespace->housenext;
+
+    namespace->housekeeping = 0;
+    namespace->housenext = NULL;
+    namespace->houseprev = NULL;
+
+    zdb_spin_unlock(&lists_lock);
+}
+
 // FIXME: no error handled externally
 void namespace_descriptor_update(namespace_t *namespace, int fd) {
     ns_header_t header;
@@ -228,7 +348,8 @@ static int namespace_load_lazy(ns_root_t *nsroot, namespace_t *namespace) {
     // now, we are sure the namespace exists, but it could be empty
     // let's call index and data initializer, they will take care of that
     namespace->index = index_init(nsroot->settings, namespace->indexpath, namespace, nsroot->branches);
-    namespace->data = data_init(nsroot->settings, namespace->datapath, namespace->index->indexid);
+    namespace->data = data_init(nsroot->settings, namespace->datapath, namespace->index->indexid, namespace->index->datatail);
+    namespace->data->namespace = namespace;
 
     return 0;
 }
@@ -253,6 +374,17 @@ namespace_t *namespace_load_light(ns_root_t *nsroot, char *name, int ensure) {
     namespace->worm = 0;    // by default, worm mode is disabled
     namespace->maxsize = 0; // by default, there are no limits
     namespace->idlist = 0;  // by default, no list is set
+    namespace->hash = namespace_hash(name);
+    namespace->hashnext = NULL;
+    namespace->next = NULL;
+    namespace->previous = NULL;
+    namespace->changednext = NULL;
+    namespace->changedprev = NULL;
+    namespace->changed = 0;
+    namespace->housenext = NULL;
+    namespace->houseprev = NULL;
+    namespace->housekeeping = 0;
+    namespace->scheduler = NULL;
 
     namespace->locked = NS_LOCK_UNLOCKED;           // by default, namespace are unlocked
     namespace->version = NAMESPACE_CURRENT_VERSION; // set current version before reading descriptor
@@ -286,43 +418,124 @@ namespace_t *namespace_load(ns_root_t *nsroot, char *name) {
 
 
 //
-// add a namespace to the main namespaces list
+// namespaces registry
 //
-static namespace_t *namespace_push(ns_root_t *root, namespace_t *namespace) {
-    size_t newlength = root->length + 1;
-    namespace_t **newlist = NULL;
+// loaded namespaces are kept on a slots list, the slot of a namespace
+// never changes while loaded and empty slots are reused, names are
+// indexed on a hash table to keep lookup constant, whatever the amount
+// of namespaces loaded
+//
+static void namespace_bucket_insert(ns_root_t *root, namespace_t *namespace) {
+    size_t bucket = namespace->hash & (root->bucketsize - 1);
 
-    // looking for an empty namespace slot
-    for(size_t i = 0; i < root->length; i++) {
-        if(root->namespaces[i])
-            continue;
+    namespace->hashnext = root->buckets[bucket];
+    root->buckets[bucket] = namespace;
+}
 
-        zdb_debug("[+] namespace: empty slot reusable found: %lu\n", i);
+static void namespace_bucket_remove(ns_root_t *root, namespace_t *namespace) {
+    namespace_t **link = &root->buckets[namespace->hash & (root->bucketsize - 1)];
 
-        // empty slot found, updating
-        namespace->idlist = i;
-        root->namespaces[i] = namespace;
-        root->effective += 1;
+    for(; *link; link = &(*link)->hashnext) {
+        if(*link == namespace) {
+            *link = namespace->hashnext;
+            namespace->hashnext = NULL;
+            return;
+        }
+    }
+}
+
+// double the amount of buckets and dispatch namespaces again
+static int namespace_buckets_grow(ns_root_t *root) {
+    size_t newsize = root->bucketsize * 2;
+    namespace_t **buckets;
 
-        return namespace;
+    zdb_debug("[+] namespace: growing registry to %lu buckets\n", newsize);
+
+    if(!(buckets = calloc(newsize, sizeof(namespace_t *)))) {
+        zdb_warnp("namespace registry calloc");
+        return 1;
     }
 
-    zdb_debug("[+] namespace: allocating new slot\n");
+    free(root->buckets);
+    root->buckets = buckets;
+    root->bucketsize = newsize;
+
+    for(namespace_t *ns = root->first; ns; ns = ns->next)
+        namespace_bucket_insert(root, ns);
+
+    return 0;
+}
+
+static int namespace_slots_grow(ns_root_t *root) {
+    size_t newlength = root->allocated * 2;
+    namespace_t **newlist;
+    size_t *newslots;
 
-    // no empty slot, allocating a new one
-    if(!(newlist = realloc(root->namespaces, sizeof(namespace_t) * newlength)))
-        return zdb_warnp("realloc namespaces list");
+    zdb_debug("[+] namespace: allocating new slots (%lu)\n", newlength);
 
-    // set list id
-    namespace->idlist = root->length;
+    if(!(newlist = realloc(root->namespaces, sizeof(namespace_t *) * newlength))) {
+        zdb_warnp("realloc namespaces list");
+        return 1;
+    }
 
-    // insert to list
     root->namespaces = newlist;
-    root->namespaces[root->length] = namespace;
-    root->length = newlength;
+
+    if(!(newslots = realloc(root->freeslots, sizeof(size_t) * newlength))) {
+        zdb_warnp("realloc namespaces free slots");
+        return 1;
+    }
+
+    root->freeslots = newslots;
+    root->allocated = newlength;
+
+    return 0;
+}
+
+// add a namespace to the main namespaces list
+static namespace_t *namespace_push(ns_root_t *root, namespace_t *namespace) {
+    if(root->freelength > 0) {
+        // empty slot available, reusing it
+        root->freelength -= 1;
+        namespace->idlist = root->freeslots[root->freelength];
+
+        zdb_debug("[+] namespace: empty slot reusable found: %lu\n", namespace->idlist);
+
+    } else {
+        if(root->length == root->allocated && namespace_slots_grow(root))
+            return NULL;
+
+        namespace->idlist = root->length;
+        root->length += 1;
+    }
+
+    root->namespaces[namespace->idlist] = namespace;
+
+    // append to the iteration list
+    namespace->next = NULL;
+    namespace->previous = root->last;
+
+    if(root->last)
+        root->last->next = namespace;
+
+    if(!root->first)
+        root->first = namespace;
+
+    root->last = namespace;
 
     // one new effective namespace
     root->effective += 1;
+    namespace_bucket_insert(root, namespace);
+
+    if(root->effective > root->bucketsize)
+        namespace_buckets_grow(root);
+
+    // index could be already updated during loading
+    if(namespace->index && namespace->index->updated)
+        namespace_changed(namespace);
+
+    // current datafile could already need a prepared next file,
+    // first idle rotation will release it if nothing is needed
+    namespace_housekeeping(namespace);
 
     return namespace;
 }
@@ -444,14 +657,27 @@ ns_root_t *namespaces_allocate(zdb_settings_t *settings) {
     if(!(root = (ns_root_t *) malloc(sizeof(ns_root_t))))
         zdb_diep("namespaces malloc");
 
-    root->length = 1;             // we start with the default one, only
-    root->effective = 1;          // no namespace has been loaded yet
+    root->length = 0;             // no slot used yet
+    root->allocated = 1;          // we start with the default one, only
+    root->effective = 0;          // no namespace has been loaded yet
     root->settings = settings;    // keep the reference to the settings, needed for paths
     root->branches = NULL;        // maybe we don't need the branches, see below
+    root->freelength = 0;
+    root->first = NULL;
+    root->last = NULL;
+    root->changed = NULL;
+    root->housekeeping = NULL;
+    root->bucketsize = NAMESPACE_BUCKETS_INITIAL;
+
+    if(!(root->namespaces = (namespace_t **) malloc(sizeof(namespace_t *) * root->allocated)))
+        zdb_diep("namespace malloc");
 
-    if(!(root->namespaces = (namespace_t **) malloc(sizeof(namespace_t *) * root->length)))
+    if(!(root->freeslots = (size_t *) malloc(sizeof(size_t) * root->allocated)))
         zdb_diep("namespace malloc");
 
+    if(!(root->buckets = (namespace_t **) calloc(root->bucketsize, sizeof(namespace_t *))))
+        zdb_diep("namespace registry calloc");
+
     // allocating (if needed, only some modes need it) the big (single) index branches
     if(settings->mode == ZDB_MODE_KEY_VALUE || settings->mode == ZDB_MODE_MIX) {
         zdb_debug("[+] namespaces: pre-allocating index (%d lazy branches)\n", buckets_branches);
@@ -485,7 +711,9 @@ int namespaces_init(zdb_settings_t *settings) {
     nsroot = namespaces_allocate(settings);
 
     // namespace 0 will always be the default one
-    if(!(nsroot->namespaces[0] = namespace_load(nsroot, NAMESPACE_DEFAULT))) {
+    namespace_t *namespace;
+
+    if(!(namespace = namespace_load(nsroot, NAMESPACE_DEFAULT)) || !namespace_push(nsroot, namespace)) {
         zdb_danger("[-] could not load or create default namespace, this is fatal");
         exit(EXIT_FAILURE);
     }
@@ -527,6 +755,10 @@ int namespaces_destroy() {
 
     namespace_t *ns;
     for(ns = namespace_iter(); ns; ns = namespace_iter_next(ns)) {
+        // files are kept, pending rotation needs to be notified
+        index_sealed_flush(ns->index);
+        data_sealed_flush(ns->data);
+
         index_destroy(ns->index);
         data_destroy(ns->data);
     }
@@ -542,6 +774,8 @@ int namespaces_destroy() {
 
     // freeing internal namespaces support
     free(nsroot->namespaces);
+    free(nsroot->freeslots);
+    free(nsroot->buckets);
     nsroot->length = 0;
 
     free(nsroot);
@@ -550,13 +784,27 @@ int namespaces_destroy() {
 }
 
 static void namespace_kick_slot(namespace_t *namespace) {
-    for(size_t i = 0; i < nsroot->length; i++) {
-        if(nsroot->namespaces[i] == namespace) {
-            // freeing this namespace slot
-            nsroot->namespaces[i] = NULL;
-            return;
-        }
-    }
+    namespace_changed_release(namespace);
+    namespace_housekeeping_release(namespace);
+    namespace_bucket_remove(nsroot, namespace);
+
+    // removing from the iteration list
+    if(namespace->previous)
+        namespace->previous->next = namespace->next;
+
+    if(namespace->next)
+        namespace->next->previous = namespace->previous;
+
+    if(nsroot->first == namespace)
+        nsroot->first = namespace->next;
+
+    if(nsroot->last == namespace)
+        nsroot->last = namespace->previous;
+
+    // freeing this namespace slot
+    nsroot->namespaces[namespace->idlist] = NULL;
+    nsroot->freeslots[nsroot->freelength] = namespace->idlist;
+    nsroot->freelength += 1;
 }
 
 // return 1 or 0 if namespace is fresh
@@ -609,6 +857,9 @@ int namespace_reload(namespace_t *namespace) {
     index_clean_namespace(namespace->index, namespace);
 
     zdb_debug("[+] namespace: reload: destroying objects\n");
+    index_sealed_flush(namespace->index);
+    data_sealed_flush(namespace->data);
+
     index_destroy(namespace->index);
     data_destroy(namespace->data);
 
@@ -736,6 +987,43 @@ int namespaces_emergency() {
     return 0;
 }
 
+// file rotation housekeeping, expected to be called periodically
+// when nothing else is going on (idle time)
+//
+// - flush and close files sealed by a previous rotation
+// - close previous datafiles not read since a while
+// - prepare next index and data files when the current datafile
+//   is close to be full, rotation will then only be a swap
+//
+// only namespaces on the housekeeping list are walked, they are
+// released when nothing is left to do (readers still opened need
+// to be expired later, failed preparation is retried)
+void namespaces_idle_rotation() {
+    namespace_t *ns, *next;
+
+    for(ns = nsroot->housekeeping; ns; ns = next) {
+        next = ns->housenext;
+
+        index_sealed_flush(ns->index);
+        data_sealed_flush(ns->data);
+        data_readers_expire(ns->data);
+
+        int pending = data_readers_opened(ns->data);
+
+        if(!(ns->index->status & INDEX_READ_ONLY) && data_prepare_needed(ns->data)) {
+            zdb_debug("[+] namespaces: preparing next files [%s]\n", ns->name);
+
+            if(index_prepare_next(ns->index) == 0)
+                data_prepare_next(ns->data, ns->index->indexid + 1);
+
+            pending |= data_prepare_needed(ns->data);
+        }
+
+        if(!pending)
+            namespace_housekeeping_release(ns);
+    }
+}
+
 // lock a namespace, which set read-only mode for everybody
 // this mode is useful when namespace goes in maintenance without
 // making namespace unavailable
@@ -11,6 +11,11 @@
 
     #define NAMESPACE_MAX_LENGTH  128
 
+    // initial amount of buckets of the namespaces registry
+    // (needs to be a power of two), the registry grows when
+    // there are more namespaces than buckets
+    #define NAMESPACE_BUCKETS_INITIAL  64
+
     typedef enum ns_flags_t {
         NS_FLAGS_PUBLIC = 1,   // public read-only namespace
         NS_FLAGS_WORM = 2,     // worm mode enabled or not
@@ -45,18 +50,43 @@
         data_root_t *data;     // data structure pointer
         char public;           // publicly readable (read without password)
         size_t maxsize;        // maximum size allowed
-        size_t idlist;         // nsroot list index
+        size_t idlist;         // nsroot list index (slot), stable while loaded
         size_t version;        // internal version used
         ns_lock_t locked;      // set namespace read/write temporary status
         char worm;             // worm mode (write only read multiple)
                                // this mode disable overwrite/deletion
 
+        uint32_t hash;                     // name hash, registry bucket selector
+        struct namespace_t *hashnext;      // next namespace on the same bucket
+        struct namespace_t *next;          // next loaded namespace (iteration)
+        struct namespace_t *previous;      // previous loaded namespace
+        struct namespace_t *changednext;   // next namespace with index updated
+        struct namespace_t *changedprev;   // previous namespace with index updated
+        int changed;                       // namespace is on the changed list
+        struct namespace_t *housenext;     // next namespace with files housekeeping pending
+        struct namespace_t *houseprev;     // previous namespace with files housekeeping pending
+        int housekeeping;                  // namespace is on the housekeeping list
+
+        void *scheduler;       // clients scheduling state (managed by the server)
+
     } namespace_t;
 
     typedef struct ns_root_t {
-        size_t length;             // amount of namespaces allocated
+        size_t length;             // amount of slots in use (including empty ones)
+        size_t allocated;          // amount of slots allocated
         size_t effective;          // amount of namespaces currently loaded
-        namespace_t **namespaces;  // pointers to namespaces
+        namespace_t **namespaces;  // pointers to namespaces, indexed by slot
+        size_t *freeslots;         // empty slots available for reuse
+        size_t freelength;         // amount of empty slots available
+
+        namespace_t **buckets;     // hash registry, lookup by name
+        size_t bucketsize;         // amount of buckets (power of two)
+
+        namespace_t *first;        // loaded namespaces, in loading order
+        namespace_t *last;
+        namespace_t *changed;      // namespaces with current index file updated
+        namespace_t *housekeeping; // namespaces with sealed files, readers or prepare pending
+
         zdb_settings_t *settings;  // global settings reminder
         index_branch_t **branches; // unique global branches list
 
@@ -76,6 +106,13 @@
     namespace_t *namespace_iter();
     namespace_t *namespace_iter_next(namespace_t *namespace);
 
+    void namespace_changed(namespace_t *namespace);
+    namespace_t *namespace_changed_iter();
+    namespace_t *namespace_changed_next(namespace_t *namespace);
+    void namespace_changed_release(namespace_t *namespace);
+
+    void namespace_housekeeping(namespace_t *namespace);
+
     int namespace_create(char *name);
     int namespace_delete(namespace_t *namespace);
     int namespace_commit(namespace_t *namespace);
@@ -95,6 +132,7 @@
     ns_root_t *namespaces_allocate(zdb_settings_t *settings);
     int namespaces_destroy();
     int namespaces_emergency();
+    void namespaces_idle_rotation();
 
     namespace_t *namespace_load(ns_root_t *nsroot, char *name);
     namespace_t *namespace_load_light(ns_root_t *nsroot, char *name, int ensure);
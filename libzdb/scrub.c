@@ -0,0 +1,309 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include "libzdb.h"
+#include "libzdb_private.h"
+
+// background integrity scrubber
+//
+// every payload written contains a crc32 in its header, this crc is
+// only verified when explicitly requested (CHECK command), which means
+// a silent disk corruption on a cold file is only found when the key
+// is read (or never)
+//
+// the scrubber walks over all the datafiles of all the namespaces and
+// verify each entry, it's designed to be called periodically by the
+// main loop when idle, each call only do a small amount of work, limited
+// by a rate (bytes per seconds) and a time slice, the position is kept
+// between calls
+//
+// only sealed datafiles are checked (not the one currently in use for
+// writing), theses files are never modified anymore
+static zdb_scrub_t scrubber = {
+    .rate = 0,
+    .fd = 0,
+};
+
+static uint8_t *scrubbuf = NULL;
+
+zdb_scrub_t *scrub_status() {
+    scrubber.rate = zdb_rootsettings.scrubrate;
+    return &scrubber;
+}
+
+static void scrub_file_close() {
+    if(scrubber.fd > 0) {
+        // we don't need theses pages anymore, don't keep
+        // cold data in the cache because of the scrubber
+        posix_fadvise(scrubber.fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(scrubber.fd);
+    }
+
+    scrubber.fd = 0;
+    scrubber.remain = 0;
+}
+
+// jump to the next datafile of the same namespace
+static void scrub_file_next() {
+    scrub_file_close();
+    scrubber.dataid += 1;
+}
+
+static int scrub_file_open(namespace_t *ns) {
+    char filename[ZDB_PATH_MAX];
+    struct stat sb;
+    int fd;
+
+    snprintf(filename, sizeof(filename), "%s/d%u", ns->data->datadir, scrubber.dataid);
+
+    // we don't use data_open_id here on purpose, a missing datafile
+    // would trigger the missing-data hook, which could download back
+    // an offloaded file just to check it
+    if((fd = open(filename, O_RDONLY)) < 0) {
+        if(errno != ENOENT)
+            zdb_warnp(filename);
+
+        return -1;
+    }
+
+    if(fstat(fd, &sb) < 0) {
+        zdb_warnp(filename);
+        close(fd);
+        return -1;
+    }
+
+    zdb_debug("[+] scrub: checking datafile: %s\n", filename);
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    scrubber.fd = fd;
+    scrubber.filesize = sb.st_size;
+    scrubber.offset = sizeof(data_header_t);
+    scrubber.remain = 0;
+
+    return fd;
+}
+
+static void scrub_corrupted(namespace_t *ns, off_t offset) {
+    zdb_scrub_corrupt_t *corrupt;
+
+    zdb_danger("[-] scrub: [%s] corrupted entry: datafile %u, offset %lu", ns->name, scrubber.dataid, offset);
+
+    // same entry already reported on a previous pass
+    for(size_t i = 0; i < ZDB_SCRUB_HISTORY && i < scrubber.recentidx; i++) {
+        corrupt = &scrubber.recent[i];
+
+        if(corrupt->dataid == scrubber.dataid && corrupt->offset == offset && strcmp(corrupt->namespace, ns->name) == 0) {
+            corrupt->detected = time(NULL);
+            return;
+        }
+    }
+
+    corrupt = &scrubber.recent[scrubber.recentidx % ZDB_SCRUB_HISTORY];
+
+    strncpy(corrupt->namespace, ns->name, NAMESPACE_MAX_LENGTH);
+    corrupt->namespace[NAMESPACE_MAX_LENGTH] = '\0';
+    corrupt->dataid = scrubber.dataid;
+    corrupt->offset = offset;
+    corrupt->detected = time(NULL);
+
+    scrubber.recentidx += 1;
+    scrubber.corrupted += 1;
+}
+
+// select the namespace to check, a new pass is started
+// from the first namespace when needed
+static namespace_t *scrub_namespace_current() {
+    namespace_t *ns = NULL;
+
+    if(scrubber.namespace[0] && (ns = namespace_get(scrubber.namespace)))
+        return ns;
+
+    // no namespace selected (new pass), or the namespace
+    // was removed in the meantime, starting from the first one
+    if(!scrubber.namespace[0])
+        scrubber.passstart = time(NULL);
+
+    scrub_file_close();
+
+    ns = namespace_iter();
+    strncpy(scrubber.namespace, ns->name, NAMESPACE_MAX_LENGTH);
+    scrubber.dataid = 0;
+
+    return ns;
+}
+
+// jump to the next namespace, returns 1 if the pass is completed
+static int scrub_namespace_next(namespace_t *ns) {
+    scrub_file_close();
+    scrubber.dataid = 0;
+
+    if((ns = namespace_iter_next(ns))) {
+        strncpy(scrubber.namespace, ns->name, NAMESPACE_MAX_LENGTH);
+        return 0;
+    }
+
+    zdb_verbose("[+] scrub: pass completed, %lu corrupted entries found so far\n", scrubber.corrupted);
+
+    scrubber.namespace[0] = '\0';
+    scrubber.passes += 1;
+    scrubber.lastpass = time(NULL);
+
+    return 1;
+}
+
+static void scrub_entry_done(namespace_t *ns) {
+    scrubber.entries += 1;
+
+    if(scrubber.crc != scrubber.integrity)
+        scrub_corrupted(ns, scrubber.entry);
+}
+
+static ssize_t scrub_entry_header(namespace_t *ns) {
+    data_entry_header_t header;
+    off_t offset = scrubber.offset;
+
+    if(offset >= scrubber.filesize) {
+        scrub_file_next();
+        return 0;
+    }
+
+    // a sealed datafile should never contains a truncated entry
+    if(pread(scrubber.fd, &header, sizeof(data_entry_header_t), offset) != sizeof(data_entry_header_t)) {
+        scrub_corrupted(ns, offset);
+        scrub_file_next();
+        return 0;
+    }
+
+    off_t next = offset + sizeof(data_entry_header_t) + header.idlength + header.datalength;
+    if(next > scrubber.filesize) {
+        scrub_corrupted(ns, offset);
+        scrub_file_next();
+        return 0;
+    }
+
+    scrubber.entry = offset;
+    scrubber.position = offset + sizeof(data_entry_header_t) + header.idlength;
+    scrubber.remain = header.datalength;
+    scrubber.integrity = header.integrity;
+    scrubber.crc = 0;
+    scrubber.offset = next;
+    scrubber.checked += sizeof(data_entry_header_t);
+
+    // empty payload (eg: deleted entry), nothing more to read
+    if(scrubber.remain == 0)
+        scrub_entry_done(ns);
+
+    return sizeof(data_entry_header_t);
+}
+
+static ssize_t scrub_entry_payload(namespace_t *ns) {
+    size_t length = scrubber.remain < ZDB_SCRUB_CHUNK ? scrubber.remain : ZDB_SCRUB_CHUNK;
+    ssize_t rlen;
+
+    if((rlen = pread(scrubber.fd, scrubbuf, length, scrubber.position)) != (ssize_t) length) {
+        zdb_warnp("scrub: payload read");
+        scrub_corrupted(ns, scrubber.entry);
+        scrub_file_next();
+        return 0;
+    }
+
+    scrubber.crc = zdb_crc32_update(scrubber.crc, scrubbuf, rlen);
+    scrubber.position += rlen;
+    scrubber.remain -= rlen;
+    scrubber.checked += rlen;
+
+    if(scrubber.remain == 0)
+        scrub_entry_done(ns);
+
+    return rlen;
+}
+
+// do one small step, returns amount of bytes read
+// or -1 if the pass is completed
+static ssize_t scrub_step() {
+    namespace_t *ns = scrub_namespace_current();
+
+    if(scrubber.fd <= 0) {
+        // current datafile is the only one still written, skipping it
+        if(scrubber.dataid >= ns->data->dataid)
+            return scrub_namespace_next(ns) ? -1 : 0;
+
+        // datafile not available (offloaded, ...), skipping it
+        if(scrub_file_open(ns) < 0) {
+            scrubber.dataid += 1;
+            return 0;
+        }
+    }
+
+    if(scrubber.remain == 0)
+        return scrub_entry_header(ns);
+
+    return scrub_entry_payload(ns);
+}
+
+static double scrub_elapsed(struct timeval *from, struct timeval *to) {
+    return (to->tv_sec - from->tv_sec) + ((to->tv_usec - from->tv_usec) / 1000000.0);
+}
+
+// do some scrubbing work, limited by rate and time
+// this needs to be called periodically
+void scrub_process() {
+    struct timeval start, now;
+    size_t rate = zdb_rootsettings.scrubrate;
+    ssize_t done;
+
+    scrubber.rate = rate;
+
+    // scrubber disabled
+    if(rate == 0)
+        return;
+
+    if(!scrubbuf && !(scrubbuf = malloc(ZDB_SCRUB_CHUNK))) {
+        zdb_warnp("scrub: malloc");
+        return;
+    }
+
+    gettimeofday(&start, NULL);
+
+    // token bucket, refilled with the time elapsed since last
+    // call, with a maximum burst of one second of rate
+    if(scrubber.lastrun.tv_sec)
+        scrubber.allowance += scrub_elapsed(&scrubber.lastrun, &start) * rate;
+
+    if(scrubber.allowance > rate)
+        scrubber.allowance = rate;
+
+    scrubber.lastrun = start;
+
+    // previous pass completed recently, waiting before the next one
+    if(!scrubber.namespace[0] && scrubber.passes && start.tv_sec - scrubber.passstart < ZDB_SCRUB_PASS_DELAY)
+        return;
+
+    while(scrubber.allowance > 0) {
+        if((done = scrub_step()) < 0)
+            return;
+
+        scrubber.allowance -= done;
+
+        gettimeofday(&now, NULL);
+        if(scrub_elapsed(&start, &now) * 1000000 > ZDB_SCRUB_SLICE_USEC)
+            return;
+    }
+}
+
+void scrub_destroy() {
+    scrub_file_close();
+
+    free(scrubbuf);
+    scrubbuf = NULL;
+}
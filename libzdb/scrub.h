@@ -0,0 +1,64 @@
+#ifndef __ZDB_SCRUB_H
+    #define __ZDB_SCRUB_H
+
+    // amount of corrupted entries kept in memory (most recent ones)
+    #define ZDB_SCRUB_HISTORY     8
+
+    // maximum amount of bytes read in one shot
+    #define ZDB_SCRUB_CHUNK       64 * 1024
+
+    // maximum time (in microseconds) spent by the scrubber
+    // on a single call, to not block the caller too long
+    #define ZDB_SCRUB_SLICE_USEC  5000
+
+    // minimum time (in seconds) between two passes start, this
+    // avoid looping over and over on small dataset
+    #define ZDB_SCRUB_PASS_DELAY  60
+
+    typedef struct zdb_scrub_corrupt_t {
+        char namespace[NAMESPACE_MAX_LENGTH + 1];  // namespace name
+        fileid_t dataid;                           // datafile id
+        off_t offset;                              // entry offset in the datafile
+        time_t detected;                           // when corruption was found
+
+    } zdb_scrub_corrupt_t;
+
+    // the scrubber walks over all the sealed (read-only) datafiles
+    // of all the namespaces and verify payload integrity (crc32)
+    // in background, in small slices, limited by a rate
+    typedef struct zdb_scrub_t {
+        size_t rate;         // maximum bytes per seconds read (0: disabled)
+        double allowance;    // amount of bytes allowed to be read now
+        struct timeval lastrun;
+
+        // current position
+        char namespace[NAMESPACE_MAX_LENGTH + 1];
+        fileid_t dataid;     // current datafile id
+        int fd;              // current datafile file descriptor
+        off_t filesize;      // current datafile size
+        off_t offset;        // offset of the next entry to check
+
+        // current entry state (entries are checked in chunks)
+        off_t entry;         // offset of the entry in progress
+        off_t position;      // offset of the next payload chunk
+        size_t remain;       // amount of payload bytes still to check
+        uint32_t crc;        // running crc of the payload
+        uint32_t integrity;  // expected crc (from the entry header)
+
+        // statistics
+        uint64_t checked;    // amount of bytes read
+        uint64_t entries;    // amount of entries checked
+        uint64_t corrupted;  // amount of distinct corrupted entries found
+        uint64_t passes;     // amount of complete passes done
+        time_t passstart;    // when the current pass started
+        time_t lastpass;     // when the last complete pass ended
+
+        zdb_scrub_corrupt_t recent[ZDB_SCRUB_HISTORY];
+        size_t recentidx;    // next slot in the recent list
+
+    } zdb_scrub_t;
+
+    void scrub_process();
+    zdb_scrub_t *scrub_status();
+    void scrub_destroy();
+#endif
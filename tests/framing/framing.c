@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "resp_line.h"
+
+//
+// framing check and benchmark
+//
+// first part compares resp_line_end against memchr for every
+// alignment and every newline position around 16 bytes blocks
+// and resp_line_integer against atoi, any mismatch fails
+//
+// second part runs on a pipelined SET trace (like redis-benchmark -P),
+// line end lookup (memchr against resp_line_end) and header decoding
+// (atoi against resp_line_integer) are measured alone, then the full
+// framing with memchr + atoi (previous implementation) and with the
+// line scanner
+//
+#define TRACE_SIZE   (64 * 1024 * 1024)
+#define BENCH_ROUNDS 5
+
+typedef struct trace_t {
+    char *buffer;       // pipelined commands
+    size_t length;
+    size_t commands;
+    size_t lines;       // amount of lines (headers and payloads)
+    char **headers;     // header lines start, and their end
+    char **ends;
+    size_t count;
+    size_t sum;         // sum of all the headers values
+
+} trace_t;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+static int check_line_end() {
+    char buffer[128];
+    int errors = 0;
+
+    // offset: start alignment, length: bytes available,
+    // position: where the newline is (length means no newline)
+    for(size_t offset = 0; offset < 16; offset++) {
+        for(size_t length = 0; length <= 64; length++) {
+            for(size_t position = 0; position <= length; position++) {
+                char *reader = buffer + offset;
+                char *writer = reader + length;
+
+                memset(buffer, 'x', sizeof(buffer));
+
+                if(position < length)
+                    reader[position] = '\n';
+
+                // newline just after the end, must not be seen
+                *writer = '\n';
+
+                char *expected = memchr(reader, '\n', length);
+                char *found = resp_line_end(reader, writer);
+
+                if(found != expected) {
+                    fprintf(stderr, "[-] line end: offset %zu, length %zu, position %zu\n", offset, length, position);
+                    errors += 1;
+                }
+            }
+        }
+    }
+
+    return errors;
+}
+
+static int check_line_integer() {
+    char *valid[] = {"*0", "*1", "$3", "$16", "*1024", "$2147483647", "$12\r", "$5x"};
+    char *invalid[] = {"*", "$-1", "$ 3", "$x", "$2147483648", "$99999999999"};
+    int errors = 0;
+
+    for(size_t i = 0; i < sizeof(valid) / sizeof(char *); i++) {
+        char *line = valid[i];
+
+        if(resp_line_integer(line, line + strlen(line)) != atoi(line + 1)) {
+            fprintf(stderr, "[-] line integer: %s\n", line);
+            errors += 1;
+        }
+    }
+
+    for(size_t i = 0; i < sizeof(invalid) / sizeof(char *); i++) {
+        char *line = invalid[i];
+
+        if(resp_line_integer(line, line + strlen(line)) != -1) {
+            fprintf(stderr, "[-] line integer: %s should be rejected\n", line);
+            errors += 1;
+        }
+    }
+
+    // value must stop at the end of the line, even if digits follows
+    if(resp_line_integer("$123", (char *) "$123" + 3) != 12) {
+        fprintf(stderr, "[-] line integer: reads past the end\n");
+        errors += 1;
+    }
+
+    return errors;
+}
+
+static void trace_build(trace_t *trace) {
+    char payload[65];
+    size_t offset = 0;
+
+    if(!(trace->buffer = malloc(TRACE_SIZE + 256))) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(payload, 'v', sizeof(payload));
+    trace->commands = 0;
+    trace->sum = 0;
+
+    while(offset < TRACE_SIZE) {
+        int keylen = 8 + (trace->commands % 8);
+        int valuelen = 8 + (trace->commands % 57);
+
+        offset += sprintf(trace->buffer + offset, "*3\r\n$3\r\nSET\r\n$%d\r\nkey:%0*zu\r\n$%d\r\n%.*s\r\n",
+                          keylen, keylen - 4, trace->commands % 10000, valuelen, valuelen, payload);
+
+        trace->sum += 3 + 3 + keylen + valuelen;
+        trace->commands += 1;
+    }
+
+    trace->length = offset;
+
+    // each command: argc line, and 3 times a length line and a payload line
+    trace->lines = trace->commands * 7;
+    trace->count = trace->commands * 4;
+
+    trace->headers = malloc(sizeof(char *) * trace->count);
+    trace->ends = malloc(sizeof(char *) * trace->count);
+
+    if(!trace->headers || !trace->ends) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    // headers are found once, to decode them alone later
+    char *reader = trace->buffer;
+    size_t header = 0;
+
+    for(size_t line = 0; line < trace->lines; line++) {
+        char *match = memchr(reader, '\n', trace->buffer + trace->length - reader);
+
+        if(*reader == '*' || *reader == '$') {
+            trace->headers[header] = reader;
+            trace->ends[header] = match;
+            header += 1;
+        }
+
+        reader = match + 1;
+    }
+}
+
+static void trace_free(trace_t *trace) {
+    free(trace->buffer);
+    free(trace->headers);
+    free(trace->ends);
+}
+
+// find every line end of the trace
+static size_t scan_memchr(trace_t *trace) {
+    char *reader = trace->buffer;
+    char *writer = trace->buffer + trace->length;
+    size_t lines = 0;
+
+    while(reader < writer) {
+        reader = (char *) memchr(reader, '\n', writer - reader) + 1;
+        lines += 1;
+    }
+
+    return lines;
+}
+
+static size_t scan_scanner(trace_t *trace) {
+    char *reader = trace->buffer;
+    char *writer = trace->buffer + trace->length;
+    size_t lines = 0;
+
+    while(reader < writer) {
+        reader = resp_line_end(reader, writer) + 1;
+        lines += 1;
+    }
+
+    return lines;
+}
+
+// decode every header line of the trace
+static size_t integer_atoi(trace_t *trace) {
+    size_t sum = 0;
+
+    for(size_t i = 0; i < trace->count; i++)
+        sum += atoi(trace->headers[i] + 1);
+
+    return sum;
+}
+
+static size_t integer_scanner(trace_t *trace) {
+    size_t sum = 0;
+
+    for(size_t i = 0; i < trace->count; i++)
+        sum += resp_line_integer(trace->headers[i], trace->ends[i]);
+
+    return sum;
+}
+
+// walk the trace like the server does: argc line, then for each
+// argument, a length line followed by the payload
+static size_t frame_memchr(trace_t *trace) {
+    char *reader = trace->buffer;
+    char *writer = trace->buffer + trace->length;
+    size_t framed = 0;
+
+    while(reader < writer) {
+        char *match = memchr(reader, '\n', writer - reader);
+        int argc = atoi(reader + 1);
+        reader = match + 1;
+
+        for(int i = 0; i < argc; i++) {
+            match = memchr(reader, '\n', writer - reader);
+            int length = atoi(reader + 1);
+            reader = match + 1 + length + 2;
+        }
+
+        framed += 1;
+    }
+
+    return framed;
+}
+
+static size_t frame_scanner(trace_t *trace) {
+    char *reader = trace->buffer;
+    char *writer = trace->buffer + trace->length;
+    size_t framed = 0;
+
+    while(reader < writer) {
+        char *match = resp_line_end(reader, writer);
+        int argc = resp_line_integer(reader, match);
+        reader = match + 1;
+
+        for(int i = 0; i < argc; i++) {
+            match = resp_line_end(reader, writer);
+            int length = resp_line_integer(reader, match);
+            reader = match + 1 + length + 2;
+        }
+
+        framed += 1;
+    }
+
+    return framed;
+}
+
+// run a benchmark, result needs to be the expected one (lines, sum of
+// the values or commands), throughput is computed on operations done
+static void bench(char *name, size_t (*run)(trace_t *), trace_t *trace, size_t expected, size_t operations) {
+    double best = 0;
+
+    for(int round = 0; round < BENCH_ROUNDS; round++) {
+        double start = now();
+        size_t result = run(trace);
+        double elapsed = now() - start;
+
+        if(result != expected) {
+            fprintf(stderr, "[-] %s: got %zu, expected %zu\n", name, result, expected);
+            exit(EXIT_FAILURE);
+        }
+
+        if(best == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("[+] %-16s: %7.1f M op/s\n", name, (operations / 1000000.0) / best);
+}
+
+int main() {
+    trace_t trace;
+    int errors = 0;
+
+    #ifdef __SSE2__
+    printf("[+] scanner: sse2\n");
+    #else
+    printf("[+] scanner: memchr fallback\n");
+    #endif
+
+    errors += check_line_end();
+    errors += check_line_integer();
+
+    if(errors) {
+        fprintf(stderr, "[-] %d mismatch found\n", errors);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("[+] line scanner: all checks passed\n");
+
+    trace_build(&trace);
+    printf("[+] trace: %zu bytes, %zu commands, %zu lines\n", trace.length, trace.commands, trace.lines);
+
+    // line end lookup alone (one op: one line)
+    bench("scan memchr", scan_memchr, &trace, trace.lines, trace.lines);
+    bench("scan scanner", scan_scanner, &trace, trace.lines, trace.lines);
+
+    // header decoding alone (one op: one header)
+    bench("integer atoi", integer_atoi, &trace, trace.sum, trace.count);
+    bench("integer scanner", integer_scanner, &trace, trace.sum, trace.count);
+
+    // full framing (one op: one command)
+    bench("frame memchr", frame_memchr, &trace, trace.commands, trace.commands);
+    bench("frame scanner", frame_scanner, &trace, trace.commands, trace.commands);
+
+    trace_free(&trace);
+
+    return 0;
+}
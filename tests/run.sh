@@ -18,6 +18,10 @@ rm -rf /tmp/zdbtest
 ./zdbd/zdb --verbose --dump --data /tmp/zdbtest-data --index /tmp/zdbtest-index
 ./zdbd/zdb --verbose --dump --data /tmp/zdbtest-data/ --index /tmp/zdbtest-index/
 
+# protocol line scanner (boundary checks and framing benchmark)
+make -C tests/framing
+./tests/framing/framing
+
 # first real test suite
 ./zdbd/zdb --background --verbose --socket /tmp/zdb.sock --data /tmp/zdbtest-data/ --index /tmp/zdbtest-index/ --hook /bin/true --datasize $((128 * 1024 * 1024))
 ./tests/zdbtests
@@ -26,6 +30,10 @@ sleep 1
 # reopen existing data
 ./zdbd/zdb --background --verbose --socket /tmp/zdb.sock --data /tmp/zdbtest-data/ --index /tmp/zdbtest-index/ --dump
 
+# reopen existing data, active datafile needs to be opened from the index
+# tail hint and not fully walked (last file only contains a fresh insert)
+./zdbd/zdb --verbose --data /tmp/zdbtest-data/ --index /tmp/zdbtest-index/ --dump | grep "test_scan_jump/d2 (index hint)"
+
 # simulate a segmentation fault
 ./zdbd/zdb --background --verbose --socket /tmp/zdb.sock --data /tmp/zdbtest-data/ --index /tmp/zdbtest-index/ --hook /bin/true
 pkill -SEGV zdb
@@ -47,6 +55,28 @@ sleep 1
 # cleaning stuff again
 rm -rf /tmp/zdbtest-data /tmp/zdbtest-index
 
+# same test suite with clients handled by network threads
+./zdbd/zdb --threads 100 || true
+./zdbd/zdb --background --verbose --socket /tmp/zdb.sock --data /tmp/zdbtest-data/ --index /tmp/zdbtest-index/ --hook /bin/true --threads 2
+./tests/zdbtests
+sleep 1
+
+rm -rf /tmp/zdbtest-data /tmp/zdbtest-index
+
+# same test suite with namespaces served by workers, alone then with network threads
+./zdbd/zdb --workers 100 || true
+./zdbd/zdb --background --verbose --socket /tmp/zdb.sock --data /tmp/zdbtest-data/ --index /tmp/zdbtest-index/ --hook /bin/true --workers 2
+./tests/zdbtests
+sleep 1
+
+rm -rf /tmp/zdbtest-data /tmp/zdbtest-index
+
+./zdbd/zdb --background --verbose --socket /tmp/zdb.sock --data /tmp/zdbtest-data/ --index /tmp/zdbtest-index/ --hook /bin/true --workers 3 --threads 2
+./tests/zdbtests
+sleep 1
+
+rm -rf /tmp/zdbtest-data /tmp/zdbtest-index
+
 # starting with authentification
 ./zdbd/zdb --background --verbose --socket /tmp/zdb.sock --data /tmp/zdbtest-data/ --index /tmp/zdbtest-index/ \
     --admin protect \
@@ -101,5 +131,72 @@ sleep 1
 
 # reload sequential database
 ./zdbd/zdb --socket /tmp/zdb.sock --data /tmp/zdbtest-data --index /tmp/zdbtest-index --mode seq --dump
+rm -rf /tmp/zdbtest-data /tmp/zdbtest-index
+
+# send commands (one per line, arguments space separated) on a single
+# connection to the tcp server, replies are printed as received
+zdbresp() {
+    # no trace of each argument sent (options restored on return)
+    local -
+    set +x
+
+    exec 3<>/dev/tcp/127.0.0.1/9900
+
+    while read -a args; do
+        printf '*%d\r\n' ${#args[@]}
+        for arg in "${args[@]}"; do printf '$%d\r\n%s\r\n' ${#arg} "$arg"; done
+    done >&3
+
+    timeout 2 cat <&3 || true
+    exec 3<&-
+}
+
+# scrubber, a payload byte corrupted on a sealed datafile needs to be found
+./zdbd/zdb --background --data /tmp/zdbtest-data --index /tmp/zdbtest-index --listen 127.0.0.1 --port 9900 --datasize $((518 * 1024))
+payload=$(head -c 4000 /dev/zero | tr '\0' x)
+seq 200 | sed "s/.*/SET scrub-& $payload/" | zdbresp > /dev/null
+echo STOP | zdbresp
+sleep 1
+
+# last byte of the first (sealed) datafile is the last entry payload
+datafile=/tmp/zdbtest-data/default/d0
+printf y | dd of=$datafile bs=1 seek=$(($(stat -c %s $datafile) - 1)) conv=notrunc
+
+./zdbd/zdb --background --data /tmp/zdbtest-data --index /tmp/zdbtest-index --listen 127.0.0.1 --port 9900 --scrub 10M
+sleep 2
+echo INFO | zdbresp > /tmp/zdbtest-info
+grep "# scrubber" /tmp/zdbtest-info
+grep "scrub_corrupted: 1" /tmp/zdbtest-info
+grep "scrub_corrupt_0: ns=default,datafile=0" /tmp/zdbtest-info
+echo STOP | zdbresp
+sleep 1
+
+rm -rf /tmp/zdbtest-data /tmp/zdbtest-index /tmp/zdbtest-info
+
+# rotation with small datafiles, next files are prepared when idle and
+# swapped in on jump, all the keys need to be readable afterward
+./zdbd/zdb --background --verbose --logfile /tmp/zdbtest-logs --data /tmp/zdbtest-data --index /tmp/zdbtest-index \
+  --listen 127.0.0.1 --port 9900 --datasize $((518 * 1024))
+
+seq 110 | sed "s/.*/SET rotate-& $payload/" | zdbresp > /dev/null
+sleep 1
+ls /tmp/zdbtest-data/default/d1.next /tmp/zdbtest-index/default/i1.next
+
+seq 111 600 | sed "s/.*/SET rotate-& $payload/" | zdbresp > /dev/null
+sleep 1
+grep "data: active file: /tmp/zdbtest-data/default/d1 (prepared)" /tmp/zdbtest-logs
+grep "index: active file: /tmp/zdbtest-index/default/i1 (prepared)" /tmp/zdbtest-logs
+test ! -e /tmp/zdbtest-data/default/d1.next
+test $(seq 600 | sed "s/.*/GET rotate-&/" | zdbresp | grep -c '^\$4000') -eq 600
+echo STOP | zdbresp
+sleep 1
+
+# and after a reload
+./zdbd/zdb --background --data /tmp/zdbtest-data --index /tmp/zdbtest-index --listen 127.0.0.1 --port 9900
+test $(seq 600 | sed "s/.*/GET rotate-&/" | zdbresp | grep -c '^\$4000') -eq 600
+echo STOP | zdbresp
+sleep 1
+
+rm -rf /tmp/zdbtest-data /tmp/zdbtest-index /tmp/zdbtest-logs
 
 echo "All tests done."
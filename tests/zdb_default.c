@@ -204,6 +204,12 @@ runtest_prio(110, default_unknown_command) {
     return zdb_command_error(test, argvsz(argv), argv);
 }
 
+// commands are matched exactly, not by prefix
+runtest_prio(110, default_prefix_command) {
+    const char *argv[] = {"GE", "hello"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
 static int overwrite(test_t *test, char *key, char *original, char *newvalue) {
     if(test->mode == SEQUENTIAL)
         return TEST_SKIPPED;
@@ -273,6 +279,115 @@ runtest_prio(115, simple_overwrite_same_value) {
     return zdb_result(reply, TEST_SUCCESS);
 }
 
+// command: mset
+runtest_prio(115, mset_missing_value) {
+    const char *argv[] = {"MSET", "mset-one", "value", "mset-two"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+runtest_prio(115, mset_keys) {
+    if(test->mode == SEQUENTIAL)
+        return TEST_SKIPPED;
+
+    redisReply *reply;
+
+    if(!(reply = redisCommand(test->zdb, "MSET mset-one hello mset-two world mset-one again")))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->type != REDIS_REPLY_ARRAY || reply->elements != 3)
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    for(size_t i = 0; i < reply->elements; i++)
+        if(reply->element[i]->type != REDIS_REPLY_STRING)
+            return zdb_result(reply, TEST_FAILED);
+
+    zdb_result(reply, TEST_SUCCESS);
+
+    if(zdb_check(test, "mset-two", "world") != TEST_SUCCESS)
+        return TEST_FAILED;
+
+    // the same key set twice, the last one wins
+    return zdb_check(test, "mset-one", "again");
+}
+
+runtest_prio(115, mset_same_value) {
+    if(test->mode == SEQUENTIAL)
+        return TEST_SKIPPED;
+
+    redisReply *reply;
+
+    if(!(reply = redisCommand(test->zdb, "MSET mset-two world mset-three hello")))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->type != REDIS_REPLY_ARRAY || reply->elements != 2)
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    // unchanged payload, nothing written
+    if(reply->element[0]->type != REDIS_REPLY_NIL)
+        return zdb_result(reply, TEST_FAILED);
+
+    if(reply->element[1]->type != REDIS_REPLY_STRING)
+        return zdb_result(reply, TEST_FAILED);
+
+    return zdb_result(reply, TEST_SUCCESS);
+}
+
+runtest_prio(115, mset_same_batch) {
+    if(test->mode == SEQUENTIAL)
+        return TEST_SKIPPED;
+
+    redisReply *reply;
+
+    // second entry compared to the first one, not to the stored value
+    if(!(reply = redisCommand(test->zdb, "MSET mset-three bye mset-three hello mset-four x mset-four x")))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->type != REDIS_REPLY_ARRAY || reply->elements != 4)
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->element[1]->type != REDIS_REPLY_STRING)
+        return zdb_result(reply, TEST_FAILED);
+
+    if(reply->element[3]->type != REDIS_REPLY_NIL)
+        return zdb_result(reply, TEST_FAILED);
+
+    zdb_result(reply, TEST_SUCCESS);
+
+    return zdb_check(test, "mset-three", "hello");
+}
+
+// command: mget
+runtest_prio(116, mget_order) {
+    if(test->mode == SEQUENTIAL)
+        return TEST_SKIPPED;
+
+    redisReply *reply;
+    const char *expected[] = {"hello", NULL, "again", "world", "again"};
+
+    // reads are reordered internally, replies are not
+    if(!(reply = redisCommand(test->zdb, "MGET mset-three mget-missing mset-one mset-two mset-one")))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->type != REDIS_REPLY_ARRAY || reply->elements != 5)
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    for(size_t i = 0; i < reply->elements; i++) {
+        redisReply *element = reply->element[i];
+
+        if(!expected[i]) {
+            if(element->type != REDIS_REPLY_NIL)
+                return zdb_result(reply, TEST_FAILED);
+
+            continue;
+        }
+
+        if(element->type != REDIS_REPLY_STRING || strcmp(element->str, expected[i]))
+            return zdb_result(reply, TEST_FAILED);
+    }
+
+    return zdb_result(reply, TEST_SUCCESS);
+}
+
 runtest_prio(110, default_set_empty_key) {
     if(test->mode == SEQUENTIAL)
         return TEST_SKIPPED;
@@ -362,6 +477,67 @@ runtest_prio(120, default_check) {
     return TEST_FAILED_FATAL;
 }
 
+// command: getrange
+static int zdb_getrange_check(test_t *test, char *start, char *end, char *expected) {
+    redisReply *reply;
+    const char *argv[] = {"GETRANGE", "hello", start, end};
+
+    if(!(reply = redisCommandArgv(test->zdb, argvsz(argv), argv, NULL)))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->type != REDIS_REPLY_STRING) {
+        log("%s\n", reply->str);
+        return zdb_result(reply, TEST_FAILED);
+    }
+
+    if(reply->len != strlen(expected) || memcmp(reply->str, expected, reply->len)) {
+        log("%.*s\n", (int) reply->len, reply->str);
+        return zdb_result(reply, TEST_FAILED_FATAL);
+    }
+
+    return zdb_result(reply, TEST_SUCCESS);
+}
+
+runtest_prio(120, default_getrange_missing_args) {
+    const char *argv[] = {"GETRANGE", "hello"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+runtest_prio(120, default_getrange_notfound) {
+    const char *argv[] = {"GETRANGE", "unknown-key", "0", "1"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+runtest_prio(120, default_getrange_deleted) {
+    const char *argv[] = {"GETRANGE", "deleted", "0", "1"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+runtest_prio(120, default_getrange_invalid) {
+    const char *argv[] = {"GETRANGE", "hello", "zero", "1"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+runtest_prio(120, default_getrange_head) {
+    if(test->mode == SEQUENTIAL)
+        return TEST_SKIPPED;
+
+    return zdb_getrange_check(test, "0", "4", "world");
+}
+
+runtest_prio(120, default_getrange_tail) {
+    if(test->mode == SEQUENTIAL)
+        return TEST_SKIPPED;
+
+    return zdb_getrange_check(test, "-3", "-1", "new");
+}
+
+runtest_prio(120, default_getrange_outside) {
+    if(test->mode == SEQUENTIAL)
+        return TEST_SKIPPED;
+
+    return zdb_getrange_check(test, "100", "200", "");
+}
 
 // run bunch of basic test on some commands
 runtest_prio(121, basic_suit_check) {
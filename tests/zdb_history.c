@@ -69,6 +69,117 @@ runtest_prio(sp, history_first_hit) {
     return history_check(test, argvsz(argv), argv, "history value 6");
 }
 
+// full chain in a single reply, newest first
+runtest_prio(sp, history_chain) {
+    if(test->mode == SEQUENTIAL)
+        return TEST_SKIPPED;
+
+    const char *argv[] = {"HISTORY", "changeme", "COUNT", "10"};
+    const char *expected[] = {
+        "history value 6", "history value 5", "new value 4",
+        "val 3", "value -- 2", "value 1"
+    };
+    redisReply *reply;
+
+    if(!(reply = redisCommandArgv(test->zdb, argvsz(argv), argv, NULL)))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->type != REDIS_REPLY_ARRAY || reply->elements != 6) {
+        log("Unexpected chain response\n");
+        return zdb_result(reply, TEST_FAILED);
+    }
+
+    for(size_t i = 0; i < reply->elements; i++) {
+        redisReply *version = reply->element[i];
+
+        if(version->type != REDIS_REPLY_ARRAY || version->elements != 3)
+            return zdb_result(reply, TEST_FAILED);
+
+        if(strcmp(version->element[2]->str, expected[i]) != 0) {
+            log("%s\n", version->element[2]->str);
+            return zdb_result(reply, TEST_FAILED);
+        }
+    }
+
+    // last version is the end of the chain
+    if(reply->element[5]->element[0]->type != REDIS_REPLY_NIL)
+        return zdb_result(reply, TEST_FAILED);
+
+    return zdb_result(reply, TEST_SUCCESS);
+}
+
+runtest_prio(sp, history_chain_invalid_count) {
+    const char *argv[] = {"HISTORY", "changeme", "COUNT", "0"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+// chain of a key updated after a datafile jump, in sequential mode
+// the original index entry is rewritten to point into the new datafile
+// while the previous version still lives in the older one
+static uint64_t history_jump_key;
+
+runtest_prio(sp, history_jump_set_first) {
+    if(test->mode == SEQUENTIAL)
+        return zdb_set_seq(test, SEQNEW, "original-0", &history_jump_key);
+
+    return zdb_set(test, "jump-0", "original-0");
+}
+
+runtest_prio(sp, history_jump_set_second) {
+    uint64_t key;
+
+    if(test->mode == SEQUENTIAL)
+        return zdb_set_seq(test, SEQNEW, "original-1", &key);
+
+    return zdb_set(test, "jump-1", "original-1");
+}
+
+runtest_prio(sp, history_jump_jump) {
+    const char *argv[] = {"NSJUMP"};
+    return zdb_command(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, history_jump_update_first) {
+    if(test->mode == SEQUENTIAL)
+        return zdb_set_seq(test, history_jump_key, "UPDATED-0-value", &history_jump_key);
+
+    return zdb_set(test, "jump-0", "UPDATED-0-value");
+}
+
+runtest_prio(sp, history_jump_chain) {
+    const char *expected[] = {"UPDATED-0-value", "original-0"};
+    redisReply *reply;
+
+    if(test->mode == SEQUENTIAL) {
+        reply = redisCommand(test->zdb, "HISTORY %b COUNT 10", &history_jump_key, sizeof(uint64_t));
+
+    } else {
+        reply = redisCommand(test->zdb, "HISTORY jump-0 COUNT 10");
+    }
+
+    if(!reply)
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->type != REDIS_REPLY_ARRAY || reply->elements != 2) {
+        log("Unexpected chain response\n");
+        return zdb_result(reply, TEST_FAILED);
+    }
+
+    for(size_t i = 0; i < reply->elements; i++) {
+        redisReply *version = reply->element[i];
+
+        if(version->type != REDIS_REPLY_ARRAY || version->elements != 3)
+            return zdb_result(reply, TEST_FAILED);
+
+        if(version->element[2]->len != strlen(expected[i]) || strcmp(version->element[2]->str, expected[i]) != 0) {
+            log("%s\n", version->element[2]->str);
+            return zdb_result(reply, TEST_FAILED);
+        }
+    }
+
+    return zdb_result(reply, TEST_SUCCESS);
+}
+
 
 /*
 // start scan test
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
@@ -208,6 +209,126 @@ runtest_prio(sp, lowlevel_open_many_connection) {
     return response;
 }
 
+// open a new connection and switch it to a special mode (MASTER, MIRROR)
+static redisContext *lowlevel_mirror_open(test_t *test, const char *command) {
+    test_t newconn = *test;
+    redisReply *reply;
+
+    initialize(&newconn);
+
+    // admin password used by the test suite, if any
+    if((reply = redisCommand(newconn.zdb, "AUTH root")))
+        freeReplyObject(reply);
+
+    if(!(reply = redisCommand(newconn.zdb, command)) || reply->type != REDIS_REPLY_STATUS) {
+        if(reply)
+            freeReplyObject(reply);
+
+        redisFree(newconn.zdb);
+        return NULL;
+    }
+
+    freeReplyObject(reply);
+
+    return newconn.zdb;
+}
+
+// send a SET as master and read the frame forwarded to the mirror,
+// returns the frame sequence or zero if the mirror was dropped
+static long long lowlevel_mirror_frame(test_t *test, redisContext *master, redisContext *mirror, char *payload, size_t length) {
+    const char *key = (test->mode == SEQUENTIAL) ? "" : "mirror-ack";
+    const char *argv[] = {"SET", key, payload, "7"};
+    size_t argvl[] = {3, strlen(key), length, 1};
+    redisReply *reply;
+    long long sequence = 0;
+
+    if(!(reply = redisCommandArgv(master, 4, argv, argvl)))
+        return -1;
+
+    freeReplyObject(reply);
+
+    if(redisGetReply(mirror, (void **) &reply) != REDIS_OK)
+        return 0;
+
+    if(reply->type == REDIS_REPLY_ARRAY && reply->elements > 0 && reply->element[0]->type == REDIS_REPLY_INTEGER)
+        sequence = reply->element[0]->integer;
+
+    freeReplyObject(reply);
+
+    return sequence;
+}
+
+// acknowledged mirror, frames acknowledged are released and the mirror
+// can receive more than the backlog, a mirror not acknowledging anything
+// is dropped once the backlog (64 MB) is exceeded
+runtest_prio(sp, lowlevel_mirror_ack) {
+    size_t length = 4 * 1024 * 1024;
+    redisContext *master, *mirror;
+    long long sequence;
+    char *payload;
+    int value = TEST_SUCCESS;
+    int done = 0;
+
+    if(!(master = lowlevel_mirror_open(test, "MASTER")))
+        return TEST_SKIPPED;
+
+    if(!(mirror = lowlevel_mirror_open(test, "MIRROR ACK"))) {
+        redisFree(master);
+        return TEST_SKIPPED;
+    }
+
+    if(!(payload = malloc(length)))
+        return TEST_FAILED_FATAL;
+
+    // same payload each time, only the first one is written
+    memset(payload, 'm', length);
+
+    // 80 MB forwarded, each frame acknowledged
+    for(int i = 0; i < 20; i++) {
+        if((sequence = lowlevel_mirror_frame(test, master, mirror, payload, length)) <= 0) {
+            log("mirror dropped after %d acknowledged frames\n", i);
+            value = TEST_FAILED;
+            goto cleanup;
+        }
+
+        redisAppendCommand(mirror, "MIRRORACK %lld", sequence);
+
+        while(!done)
+            if(redisBufferWrite(mirror, &done) != REDIS_OK)
+                break;
+
+        done = 0;
+    }
+
+    // nothing acknowledged anymore, mirror needs to be dropped
+    // when 64 MB are pending, before the 17th frame
+    for(int i = 0; i < 20; i++) {
+        if((sequence = lowlevel_mirror_frame(test, master, mirror, payload, length)) < 0) {
+            value = TEST_FAILED_FATAL;
+            goto cleanup;
+        }
+
+        if(sequence == 0) {
+            if(i > 16) {
+                log("mirror dropped after %d frames not acknowledged\n", i);
+                value = TEST_FAILED;
+            }
+
+            goto cleanup;
+        }
+    }
+
+    log("mirror not dropped without acknowledgment\n");
+    value = TEST_FAILED;
+
+cleanup:
+    free(payload);
+    redisFree(master);
+    redisFree(mirror);
+
+    return value;
+}
+
 runtest_prio(sp, lowlevel_mirror) {
     const char *argv[] = {"MIRROR"};
     int value = zdb_command(test, argvsz(argv), argv);
@@ -4,6 +4,7 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <time.h>
 #include "tests_user.h"
 #include "zdb_utils.h"
 #include "tests.h"
@@ -44,6 +45,22 @@ runtest_prio(sp, misc_info) {
     return zdb_command_str(test, argvsz(argv), argv);
 }
 
+runtest_prio(sp, misc_info_output) {
+    redisReply *reply;
+
+    if(!(reply = redisCommand(test->zdb, "INFO")))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->type != REDIS_REPLY_STRING)
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    // output buffers usage
+    if(!strstr(reply->str, "output_pending_bytes: ") || !strstr(reply->str, "clients_paused: "))
+        return zdb_result(reply, TEST_FAILED);
+
+    return zdb_result(reply, TEST_SUCCESS);
+}
+
 runtest_prio(sp, misc_wait_missing_args) {
     const char *argv[] = {"WAIT"};
     return zdb_command_error(test, argvsz(argv), argv);
@@ -54,6 +71,22 @@ runtest_prio(sp, misc_wait_cmd_not_exists) {
     return zdb_command_error(test, argvsz(argv), argv);
 }
 
+// shortest timeout needs to be fired on the next ticks of the
+// timer wheel, not after a full rotation
+runtest_prio(sp, misc_wait_short_timeout) {
+    const char *argv[] = {"WAIT", "PING", "100"};
+    time_t start = time(NULL);
+
+    int value = zdb_command_error(test, argvsz(argv), argv);
+
+    if(value == TEST_SUCCESS && time(NULL) - start > 2) {
+        log("timeout fired after %ld seconds\n", time(NULL) - start);
+        return TEST_FAILED;
+    }
+
+    return value;
+}
+
 static void *misc_wait_send_ping(void *args) {
     usleep(500000);
 
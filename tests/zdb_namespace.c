@@ -22,6 +22,7 @@ static char *namespace_password_try2 = "hellowo";
 static char *namespace_password_try3 = "helloworldhello";
 static char *namespace_maxsize = "test_ns_maxsize";
 static char *namespace_traversal = "../../hello";
+static char *namespace_scheduler = "test_ns_scheduler";
 
 // select not existing namespace
 runtest_prio(sp, namespace_select_not_existing) {
@@ -608,3 +609,159 @@ runtest_prio(sp, namespace_simple_get_after_reload) {
 }
 
 
+
+// create more namespaces than initial registry buckets, delete
+// some of them and create them again (reusing empty slots)
+static int namespace_registry_exec(test_t *test, const char *command, int index) {
+    redisReply *reply;
+    char nsname[64];
+
+    sprintf(nsname, "registry-%d", index);
+
+    if(!(reply = redisCommand(test->zdb, "%s %s", command, nsname)))
+        return TEST_FAILED_FATAL;
+
+    if(reply->type == REDIS_REPLY_ERROR) {
+        log("%s %s: %s\n", command, nsname, reply->str);
+        return zdb_result(reply, TEST_FAILED);
+    }
+
+    return zdb_result(reply, TEST_SUCCESS);
+}
+
+runtest_prio(sp, namespace_registry_many) {
+    int value;
+
+    for(int i = 0; i < 200; i++)
+        if((value = namespace_registry_exec(test, "NSNEW", i)) != TEST_SUCCESS)
+            return value;
+
+    for(int i = 0; i < 200; i += 3)
+        if((value = namespace_registry_exec(test, "NSDEL", i)) != TEST_SUCCESS)
+            return value;
+
+    for(int i = 0; i < 200; i += 6)
+        if((value = namespace_registry_exec(test, "NSNEW", i)) != TEST_SUCCESS)
+            return value;
+
+    for(int i = 0; i < 200; i++) {
+        // deleted and not created again
+        if(i % 3 == 0 && i % 6 != 0)
+            continue;
+
+        if((value = namespace_registry_exec(test, "NSINFO", i)) != TEST_SUCCESS)
+            return value;
+    }
+
+    return TEST_SUCCESS;
+}
+
+runtest_prio(sp, namespace_registry_deleted) {
+    const char *argv[] = {"NSINFO", "registry-3"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+// scheduling properties
+runtest_prio(sp, namespace_scheduler_create) {
+    return zdb_nsnew(test, namespace_scheduler);
+}
+
+runtest_prio(sp, namespace_scheduler_weight) {
+    const char *argv[] = {"NSSET", namespace_scheduler, "weight", "10"};
+    return zdb_command(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, namespace_scheduler_weight_zero) {
+    const char *argv[] = {"NSSET", namespace_scheduler, "weight", "0"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, namespace_scheduler_weight_too_large) {
+    redisReply *reply;
+
+    if(!(reply = redisCommand(test->zdb, "NSSET %s weight 101", namespace_scheduler)))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->type != REDIS_REPLY_ERROR)
+        return zdb_result(reply, TEST_FAILED);
+
+    // error needs to give the valid range
+    if(!strstr(reply->str, "between 1 and 100")) {
+        log("%s\n", reply->str);
+        return zdb_result(reply, TEST_FAILED);
+    }
+
+    return zdb_result(reply, TEST_SUCCESS);
+}
+
+runtest_prio(sp, namespace_scheduler_maxops_invalid) {
+    const char *argv[] = {"NSSET", namespace_scheduler, "maxops", "-1"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, namespace_scheduler_maxmbps_invalid) {
+    const char *argv[] = {"NSSET", namespace_scheduler, "maxmbps", "12abc"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, namespace_scheduler_default_weight) {
+    const char *argv[] = {"NSSET", namespace_default, "weight", "1"};
+    return zdb_command(test, argvsz(argv), argv);
+}
+
+// limit of 5 operations per second, a burst of one operation
+// is allowed, the next ones are delayed by 200 ms each
+runtest_prio(sp, namespace_scheduler_maxops) {
+    const char *argv[] = {"NSSET", namespace_scheduler, "maxops", "5"};
+    return zdb_command(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, namespace_scheduler_select) {
+    const char *argv[] = {"SELECT", namespace_scheduler};
+    return zdb_command(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, namespace_scheduler_throttled) {
+    for(int i = 0; i < 4; i++) {
+        const char *argv[] = {"PING"};
+        int value;
+
+        if((value = zdb_command(test, argvsz(argv), argv)) != TEST_SUCCESS)
+            return value;
+    }
+
+    return TEST_SUCCESS;
+}
+
+runtest_prio(sp, namespace_scheduler_switchback_default) {
+    const char *argv[] = {"SELECT", namespace_default};
+    return zdb_command(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, namespace_scheduler_nsinfo) {
+    redisReply *reply;
+
+    if(!(reply = redisCommand(test->zdb, "NSINFO %s", namespace_scheduler)))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->type != REDIS_REPLY_STRING)
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(!strstr(reply->str, "scheduler_weight: 10\n") || !strstr(reply->str, "scheduler_limit_ops: 5\n")) {
+        log("%s\n", reply->str);
+        return zdb_result(reply, TEST_FAILED);
+    }
+
+    // commands were delayed by the rate limit
+    if(!strstr(reply->str, "scheduler_throttled_count: ") || strstr(reply->str, "scheduler_throttled_count: 0\n")) {
+        log("%s\n", reply->str);
+        return zdb_result(reply, TEST_FAILED);
+    }
+
+    return zdb_result(reply, TEST_SUCCESS);
+}
+
+runtest_prio(sp, namespace_scheduler_unlimited) {
+    const char *argv[] = {"NSSET", namespace_scheduler, "maxops", "0"};
+    return zdb_command(test, argvsz(argv), argv);
+}
@@ -20,6 +20,7 @@ static size_t sizes_payload[] = {
     2 * 1024 * 1024,   // 2 MB
     4 * 1024 * 1024,   // 4 MB
     8 * 1024 * 1024,   // 8 MB
+    16 * 1024 * 1024,  // 16 MB (streamed)
 };
 
 #define cmdptr  int (*command)(test_t *, void *, size_t, void *, size_t)
@@ -123,6 +124,10 @@ runtest_prio(sp, payload_set_8m) {
     return set_fixed_payload(test, 8);
 }
 
+runtest_prio(sp, payload_set_16m) {
+    return set_fixed_payload(test, 9);
+}
+
 /*
 // client is disconnected if payload is too big
 //
@@ -174,4 +179,8 @@ runtest_prio(sp, payload_get_8m) {
     return get_fixed_payload(test, 8);
 }
 
+runtest_prio(sp, payload_get_16m) {
+    return get_fixed_payload(test, 9);
+}
+
 
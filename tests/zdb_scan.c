@@ -77,6 +77,67 @@ runtest_prio(sp, scan_get_last_key) {
     return scan_check(test, argvsz(argv), argv, "key6");
 }
 
+static int scan_check_count(test_t *test, int argc, const char *argv[], size_t expected) {
+    if(test->mode == SEQUENTIAL)
+        return TEST_SKIPPED;
+
+    redisReply *reply;
+
+    if(!(reply = zdb_response_scan(test, argc, argv)))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    if(reply->element[1]->elements == expected)
+        return zdb_result(reply, TEST_SUCCESS);
+
+    log("%lu entries received\n", reply->element[1]->elements);
+
+    return zdb_result(reply, TEST_FAILED);
+}
+
+runtest_prio(sp, scan_count) {
+    const char *argv[] = {"SCAN", "COUNT", "2"};
+    return scan_check_count(test, argvsz(argv), argv, 2);
+}
+
+runtest_prio(sp, rscan_count) {
+    const char *argv[] = {"RSCAN", "COUNT", "4"};
+    return scan_check_count(test, argvsz(argv), argv, 4);
+}
+
+// sequential mode doesn't have the keys above, only
+// add one entry for the payload check
+runtest_prio(sp, scan_payload_init_seq) {
+    uint64_t key;
+    return zdb_set_seq(test, SEQNEW, "aaaa", &key);
+}
+
+runtest_prio(sp, scan_payload) {
+    const char *argv[] = {"SCAN", "COUNT", "1", "PAYLOAD"};
+    redisReply *reply;
+
+    if(!(reply = zdb_response_scan(test, argvsz(argv), argv)))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    redisReply *entry = reply->element[1]->element[0];
+
+    // key, length, timestamp and payload
+    if(entry->elements != 4 || entry->element[3]->type != REDIS_REPLY_STRING)
+        return zdb_result(reply, TEST_FAILED);
+
+    if(strcmp(entry->element[3]->str, "aaaa"))
+        return zdb_result(reply, TEST_FAILED);
+
+    if(test->mode != SEQUENTIAL && strcmp(entry->element[0]->str, "key1"))
+        return zdb_result(reply, TEST_FAILED);
+
+    return zdb_result(reply, TEST_SUCCESS);
+}
+
+runtest_prio(sp, scan_count_invalid) {
+    const char *argv[] = {"SCAN", "COUNT", "0"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
 /*
 runtest_prio(sp, scan_get_second_key) {
     const char *argv[] = {"SCAN", "key1"};
@@ -172,6 +233,32 @@ runtest_prio(sp, scan_kscan_invalid) {
     return zdb_command_error(test, argvsz(argv), argv);
 }
 
+// CHANGES turns the connection into a stream, only
+// invalid requests can be tested here
+runtest_prio(sp, scan_changes_invalid_args) {
+    const char *argv[] = {"CHANGES", "1"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, scan_changes_invalid_position) {
+    const char *argv[] = {"CHANGES", "nope", "1"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, scan_changes_position_too_far) {
+    const char *argv[] = {"CHANGES", "9999", "40", "PAYLOAD"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
+// feed is not supported in sequential mode
+runtest_prio(sp, scan_changes_sequential) {
+    if(test->mode != SEQUENTIAL)
+        return TEST_SKIPPED;
+
+    const char *argv[] = {"CHANGES"};
+    return zdb_command_error(test, argvsz(argv), argv);
+}
+
 runtest_prio(sp, scan_kscan_switch_default) {
     const char *argv[] = {"SELECT", "default"};
     return zdb_command(test, argvsz(argv), argv);
@@ -192,3 +279,93 @@ runtest_prio(sp, scan_kscan) {
     return TEST_FAILED;
 }
 
+// payload of a key updated after a datafile jump, in sequential
+// mode the original index entry is rewritten to point into the
+// new datafile, payload needs to be read from there
+static char *namespace_scan_jump = "test_scan_jump";
+static uint64_t scan_jump_keys[3];
+
+static int scan_jump_set(test_t *test, int index, char *value) {
+    char key[32];
+
+    if(test->mode == SEQUENTIAL) {
+        uint64_t target = (strncmp(value, "UPDATED", 7) == 0) ? scan_jump_keys[index] : SEQNEW;
+        return zdb_set_seq(test, target, value, &scan_jump_keys[index]);
+    }
+
+    sprintf(key, "jump-%d", index);
+    return zdb_set(test, key, value);
+}
+
+runtest_prio(sp, scan_jump_init) {
+    return zdb_nsnew(test, namespace_scan_jump);
+}
+
+runtest_prio(sp, scan_jump_select) {
+    const char *argv[] = {"SELECT", namespace_scan_jump};
+    return zdb_command(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, scan_jump_set_first) {
+    return scan_jump_set(test, 0, "original-0");
+}
+
+runtest_prio(sp, scan_jump_set_second) {
+    return scan_jump_set(test, 1, "original-1");
+}
+
+runtest_prio(sp, scan_jump_jump) {
+    const char *argv[] = {"NSJUMP"};
+    return zdb_command(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, scan_jump_update_first) {
+    return scan_jump_set(test, 0, "UPDATED-0-value");
+}
+
+runtest_prio(sp, scan_jump_payload) {
+    const char *argv[] = {"SCAN", "COUNT", "10", "PAYLOAD"};
+    redisReply *reply;
+    int found = 0;
+
+    if(!(reply = zdb_response_scan(test, argvsz(argv), argv)))
+        return zdb_result(reply, TEST_FAILED_FATAL);
+
+    redisReply *list = reply->element[1];
+
+    for(size_t i = 0; i < list->elements; i++) {
+        redisReply *entry = list->element[i];
+
+        if(entry->elements != 4 || entry->element[3]->type != REDIS_REPLY_STRING)
+            return zdb_result(reply, TEST_FAILED);
+
+        if(strncmp(entry->element[3]->str, "original-0", 10) == 0) {
+            log("outdated payload received: %s\n", entry->element[3]->str);
+            return zdb_result(reply, TEST_FAILED);
+        }
+
+        if(strcmp(entry->element[3]->str, "UPDATED-0-value") == 0)
+            found += 1;
+    }
+
+    if(found != 1)
+        return zdb_result(reply, TEST_FAILED);
+
+    return zdb_result(reply, TEST_SUCCESS);
+}
+
+// last datafile only contains a fresh insert, when reloaded (see run.sh)
+// this datafile needs to be opened from the index tail hint
+runtest_prio(sp, scan_jump_jump_again) {
+    const char *argv[] = {"NSJUMP"};
+    return zdb_command(test, argvsz(argv), argv);
+}
+
+runtest_prio(sp, scan_jump_set_third) {
+    return scan_jump_set(test, 2, "original-2");
+}
+
+runtest_prio(sp, scan_jump_switch_default) {
+    const char *argv[] = {"SELECT", "default"};
+    return zdb_command(test, argvsz(argv), argv);
+}
@@ -11,6 +11,7 @@
 #include "zdbd.h"
 #include "redis.h"
 #include "commands.h"
+#include "worker.h"
 #include "commands_get.h"
 #include "commands_set.h"
 #include "commands_scan.h"
@@ -73,8 +74,8 @@ int command_args_validate(redis_client_t *client, int expected) {
 
 int command_admin_authorized(redis_client_t *client) {
     if(!client->admin) {
-        // update failed statistics
-        zdbd_rootsettings.stats.adminfailed += 1;
+        // update failed statistics (can be called from a worker)
+        __atomic_add_fetch(&zdbd_rootsettings.stats.adminfailed, 1, __ATOMIC_RELAXED);
 
         redis_hardsend(client, "-Permission denied");
         return 0;
@@ -110,56 +111,129 @@ int command_args_namespace(redis_client_t *client, int argidx) {
 
 static command_t commands_handlers[] = {
     // replication
-    {.command = "*",       .handler = command_asterisk}, // special command used to match all in WAIT
-    {.command = "WAIT",    .handler = command_wait},     // custom WAIT command to wait on events
-    {.command = "MIRROR",  .handler = command_mirror},   // custom MIRROR command to sync full network traffic
-    {.command = "MASTER",  .handler = command_master},   // custom MASTER command to flag client as sync source
+    {.command = "*",        .handler = command_asterisk,  .flags = COMMAND_LOCAL},   // special command used to match all in WAIT
+    {.command = "WAIT",     .handler = command_wait,      .flags = COMMAND_LOCAL},   // custom WAIT command to wait on events
+    {.command = "MIRROR",   .handler = command_mirror,    .flags = 0},               // custom MIRROR command to sync full network traffic
+    {.command = "MIRRORACK", .handler = command_mirrorack, .flags = COMMAND_LOCAL},  // custom command to acknowledge mirrored frames
+    {.command = "CHANGES",  .handler = command_changes,   .flags = 0},               // custom command to follow namespace changes
+    {.command = "MASTER",   .handler = command_master,    .flags = 0},               // custom MASTER command to flag client as sync source
 
     // system
-    {.command = "PING",    .handler = command_ping},     // default PING command
-    {.command = "TIME",    .handler = command_time},     // default TIME command
-    {.command = "AUTH",    .handler = command_auth},     // custom AUTH command to authentifcate admin
-    {.command = "HOOKS",   .handler = command_hooks},    // custom HOOKS command to list running hooks
-    {.command = "INDEX",   .handler = command_index},    // custom INDEX command to query internal index
-    {.command = "DATA",    .handler = command_data},     // custom DATA command to query internal data
+    {.command = "PING",     .handler = command_ping,      .flags = COMMAND_LOCAL},   // default PING command
+    {.command = "TIME",     .handler = command_time,      .flags = COMMAND_LOCAL},   // default TIME command
+    {.command = "AUTH",     .handler = command_auth,      .flags = COMMAND_LOCAL},   // custom AUTH command to authentifcate admin
+    {.command = "HOOKS",    .handler = command_hooks,     .flags = 0},               // custom HOOKS command to list running hooks
+    {.command = "INDEX",    .handler = command_index,     .flags = 0},               // custom INDEX command to query internal index
+    {.command = "DATA",     .handler = command_data,      .flags = 0},               // custom DATA command to query internal data
 
     // dataset
-    {.command = "SET",     .handler = command_set},      // default SET command
-    {.command = "SETX",    .handler = command_set},      // alias for SET command
-    {.command = "GET",     .handler = command_get},      // default GET command
-    {.command = "MGET",    .handler = command_mget},     // default MGET command (multiple get)
-    {.command = "DEL",     .handler = command_del},      // default DEL command
-    {.command = "EXISTS",  .handler = command_exists},   // default EXISTS command
-    {.command = "CHECK",   .handler = command_check},    // custom command to verify data integrity
-    {.command = "SCAN",    .handler = command_scan},     // modified SCAN which walk forward dataset
-    {.command = "SCANX",   .handler = command_scan},     // alias for SCAN command
-    {.command = "RSCAN",   .handler = command_rscan},    // custom command to walk backward dataset
-    {.command = "KSCAN",   .handler = command_kscan},    // custom command to iterate over keys matching pattern
-    {.command = "HISTORY", .handler = command_history},  // custom command to get previous version of a key
-    {.command = "KEYCUR",  .handler = command_keycur},   // custom command to get cursor id from a key
-    {.command = "LENGTH",  .handler = command_length},   // custom command to get value length of a key
-    {.command = "KEYTIME", .handler = command_keytime},  // custom command to get last updated timestamp of a key
+    {.command = "SET",      .handler = command_set,       .flags = COMMAND_SHARDED}, // default SET command
+    {.command = "MSET",     .handler = command_mset,      .flags = COMMAND_SHARDED}, // batched SET command (multiple set)
+    {.command = "SETX",     .handler = command_set,       .flags = COMMAND_SHARDED}, // alias for SET command
+    {.command = "GET",      .handler = command_get,       .flags = COMMAND_SHARDED}, // default GET command
+    {.command = "MGET",     .handler = command_mget,      .flags = COMMAND_SHARDED}, // default MGET command (multiple get)
+    {.command = "GETRANGE", .handler = command_getrange,  .flags = COMMAND_SHARDED}, // default GETRANGE command (partial payload)
+    {.command = "DEL",      .handler = command_del,       .flags = COMMAND_SHARDED}, // default DEL command
+    {.command = "EXISTS",   .handler = command_exists,    .flags = COMMAND_SHARDED}, // default EXISTS command
+    {.command = "CHECK",    .handler = command_check,     .flags = COMMAND_SHARDED}, // custom command to verify data integrity
+    {.command = "SCAN",     .handler = command_scan,      .flags = COMMAND_SHARDED}, // modified SCAN which walk forward dataset
+    {.command = "SCANX",    .handler = command_scan,      .flags = COMMAND_SHARDED}, // alias for SCAN command
+    {.command = "RSCAN",    .handler = command_rscan,     .flags = COMMAND_SHARDED}, // custom command to walk backward dataset
+    {.command = "KSCAN",    .handler = command_kscan,     .flags = 0},               // custom command to iterate over keys matching pattern
+    {.command = "HISTORY",  .handler = command_history,   .flags = COMMAND_SHARDED}, // custom command to get previous version of a key
+    {.command = "KEYCUR",   .handler = command_keycur,    .flags = COMMAND_SHARDED}, // custom command to get cursor id from a key
+    {.command = "LENGTH",   .handler = command_length,    .flags = COMMAND_SHARDED}, // custom command to get value length of a key
+    {.command = "KEYTIME",  .handler = command_keytime,   .flags = COMMAND_SHARDED}, // custom command to get last updated timestamp of a key
 
     // query
-    {.command = "INFO",    .handler = command_info},     // returns 0-db server name
-    {.command = "STOP",    .handler = command_stop},     // custom command for debug purposes
+    {.command = "INFO",     .handler = command_info,      .flags = 0},               // returns 0-db server name
+    {.command = "STOP",     .handler = command_stop,      .flags = 0},               // custom command for debug purposes
 
     // namespace
-    {.command = "DBSIZE",  .handler = command_dbsize},   // default DBSIZE command
-    {.command = "NSNEW",   .handler = command_nsnew},    // custom command to create a namespace
-    {.command = "NSDEL",   .handler = command_nsdel},    // custom command to remove a namespace
-    {.command = "NSLIST",  .handler = command_nslist},   // custom command to list namespaces
-    {.command = "NSSET",   .handler = command_nsset},    // custom command to edit namespace settings
-    {.command = "NSINFO",  .handler = command_nsinfo},   // custom command to get namespace information
-    {.command = "NSJUMP",  .handler = command_nsjump},   // custom command to force jumping to next index/data
-    {.command = "SELECT",  .handler = command_select},   // default SELECT (with pwd) namespace switch
-    {.command = "RELOAD",  .handler = command_reload},   // custom command to reload a namespace
-    {.command = "FLUSH",   .handler = command_flush},    // custom command to reset a namespace
+    {.command = "DBSIZE",   .handler = command_dbsize,    .flags = COMMAND_SHARDED}, // default DBSIZE command
+    {.command = "NSNEW",    .handler = command_nsnew,     .flags = 0},               // custom command to create a namespace
+    {.command = "NSDEL",    .handler = command_nsdel,     .flags = 0},               // custom command to remove a namespace
+    {.command = "NSLIST",   .handler = command_nslist,    .flags = 0},               // custom command to list namespaces
+    {.command = "NSSET",    .handler = command_nsset,     .flags = 0},               // custom command to edit namespace settings
+    {.command = "NSINFO",   .handler = command_nsinfo,    .flags = 0},               // custom command to get namespace information
+    {.command = "NSJUMP",   .handler = command_nsjump,    .flags = 0},               // custom command to force jumping to next index/data
+    {.command = "SELECT",   .handler = command_select,    .flags = COMMAND_LOCAL},   // default SELECT (with pwd) namespace switch
+    {.command = "RELOAD",   .handler = command_reload,    .flags = 0},               // custom command to reload a namespace
+    {.command = "FLUSH",    .handler = command_flush,     .flags = 0},               // custom command to reset a namespace
 };
 
+// commands lookup table
+//
+// commands are matched exactly (case insensitive) using a small open
+// addressing hash table, built once from the handlers list above,
+// this avoid comparing the request against each command one by one
+// (and avoid matching a prefix of a command, like 'G' for 'GET')
+//
+// table size needs to be a power of two and larger than the amount
+// of commands, to keep probing short
+#define COMMANDS_HASH_SIZE  128
+#define COMMANDS_HASH_MASK  (COMMANDS_HASH_SIZE - 1)
+
+static command_t *commands_hashtable[COMMANDS_HASH_SIZE];
+static size_t commands_lengths[sizeof(commands_handlers) / sizeof(command_t)];
+static int commands_hashed = 0;
+
+// fnv-1a over upper case characters
+static uint32_t command_hash(const char *name, size_t length) {
+    uint32_t hash = 2166136261u;
+
+    for(size_t i = 0; i < length; i++) {
+        uint8_t c = (uint8_t) name[i];
+
+        if(c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+
+        hash ^= c;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void commands_hash_build() {
+    for(unsigned int i = 0; i < sizeof(commands_handlers) / sizeof(command_t); i++) {
+        size_t length = strlen(commands_handlers[i].command);
+        uint32_t index = command_hash(commands_handlers[i].command, length) & COMMANDS_HASH_MASK;
+
+        while(commands_hashtable[index])
+            index = (index + 1) & COMMANDS_HASH_MASK;
+
+        commands_hashtable[index] = &commands_handlers[i];
+        commands_lengths[i] = length;
+    }
+
+    commands_hashed = 1;
+}
+
+static command_t *command_lookup(resp_object_t *key) {
+    command_t *command;
+
+    if(!commands_hashed)
+        commands_hash_build();
+
+    uint32_t index = command_hash(key->buffer, key->length) & COMMANDS_HASH_MASK;
+
+    while((command = commands_hashtable[index])) {
+        size_t length = commands_lengths[command - commands_handlers];
+
+        if(length == (size_t) key->length && strncasecmp(key->buffer, command->command, length) == 0)
+            return command;
+
+        index = (index + 1) & COMMANDS_HASH_MASK;
+    }
+
+    return NULL;
+}
+
 int redis_dispatcher(redis_client_t *client) {
     resp_request_t *request = client->request;
     resp_object_t *key = request->argv[0];
+    command_t *handler;
 
     // client doesn't have a running namespace
     // this will happens when a namespace is removed
@@ -183,17 +257,26 @@ int redis_dispatcher(redis_client_t *client) {
 
     zdbd_debug("[+] command: '%.*s' [+%d args]\n", key->length, (char *) key->buffer, request->argc - 1);
 
-    for(unsigned int i = 0; i < sizeof(commands_handlers) / sizeof(command_t); i++) {
-        if(strncasecmp(key->buffer, commands_handlers[i].command, key->length) == 0) {
-            // save last command executed
-            client->executed = &commands_handlers[i];
+    if((handler = command_lookup(key))) {
+        // save last command executed
+        client->executed = handler;
 
-            // update statistics
-            zdbd_rootsettings.stats.cmdsvalid += 1;
+        // update statistics
+        zdbd_rootsettings.stats.cmdsvalid += 1;
 
-            // execute handler
-            return commands_handlers[i].handler(client);
+        // with namespaces workers, commands on the client namespace are
+        // executed by the worker owning it, anything else touching the
+        // namespaces is executed when all the workers are idle
+        if(worker_enabled()) {
+            if(handler->flags & COMMAND_SHARDED)
+                return worker_route(client, handler);
+
+            if(!(handler->flags & COMMAND_LOCAL))
+                worker_quiesce(NULL);
         }
+
+        // execute handler
+        return handler->handler(client);
     }
 
     // unknown command
@@ -210,7 +293,7 @@ int redis_dispatcher(redis_client_t *client) {
 // set the client to wait on a special handler to be triggered
 int command_wait(redis_client_t *client) {
     resp_request_t *request = client->request;
-    command_t *handler = NULL;
+    command_t *handler;
 
     if(client->request->argc != 2 && client->request->argc != 3) {
         redis_hardsend(client, "-Invalid arguments");
@@ -221,14 +304,7 @@ int command_wait(redis_client_t *client) {
     resp_object_t *key = request->argv[1];
 
     // checking if the requested command is supported
-    for(unsigned int i = 0; i < sizeof(commands_handlers) / sizeof(command_t); i++) {
-        if(strncasecmp(key->buffer, commands_handlers[i].command, key->length) == 0) {
-            handler = &commands_handlers[i];
-            break;
-        }
-    }
-
-    if(handler == NULL) {
+    if(!(handler = command_lookup(key))) {
         redis_hardsend(client, "-Unknown command to watch");
         return 0;
     }
@@ -3,6 +3,12 @@
 
     #define COMMAND_MAXLEN  256
 
+    // where a command is executed with namespaces workers (see worker.c),
+    // commands without flag are executed by the main thread, with all
+    // the workers paused
+    #define COMMAND_SHARDED  1   // only touches the client namespace, executed by its worker
+    #define COMMAND_LOCAL    2   // doesn't touch any namespace, executed right away
+
     int redis_dispatcher(redis_client_t *client);
 
     int command_args_validate(redis_client_t *client, int expected);
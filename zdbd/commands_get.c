@@ -6,12 +6,49 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <inttypes.h>
+#include <errno.h>
 #include "libzdb.h"
 #include "index.h"
 #include "zdbd.h"
 #include "redis.h"
 #include "commands.h"
 
+// payload location of an index entry
+static data_location_t command_get_location(index_entry_t *entry) {
+    data_location_t location = {
+        .dataid = entry->dataid,
+        .offset = entry->offset,
+        .length = entry->length,
+        .idlength = entry->idlength,
+        .buffer = NULL,
+    };
+
+    return location;
+}
+
+// send a large payload (or a part of it) without loading it in memory, the
+// bulk header is sent first then the payload is streamed from the datafile
+static int command_get_stream(redis_client_t *client, data_location_t *location, size_t start, size_t length) {
+    data_root_t *data = client->ns->data;
+    data_stream_t stream = data_get_stream_range(data, location->offset, start, length, location->dataid, location->idlength);
+    char header[64];
+
+    if(stream.fd < 0) {
+        zdb_log("[-] command: get: cannot open payload\n");
+        redis_hardsend(client, "-Internal Error");
+        return 0;
+    }
+
+    zdbd_debug("[+] command: get: streaming %zu bytes\n", stream.length);
+
+    sprintf(header, "$%zu\r\n", stream.length);
+    redis_reply_stack(client, header, strlen(header));
+    redis_reply_file(client, stream.fd, stream.offset, stream.length);
+    redis_reply_stack(client, "\r\n", 2);
+
+    return 0;
+}
+
 static int command_get_single(redis_client_t *client, char *buffer, int length) {
     index_entry_t *entry = NULL;
 
@@ -34,6 +71,13 @@ static int command_get_single(redis_client_t *client, char *buffer, int length)
     zdbd_debug("[+] command: get: data file: %d, data offset: %" PRIu32 "\n", entry->dataid, entry->offset);
 
     data_root_t *data = client->ns->data;
+
+    // large payload are sent directly from the datafile
+    if(entry->length > REDIS_STREAM_THRESHOLD) {
+        data_location_t location = command_get_location(entry);
+        return command_get_stream(client, &location, 0, entry->length);
+    }
+
     data_payload_t payload = data_get(data, entry->offset, entry->length, entry->dataid, entry->idlength);
 
     if(!payload.buffer) {
@@ -74,8 +118,19 @@ int command_get(redis_client_t *client) {
     return command_get_single(client, request->argv[1]->buffer, request->argv[1]->length);
 }
 
+// one key requested by MGET, resolved from the index
+typedef struct command_mget_key_t {
+    data_location_t location;
+    int found;   // key exists (and is not deleted)
+    int read;    // index on the batched reads list, -1 if streamed
+
+} command_mget_key_t;
+
 int command_mget(redis_client_t *client) {
     resp_request_t *request = client->request;
+    command_mget_key_t *keys;
+    data_location_t *reads;
+    size_t batched = 0;
 
     if(client->request->argc < 2) {
         redis_hardsend(client, "-Invalid arguments");
@@ -94,19 +149,193 @@ int command_mget(redis_client_t *client) {
     if(namespace_is_frozen(client->ns))
         return command_error_frozen(client);
 
-    // streaming response to client
-    char line[512];
     int length = client->request->argc - 1;
 
+    if(!(keys = calloc(length, sizeof(command_mget_key_t))))
+        zdbd_diep("command: mget: calloc");
+
+    if(!(reads = calloc(length, sizeof(data_location_t))))
+        zdbd_diep("command: mget: calloc");
+
+    // resolving all keys first, entry returned by the index could be
+    // a reusable object (sequential mode), location is copied
+    for(int i = 0; i < length; i++) {
+        resp_object_t *key = request->argv[i + 1];
+        index_entry_t *entry;
+
+        if(!(entry = index_get(client->ns->index, key->buffer, key->length)))
+            continue;
+
+        if(entry->flags & INDEX_ENTRY_DELETED)
+            continue;
+
+        keys[i].found = 1;
+        keys[i].location = command_get_location(entry);
+        keys[i].read = -1;
+
+        // large payload are streamed from the datafile later
+        if(entry->length > REDIS_STREAM_THRESHOLD)
+            continue;
+
+        keys[i].read = batched;
+        reads[batched] = keys[i].location;
+        batched += 1;
+    }
+
+    // reading all payloads at once, ordered by datafile and
+    // offset, to keep disk access as sequential as possible
+    data_get_batch(client->ns->data, reads, batched);
+
+    // streaming response to client, in the requested order
+    char line[512];
+
     sprintf(line, "*%d\r\n", length);
     redis_reply_stack(client, line, strlen(line));
 
-    zdbd_debug("[+] command: mget: sending %d responses\n", length);
+    zdbd_debug("[+] command: mget: sending %d responses (%zu batched)\n", length, batched);
+
+    for(int i = 0; i < length; i++) {
+        command_mget_key_t *key = &keys[i];
+
+        if(!key->found) {
+            redis_hardsend(client, "$-1");
+            continue;
+        }
+
+        if(key->read < 0) {
+            command_get_stream(client, &key->location, 0, key->location.length);
+            continue;
+        }
+
+        data_location_t *payload = &reads[key->read];
+
+        if(!payload->buffer) {
+            zdb_log("[-] command: mget: cannot read payload\n");
+            redis_hardsend(client, "-Internal Error");
+            continue;
+        }
+
+        redis_bulk_t response = redis_bulk(payload->buffer, payload->length);
+        free(payload->buffer);
 
-    for(int i = 1; i < request->argc; i++) {
-        command_get_single(client, request->argv[i]->buffer, request->argv[i]->length);
+        if(!response.buffer) {
+            redis_hardsend(client, "$-1");
+            continue;
+        }
+
+        redis_reply_heap(client, response.buffer, response.length, free);
     }
 
+    free(reads);
+    free(keys);
+
     return 0;
 }
 
+
+// parse a signed integer argument, returns 0 if the argument
+// is not a valid integer
+static int command_getrange_integer(resp_object_t *argument, long long *target) {
+    char buffer[24];
+    char *endp = NULL;
+
+    if(argument->length == 0 || argument->length >= (int) sizeof(buffer))
+        return 0;
+
+    memcpy(buffer, argument->buffer, argument->length);
+    buffer[argument->length] = '\0';
+
+    errno = 0;
+    *target = strtoll(buffer, &endp, 10);
+
+    return (errno == 0 && *endp == '\0');
+}
+
+// GETRANGE key start end
+//
+// same semantic as redis: start and end are inclusive, negative
+// values are offsets from the end of the payload, only the requested
+// range is read from the datafile
+int command_getrange(redis_client_t *client) {
+    resp_request_t *request = client->request;
+    index_entry_t *entry = NULL;
+    long long start, end;
+
+    if(!command_args_validate(client, 4))
+        return 1;
+
+    if(request->argv[1]->length > MAX_KEY_LENGTH) {
+        zdbd_debug("[-] command: getrange: invalid key size (too big)\n");
+        redis_hardsend(client, "-Invalid key");
+        return 1;
+    }
+
+    if(!command_getrange_integer(request->argv[2], &start) || !command_getrange_integer(request->argv[3], &end)) {
+        redis_hardsend(client, "-Invalid range");
+        return 1;
+    }
+
+    if(namespace_is_frozen(client->ns))
+        return command_error_frozen(client);
+
+    if(!(entry = index_get(client->ns->index, request->argv[1]->buffer, request->argv[1]->length))) {
+        zdbd_debug("[-] command: getrange: key not found\n");
+        redis_hardsend(client, "$-1");
+        return 1;
+    }
+
+    if(entry->flags & INDEX_ENTRY_DELETED) {
+        zdbd_verbose("[-] command: getrange: key deleted\n");
+        redis_hardsend(client, "$-1");
+        return 1;
+    }
+
+    long long length = entry->length;
+
+    // convert negative offsets and clamp the range
+    if(start < 0)
+        start = length + start;
+
+    if(end < 0)
+        end = length + end;
+
+    if(start < 0)
+        start = 0;
+
+    if(end >= length)
+        end = length - 1;
+
+    if(length == 0 || end < 0 || start > end) {
+        redis_hardsend(client, "$0\r\n");
+        return 0;
+    }
+
+    size_t rlength = end - start + 1;
+
+    zdbd_debug("[+] command: getrange: data file: %d, data offset: %" PRIu32 ", range: %lld-%lld\n", entry->dataid, entry->offset, start, end);
+
+    if(rlength > REDIS_STREAM_THRESHOLD) {
+        data_location_t location = command_get_location(entry);
+        return command_get_stream(client, &location, start, rlength);
+    }
+
+    data_payload_t payload = data_get_range(client->ns->data, entry->offset, start, rlength, entry->dataid, entry->idlength);
+
+    if(!payload.buffer) {
+        zdb_log("[-] command: getrange: cannot read payload\n");
+        redis_hardsend(client, "-Internal Error");
+        return 0;
+    }
+
+    redis_bulk_t response = redis_bulk(payload.buffer, payload.length);
+    free(payload.buffer);
+
+    if(!response.buffer) {
+        redis_hardsend(client, "$-1");
+        return 0;
+    }
+
+    redis_reply_heap(client, response.buffer, response.length, free);
+
+    return 0;
+}
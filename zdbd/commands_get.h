@@ -3,4 +3,5 @@
 
     int command_get(redis_client_t *client);
     int command_mget(redis_client_t *client);
+    int command_getrange(redis_client_t *client);
 #endif
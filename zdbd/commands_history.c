@@ -11,6 +11,7 @@
 #include "redis.h"
 #include "commands.h"
 #include "commands_get.h"
+#include "commands_history.h"
 
 // history support
 //
@@ -41,6 +42,14 @@
 // (by comparing the keys)
 //
 // when you reach the end of the chain, the binary received is nil
+//
+// auditing a long history one version per call costs one round trip (and
+// one index file open) per version, with the COUNT option, the chain is
+// followed server-side and up to 'count' versions are sent in a single
+// array, newest first, each element being the same 3 fields array
+//
+// the first field of the last element can be used to continue the walk
+// on a next call (nil when the whole chain was sent)
 
 typedef struct history_response_t {
     uint32_t timestamp;
@@ -97,15 +106,16 @@ static int history_send_array(redis_client_t *client, history_response_t *histor
     return 0;
 }
 
-int history_send(redis_client_t *client, index_item_t *item, index_ekey_t *ekey) {
+int history_send(redis_client_t *client, index_item_t *item, fileid_t fileid, index_ekey_t *ekey) {
     data_root_t *data = client->ns->data;
+    fileid_t dataid = index_item_dataid(client->ns->index, item, fileid);
     history_response_t response;
 
     // dump entry found
     index_item_header_dump(item);
 
     // get data payload for this entry
-    response.payload = data_get(data, item->offset, item->length, item->dataid, item->idlength);
+    response.payload = data_get(data, item->offset, item->length, dataid, item->idlength);
 
     if(!response.payload.buffer) {
         zdb_log("[-] command: history: cannot read payload\n");
@@ -127,6 +137,217 @@ int history_send(redis_client_t *client, index_item_t *item, index_ekey_t *ekey)
     return 0;
 }
 
+typedef struct history_version_t {
+    index_item_t *item;
+    fileid_t fileid;      // index file of this version
+    fileid_t dataid;      // data file of this version (see index_item_dataid)
+    index_ekey_t parent;  // location of the previous version
+
+} history_version_t;
+
+static int history_integer(resp_object_t *argument, size_t *value) {
+    char buffer[24];
+    char *end = NULL;
+
+    if(argument->length <= 0 || argument->length > 20)
+        return 0;
+
+    memcpy(buffer, argument->buffer, argument->length);
+    buffer[argument->length] = '\0';
+
+    *value = strtoull(buffer, &end, 10);
+
+    return (*end == '\0');
+}
+
+// serialize the first two fields of a version, the payload
+// is appended by the caller
+static size_t history_chain_entry(history_version_t *version, char *response) {
+    char datestr[64];
+    size_t offset = 0;
+
+    if(version->parent.indexid != 0 || version->parent.offset != 0) {
+        offset = sprintf(response, "*3\r\n$%lu\r\n", sizeof(index_ekey_t));
+
+        memcpy(response + offset, &version->parent, sizeof(index_ekey_t));
+        offset += sizeof(index_ekey_t);
+
+    } else {
+        offset = sprintf(response, "*3\r\n$-1");
+    }
+
+    sprintf(datestr, "%" PRIu32, version->item->timestamp);
+    offset += sprintf(response + offset, "\r\n$%lu\r\n%s\r\n", strlen(datestr), datestr);
+
+    return offset;
+}
+
+// payloads of the whole chain are read in one batch, sorted per datafile
+// and offset, large payloads are streamed from the datafile
+static int history_chain_send(redis_client_t *client, history_version_t *versions, size_t length) {
+    data_root_t *data = client->ns->data;
+    data_location_t *locations;
+    size_t batched = 0;
+    size_t remain = 0;
+    size_t offset = 0;
+    char *response;
+
+    if(!(locations = calloc(length, sizeof(data_location_t))))
+        return 1;
+
+    for(size_t i = 0; i < length; i++) {
+        index_item_t *item = versions[i].item;
+
+        remain += sizeof(index_ekey_t) + 128;
+
+        if(item->length > REDIS_STREAM_THRESHOLD)
+            continue;
+
+        locations[batched].dataid = versions[i].dataid;
+        locations[batched].offset = item->offset;
+        locations[batched].length = item->length;
+        locations[batched].idlength = item->idlength;
+        batched += 1;
+
+        remain += item->length;
+    }
+
+    data_get_batch(data, locations, batched);
+
+    if(!(response = malloc(remain + 32)))
+        zdbd_diep("command: history: malloc");
+
+    offset = sprintf(response, "*%zu\r\n", length);
+    batched = 0;
+
+    for(size_t i = 0; i < length; i++) {
+        index_item_t *item = versions[i].item;
+
+        offset += history_chain_entry(&versions[i], response + offset);
+        remain -= sizeof(index_ekey_t) + 128;
+
+        if(item->length > REDIS_STREAM_THRESHOLD) {
+            data_stream_t stream = data_get_stream(data, item->offset, item->length, versions[i].dataid, item->idlength);
+
+            if(stream.fd < 0) {
+                offset += sprintf(response + offset, "-Internal Error\r\n");
+                continue;
+            }
+
+            offset += sprintf(response + offset, "$%zu\r\n", stream.length);
+            redis_reply_heap(client, response, offset, free);
+            redis_reply_file(client, stream.fd, stream.offset, stream.length);
+
+            if(!(response = malloc(remain + 32)))
+                zdbd_diep("command: history: malloc");
+
+            offset = sprintf(response, "\r\n");
+            continue;
+        }
+
+        data_location_t *location = &locations[batched];
+        batched += 1;
+
+        if(!location->buffer) {
+            zdb_log("[-] command: history: cannot read payload\n");
+            offset += sprintf(response + offset, "-Internal Error\r\n");
+            continue;
+        }
+
+        offset += sprintf(response + offset, "$%zu\r\n", location->length);
+        memcpy(response + offset, location->buffer, location->length);
+        offset += location->length;
+        offset += sprintf(response + offset, "\r\n");
+
+        remain -= location->length;
+        free(location->buffer);
+    }
+
+    redis_reply_heap(client, response, offset, free);
+    free(locations);
+
+    return 0;
+}
+
+// follow the chain from the version at fileid/offset, index entries are
+// read through a single iterator which keeps the index file opened
+// and serves entries close to each other from the same buffer
+static int history_chain(redis_client_t *client, fileid_t fileid, size_t offset, size_t count) {
+    index_root_t *index = client->ns->index;
+    resp_object_t *key = client->request->argv[1];
+    history_version_t *versions;
+    index_iterator_t iter;
+    index_item_t *item;
+    size_t length = 0;
+    size_t budget = 0;
+    int mismatch = 0;
+
+    if(!(versions = calloc(count, sizeof(history_version_t)))) {
+        zdbd_warnp("command: history: calloc");
+        redis_hardsend(client, "-Internal Error");
+        return 1;
+    }
+
+    index_iterator_init(&iter, index, fileid, offset);
+
+    // the last version can go over the payload budget
+    while(length < count && budget < HISTORY_PAYLOAD_BUDGET) {
+        if(!(item = index_iterator_item(&iter, fileid, offset, key->length))) {
+            zdbd_debug("[-] command: history: cannot read index entry %u:%zu\n", fileid, offset);
+            break;
+        }
+
+        if(memcmp(key->buffer, item->id, key->length)) {
+            zdbd_debug("[-] command: history: key mismatch from user and index, denied\n");
+            mismatch = 1;
+            free(item);
+            break;
+        }
+
+        versions[length].item = item;
+        versions[length].fileid = fileid;
+        versions[length].dataid = index_item_dataid(index, item, fileid);
+        versions[length].parent.indexid = item->parentid;
+        versions[length].parent.offset = item->parentoff;
+
+        length += 1;
+        budget += item->length;
+
+        // end of the chain
+        if(item->parentid == 0 && item->parentoff == 0)
+            break;
+
+        fileid = item->parentid;
+        offset = item->parentoff;
+    }
+
+    index_iterator_free(&iter);
+
+    if(length == 0) {
+        if(mismatch) {
+            redis_hardsend(client, "-Invalid arguments (invalid key)");
+
+        } else {
+            redis_hardsend(client, "-Invalid arguments (index query)");
+        }
+
+        free(versions);
+        return 1;
+    }
+
+    zdbd_debug("[+] command: history: %zu versions collected, sending\n", length);
+
+    if(history_chain_send(client, versions, length))
+        redis_hardsend(client, "-Internal Error");
+
+    for(size_t i = 0; i < length; i++)
+        free(versions[i].item);
+
+    free(versions);
+
+    return 0;
+}
+
 //
 // HISTORY
 //
@@ -137,6 +358,8 @@ int command_history(redis_client_t *client) {
         .indexid = 0,
         .offset = 0,
     };
+    int argc = client->request->argc;
+    size_t count = 0;
 
     // only accept 1 or 2 extra arguments
     //
@@ -147,7 +370,23 @@ int command_history(redis_client_t *client) {
     //
     // the second argument is an optional offset to even older
     // key, which is returned by another history command
-    if(client->request->argc != 2 && client->request->argc != 3) {
+    //
+    // the chain can be walked server-side with 'COUNT count'
+    // as last arguments
+    if(argc >= 4) {
+        resp_object_t *option = client->request->argv[argc - 2];
+
+        if(option->length == 5 && strncasecmp(option->buffer, "COUNT", 5) == 0) {
+            if(!history_integer(client->request->argv[argc - 1], &count) || count == 0 || count > HISTORY_COUNT_MAX) {
+                redis_hardsend(client, "-Invalid count");
+                return 1;
+            }
+
+            argc -= 2;
+        }
+    }
+
+    if(argc != 2 && argc != 3) {
         redis_hardsend(client, "-Invalid arguments");
         return 1;
     }
@@ -157,7 +396,7 @@ int command_history(redis_client_t *client) {
 
     // requesting a previous data, without any exact offset
     // this basicly request the first older entry of a specific key
-    if(client->request->argc == 2) {
+    if(argc == 2) {
         // grabbing original entry
         if(!(entry = index_get(index, client->request->argv[1]->buffer, client->request->argv[1]->length))) {
             zdbd_debug("[-] command: history: key not found\n");
@@ -172,13 +411,16 @@ int command_history(redis_client_t *client) {
             return 1;
         }
 
+        if(count)
+            return history_chain(client, entry->indexid, entry->idxoffset, count);
+
         // we can now find the parent
         ekey.indexid = entry->parentid;
         ekey.offset = entry->parentoff;
 
         index_item_t *item = index_item_get_disk(index, entry->indexid, entry->idxoffset, entry->idlength);
 
-        return history_send(client, item, &ekey);
+        return history_send(client, item, entry->indexid, &ekey);
     }
 
     // user requested an older entry
@@ -205,6 +447,9 @@ int command_history(redis_client_t *client) {
         return 1;
     }
 
+    if(count)
+        return history_chain(client, ekey.indexid, ekey.offset, count);
+
     if(!(item = index_item_get_disk(index, ekey.indexid, ekey.offset, idlength))) {
         zdbd_debug("[-] command: history: cannot read index entry requested\n");
         redis_hardsend(client, "-Invalid arguments (index query)");
@@ -218,11 +463,13 @@ int command_history(redis_client_t *client) {
         return 1;
     }
 
+    fileid_t fileid = ekey.indexid;
+
     ekey.indexid = item->parentid;
     ekey.offset = item->parentoff;
 
     // okay, everything seems to be legitim now
-    return history_send(client, item, &ekey);
+    return history_send(client, item, fileid, &ekey);
 }
 
 
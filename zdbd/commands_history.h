@@ -2,4 +2,12 @@
     #define ZDB_COMMANDS_HISTORY_H
 
     int command_history(redis_client_t *client);
+
+    // maximum amount of versions which can be
+    // requested with HISTORY COUNT option
+    #define HISTORY_COUNT_MAX  1024
+
+    // amount of payload bytes sent by one call to HISTORY
+    // with COUNT, the last version can go over this limit
+    #define HISTORY_PAYLOAD_BUDGET  8 * 1024 * 1024
 #endif
@@ -7,9 +7,11 @@
 #include <sys/time.h>
 #include <inttypes.h>
 #include <sys/statvfs.h>
+#include <errno.h>
 #include "libzdb.h"
 #include "zdbd.h"
 #include "redis.h"
+#include "scheduler.h"
 #include "commands.h"
 #include "auth.h"
 
@@ -96,6 +98,7 @@ int command_nsdel(redis_client_t *client) {
 
     // detach all clients attached to this namespace
     redis_detach_clients(namespace);
+    scheduler_release(namespace);
 
     // delete the new namespace
     if(namespace_delete(namespace)) {
@@ -368,6 +371,26 @@ int command_nsinfo(redis_client_t *client) {
         len += sprintf(info + len, "data_current_offset: %lu\n", offset);
     }
 
+    // scheduling statistics, state is only allocated when
+    // the namespace was used at least once
+    scheduler_t *scheduler = namespace->scheduler;
+    scheduler_t empty = {
+        .weight = SCHEDULER_WEIGHT_DEFAULT,
+    };
+
+    if(!scheduler)
+        scheduler = &empty;
+
+    len += sprintf(info + len, "scheduler_weight: %lu\n", scheduler->weight);
+    len += sprintf(info + len, "scheduler_limit_ops: %lu\n", scheduler->maxops);
+    len += sprintf(info + len, "scheduler_limit_mbps: %lu\n", scheduler->maxbytes / (1024 * 1024));
+    len += sprintf(info + len, "scheduler_queue_depth: %lu\n", scheduler->depth);
+    len += sprintf(info + len, "scheduler_served_ops: %lu\n", scheduler->served);
+    len += sprintf(info + len, "scheduler_served_bytes: %lu\n", scheduler->servedbytes);
+    len += sprintf(info + len, "scheduler_throttled_ms: %" PRIu64 "\n", scheduler_throttled_us(scheduler) / 1000);
+    len += sprintf(info + len, "scheduler_throttled_count: %lu\n", scheduler->throttles);
+    len += sprintf(info + len, "scheduler_yields: %lu\n", scheduler->yields);
+
     redis_bulk_t response = redis_bulk(info, len);
     if(!response.buffer) {
         redis_hardsend(client, "$-1");
@@ -481,6 +504,82 @@ static int command_nsset_freeze(namespace_t *namespace, char *value) {
     return 0;
 }
 
+// scheduler properties value, unsigned integer up to maximum
+static int command_nsset_integer(redis_client_t *client, char *value, size_t maximum, size_t *target) {
+    char *endptr = NULL;
+
+    errno = 0;
+    unsigned long long parsed = strtoull(value, &endptr, 10);
+
+    if(errno || endptr == value || *endptr != '\0' || value[0] == '-' || parsed > maximum) {
+        zdbd_debug("[-] command: nsset: invalid integer value '%s'\n", value);
+        redis_hardsend(client, "-Invalid property value (expected: positive integer)");
+        return 1;
+    }
+
+    *target = parsed;
+
+    return 0;
+}
+
+// NSSET weight
+static int command_nsset_weight(redis_client_t *client, namespace_t *namespace, char *value) {
+    char response[128];
+    size_t weight;
+
+    if(command_nsset_integer(client, value, UINT32_MAX, &weight))
+        return 1;
+
+    if(weight < 1 || weight > SCHEDULER_WEIGHT_MAX) {
+        sprintf(response, "-Invalid property value (weight needs to be between 1 and %d)\r\n", SCHEDULER_WEIGHT_MAX);
+        redis_reply_stack(client, response, strlen(response));
+        return 1;
+    }
+
+    if(scheduler_set_weight(namespace, weight)) {
+        redis_hardsend(client, "-Internal memory error");
+        return 1;
+    }
+
+    zdbd_debug("[+] command: nsset: scheduler weight set to: %lu\n", weight);
+
+    return 0;
+}
+
+// NSSET maxops
+static int command_nsset_maxops(redis_client_t *client, namespace_t *namespace, char *value) {
+    size_t maxops;
+
+    if(command_nsset_integer(client, value, UINT32_MAX, &maxops))
+        return 1;
+
+    if(scheduler_set_maxops(namespace, maxops)) {
+        redis_hardsend(client, "-Internal memory error");
+        return 1;
+    }
+
+    zdbd_debug("[+] command: nsset: operations limit set to: %lu/s\n", maxops);
+
+    return 0;
+}
+
+// NSSET maxmbps
+static int command_nsset_maxmbps(redis_client_t *client, namespace_t *namespace, char *value) {
+    size_t maxmbps;
+
+    if(command_nsset_integer(client, value, UINT32_MAX, &maxmbps))
+        return 1;
+
+    if(scheduler_set_maxbytes(namespace, maxmbps * 1024 * 1024)) {
+        redis_hardsend(client, "-Internal memory error");
+        return 1;
+    }
+
+    zdbd_debug("[+] command: nsset: bandwidth limit set to: %lu MB/s\n", maxmbps);
+
+    return 0;
+}
+
 
 
 // change namespace settings
@@ -490,6 +589,9 @@ static int command_nsset_freeze(namespace_t *namespace, char *value) {
 //                                          if this is more than actual size, there
 //                                          is no shrink, it stay as it
 //   NSSET [namespace] public [1 or 0]   -> enable or disable public access
+//   NSSET [namespace] weight [1-100]    -> share compared to other namespaces
+//   NSSET [namespace] maxops [123]      -> operations per second limit (0: none)
+//   NSSET [namespace] maxmbps [12]      -> MB per second limit (0: none)
 int command_nsset(redis_client_t *client) {
     resp_request_t *request = client->request;
     namespace_t *namespace = NULL;
@@ -541,6 +643,18 @@ int command_nsset(redis_client_t *client) {
         if(command_nsset_freeze(namespace, value) == 1)
             return 1;
 
+    } else if(strcmp(command, "weight") == 0) {
+        if(command_nsset_weight(client, namespace, value) == 1)
+            return 1;
+
+    } else if(strcmp(command, "maxops") == 0) {
+        if(command_nsset_maxops(client, namespace, value) == 1)
+            return 1;
+
+    } else if(strcmp(command, "maxmbps") == 0) {
+        if(command_nsset_maxmbps(client, namespace, value) == 1)
+            return 1;
+
     // checking if we try to change settings on
     // the default namespace, after this point, we
     // deny any changes on default namespace
@@ -10,18 +10,58 @@
 #include "zdbd.h"
 #include "redis.h"
 #include "commands.h"
+#include "commands_scan.h"
 #include "commands_replicate.h"
 
 int command_mirror(redis_client_t *client) {
+    resp_request_t *request = client->request;
+    int acknowledge = 0;
+
     if(!command_admin_authorized(client))
         return 1;
 
-    client->mirror = 1;
+    if(request->argc > 2) {
+        redis_hardsend(client, "-Invalid arguments");
+        return 1;
+    }
+
+    // acknowledged mode, frames are prefixed with a sequence
+    // number and client needs to acknowledge them (MIRRORACK)
+    if(request->argc == 2) {
+        if(request->argv[1]->length != 3 || strncasecmp(request->argv[1]->buffer, "ACK", 3) != 0) {
+            redis_hardsend(client, "-Invalid mirror mode");
+            return 1;
+        }
+
+        acknowledge = 1;
+    }
+
+    redis_client_set_mirror(client, acknowledge);
     redis_hardsend(client, "+Starting mirroring");
 
     return 0;
 }
 
+// acknowledge frames received by a mirror client, there is no
+// reply to this command, to not interfere with the mirror stream
+int command_mirrorack(redis_client_t *client) {
+    resp_request_t *request = client->request;
+    char buffer[24];
+
+    if(!client->mirror || !client->mirrorack || request->argc != 2)
+        return 1;
+
+    if(request->argv[1]->length <= 0 || request->argv[1]->length > 20)
+        return 1;
+
+    memcpy(buffer, request->argv[1]->buffer, request->argv[1]->length);
+    buffer[request->argv[1]->length] = '\0';
+
+    redis_client_mirror_ack(client, strtoull(buffer, NULL, 10));
+
+    return 0;
+}
+
 int command_master(redis_client_t *client) {
     if(!command_admin_authorized(client))
         return 1;
@@ -32,3 +72,216 @@ int command_master(redis_client_t *client) {
     return 0;
 }
 
+
+//
+// CHANGES
+//
+// stream the entries of the namespace in the order they were written
+// (index order), each entry is sent with its index position, which can
+// be used to resume the stream later (CHANGES indexid offset), entries
+// are sent until the end of the index then the client receives the new
+// entries when they are written, entries are produced between network
+// events (see redis_followers_process)
+//
+// each entry is an array: [indexid, offset, key, timestamp, length]
+// followed by the payload when requested (CHANGES [...] PAYLOAD)
+//
+// overwritten entries are flagged in place on the index, only the latest
+// version of a key is sent, a deletion appends a tombstone on the index
+// which is sent like an entry, with a nil length (and payload)
+//
+// this is only supported in userkey mode, in sequential mode an update
+// rewrites the original entry in place, the index order doesn't reflect
+// the changes order anymore
+//
+static int command_changes_argument(resp_object_t *argument, size_t *value) {
+    char buffer[24];
+    char *end = NULL;
+
+    if(argument->length <= 0 || argument->length > 20)
+        return 1;
+
+    memcpy(buffer, argument->buffer, argument->length);
+    buffer[argument->length] = '\0';
+
+    *value = strtoull(buffer, &end, 10);
+
+    return (*end != '\0');
+}
+
+static int command_changes_payload(redis_client_t *client, index_item_t *item, fileid_t indexid) {
+    data_root_t *data = client->ns->data;
+    fileid_t dataid = index_item_dataid(client->ns->index, item, indexid);
+
+    // large payload are sent directly from the datafile
+    if(item->length > REDIS_STREAM_THRESHOLD) {
+        data_stream_t stream = data_get_stream_range(data, item->offset, 0, item->length, dataid, item->idlength);
+        char header[64];
+
+        if(stream.fd < 0) {
+            zdb_log("[-] command: changes: cannot open payload\n");
+            redis_hardsend(client, "$-1");
+            return 1;
+        }
+
+        sprintf(header, "$%zu\r\n", stream.length);
+        redis_reply_stack(client, header, strlen(header));
+        redis_reply_file(client, stream.fd, stream.offset, stream.length);
+        redis_reply_stack(client, "\r\n", 2);
+
+        return 0;
+    }
+
+    data_payload_t payload = data_get(data, item->offset, item->length, dataid, item->idlength);
+
+    if(!payload.buffer) {
+        zdb_log("[-] command: changes: cannot read payload\n");
+        redis_hardsend(client, "$-1");
+        return 1;
+    }
+
+    redis_bulk_t response = redis_bulk(payload.buffer, payload.length);
+    free(payload.buffer);
+
+    if(!response.buffer) {
+        redis_hardsend(client, "$-1");
+        return 1;
+    }
+
+    redis_reply_heap(client, response.buffer, response.length, free);
+
+    return 0;
+}
+
+static int command_changes_send(redis_client_t *client, index_scan_t *scan) {
+    index_item_t *item = scan->header;
+    char response[MAX_KEY_LENGTH + 160];
+    size_t offset = 0;
+
+    offset += sprintf(response, "*%d\r\n", client->follow.payload ? 6 : 5);
+    offset += sprintf(response + offset, ":%" PRIu32 "\r\n", (uint32_t) scan->fileid);
+    offset += sprintf(response + offset, ":%zu\r\n", scan->target);
+
+    offset += sprintf(response + offset, "$%u\r\n", item->idlength);
+    memcpy(response + offset, item->id, item->idlength);
+    offset += item->idlength;
+
+    offset += sprintf(response + offset, "\r\n:%" PRIu32 "\r\n", item->timestamp);
+
+    // deleted key, no length and no payload
+    if(item->flags & INDEX_ENTRY_TOMBSTONE) {
+        offset += sprintf(response + offset, "$-1\r\n");
+
+        if(client->follow.payload)
+            offset += sprintf(response + offset, "$-1\r\n");
+
+        redis_reply_stack(client, response, offset);
+        return 0;
+    }
+
+    offset += sprintf(response + offset, ":%" PRIu32 "\r\n", item->length);
+
+    redis_reply_stack(client, response, offset);
+
+    if(client->follow.payload)
+        return command_changes_payload(client, item, scan->fileid);
+
+    return 0;
+}
+
+// send entries following the cursor, until the end of the index, the
+// time slice or the maximum amount of bytes pending is reached
+int command_changes_produce(redis_client_t *client) {
+    redis_follow_t *follow = &client->follow;
+    index_root_t *index = client->ns->index;
+    uint64_t basetime = ustime();
+    index_scan_t scan;
+
+    while(client->responsebytes < REDIS_FOLLOW_BACKLOG) {
+        if(ustime() - basetime >= REDIS_FOLLOW_TIMESLICE_US)
+            return 0;
+
+        if(follow->started)
+            scan = index_next_change(index, follow->indexid, follow->offset);
+        else
+            scan = index_first_change(index);
+
+        if(scan.status != INDEX_SCAN_SUCCESS) {
+            if(scan.status == INDEX_SCAN_UNEXPECTED)
+                zdb_log("[-] command: changes: could not read next entry\n");
+
+            // end of the index, waiting for new entries
+            follow->tail = 1;
+            follow->tailid = index->indexid;
+            follow->tailoffset = index->previous;
+
+            return 0;
+        }
+
+        command_changes_send(client, &scan);
+
+        follow->started = 1;
+        follow->indexid = scan.fileid;
+        follow->offset = scan.target;
+
+        free(scan.header);
+    }
+
+    return 0;
+}
+
+int command_changes(redis_client_t *client) {
+    resp_request_t *request = client->request;
+    redis_follow_t *follow = &client->follow;
+    int argc = request->argc;
+    int payload = 0;
+    size_t indexid = 0;
+    size_t offset = 0;
+
+    if(argc > 1) {
+        resp_object_t *last = request->argv[argc - 1];
+
+        if(last->length == 7 && strncasecmp(last->buffer, "PAYLOAD", 7) == 0) {
+            payload = 1;
+            argc -= 1;
+        }
+    }
+
+    if(argc != 1 && argc != 3) {
+        redis_hardsend(client, "-Invalid arguments");
+        return 1;
+    }
+
+    if(namespace_is_frozen(client->ns))
+        return command_error_frozen(client);
+
+    if(client->ns->index->mode != ZDB_MODE_KEY_VALUE) {
+        redis_hardsend(client, "-CHANGES is only supported in userkey mode");
+        return 1;
+    }
+
+    if(argc == 3) {
+        if(command_changes_argument(request->argv[1], &indexid) || command_changes_argument(request->argv[2], &offset)) {
+            redis_hardsend(client, "-Invalid position");
+            return 1;
+        }
+
+        // position needs to point to an index entry
+        if(indexid > client->ns->index->indexid || offset < sizeof(index_header_t)) {
+            redis_hardsend(client, "-Invalid position");
+            return 1;
+        }
+    }
+
+    follow->started = (argc == 3);
+    follow->payload = payload;
+    follow->tail = 0;
+    follow->ns = client->ns;
+    follow->indexid = indexid;
+    follow->offset = offset;
+
+    redis_client_set_follower(client);
+    redis_hardsend(client, "+Following changes");
+
+    return 0;
+}
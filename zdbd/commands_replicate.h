@@ -2,5 +2,8 @@
     #define ZDB_COMMANDS_MIRROR_H
 
     int command_mirror(redis_client_t *client);
+    int command_mirrorack(redis_client_t *client);
     int command_master(redis_client_t *client);
+    int command_changes(redis_client_t *client);
+    int command_changes_produce(redis_client_t *client);
 #endif
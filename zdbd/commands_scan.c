@@ -88,12 +88,60 @@ static void scaninfo_from_entry(scan_info_t *info, index_entry_t *entry) {
 //
 // redis serialization of the scan list
 //
+
+// array response, with 2 arguments:
+//  - first one is the next SCAN key value
+//    (in our case, this is always the same value as the returned id)
+//  - the second one is another array, of each keys found, each entry containins
+//    information about this key like timestamp and size
+//
+// this writes the first argument and the second array header
+static size_t command_scan_header(scan_list_t *scanlist, char *response) {
+    size_t offset = 0;
+
+    // converting the last object key into a binary serialized key
+    index_item_t *entry = scanlist->items[scanlist->length - 1];
+    scan_info_t *scaninfo = &scanlist->scansinfo[scanlist->length - 1];
+    index_bkey_t bkey = index_item_serialize(entry, scaninfo->idxoffset, scaninfo->idxid);
+
+    // get last entry for the next key value
+    offset = sprintf(response, "*2\r\n$%ld\r\n", sizeof(index_bkey_t));
+
+    // copy the key
+    memcpy(response + offset, &bkey, sizeof(index_bkey_t));
+    offset += sizeof(index_bkey_t);
+
+    // iterating over the full list and building the list response
+    offset += sprintf(response + offset, "\r\n*%lu\r\n", scanlist->length);
+
+    return offset;
+}
+
+// one entry of the list: the key, the size of the payload and
+// the creation timestamp (and the payload, sent after, if requested)
+static size_t command_scan_entry(index_item_t *entry, char *response, int payload) {
+    size_t offset = 0;
+
+    // adding the array of response with the single response
+    offset += sprintf(response + offset, "*%d\r\n", payload ? 4 : 3);
+
+    // adding the key
+    offset += sprintf(response + offset, "$%u\r\n", entry->idlength);
+    memcpy(response + offset, entry->id, entry->idlength);
+    offset += entry->idlength;
+
+    // adding the length of the payload
+    offset += sprintf(response + offset, "\r\n:%d\r\n", entry->length);
+
+    // adding the timestamp to the payload
+    offset += sprintf(response + offset, ":%d\r\n", entry->timestamp);
+
+    return offset;
+}
+
 static int command_scan_send_scanlist(scan_list_t *scanlist, redis_client_t *client) {
     char *response;
     size_t offset = 0;
-    index_item_t *entry;
-    scan_info_t *scaninfo;
-    index_bkey_t bkey;
 
     // if the list is empty, we have nothing
     // to send, obviously
@@ -106,62 +154,109 @@ static int command_scan_send_scanlist(scan_list_t *scanlist, redis_client_t *cli
         scaninfo_dump(&scanlist->scansinfo[i]);
     }
 
-    // array response, with 2 arguments:
-    //  - first one is the next SCAN key value
-    //    (in our case, this is always the same value as the returned id)
-    //  - the second one is another array, of each keys found, each entry containins
-    //    information about this key like timestamp and size
-    if(!(response = malloc(((MAX_KEY_LENGTH * 2) + 128) * scanlist->length)))
+    if(!(response = malloc(((MAX_KEY_LENGTH * 2) + 128) * (scanlist->length + 1))))
         return 1;
 
-    // converting the last object key into a binary serialized key
-    entry = scanlist->items[scanlist->length - 1];
-    scaninfo = &scanlist->scansinfo[scanlist->length - 1];
-    bkey = index_item_serialize(entry, scaninfo->idxoffset, scaninfo->idxid);
+    offset = command_scan_header(scanlist, response);
 
-    // get last entry for the next key value
-    offset = sprintf(response, "*2\r\n$%ld\r\n", sizeof(index_bkey_t));
+    for(size_t i = 0; i < scanlist->length; i++)
+        offset += command_scan_entry(scanlist->items[i], response + offset, 0);
 
-    // copy the key
-    memcpy(response + offset, &bkey, sizeof(index_bkey_t));
-    offset += sizeof(index_bkey_t);
+    redis_reply_heap(client, response, offset, free);
 
-    // iterating over the full list and building the list response
-    offset += sprintf(response + offset, "\r\n*%lu\r\n", scanlist->length);
+    return 0;
+}
+
+// same as the scan list, with the payload of each entry, payloads are
+// read at once, ordered by datafile and offset (see data_get_batch)
+//
+// large payloads are sent from the datafile directly, the response
+// built so far is queued before
+static int command_scan_send_payloads(scan_list_t *scanlist, redis_client_t *client) {
+    data_root_t *data = client->ns->data;
+    data_location_t *locations;
+    size_t batched = 0;
+    size_t remain = 0;
+    size_t offset = 0;
+    char *response;
 
+    if(!(locations = calloc(scanlist->length, sizeof(data_location_t))))
+        return 1;
+
+    // payload datafile depends on the mode, see index_item_dataid
     for(size_t i = 0; i < scanlist->length; i++) {
-        entry = scanlist->items[i];
+        index_item_t *entry = scanlist->items[i];
 
-        // end of the key
-        // adding the array of response with the single response
-        offset += sprintf(response + offset, "*3\r\n");
+        remain += ((MAX_KEY_LENGTH * 2) + 128);
 
-        // adding the key
-        offset += sprintf(response + offset, "$%u\r\n", entry->idlength);
-        memcpy(response + offset, entry->id, entry->idlength);
-        offset += entry->idlength;
+        if(entry->length > REDIS_STREAM_THRESHOLD)
+            continue;
 
-        // adding the length of the payload
-        offset += sprintf(response + offset, "\r\n:%d\r\n", entry->length);
+        locations[batched].dataid = index_item_dataid(client->ns->index, entry, scanlist->scansinfo[i].idxid);
+        locations[batched].offset = entry->offset;
+        locations[batched].length = entry->length;
+        locations[batched].idlength = entry->idlength;
+        batched += 1;
 
-        // adding the timestamp to the payload
-        offset += sprintf(response + offset, ":%d\r\n", entry->timestamp);
+        remain += entry->length;
     }
 
-    redis_reply_heap(client, response, offset, free);
+    data_get_batch(data, locations, batched);
 
-    return 0;
-}
+    if(!(response = malloc(remain + (MAX_KEY_LENGTH * 2) + 128)))
+        zdbd_diep("command: scan: malloc");
 
-static scan_info_t *scan_initial_info(scan_info_t *info, scan_list_t *scanlist, index_scan_t *scan) {
-    // could not get initial scan entry
-    if(scan->status != INDEX_SCAN_SUCCESS)
-        return NULL;
+    offset = command_scan_header(scanlist, response);
+    batched = 0;
 
-    scaninfo_from_scan(info, scan);
-    scanlist_append(scanlist, scan, info);
+    for(size_t i = 0; i < scanlist->length; i++) {
+        index_item_t *entry = scanlist->items[i];
 
-    return info;
+        offset += command_scan_entry(entry, response + offset, 1);
+        remain -= ((MAX_KEY_LENGTH * 2) + 128);
+
+        if(entry->length > REDIS_STREAM_THRESHOLD) {
+            fileid_t dataid = index_item_dataid(client->ns->index, entry, scanlist->scansinfo[i].idxid);
+            data_stream_t stream = data_get_stream(data, entry->offset, entry->length, dataid, entry->idlength);
+
+            if(stream.fd < 0) {
+                offset += sprintf(response + offset, "-Internal Error\r\n");
+                continue;
+            }
+
+            offset += sprintf(response + offset, "$%zu\r\n", stream.length);
+            redis_reply_heap(client, response, offset, free);
+            redis_reply_file(client, stream.fd, stream.offset, stream.length);
+
+            if(!(response = malloc(remain + (MAX_KEY_LENGTH * 2) + 128)))
+                zdbd_diep("command: scan: malloc");
+
+            offset = sprintf(response, "\r\n");
+            continue;
+        }
+
+        data_location_t *location = &locations[batched];
+        batched += 1;
+
+        if(!location->buffer) {
+            zdb_log("[-] command: scan: cannot read payload\n");
+            offset += sprintf(response + offset, "-Internal Error\r\n");
+            continue;
+        }
+
+        offset += sprintf(response + offset, "$%zu\r\n", location->length);
+        memcpy(response + offset, location->buffer, location->length);
+        offset += location->length;
+        offset += sprintf(response + offset, "\r\n");
+
+        remain -= location->length;
+        free(location->buffer);
+    }
+
+    redis_reply_heap(client, response, offset, free);
+    free(locations);
+
+    return 0;
 }
 
 static scan_info_t *scan_initial_get(scan_info_t *info, redis_client_t *client) {
@@ -215,99 +310,132 @@ static int scan_failure(index_scan_t *scan, redis_client_t *client) {
     return 1;
 }
 
-//
-// SCAN
-//
-int command_scan(redis_client_t *client) {
-    index_scan_t scan;
-    scan_list_t scanlist;
-    scan_info_t info;
+// parse a positive integer argument, returns 0 if
+// the argument is not a valid integer
+static int command_scan_integer(resp_object_t *argument, size_t *value) {
+    char buffer[24];
+    char *end = NULL;
 
-    if(namespace_is_frozen(client->ns))
-        return command_error_frozen(client);
+    if(argument->length <= 0 || argument->length > 20)
+        return 0;
 
-    // initialize empty scanlist
-    scanlist_init(&scanlist);
+    memcpy(buffer, argument->buffer, argument->length);
+    buffer[argument->length] = '\0';
 
-    // scan requested without initial key
-    if(client->request->argc == 1) {
-        scan = index_first_header(client->ns->index);
+    *value = strtoull(buffer, &end, 10);
 
-        if(!scan_initial_info(&info, &scanlist, &scan))
-            return scan_failure(&scan, client);
+    return (*end == '\0');
+}
 
-    } else {
-        // scan requested with an initial key
-        if(!scan_initial_get(&info, client))
-            return 1;
-    }
+// SCAN [cursor] [COUNT count] [PAYLOAD]
+//
+// the cursor is always the first argument when set (a cursor cannot
+// be mistaken with an option, they don't have the same length)
+static int command_scan_arguments(redis_client_t *client, int *cursor, size_t *count, int *payload) {
+    resp_request_t *request = client->request;
+    int index = 1;
 
-    // we have everything needed to start walking over
-    // the keys and building our scan response
-    uint64_t basetime = ustime();
+    *cursor = 0;
+    *count = 0;
+    *payload = 0;
 
-    while(ustime() - basetime < SCAN_TIMESLICE_US) {
-        zdbd_debug("[+] scan: elapsed time: %" PRIu64 " us\n", ustime() - basetime);
+    if(request->argc > 1 && request->argv[1]->length == sizeof(index_bkey_t)) {
+        *cursor = 1;
+        index = 2;
+    }
 
-        // reading entry and appending it
-        scan = index_next_header(client->ns->index, info.idxid, info.idxoffset);
+    for(; index < request->argc; index++) {
+        resp_object_t *option = request->argv[index];
 
-        // this scan failed, let's guess it's the end
-        if(scan.status != INDEX_SCAN_SUCCESS)
-            break;
+        if(option->length == 7 && strncasecmp(option->buffer, "PAYLOAD", 7) == 0) {
+            *payload = 1;
+            continue;
+        }
 
-        // preparing next call
-        scaninfo_from_scan(&info, &scan);
+        if(option->length == 5 && strncasecmp(option->buffer, "COUNT", 5) == 0 && index + 1 < request->argc) {
+            index += 1;
 
-        // append object to the list
-        scanlist_append(&scanlist, &scan, &info);
-    }
+            if(!command_scan_integer(request->argv[index], count) || *count == 0 || *count > SCAN_COUNT_MAX) {
+                redis_hardsend(client, "-Invalid count");
+                return 1;
+            }
 
-    zdbd_debug("[+] scan: retreived %lu entries in %" PRIu64 " us\n", scanlist.length, ustime() - basetime);
+            continue;
+        }
 
-    if(command_scan_send_scanlist(&scanlist, client))
-        redis_hardsend(client, "-Internal Error");
+        // not an option, single argument is the cursor
+        if(index == 1 && request->argc == 2) {
+            *cursor = 1;
+            continue;
+        }
+
+        redis_hardsend(client, "-Invalid arguments");
+        return 1;
+    }
 
-    scanlist_free(&scanlist);
     return 0;
 }
 
-//
-// RSCAN
-//
-int command_rscan(redis_client_t *client) {
-    index_scan_t scan;
+// walk over the index, from the cursor or from the first (last) key,
+// entries are collected until the requested amount is reached or,
+// when no amount is set, during a limited amount of time
+static int command_scan_walk(redis_client_t *client, int backward) {
+    index_root_t *index = client->ns->index;
+    index_iterator_t iter;
     scan_list_t scanlist;
     scan_info_t info;
+    size_t budget = 0;
+    size_t count;
+    int payload;
+    int cursor;
+
+    index_scan_t scan = {
+        .status = INDEX_SCAN_NO_MORE_DATA,
+    };
 
     if(namespace_is_frozen(client->ns))
         return command_error_frozen(client);
 
+    if(command_scan_arguments(client, &cursor, &count, &payload))
+        return 1;
+
     // initialize empty scanlist
     scanlist_init(&scanlist);
 
-    // scan requested without initial key
-    if(client->request->argc == 1) {
-        scan = index_last_header(client->ns->index);
-
-        if(!scan_initial_info(&info, &scanlist, &scan))
-            return scan_failure(&scan, client);
-
-    } else {
+    if(cursor) {
         // scan requested with an initial key
         if(!scan_initial_get(&info, client))
             return 1;
+
+        index_iterator_init(&iter, index, info.idxid, info.idxoffset);
+
+    } else if(backward) {
+        index_iterator_last(&iter, index);
+
+    } else {
+        index_iterator_first(&iter, index);
     }
 
     // we have everything needed to start walking over
     // the keys and building our scan response
     uint64_t basetime = ustime();
 
-    while(ustime() - basetime < SCAN_TIMESLICE_US) {
-        zdbd_debug("[+] rscan: elapsed time: %" PRIu64 " us\n", ustime() - basetime);
+    while(1) {
+        if(count > 0 && scanlist.length >= count)
+            break;
+
+        // payloads are sent with the keys, the response size is limited
+        if(payload && budget >= SCAN_PAYLOAD_BUDGET)
+            break;
+
+        if(count == 0 && ustime() - basetime >= SCAN_TIMESLICE_US)
+            break;
 
         // reading entry and appending it
-        scan = index_previous_header(client->ns->index, info.idxid, info.idxoffset);
+        if(backward)
+            scan = index_iterator_previous(&iter);
+        else
+            scan = index_iterator_next(&iter);
 
         // this scan failed, let's guess it's the end
         if(scan.status != INDEX_SCAN_SUCCESS)
@@ -318,17 +446,41 @@ int command_rscan(redis_client_t *client) {
 
         // append object to the list
         scanlist_append(&scanlist, &scan, &info);
+        budget += scan.header->length;
+    }
+
+    index_iterator_free(&iter);
+
+    zdbd_debug("[+] scan: retreived %lu entries in %" PRIu64 " us\n", scanlist.length, ustime() - basetime);
+
+    if(scanlist.length == 0) {
+        scanlist_free(&scanlist);
+        return scan_failure(&scan, client);
     }
 
-    zdbd_debug("[+] rscan: retreived %lu entries in %" PRIu64 " us\n", scanlist.length, ustime() - basetime);
+    int value = (payload) ? command_scan_send_payloads(&scanlist, client) : command_scan_send_scanlist(&scanlist, client);
 
-    if(command_scan_send_scanlist(&scanlist, client))
+    if(value)
         redis_hardsend(client, "-Internal Error");
 
     scanlist_free(&scanlist);
     return 0;
 }
 
+//
+// SCAN
+//
+int command_scan(redis_client_t *client) {
+    return command_scan_walk(client, 0);
+}
+
+//
+// RSCAN
+//
+int command_rscan(redis_client_t *client) {
+    return command_scan_walk(client, 1);
+}
+
 //
 // KEYCUR
 //
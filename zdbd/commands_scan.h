@@ -28,8 +28,18 @@
 
     } list_t;
 
+    uint64_t ustime();
+
     // one call to SCAN/RSCAN can take up to
     // 2000 microseconds (2 milliseconds)
     #define SCAN_TIMESLICE_US  2000
 
+    // maximum amount of entries which can be
+    // requested with SCAN/RSCAN COUNT option
+    #define SCAN_COUNT_MAX  16384
+
+    // amount of payload bytes sent by one call to SCAN/RSCAN with
+    // payloads, the last entry can go over this limit
+    #define SCAN_PAYLOAD_BUDGET  8 * 1024 * 1024
+
 #endif
@@ -89,6 +89,7 @@ static size_t redis_set_handler_userkey(redis_client_t *client, index_entry_t *e
 
     unsigned char *value = request->argv[2]->buffer;
     uint32_t valuelength = request->argv[2]->length;
+    int spool = request->argv[2]->spool;
 
     // setting the timestamp
     time_t timestamp = timestamp_from_set(request, 3);
@@ -99,16 +100,18 @@ static size_t redis_set_handler_userkey(redis_client_t *client, index_entry_t *e
 
     data_request_t dreq = {
         .data = value,
+        .datafd = spool,
         .datalength = valuelength,
         .vid = id,
         .idlength = idlength,
         .flags = 0,
-        .crc = zdb_crc32(value, valuelength),
+        .crc = spool ? request->argv[2]->crc : zdb_crc32(value, valuelength),
         .timestamp = timestamp,
     };
 
     // checking if we need to update this entry of if data are unchanged
-    if(existing && existing->crc == dreq.crc) {
+    // (streamed payload are not in memory and are always written)
+    if(existing && existing->crc == dreq.crc && !spool) {
         // deep inspection of data to check if replacement is needed
         if(data_compare_matching(existing, &dreq, data) == 1) {
             redis_hardsend(client, "$-1");
@@ -199,6 +202,7 @@ static size_t redis_set_handler_sequential(redis_client_t *client, index_entry_t
 
     unsigned char *value = request->argv[2]->buffer;
     uint32_t valuelength = request->argv[2]->length;
+    int spool = request->argv[2]->spool;
 
     // setting the timestamp
     time_t timestamp = timestamp_from_set(request, 3);
@@ -209,16 +213,18 @@ static size_t redis_set_handler_sequential(redis_client_t *client, index_entry_t
 
     data_request_t dreq = {
         .data = value,
+        .datafd = spool,
         .datalength = valuelength,
         .vid = &id,
         .idlength = idlength,
         .flags = 0,
-        .crc = zdb_crc32(value, valuelength),
+        .crc = spool ? request->argv[2]->crc : zdb_crc32(value, valuelength),
         .timestamp = timestamp,
     };
 
     // checking if we need to update this entry or if data are unchanged
-    if(existing && existing->crc == dreq.crc) {
+    // (streamed payload are not in memory and are always written)
+    if(existing && existing->crc == dreq.crc && !spool) {
         // deep inspection of data to check if replacement is needed
         if(data_compare_matching(existing, &dreq, data) == 1) {
             redis_hardsend(client, "$-1");
@@ -379,3 +385,115 @@ int command_set(redis_client_t *client) {
     return 0;
 }
 
+
+//
+// MSET
+//
+// set multiple keys in one request, everything is validated first
+// then all the entries are written together (see zdb_api_mset), the
+// response is an array with one reply per key, the same reply SET
+// would return for this key (key inserted, nil if unchanged, or error)
+//
+static void command_mset_reply(redis_client_t *client, zdb_api_t *reply) {
+    char buffer[256];
+
+    switch(reply->status) {
+        case ZDB_API_BUFFER: {
+            zdb_api_buffer_t *key = reply->payload;
+            redis_bulk_t response = redis_bulk(key->payload, key->size);
+
+            if(!response.buffer) {
+                redis_hardsend(client, "$-1");
+                break;
+            }
+
+            redis_reply_heap(client, response.buffer, response.length, free);
+            break;
+        }
+
+        case ZDB_API_UP_TO_DATE:
+            redis_hardsend(client, "$-1");
+            break;
+
+        case ZDB_API_INSERT_DENIED:
+            redis_hardsend(client, "-Invalid key, only update authorized");
+            break;
+
+        case ZDB_API_FAILURE:
+            snprintf(buffer, sizeof(buffer), "-%s\r\n", (char *) reply->payload);
+            redis_reply_stack(client, buffer, strlen(buffer));
+            break;
+
+        default:
+            redis_hardsend(client, "-Internal Error");
+    }
+}
+
+int command_mset(redis_client_t *client) {
+    resp_request_t *request = client->request;
+    char header[32];
+
+    // key-value pairs expected
+    if(request->argc < 3 || (request->argc - 1) % 2 != 0) {
+        redis_hardsend(client, "-Invalid arguments");
+        return 1;
+    }
+
+    if(!client->writable) {
+        zdbd_debug("[-] command: mset: denied, read-only namespace\n");
+        redis_hardsend(client, "-Namespace is in read-only mode");
+        return 1;
+    }
+
+    if(namespace_is_frozen(client->ns))
+        return command_error_frozen(client);
+
+    if(namespace_is_locked(client->ns))
+        return command_error_locked(client);
+
+    size_t count = (request->argc - 1) / 2;
+
+    // validating all the keys before writing anything
+    for(int i = 1; i < request->argc; i += 2) {
+        if(request->argv[i]->length > MAX_KEY_LENGTH) {
+            redis_hardsend(client, "-Key too large");
+            return 1;
+        }
+    }
+
+    zdb_api_entry_t *entries;
+    zdb_api_t **replies;
+
+    if(!(entries = calloc(sizeof(zdb_api_entry_t), count)) || !(replies = calloc(sizeof(zdb_api_t *), count))) {
+        free(entries);
+        redis_hardsend(client, "-Internal Error");
+        return 1;
+    }
+
+    // entries point to the request arguments directly
+    for(size_t i = 0; i < count; i++) {
+        resp_object_t *key = request->argv[1 + (i * 2)];
+        resp_object_t *value = request->argv[2 + (i * 2)];
+
+        entries[i].key.payload = key->buffer;
+        entries[i].key.size = key->length;
+        entries[i].payload.payload = value->buffer;
+        entries[i].payload.size = value->length;
+    }
+
+    size_t written = zdb_api_mset(client->ns, entries, count, replies);
+    zdbd_debug("[+] command: mset: %lu/%lu entries written\n", written, count);
+
+    sprintf(header, "*%lu\r\n", count);
+    redis_reply_stack(client, header, strlen(header));
+
+    for(size_t i = 0; i < count; i++) {
+        command_mset_reply(client, replies[i]);
+        zdb_api_reply_free(replies[i]);
+    }
+
+    free(entries);
+    free(replies);
+
+    return 0;
+}
@@ -2,4 +2,5 @@
     #define ZDB_COMMANDS_SET_H
 
     int command_set(redis_client_t *client);
+    int command_mset(redis_client_t *client);
 #endif
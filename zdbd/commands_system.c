@@ -59,15 +59,19 @@ int command_stop(redis_client_t *client) {
 }
 
 int command_info(redis_client_t *client) {
-    char info[4096];
+    char info[8192];
     struct timeval current;
     zdb_settings_t *zdb_settings = zdb_settings_get();
     zdb_stats_t *lstats = &zdb_settings->stats;
     zdbd_stats_t *dstats = &zdbd_rootsettings.stats;
+    zdb_scrub_t *scrub = scrub_status();
+    redis_output_t output, largest[REDIS_OUTPUT_REPORT];
     int len = 0;
 
     gettimeofday(&current, NULL);
 
+    size_t connected = redis_clients_output(&output, largest, REDIS_OUTPUT_REPORT);
+
     len += sprintf(info, "# server\n");
     len += sprintf(info + len, "server_name: 0-db (zdb)\n");
     len += sprintf(info + len, "server_revision: " ZDBD_REVISION "\n");
@@ -79,6 +83,22 @@ int command_info(redis_client_t *client) {
 
     len += sprintf(info + len, "\n# clients\n");
     len += sprintf(info + len, "clients_lifetime: %" PRIu32 "\n", dstats->clients);
+    len += sprintf(info + len, "clients_connected: %zu\n", connected);
+    len += sprintf(info + len, "clients_paused: %zu\n", output.paused);
+    len += sprintf(info + len, "clients_paused_lifetime: %" PRIu64 "\n", dstats->clientspaused);
+    len += sprintf(info + len, "clients_dropped: %" PRIu64 "\n", dstats->clientsdropped);
+    len += sprintf(info + len, "output_pending_bytes: %zu\n", output.bytes);
+    len += sprintf(info + len, "output_pending_memory: %zu\n", output.memory);
+
+    // clients with the largest output pending
+    for(size_t i = 0; i < REDIS_OUTPUT_REPORT && largest[i].fd >= 0; i++) {
+        len += sprintf(info + len, "client_output_%zu: fd=%d,bytes=%zu,memory=%zu,paused=%zu\n",
+                i, largest[i].fd, largest[i].bytes, largest[i].memory, largest[i].paused);
+    }
+
+    len += sprintf(info + len, "\n# replication\n");
+    len += sprintf(info + len, "mirror_sequence: %" PRIu64 "\n", dstats->mirrorsequence);
+    len += sprintf(info + len, "mirror_dropped: %" PRIu64 "\n", dstats->mirrordropped);
 
     len += sprintf(info + len, "\n# internals\n");
     len += sprintf(info + len, "sequential_key_size: %ld\n", sizeof(seqid_t));
@@ -105,10 +125,37 @@ int command_info(redis_client_t *client) {
     len += sprintf(info + len, "data_disk_write_bytes: %" PRIu64 "\n", lstats->datadiskwrite);
     len += sprintf(info + len, "data_disk_write_mb: %.2f\n", lstats->datadiskwrite / (1024 * 1024.0));
 
-    len += sprintf(info + len, "network_rx_bytes: %" PRIu64 "\n", dstats->networkrx);
-    len += sprintf(info + len, "network_rx_mb: %.2f\n", dstats->networkrx / (1024 * 1024.0));
-    len += sprintf(info + len, "network_tx_bytes: %" PRIu64 "\n", dstats->networktx);
-    len += sprintf(info + len, "network_tx_mb: %.2f\n", dstats->networktx / (1024 * 1024.0));
+    // network threads keep updating theses while we read them
+    uint64_t networkrx = __atomic_load_n(&dstats->networkrx, __ATOMIC_RELAXED);
+    uint64_t networktx = __atomic_load_n(&dstats->networktx, __ATOMIC_RELAXED);
+
+    len += sprintf(info + len, "network_rx_bytes: %" PRIu64 "\n", networkrx);
+    len += sprintf(info + len, "network_rx_mb: %.2f\n", networkrx / (1024 * 1024.0));
+    len += sprintf(info + len, "network_tx_bytes: %" PRIu64 "\n", networktx);
+    len += sprintf(info + len, "network_tx_mb: %.2f\n", networktx / (1024 * 1024.0));
+
+    len += sprintf(info + len, "\n# scrubber\n");
+    len += sprintf(info + len, "scrub_enabled: %d\n", scrub->rate ? 1 : 0);
+    len += sprintf(info + len, "scrub_rate_bytes: %lu\n", scrub->rate);
+    len += sprintf(info + len, "scrub_namespace: %s\n", scrub->namespace);
+    len += sprintf(info + len, "scrub_datafile: %u\n", scrub->dataid);
+    len += sprintf(info + len, "scrub_offset: %ld\n", scrub->fd > 0 ? scrub->offset : 0);
+    len += sprintf(info + len, "scrub_checked_bytes: %" PRIu64 "\n", scrub->checked);
+    len += sprintf(info + len, "scrub_checked_entries: %" PRIu64 "\n", scrub->entries);
+    len += sprintf(info + len, "scrub_pass_started: %ld\n", scrub->passstart);
+    len += sprintf(info + len, "scrub_passes: %" PRIu64 "\n", scrub->passes);
+    len += sprintf(info + len, "scrub_last_pass: %ld\n", scrub->lastpass);
+    len += sprintf(info + len, "scrub_corrupted: %" PRIu64 "\n", scrub->corrupted);
+
+    // most recent corrupted entries first
+    size_t recents = scrub->recentidx < ZDB_SCRUB_HISTORY ? scrub->recentidx : ZDB_SCRUB_HISTORY;
+
+    for(size_t i = 0; i < recents; i++) {
+        zdb_scrub_corrupt_t *corrupt = &scrub->recent[(scrub->recentidx - 1 - i) % ZDB_SCRUB_HISTORY];
+
+        len += sprintf(info + len, "scrub_corrupt_%lu: ns=%s,datafile=%u,offset=%ld,time=%ld\n",
+                i, corrupt->namespace, corrupt->dataid, corrupt->offset, corrupt->detected);
+    }
 
     redis_bulk_t response = redis_bulk(info, len);
     if(!response.buffer) {
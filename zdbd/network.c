@@ -0,0 +1,1411 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "libzdb.h"
+#include "zdbd.h"
+#include "redis.h"
+#include "network.h"
+
+// this implementation is only used on linux
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include "resp_line.h"
+
+//
+// network threads
+//
+// with --threads, clients sockets are not handled by the main event loop
+// anymore, each network thread owns the connections it accepted: it receives
+// and parses requests, and sends replies, commands are still executed by the
+// main (storage) thread, one at a time, exactly like without threads, nothing
+// else (namespaces, index, data, clients state) is shared
+//
+// threads only talk through messages: commands fully received on a connection
+// are shipped at once (one request) to the storage thread, which executes them
+// and ships back the replies queue, the network thread sends it then gives it
+// back to be released (responses and their pools are only used by the storage
+// thread)
+//
+// each thread have one inbox, a lock-free multiple producers single consumer
+// queue, messages produced during one loop iteration are pushed at once, the
+// consumer is woken up by an eventfd, only when the queue was empty
+//
+// a connection is released in two steps: the storage thread releases the client
+// and sends a close, the network thread closes the socket and sends back closed,
+// which is the last message of this connection, the connection is freed then
+//
+
+// amount of events fetched per wakeup, adaptive (see socket_epoll.c)
+#define MAXEVENTS_MIN 64
+#define MAXEVENTS_MAX 4096
+
+// unix listening sockets are shared by all the threads, only one thread
+// is woken up per new connection (if supported by the kernel)
+#ifndef EPOLLEXCLUSIVE
+    #define EPOLLEXCLUSIVE 0
+#endif
+
+static net_thread_t *threads = NULL;
+static int threadslen = 0;
+
+// storage thread inbox
+static net_queue_t storage = {
+    .head = NULL,
+    .notifyfd = -1,
+};
+
+// storage side state, stopping is set when a shutdown was
+// requested (nothing is executed anymore), stopped is set when
+// the network threads are gone
+static int stopping = 0;
+static int stopped = 0;
+
+//
+// messages queues
+//
+static net_message_t *network_message(net_message_type_t type, net_conn_t *conn) {
+    net_message_t *message;
+
+    // losing a message would leak or break a connection
+    // forever, there is no way to recover from that
+    if(!(message = calloc(sizeof(net_message_t), 1)))
+        zdbd_diep("network: message calloc");
+
+    message->type = type;
+    message->conn = conn;
+
+    return message;
+}
+
+static void network_batch_append(net_batch_t *batch, net_message_t *message) {
+    message->next = batch->newest;
+    batch->newest = message;
+
+    if(!batch->oldest)
+        batch->oldest = message;
+}
+
+// push a batch of messages on a queue, the consumer is notified
+// only if the queue was empty, otherwise it was already notified
+static void network_queue_push(net_queue_t *queue, net_batch_t *batch) {
+    uint64_t notify = 1;
+    net_message_t *head;
+
+    if(!batch->newest)
+        return;
+
+    head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+
+    do {
+        batch->oldest->next = head;
+    } while(!__atomic_compare_exchange_n(&queue->head, &head, batch->newest, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    batch->newest = NULL;
+    batch->oldest = NULL;
+
+    if(head == NULL && write(queue->notifyfd, &notify, sizeof(notify)) != sizeof(notify))
+        zdbd_warnp("network: queue notify");
+}
+
+// take all the messages of a queue, oldest first
+static net_message_t *network_queue_take(net_queue_t *queue) {
+    net_message_t *message, *next, *ordered = NULL;
+    uint64_t notified;
+
+    // notification is cleared before taking the messages,
+    // a push done in the meantime will notify again
+    if(read(queue->notifyfd, &notified, sizeof(notified)) < 0 && errno != EAGAIN)
+        zdbd_warnp("network: queue notification");
+
+    message = __atomic_exchange_n(&queue->head, NULL, __ATOMIC_ACQUIRE);
+
+    // stack is newest first, reversing it
+    for(; message; message = next) {
+        next = message->next;
+        message->next = ordered;
+        ordered = message;
+    }
+
+    return ordered;
+}
+
+//
+// requests
+//
+static net_request_t *network_request_new() {
+    net_request_t *request;
+
+    if(!(request = calloc(sizeof(net_request_t), 1)))
+        zdbd_warnp("network: request calloc");
+
+    return request;
+}
+
+// release a request and the arguments still owned by it, arguments
+// executed are owned by the client request (see redis_remote_process)
+void network_request_free(net_request_t *request) {
+    for(size_t i = 0; i < request->argslength; i++) {
+        net_argument_t *argument = &request->arguments[i];
+
+        if(argument->spool > 0)
+            close(argument->spool);
+
+        free(argument->external);
+    }
+
+    free(request->commands);
+    free(request->arguments);
+    free(request->buffer);
+    free(request);
+}
+
+//
+// network thread: receiving
+//
+
+// link connection on the thread list of connections
+// having commands to ship at the end of this iteration
+static void network_pending(net_thread_t *thread, net_conn_t *conn) {
+    if(conn->pending)
+        return;
+
+    conn->pending = 1;
+    conn->shipnext = thread->pending;
+    thread->pending = conn;
+}
+
+// release arguments of the command not fully received
+static void network_command_reset(net_conn_t *conn) {
+    for(int i = 0; i < conn->argc; i++) {
+        net_argument_t *argument = &conn->args[i];
+
+        if(argument->spool > 0)
+            close(argument->spool);
+
+        free(argument->external);
+        memset(argument, 0, sizeof(net_argument_t));
+    }
+
+    conn->argc = 0;
+    conn->argi = 0;
+    conn->filling = -1;
+    conn->externals = 0;
+}
+
+// commands received are not usable anymore, the connection is only
+// kept until the storage thread releases the client
+static void network_hangup(net_thread_t *thread, net_conn_t *conn);
+
+// arguments of the current command pointing to the buffer are moved
+// when the buffer content is moved
+static void network_rebase(net_conn_t *conn, size_t shift) {
+    for(int i = 0; i < conn->argi; i++)
+        if(!conn->args[i].external && conn->args[i].spool == 0)
+            conn->args[i].offset -= shift;
+
+    conn->cursor -= shift;
+    conn->length -= shift;
+    conn->start = 0;
+}
+
+// ship commands parsed to the storage thread, the request takes
+// the buffer, the current command (not fully received) is moved
+// to a new buffer
+static void network_ship(net_thread_t *thread, net_conn_t *conn) {
+    net_request_t *request = conn->request;
+    size_t tail = conn->length - conn->start;
+    char *buffer = conn->buffer;
+    net_message_t *message;
+
+    if(!request)
+        return;
+
+    conn->request = NULL;
+    request->buffer = buffer;
+
+    // buffer was mostly empty, going back to smaller buffers
+    if(conn->length < conn->allocated / 4 && conn->size > REDIS_BUFFER_SIZE)
+        conn->size /= 2;
+
+    if(tail == 0) {
+        conn->buffer = NULL;
+        conn->allocated = 0;
+        conn->length = 0;
+        conn->start = 0;
+        conn->cursor = 0;
+
+    } else {
+        size_t allocated = (tail > conn->size) ? tail : conn->size;
+
+        if(!(conn->buffer = malloc(allocated))) {
+            zdbd_warnp("network: buffer malloc");
+            conn->allocated = 0;
+            network_command_reset(conn);
+            network_hangup(thread, conn);
+
+        } else {
+            memcpy(conn->buffer, buffer + conn->start, tail);
+            network_rebase(conn, conn->start);
+            conn->allocated = allocated;
+        }
+    }
+
+    conn->inflight += request->received;
+
+    message = network_message(NET_REQUEST, conn);
+    message->request = request;
+    network_batch_append(&thread->storagebatch, message);
+}
+
+// protocol error, commands received before are still executed then
+// the storage thread replies the error and closes the connection
+static void network_fail(net_thread_t *thread, net_conn_t *conn, const char *error) {
+    zdbd_debug("[-] network: connection %d: %s", conn->fd, error);
+
+    network_command_reset(conn);
+    conn->failed = 1;
+
+    if(!conn->request && !(conn->request = network_request_new())) {
+        network_hangup(thread, conn);
+        return;
+    }
+
+    conn->request->error = error;
+    network_pending(thread, conn);
+}
+
+static void network_hangup(net_thread_t *thread, net_conn_t *conn) {
+    if(conn->hangup)
+        return;
+
+    zdbd_debug("[+] network: connection %d lost\n", conn->fd);
+
+    // commands fully received are still executed
+    network_ship(thread, conn);
+    conn->hangup = 1;
+
+    // replies pending are dropped
+    while(conn->replies) {
+        net_message_t *message = conn->replies;
+
+        conn->replies = message->next;
+        message->type = NET_SENT;
+        network_batch_append(&thread->storagebatch, message);
+    }
+
+    conn->repliestail = NULL;
+
+    epoll_ctl(thread->evfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    network_batch_append(&thread->storagebatch, network_message(NET_HANGUP, conn));
+}
+
+// ensure the current command have enough arguments slots
+static int network_arguments(net_conn_t *conn, int argc) {
+    if(argc <= conn->argscap)
+        return 0;
+
+    int capacity = (conn->argscap) ? conn->argscap : REDIS_ARGUMENTS_INITIAL;
+    net_argument_t *args;
+
+    while(capacity < argc)
+        capacity *= 2;
+
+    if(!(args = realloc(conn->args, sizeof(net_argument_t) * capacity)))
+        return 1;
+
+    memset(args + conn->argscap, 0, sizeof(net_argument_t) * (capacity - conn->argscap));
+
+    conn->args = args;
+    conn->argscap = capacity;
+
+    return 0;
+}
+
+// current command fully received, appended to the request
+static int network_command(net_thread_t *thread, net_conn_t *conn) {
+    net_request_t *request = conn->request;
+
+    if(!request) {
+        if(!(request = network_request_new()))
+            return 1;
+
+        conn->request = request;
+        network_pending(thread, conn);
+    }
+
+    if(request->count == request->allocated) {
+        size_t allocated = (request->allocated) ? request->allocated * 2 : 16;
+        net_command_t *commands;
+
+        if(!(commands = realloc(request->commands, sizeof(net_command_t) * allocated)))
+            return 1;
+
+        request->commands = commands;
+        request->allocated = allocated;
+    }
+
+    if(request->argslength + conn->argc > request->argsallocated) {
+        size_t allocated = (request->argsallocated) ? request->argsallocated : 32;
+        net_argument_t *arguments;
+
+        while(allocated < request->argslength + conn->argc)
+            allocated *= 2;
+
+        if(!(arguments = realloc(request->arguments, sizeof(net_argument_t) * allocated)))
+            return 1;
+
+        request->arguments = arguments;
+        request->argsallocated = allocated;
+    }
+
+    // arguments are owned by the request now
+    memcpy(request->arguments + request->argslength, conn->args, sizeof(net_argument_t) * conn->argc);
+    memset(conn->args, 0, sizeof(net_argument_t) * conn->argc);
+
+    request->commands[request->count].first = request->argslength;
+    request->commands[request->count].argc = conn->argc;
+    request->count += 1;
+    request->argslength += conn->argc;
+    request->received += (conn->cursor - conn->start) + conn->externals;
+
+    conn->argc = 0;
+    conn->argi = 0;
+    conn->externals = 0;
+    conn->start = conn->cursor;
+
+    return 0;
+}
+
+// payload larger than the maximum in-memory payload are only supported
+// for the value of a SET request, streamed into a spool file while
+// received (see redis_request_streamable)
+static int network_streamable(net_conn_t *conn, net_argument_t *argument) {
+    zdb_settings_t *settings = zdb_settings_get();
+    net_argument_t *command = &conn->args[0];
+    char *name;
+
+    if(conn->argi != 2 || command->length != 3 || command->spool > 0)
+        return 0;
+
+    name = (command->external) ? command->external : conn->buffer + command->offset;
+
+    if(strncasecmp(name, "SET", 3) != 0)
+        return 0;
+
+    if(argument->length > ZDB_DATA_MAX_STREAM_PAYLOAD || (size_t) argument->length > settings->datasize)
+        return 0;
+
+    return 1;
+}
+
+// move payload available on the buffer to the argument received
+// outside of the buffer, payload bytes are removed from the buffer
+static int network_fill(net_conn_t *conn) {
+    net_argument_t *argument = &conn->args[conn->filling];
+    size_t size = argument->length + 2;
+    size_t available = conn->length - conn->cursor;
+    size_t take = size - conn->filled;
+    char *source = conn->buffer + conn->cursor;
+
+    if(take > available)
+        take = available;
+
+    if(take > 0 && argument->spool > 0) {
+        // trailing \r\n is not part of the payload
+        size_t payload = 0;
+
+        if(conn->filled < (size_t) argument->length) {
+            payload = argument->length - conn->filled;
+            payload = (payload > take) ? take : payload;
+        }
+
+        if(payload > 0) {
+            if(write(argument->spool, source, payload) != (ssize_t) payload) {
+                zdbd_warnp("network: spool write");
+                return 1;
+            }
+
+            argument->crc = zdb_crc32_update(argument->crc, (uint8_t *) source, payload);
+        }
+
+    } else if(take > 0) {
+        memcpy(argument->external + conn->filled, source, take);
+    }
+
+    if(take > 0) {
+        memmove(source, source + take, available - take);
+        conn->length -= take;
+        conn->filled += take;
+    }
+
+    if(conn->filled == size) {
+        conn->externals += size;
+        conn->filling = -1;
+        conn->argi += 1;
+    }
+
+    return 0;
+}
+
+// parse everything available on the connection buffer, commands
+// fully received are appended to the pending request
+static void network_parse(net_thread_t *thread, net_conn_t *conn) {
+    while(!conn->failed && !conn->hangup) {
+        char *match;
+
+        if(conn->filling >= 0) {
+            if(network_fill(conn)) {
+                network_fail(thread, conn, "-Internal spool error\r\n");
+                return;
+            }
+
+            // waiting for more data
+            if(conn->filling >= 0)
+                return;
+        }
+
+        if(conn->argc > 0 && conn->argi == conn->argc) {
+            if(network_command(thread, conn)) {
+                zdbd_warnp("network: request malloc");
+                network_fail(thread, conn, "-Internal memory error\r\n");
+                return;
+            }
+
+            continue;
+        }
+
+        char *reader = conn->buffer + conn->cursor;
+        char *writer = conn->buffer + conn->length;
+
+        if(reader >= writer || !(match = resp_line_end(reader, writer)))
+            return;
+
+        // array header, new command
+        if(conn->argc == 0) {
+            if(*reader != '*') {
+                network_fail(thread, conn, "-Malformed request, array expected\r\n");
+                return;
+            }
+
+            int argc = resp_line_integer(reader, match);
+
+            if(argc <= 0) {
+                network_fail(thread, conn, "-Missing arguments\r\n");
+                return;
+            }
+
+            if(argc > 1024) {
+                network_fail(thread, conn, "-Too many arguments\r\n");
+                return;
+            }
+
+            if(network_arguments(conn, argc)) {
+                zdbd_warnp("network: arguments malloc");
+                network_fail(thread, conn, "-Internal memory error\r\n");
+                return;
+            }
+
+            conn->argc = argc;
+            conn->argi = 0;
+            conn->externals = 0;
+            conn->cursor = (match + 1) - conn->buffer;
+            continue;
+        }
+
+        // argument header
+        if(*reader != '$') {
+            network_fail(thread, conn, "-Malformed query string\r\n");
+            return;
+        }
+
+        net_argument_t *argument = &conn->args[conn->argi];
+        size_t payload = (match + 1) - conn->buffer;
+        int length = resp_line_integer(reader, match);
+
+        if(length < 0) {
+            network_fail(thread, conn, "-Malformed query string\r\n");
+            return;
+        }
+
+        memset(argument, 0, sizeof(net_argument_t));
+        argument->length = length;
+
+        if(length > REDIS_MAX_PAYLOAD) {
+            if(!network_streamable(conn, argument)) {
+                network_fail(thread, conn, "-Payload too big\r\n");
+                return;
+            }
+
+            zdbd_debug("[+] network: streaming %d bytes payload to spool\n", length);
+
+            if((argument->spool = data_spool_open_path(zdb_settings_get()->datapath)) < 0) {
+                argument->spool = 0;
+                network_fail(thread, conn, "-Internal spool error\r\n");
+                return;
+            }
+
+        } else if(payload + length + 2 <= conn->length) {
+            // the whole argument is already received
+            argument->offset = payload;
+            conn->cursor = payload + length + 2;
+            conn->argi += 1;
+            continue;
+
+        } else if(payload + length + 2 - conn->start <= conn->allocated) {
+            // the command will fit on the buffer, waiting for
+            // more data, the header will be parsed again
+            return;
+
+        } else if(!(argument->external = malloc(length + 2))) {
+            zdbd_warnp("network: argument malloc");
+            network_fail(thread, conn, "-Internal memory error\r\n");
+            return;
+        }
+
+        // payload is received outside of the buffer
+        conn->cursor = payload;
+        conn->filling = conn->argi;
+        conn->filled = 0;
+    }
+}
+
+// arguments of the current command are moved outside of the buffer,
+// the buffer can't grow anymore and the command doesn't fit on it
+static int network_pin(net_conn_t *conn) {
+    for(int i = 0; i < conn->argi; i++) {
+        net_argument_t *argument = &conn->args[i];
+
+        if(argument->external || argument->spool > 0)
+            continue;
+
+        if(!(argument->external = malloc(argument->length + 2)))
+            return 1;
+
+        memcpy(argument->external, conn->buffer + argument->offset, argument->length + 2);
+        conn->externals += argument->length + 2;
+    }
+
+    // headers of theses arguments are not needed anymore
+    conn->start = conn->cursor;
+
+    return 0;
+}
+
+// move the current command at the beginning of the buffer
+static void network_shift(net_conn_t *conn) {
+    memmove(conn->buffer, conn->buffer + conn->start, conn->length - conn->start);
+    network_rebase(conn, conn->start);
+}
+
+// ensure some room is available on the receive buffer
+static int network_room(net_thread_t *thread, net_conn_t *conn) {
+    if(conn->buffer && conn->length == conn->allocated) {
+        // commands parsed are shipped right now, or
+        // discarded, the current command is moved
+        if(conn->request)
+            network_ship(thread, conn);
+
+        else if(conn->start > 0)
+            network_shift(conn);
+    }
+
+    // buffer is only allocated when receiving
+    if(!conn->buffer) {
+        if(!(conn->buffer = malloc(conn->size)))
+            return 1;
+
+        conn->allocated = conn->size;
+        conn->length = 0;
+        conn->start = 0;
+        conn->cursor = 0;
+    }
+
+    if(conn->length < conn->allocated)
+        return 0;
+
+    // the current command fills the whole buffer
+    if(conn->allocated < REDIS_BUFFER_MAX_SIZE) {
+        size_t allocated = conn->allocated * 2;
+        char *buffer;
+
+        if(allocated > REDIS_BUFFER_MAX_SIZE)
+            allocated = REDIS_BUFFER_MAX_SIZE;
+
+        if(!(buffer = realloc(conn->buffer, allocated)))
+            return 1;
+
+        conn->buffer = buffer;
+        conn->allocated = allocated;
+
+        return 0;
+    }
+
+    if(network_pin(conn))
+        return 1;
+
+    // a single header line fills the whole buffer
+    if(conn->start == 0)
+        return 1;
+
+    network_shift(conn);
+
+    return 0;
+}
+
+// large payload expected are received directly into the
+// argument when nothing is left on the buffer
+static net_argument_t *network_direct(net_conn_t *conn) {
+    net_argument_t *argument;
+
+    if(conn->filling < 0 || conn->cursor != conn->length)
+        return NULL;
+
+    argument = &conn->args[conn->filling];
+
+    if(argument->spool > 0)
+        return NULL;
+
+    if(argument->length + 2 - conn->filled < REDIS_BUFFER_SIZE)
+        return NULL;
+
+    return argument;
+}
+
+// receive everything available on the socket, sockets are edge-triggered,
+// the socket needs to be drained, except when too much was received and
+// not yet executed, reading continues when the storage thread consumed it
+static void network_receive(net_thread_t *thread, net_conn_t *conn) {
+    while(!conn->hangup && !conn->failed) {
+        net_argument_t *direct;
+        size_t requested;
+        ssize_t length;
+        char *target;
+
+        if(conn->inflight >= NETWORK_INFLIGHT_MAX) {
+            conn->blocked = 1;
+            return;
+        }
+
+        if((direct = network_direct(conn))) {
+            target = direct->external + conn->filled;
+            requested = direct->length + 2 - conn->filled;
+
+        } else {
+            if(network_room(thread, conn)) {
+                zdbd_warnp("network: receive buffer");
+                network_fail(thread, conn, "-Internal memory error\r\n");
+                return;
+            }
+
+            target = conn->buffer + conn->length;
+            requested = conn->allocated - conn->length;
+        }
+
+        if((length = recv(conn->fd, target, requested, 0)) < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+
+            if(errno != ECONNRESET)
+                zdbd_warnp("network: recv");
+
+            network_hangup(thread, conn);
+            return;
+        }
+
+        if(length == 0) {
+            network_hangup(thread, conn);
+            return;
+        }
+
+        __atomic_fetch_add(&zdbd_rootsettings.stats.networkrx, length, __ATOMIC_RELAXED);
+
+        if(direct)
+            conn->filled += length;
+        else
+            conn->length += length;
+
+        network_parse(thread, conn);
+
+        // socket receive queue was empty
+        if((size_t) length < requested)
+            return;
+
+        // a single read was not enough, next buffers will be larger
+        if(!direct && conn->size < REDIS_BUFFER_MAX_SIZE)
+            conn->size *= 2;
+    }
+}
+
+//
+// network thread: sending
+//
+
+// replies queues fully sent are given back to the storage thread
+static void network_sent(net_thread_t *thread, net_conn_t *conn) {
+    while(conn->replies) {
+        net_message_t *message = conn->replies;
+
+        while(message->current && message->current->length == 0)
+            message->current = message->current->next;
+
+        if(message->current)
+            return;
+
+        conn->replies = message->next;
+
+        if(!conn->replies)
+            conn->repliestail = NULL;
+
+        message->type = NET_SENT;
+        network_batch_append(&thread->storagebatch, message);
+    }
+}
+
+// send as much as possible of the replies pending, memory buffers
+// are sent together (writev), files are sent on their own
+static void network_send(net_thread_t *thread, net_conn_t *conn) {
+    struct iovec iov[REDIS_RESPONSE_IOV];
+
+    while(1) {
+        redis_response_t *file = NULL;
+        size_t requested = 0;
+        ssize_t sent;
+        int count = 0;
+
+        network_sent(thread, conn);
+
+        if(!conn->replies)
+            return;
+
+        for(net_message_t *message = conn->replies; message && !file && count < REDIS_RESPONSE_IOV; message = message->next) {
+            for(redis_response_t *response = message->current; response && count < REDIS_RESPONSE_IOV; response = response->next) {
+                if(response->length == 0)
+                    continue;
+
+                if(response->fd > 0) {
+                    file = response;
+                    break;
+                }
+
+                iov[count].iov_base = response->reader;
+                iov[count].iov_len = response->length;
+                requested += response->length;
+                count += 1;
+            }
+        }
+
+        if(count > 0)
+            sent = writev(conn->fd, iov, count);
+        else
+            sent = sendfile(conn->fd, file->fd, &file->offset, file->length);
+
+        if(sent < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+
+            if(errno != EPIPE && errno != ECONNRESET)
+                zdbd_warnp("network: send");
+
+            network_hangup(thread, conn);
+            return;
+        }
+
+        // file shorter than expected
+        if(sent == 0 && count == 0) {
+            zdbd_warning("[-] network: connection %d: file reply truncated", conn->fd);
+            network_hangup(thread, conn);
+            return;
+        }
+
+        __atomic_fetch_add(&zdbd_rootsettings.stats.networktx, sent, __ATOMIC_RELAXED);
+
+        if(count == 0) {
+            file->length -= sent;
+            continue;
+        }
+
+        // discarding what was sent
+        size_t remain = sent;
+
+        for(net_message_t *message = conn->replies; message && remain > 0; message = message->next) {
+            for(redis_response_t *response = message->current; response && remain > 0; response = response->next) {
+                size_t length = (remain < response->length) ? remain : response->length;
+
+                response->reader += length;
+                response->length -= length;
+                remain -= length;
+            }
+        }
+
+        // socket send queue is full
+        if((size_t) sent < requested)
+            return;
+    }
+}
+
+//
+// network thread: connections
+//
+static void network_conn_new(net_thread_t *thread, int fd) {
+    struct epoll_event event;
+    net_conn_t *conn;
+
+    if(!(conn = calloc(sizeof(net_conn_t), 1))) {
+        zdbd_warnp("network: connection calloc");
+        close(fd);
+        return;
+    }
+
+    conn->fd = fd;
+    conn->thread = thread;
+    conn->size = REDIS_BUFFER_SIZE;
+    conn->filling = -1;
+
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.data.ptr = conn;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+
+    if(epoll_ctl(thread->evfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        zdbd_verbosep("network", "epoll_ctl");
+        close(fd);
+        free(conn);
+        return;
+    }
+
+    conn->next = thread->conns;
+
+    if(thread->conns)
+        thread->conns->prev = conn;
+
+    thread->conns = conn;
+
+    zdbd_verbose("[+] incoming connection (socket %d, thread %d)\n", fd, thread->id);
+
+    network_batch_append(&thread->storagebatch, network_message(NET_OPEN, conn));
+}
+
+// release everything owned by the network thread, the connection
+// object is freed by the storage thread
+static void network_conn_release(net_thread_t *thread, net_conn_t *conn) {
+    while(conn->replies) {
+        net_message_t *message = conn->replies;
+
+        conn->replies = message->next;
+        message->type = NET_SENT;
+        network_batch_append(&thread->storagebatch, message);
+    }
+
+    network_command_reset(conn);
+
+    if(conn->request)
+        network_request_free(conn->request);
+
+    free(conn->args);
+    free(conn->buffer);
+
+    conn->request = NULL;
+    conn->args = NULL;
+    conn->buffer = NULL;
+    conn->closed = 1;
+
+    if(conn->prev)
+        conn->prev->next = conn->next;
+    else
+        thread->conns = conn->next;
+
+    if(conn->next)
+        conn->next->prev = conn->prev;
+}
+
+// client released by the storage thread
+static void network_conn_close(net_thread_t *thread, net_conn_t *conn, net_message_t *message) {
+    // last chance for the replies pending (eg: an error
+    // sent right before closing)
+    if(!conn->hangup)
+        network_send(thread, conn);
+
+    zdbd_debug("[+] network: closing connection %d\n", conn->fd);
+
+    close(conn->fd);
+    network_conn_release(thread, conn);
+
+    message->type = NET_CLOSED;
+    network_batch_append(&thread->storagebatch, message);
+}
+
+static void network_accept(net_thread_t *thread, int fd) {
+    for(int accepted = 0; accepted < NETWORK_ACCEPT_BATCH; accepted++) {
+        int clientfd;
+
+        if((clientfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK)) == -1) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                zdbd_verbosep("network", "accept");
+
+            return;
+        }
+
+        socket_keepalive(clientfd);
+        socket_nodelay(clientfd);
+
+        network_conn_new(thread, clientfd);
+    }
+}
+
+// messages from the storage thread
+static void network_thread_messages(net_thread_t *thread) {
+    net_message_t *message, *next;
+
+    for(message = network_queue_take(&thread->inbox); message; message = next) {
+        net_conn_t *conn = message->conn;
+
+        next = message->next;
+        message->next = NULL;
+
+        switch(message->type) {
+            case NET_REPLY:
+                message->current = message->responses;
+
+                if(conn->hangup) {
+                    message->type = NET_SENT;
+                    network_batch_append(&thread->storagebatch, message);
+                    break;
+                }
+
+                if(conn->repliestail)
+                    conn->repliestail->next = message;
+                else
+                    conn->replies = message;
+
+                conn->repliestail = message;
+                network_send(thread, conn);
+                break;
+
+            case NET_CONSUMED:
+                conn->inflight -= message->bytes;
+                free(message);
+
+                // reading again, data pending won't trigger a new event
+                if(conn->blocked && conn->inflight < NETWORK_INFLIGHT_MAX && !thread->stop) {
+                    conn->blocked = 0;
+                    network_receive(thread, conn);
+                }
+
+                break;
+
+            case NET_CLOSE:
+                network_conn_close(thread, conn, message);
+                break;
+
+            default:
+                free(message);
+        }
+    }
+}
+
+static void network_event(net_thread_t *thread, struct epoll_event *event) {
+    net_conn_t *conn = event->data.ptr;
+
+    if(event->data.ptr == &thread->inbox) {
+        network_thread_messages(thread);
+        return;
+    }
+
+    for(int i = 0; i < thread->listenlen; i++) {
+        if(event->data.ptr == &thread->listenfd[i]) {
+            network_accept(thread, thread->listenfd[i]);
+            return;
+        }
+    }
+
+    // released earlier during this iteration
+    if(conn->closed)
+        return;
+
+    if(event->events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        network_receive(thread, conn);
+
+    if((event->events & EPOLLOUT) && !conn->closed && !conn->hangup)
+        network_send(thread, conn);
+}
+
+static void *network_thread(void *arg) {
+    net_thread_t *thread = (net_thread_t *) arg;
+    struct epoll_event *events;
+    sigset_t mask;
+
+    // signals are handled by the main thread
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    if(!(events = calloc(MAXEVENTS_MAX, sizeof(struct epoll_event))))
+        zdbd_diep("network: events calloc");
+
+    while(!__atomic_load_n(&thread->stop, __ATOMIC_ACQUIRE)) {
+        int n = epoll_wait(thread->evfd, events, thread->maxevents, -1);
+        __atomic_fetch_add(&zdbd_rootsettings.stats.netevents, 1, __ATOMIC_RELAXED);
+
+        if(n < 0) {
+            if(errno != EINTR)
+                zdbd_warnp("network: epoll_wait");
+
+            continue;
+        }
+
+        for(int i = 0; i < n; i++)
+            network_event(thread, &events[i]);
+
+        // commands received during this iteration are
+        // shipped, one request per connection
+        for(net_conn_t *conn = thread->pending, *next; conn; conn = next) {
+            next = conn->shipnext;
+            conn->shipnext = NULL;
+            conn->pending = 0;
+
+            if(!conn->closed)
+                network_ship(thread, conn);
+        }
+
+        thread->pending = NULL;
+        network_queue_push(&storage, &thread->storagebatch);
+
+        if(n == thread->maxevents && thread->maxevents < MAXEVENTS_MAX) {
+            thread->maxevents *= 2;
+
+        } else if(n < thread->maxevents / 4 && thread->maxevents > MAXEVENTS_MIN) {
+            thread->maxevents /= 2;
+        }
+    }
+
+    // last messages from the storage thread, then everything
+    // still owned is released, sockets of clients still connected
+    // are closed by the storage thread
+    network_thread_messages(thread);
+
+    while(thread->conns)
+        network_conn_release(thread, thread->conns);
+
+    network_queue_push(&storage, &thread->storagebatch);
+    free(events);
+
+    return NULL;
+}
+
+// tcp listening socket of a thread, bound to the same address than the main
+// one (SO_REUSEPORT, see redis_tcp_listen), the kernel spreads incoming
+// connections across the threads sockets, an accept storm is then handled
+// by all the threads in parallel instead of waking them up for the same queue
+//
+// unix sockets can't be shared this way, they are shared by all the threads
+// (only one is woken up per connection, EPOLLEXCLUSIVE), returns -1 for them
+static int network_listen_reuse(int fd) {
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    int yes = 1;
+    int newfd;
+
+    if(getsockname(fd, (struct sockaddr *) &addr, &addrlen) < 0)
+        zdbd_diep("network: getsockname");
+
+    if(addr.ss_family != AF_INET && addr.ss_family != AF_INET6)
+        return -1;
+
+    if((newfd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
+        zdbd_diep("network: tcp socket");
+
+    if(setsockopt(newfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) < 0)
+        zdbd_diep("network: tcp setsockopt");
+
+    if(setsockopt(newfd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) < 0)
+        zdbd_diep("network: tcp setsockopt");
+
+    if(bind(newfd, (struct sockaddr *) &addr, addrlen) < 0)
+        zdbd_diep("network: tcp bind");
+
+    if(listen(newfd, SOMAXCONN) < 0)
+        zdbd_diep("network: listen");
+
+    return newfd;
+}
+
+//
+// storage thread
+//
+int network_start(redis_handler_t *handler) {
+    int count = zdbd_rootsettings.threads;
+
+    if((storage.notifyfd = eventfd(0, EFD_NONBLOCK)) < 0)
+        zdbd_diep("network: eventfd");
+
+    if(!(threads = calloc(sizeof(net_thread_t), count)))
+        zdbd_diep("network: threads calloc");
+
+    for(int i = 0; i < count; i++) {
+        net_thread_t *thread = &threads[i];
+        struct epoll_event event;
+
+        thread->id = i;
+        thread->maxevents = MAXEVENTS_MIN;
+        thread->listenlen = handler->fdlen;
+        thread->reusefd = -1;
+
+        if(!(thread->listenfd = malloc(sizeof(int) * handler->fdlen)))
+            zdbd_diep("network: listen malloc");
+
+        if((thread->evfd = epoll_create1(0)) < 0)
+            zdbd_diep("network: epoll_create1");
+
+        if((thread->inbox.notifyfd = eventfd(0, EFD_NONBLOCK)) < 0)
+            zdbd_diep("network: eventfd");
+
+        memset(&event, 0, sizeof(struct epoll_event));
+        event.data.ptr = &thread->inbox;
+        event.events = EPOLLIN;
+
+        if(epoll_ctl(thread->evfd, EPOLL_CTL_ADD, thread->inbox.notifyfd, &event) < 0)
+            zdbd_diep("network: epoll_ctl");
+
+        for(int j = 0; j < thread->listenlen; j++) {
+            int reuse = (i > 0) ? network_listen_reuse(handler->mainfd[j]) : -1;
+
+            // first thread uses the main sockets
+            thread->listenfd[j] = (reuse >= 0) ? reuse : handler->mainfd[j];
+            event.data.ptr = &thread->listenfd[j];
+            event.events = EPOLLIN | EPOLLEXCLUSIVE;
+
+            if(reuse >= 0) {
+                thread->reusefd = reuse;
+                event.events = EPOLLIN;
+            }
+
+            if(epoll_ctl(thread->evfd, EPOLL_CTL_ADD, thread->listenfd[j], &event) < 0)
+                zdbd_diep("network: epoll_ctl");
+        }
+
+        if((errno = pthread_create(&thread->thread, NULL, network_thread, thread)))
+            zdbd_diep("network: pthread_create");
+    }
+
+    threadslen = count;
+    zdb_log("[+] network: %d threads started\n", count);
+
+    return storage.notifyfd;
+}
+
+// messages from the network threads
+resp_status_t network_process() {
+    resp_status_t status = RESP_STATUS_SUCCESS;
+    net_message_t *message, *next;
+
+    for(message = network_queue_take(&storage); message; message = next) {
+        net_conn_t *conn = message->conn;
+        redis_client_t *client = conn->client;
+        resp_status_t value = RESP_STATUS_SUCCESS;
+
+        next = message->next;
+
+        switch(message->type) {
+            case NET_OPEN:
+                if(!(conn->client = redis_remote_open(conn)))
+                    network_close(conn);
+
+                break;
+
+            case NET_REQUEST:
+                if(!client || stopping) {
+                    network_request_free(message->request);
+                    break;
+                }
+
+                value = redis_remote_request(client, message->request);
+                break;
+
+            case NET_SENT:
+                for(redis_response_t *response = message->responses, *rnext; response; response = rnext) {
+                    rnext = response->next;
+                    redis_response_free(response);
+                }
+
+                if(client && !stopping)
+                    value = redis_remote_sent(client, message->bytes, message->memory);
+
+                break;
+
+            case NET_HANGUP:
+                if(client && !stopping)
+                    socket_client_free(client->fd);
+
+                break;
+
+            case NET_CLOSED:
+                free(conn);
+                break;
+
+            default:
+                break;
+        }
+
+        free(message);
+
+        if(value == RESP_STATUS_DISCARD || value == RESP_STATUS_DISCONNECTED)
+            socket_client_free(client->fd);
+
+        // nothing is executed anymore, remaining
+        // messages are only released
+        if(value == RESP_STATUS_SHUTDOWN) {
+            status = RESP_STATUS_SHUTDOWN;
+            stopping = 1;
+        }
+    }
+
+    return status;
+}
+
+// push messages produced to the network threads
+void network_flush() {
+    redis_remote_ship();
+
+    for(int i = 0; i < threadslen; i++)
+        network_queue_push(&threads[i].inbox, &threads[i].threadbatch);
+}
+
+void network_stop() {
+    uint64_t notify = 1;
+
+    stopping = 1;
+
+    // replies and close messages pending are delivered
+    // first, the threads handle them before stopping
+    network_flush();
+
+    for(int i = 0; i < threadslen; i++) {
+        __atomic_store_n(&threads[i].stop, 1, __ATOMIC_RELEASE);
+
+        if(write(threads[i].inbox.notifyfd, &notify, sizeof(notify)) != sizeof(notify))
+            zdbd_warnp("network: stop notify");
+    }
+
+    for(int i = 0; i < threadslen; i++) {
+        pthread_join(threads[i].thread, NULL);
+        close(threads[i].evfd);
+        close(threads[i].inbox.notifyfd);
+
+        if(threads[i].reusefd >= 0)
+            close(threads[i].reusefd);
+
+        free(threads[i].listenfd);
+    }
+
+    // last messages of the threads, connections of clients
+    // still connected are closed when the clients are released
+    stopped = 1;
+    network_process();
+
+    close(storage.notifyfd);
+    free(threads);
+
+    threads = NULL;
+    threadslen = 0;
+}
+
+void network_reply(net_conn_t *conn, redis_response_t *responses, size_t bytes, size_t memory) {
+    net_message_t *message;
+
+    if(stopped) {
+        for(redis_response_t *next; responses; responses = next) {
+            next = responses->next;
+            redis_response_free(responses);
+        }
+
+        return;
+    }
+
+    message = network_message(NET_REPLY, conn);
+    message->responses = responses;
+    message->bytes = bytes;
+    message->memory = memory;
+
+    network_batch_append(&conn->thread->threadbatch, message);
+}
+
+void network_consumed(net_conn_t *conn, size_t bytes) {
+    net_message_t *message;
+
+    if(stopped)
+        return;
+
+    message = network_message(NET_CONSUMED, conn);
+    message->bytes = bytes;
+
+    network_batch_append(&conn->thread->threadbatch, message);
+}
+
+void network_close(net_conn_t *conn) {
+    conn->client = NULL;
+
+    // network threads are gone, nothing else
+    // owns the connection anymore
+    if(stopped) {
+        close(conn->fd);
+        free(conn);
+        return;
+    }
+
+    network_batch_append(&conn->thread->threadbatch, network_message(NET_CLOSE, conn));
+}
+
+#else
+
+// network threads are not supported on this platform (see zdbd.c)
+// clients are never remote, theses are never called
+int network_start(redis_handler_t *handler) {
+    (void) handler;
+    return -1;
+}
+
+resp_status_t network_process() {
+    return RESP_STATUS_SUCCESS;
+}
+
+void network_flush() {
+}
+
+void network_stop() {
+}
+
+void network_reply(net_conn_t *conn, redis_response_t *responses, size_t bytes, size_t memory) {
+    (void) conn;
+    (void) responses;
+    (void) bytes;
+    (void) memory;
+}
+
+void network_consumed(net_conn_t *conn, size_t bytes) {
+    (void) conn;
+    (void) bytes;
+}
+
+void network_close(net_conn_t *conn) {
+    (void) conn;
+}
+
+void network_request_free(net_request_t *request) {
+    (void) request;
+}
+
+#endif // __linux__
@@ -0,0 +1,175 @@
+#ifndef ZDBD_NETWORK_H
+    #define ZDBD_NETWORK_H
+
+    #include <stdint.h>
+    #include <pthread.h>
+
+    // network threads (--threads): sockets are owned by network threads
+    // which receive and parse requests and send replies, commands are
+    // still executed by the single storage thread, threads exchange
+    // messages through lock-free queues (see network.c)
+
+    // maximum amount of network threads
+    #define NETWORK_THREADS_MAX  64
+
+    // amount of bytes received and not yet executed by the storage
+    // thread, a connection is not read anymore above this limit
+    #define NETWORK_INFLIGHT_MAX  1024 * 1024
+
+    // amount of connections accepted in a row by one thread
+    #define NETWORK_ACCEPT_BATCH  256
+
+    typedef enum net_message_type_t {
+        NET_OPEN,      // network: new connection
+        NET_REQUEST,   // network: commands received
+        NET_SENT,      // network: replies sent (or dropped), to be released
+        NET_HANGUP,    // network: connection lost
+        NET_CLOSED,    // network: connection released, last message of it
+        NET_REPLY,     // storage: replies to send
+        NET_CONSUMED,  // storage: commands executed, more can be received
+        NET_CLOSE,     // storage: client released, connection can be closed
+
+    } net_message_type_t;
+
+    // one argument of a received command, the payload is on the
+    // request buffer or, for large payload, allocated on its own
+    typedef struct net_argument_t {
+        size_t offset;    // payload offset on the request buffer
+        char *external;   // payload allocated outside of the buffer
+        int length;       // payload length (without trailing \r\n)
+        int spool;        // spool file descriptor (0 if not used)
+        uint32_t crc;     // crc32 of the streamed payload
+
+    } net_argument_t;
+
+    typedef struct net_command_t {
+        size_t first;     // first argument on the request arguments list
+        int argc;         // amount of arguments
+
+    } net_command_t;
+
+    // commands received at once on one connection, the request owns
+    // the receive buffer the arguments are pointing to
+    typedef struct net_request_t {
+        char *buffer;
+        size_t received;  // amount of bytes of theses commands
+
+        net_command_t *commands;
+        size_t count;
+        size_t allocated;
+
+        net_argument_t *arguments;
+        size_t argslength;
+        size_t argsallocated;
+
+        // protocol error found after the commands, the storage
+        // thread replies it then closes the connection
+        const char *error;
+
+        size_t executed;              // commands executed (storage side)
+        struct net_request_t *next;   // client requests queue (storage side)
+
+    } net_request_t;
+
+    typedef struct net_message_t {
+        net_message_type_t type;
+        struct net_conn_t *conn;
+
+        net_request_t *request;       // request received
+        redis_response_t *responses;  // replies to send (or sent)
+        redis_response_t *current;    // first reply not fully sent (network side)
+        size_t bytes;                 // replies bytes, or bytes consumed
+        size_t memory;                // part of replies bytes kept in memory
+
+        struct net_message_t *next;
+
+    } net_message_t;
+
+    // multiple producers, single consumer queue, producers push a
+    // chain of messages at once (lock-free stack), the consumer takes
+    // everything at once and reverse it, the eventfd is signaled when
+    // the queue becomes non-empty
+    typedef struct net_queue_t {
+        net_message_t *head;
+        int notifyfd;
+
+    } net_queue_t;
+
+    // messages produced by one thread for one queue, pushed at once
+    typedef struct net_batch_t {
+        net_message_t *newest;
+        net_message_t *oldest;
+
+    } net_batch_t;
+
+    typedef struct net_thread_t net_thread_t;
+
+    // one client connection, fields are either owned by the storage
+    // thread or by the network thread, never by both
+    typedef struct net_conn_t {
+        int fd;
+        net_thread_t *thread;
+        redis_client_t *client;   // storage: client (NULL when released)
+
+        // network: receive buffer, commands are parsed from start
+        char *buffer;
+        size_t allocated;         // buffer allocated size
+        size_t size;              // preferred buffer size (grows when pipelining)
+        size_t length;            // amount of bytes on the buffer
+        size_t start;             // first byte of the current command
+        size_t cursor;            // next header to parse
+
+        // network: current command, arguments parsed so far
+        int argc;                 // amount of arguments (0: array header expected)
+        int argi;                 // amount of arguments parsed
+        int argscap;
+        net_argument_t *args;
+        int filling;              // argument received outside of the buffer (-1: none)
+        size_t filled;            // amount of bytes received for it
+        size_t externals;         // bytes of the current command outside of the buffer
+
+        net_request_t *request;   // network: commands parsed, not shipped yet
+        net_message_t *replies;   // network: replies to send
+        net_message_t *repliestail;
+        size_t inflight;          // network: bytes shipped, not executed yet
+
+        int blocked;              // not read, too many bytes in flight
+        int hangup;               // connection lost (or failed), replies are dropped
+        int failed;               // protocol error, nothing is read anymore
+        int closed;               // released (on the network side)
+        int pending;              // linked on the thread ship list
+
+        struct net_conn_t *shipnext;
+        struct net_conn_t *next;  // connections of the thread
+        struct net_conn_t *prev;
+
+    } net_conn_t;
+
+    struct net_thread_t {
+        int id;
+        pthread_t thread;
+        int evfd;                 // epoll of this thread
+        int maxevents;            // adaptive amount of events fetched
+        int *listenfd;            // listening sockets (tcp: own socket, unix: shared)
+        int listenlen;
+        int reusefd;              // own tcp listening socket (-1: none, main one)
+        int stop;                 // requested to stop
+
+        net_queue_t inbox;        // messages from the storage thread
+        net_batch_t storagebatch; // messages for the storage thread (network side)
+        net_batch_t threadbatch;  // messages for this thread (storage side)
+
+        net_conn_t *conns;        // connections owned
+        net_conn_t *pending;      // connections with commands to ship
+    };
+
+    int network_start(redis_handler_t *handler);
+    resp_status_t network_process();
+    void network_flush();
+    void network_stop();
+
+    void network_reply(net_conn_t *conn, redis_response_t *responses, size_t bytes, size_t memory);
+    void network_consumed(net_conn_t *conn, size_t bytes);
+    void network_close(net_conn_t *conn);
+    void network_request_free(net_request_t *request);
+#endif
@@ -7,17 +7,29 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <time.h>
 #include <sys/time.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <stddef.h>
 #include <errno.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include "sockets.h"
 #include "libzdb.h"
 #include "zdbd.h"
 #include "redis.h"
+#include "resp_line.h"
+#include "scheduler.h"
+#include "network.h"
+#include "worker.h"
 #include "commands.h"
+#include "commands_replicate.h"
 
 // full protocol debug
 // this produce full dump of socket payload
@@ -45,14 +57,34 @@ static redis_clients_t clients = {
     .list = NULL,
 };
 
+// clients handled by a network thread (see below)
+static int redis_remote_flush(redis_client_t *client);
+static void redis_remote_defer(redis_client_t *client);
+static void redis_remote_release(redis_client_t *client);
+static resp_status_t redis_remote_read(redis_client_t *client);
+
 //
 // custom buffer
 //
 
+// client receive buffers are only allocated when the client send
+// something, and released when everything received was processed,
+// most of the clients are idle most of the time, they don't need
+// to keep a buffer
+//
+// buffers with the default size are kept on a pool to be reused, a
+// buffer is grown when a single read fills it (pipelining client)
+// up to a limit, grown buffers are not pooled
+
+// pool of default size buffers, linked with
+// their first bytes
+static char *buffers_pool = NULL;
+static size_t buffers_pooled = 0;
+
 // reset buffer to point like empty
 static void buffer_reset(buffer_t *buffer) {
     buffer->length = 0;
-    buffer->remain = REDIS_BUFFER_SIZE;
+    buffer->remain = buffer->size;
     buffer->reader = buffer->buffer;
     buffer->writer = buffer->buffer;
 }
@@ -68,7 +100,7 @@ static void buffer_shift(buffer_t *buffer) {
     pzdbd_debug("[+] redis: buffer shifting\n");
 
     buffer->length = buffer->writer - buffer->reader;
-    buffer->remain = REDIS_BUFFER_SIZE - buffer->length;
+    buffer->remain = buffer->size - buffer->length;
     memmove(buffer->buffer, buffer->reader, buffer->length);
 
     buffer->reader = buffer->buffer;
@@ -78,24 +110,74 @@ static void buffer_shift(buffer_t *buffer) {
 static buffer_t buffer_new() {
     buffer_t buffer;
 
-    // initializing empty buffer
+    // initializing empty buffer, memory will be
+    // allocated when data are received
+    buffer.buffer = NULL;
+    buffer.size = 0;
+    buffer.busy = 0;
     buffer_reset(&buffer);
 
-    // allocating memory
-    if(!(buffer.buffer = (char *) malloc(sizeof(char) * REDIS_BUFFER_SIZE))) {
-        zdbd_warnp("new client buffer malloc");
-        return buffer;
+    return buffer;
+}
+
+// allocate memory to an empty buffer
+static int buffer_acquire(buffer_t *buffer) {
+    if(buffers_pool) {
+        buffer->buffer = buffers_pool;
+        buffers_pool = *((char **) buffers_pool);
+        buffers_pooled -= 1;
+
+    } else if(!(buffer->buffer = (char *) malloc(sizeof(char) * REDIS_BUFFER_SIZE))) {
+        zdbd_warnp("client buffer malloc");
+        return 1;
     }
 
-    // reset pointer to the new buffer
-    buffer.reader = buffer.buffer;
-    buffer.writer = buffer.buffer;
+    buffer->size = REDIS_BUFFER_SIZE;
+    buffer_reset(buffer);
 
-    return buffer;
+    return 0;
+}
+
+// double the buffer size, keeping content
+static int buffer_grow(buffer_t *buffer) {
+    size_t size = buffer->size * 2;
+    char *newbuffer;
+
+    if(size > REDIS_BUFFER_MAX_SIZE)
+        return 1;
+
+    if(!(newbuffer = realloc(buffer->buffer, size))) {
+        zdbd_warnp("client buffer realloc");
+        return 1;
+    }
+
+    zdbd_debug("[+] redis: growing client buffer to %lu bytes\n", size);
+
+    buffer->reader = newbuffer + (buffer->reader - buffer->buffer);
+    buffer->writer = newbuffer + (buffer->writer - buffer->buffer);
+    buffer->remain += size - buffer->size;
+    buffer->buffer = newbuffer;
+    buffer->size = size;
+
+    return 0;
 }
 
+// release buffer memory, default sized buffers
+// are given back to the pool
 static void buffer_free(buffer_t *buffer) {
-    free(buffer->buffer);
+    if(buffer->size == REDIS_BUFFER_SIZE && buffers_pooled < REDIS_BUFFER_POOL) {
+        *((char **) buffer->buffer) = buffers_pool;
+        buffers_pool = buffer->buffer;
+        buffers_pooled += 1;
+
+    } else {
+        free(buffer->buffer);
+    }
+
+    buffer->buffer = NULL;
+    buffer->size = 0;
+    buffer->busy = 0;
+    buffer_reset(buffer);
 }
 
 //
@@ -105,23 +187,50 @@ static void buffer_free(buffer_t *buffer) {
 //
 // since sending responses to clients can take more than one send call
 // we need a way to deal with these clients without losing performance
-// for the other clients connected, while threading or any parallel execution
-// is prohibited by design in this project
+// for the other clients connected, while clients are always handled by a
+// single thread (network threads, when enabled, only move bytes, see network.c,
+// and namespaces workers only execute commands on their namespaces, see worker.c)
+//
+// each client have a queue of responses, replies are always appended to
+// that queue then the queue is flushed, with a single writev for all the
+// memory buffers pending
 //
-// when we need to send a response to a client, we try to do it without
-// any extra allocation, we just send data as it, if they was sent in one shot, there
-// is nothing more to do, otherwise we need to start queuing stuff
+// while a client request buffer is being processed, the client is 'corked':
+// replies are only queued and the queue is flushed once when all the commands
+// available were executed, a pipeline of hundred commands then produces one
+// single send syscall instead of one per reply
 //
-// if a queue for a client exists, we can't do our preliminary send anymore, since this
-// could break the protocol stream
+// small replies are not queued one by one, they are copied into a shared
+// chunk (the tail of the queue), which avoid allocations per reply and keep
+// the amount of iovec small
 //
 // the response object have a buffer, a reader pointer and a destruction function pointer
 // which is used to destroy the buffer when it's not needed anymore
+
+// responses objects (and chunks) freed are kept here
+// to be reused, this avoid malloc/free per reply
+//
+// replies are also produced by namespaces workers (see worker.c),
+// each thread have its own pools
+static __thread redis_response_t *responses_pool = NULL;
+static __thread size_t responses_pooled = 0;
+
+static __thread redis_response_t *chunks_pool = NULL;
+static __thread size_t chunks_pooled = 0;
+
 redis_response_t *redis_response_new(void *payload, size_t length, void (*destructor)(void *)) {
     redis_response_t *response;
 
-    if(!(response = calloc(sizeof(redis_response_t), 1)))
+    if(responses_pool) {
+        response = responses_pool;
+        responses_pool = response->next;
+        responses_pooled -= 1;
+
+        memset(response, 0, sizeof(redis_response_t));
+
+    } else if(!(response = calloc(sizeof(redis_response_t), 1))) {
         return NULL;
+    }
 
     response->buffer = payload;
     response->length = length;
@@ -131,22 +240,81 @@ redis_response_t *redis_response_new(void *payload, size_t length, void (*destru
     return response;
 }
 
+// create a chunk response, which is a response with an
+// internal buffer where small replies can be appended
+static redis_response_t *redis_response_chunk() {
+    redis_response_t *response;
+
+    if(chunks_pool) {
+        response = chunks_pool;
+        chunks_pool = response->next;
+        chunks_pooled -= 1;
+
+    } else {
+        if(!(response = calloc(sizeof(redis_response_t), 1)))
+            return NULL;
+
+        if(!(response->buffer = malloc(REDIS_RESPONSE_CHUNK))) {
+            free(response);
+            return NULL;
+        }
+
+        response->capacity = REDIS_RESPONSE_CHUNK;
+    }
+
+    response->reader = response->buffer;
+    response->length = 0;
+    response->next = NULL;
+
+    return response;
+}
+
 // clean the response object and call the destructor
 // if set, to clean the buffer
 void redis_response_free(redis_response_t *response) {
+    // chunk buffer is kept with the response
+    if(response->capacity > 0) {
+        if(chunks_pooled < REDIS_RESPONSE_CHUNKS_POOL) {
+            response->next = chunks_pool;
+            chunks_pool = response;
+            chunks_pooled += 1;
+            return;
+        }
+
+        free(response->buffer);
+        free(response);
+        return;
+    }
+
     if(response->destructor)
         response->destructor(response->buffer);
 
+    if(response->fd > 0)
+        close(response->fd);
+
+    if(responses_pooled < REDIS_RESPONSE_POOL) {
+        response->next = responses_pool;
+        responses_pool = response;
+        responses_pooled += 1;
+        return;
+    }
+
     free(response);
 }
 
 // add a response to the client responses queue
 void redis_response_push(redis_client_t *client, redis_response_t *response) {
+    response->next = NULL;
+    client->responsebytes += response->length;
+    client->produced += response->length;
+
+    if(response->fd <= 0)
+        client->responsememory += response->length;
+
     // no pending response was there, just point to the new one
     if(client->responses == NULL) {
         client->responses = response;
         client->responsetail = response;
-        response->next = NULL;
         return;
     }
 
@@ -156,6 +324,67 @@ void redis_response_push(redis_client_t *client, redis_response_t *response) {
     client->responsetail = response;
 }
 
+// remove the first response of the queue (fully sent)
+static void redis_response_pop(redis_client_t *client) {
+    redis_response_t *response = client->responses;
+
+    client->responses = response->next;
+    client->responsebytes -= response->length;
+
+    if(response->fd <= 0)
+        client->responsememory -= response->length;
+
+    // this was the last response, cleaning the tail
+    if(client->responses == NULL)
+        client->responsetail = NULL;
+
+    redis_response_free(response);
+}
+
+// copy a small payload at the end of the queue, using the last
+// chunk if there is enough room left, or a new chunk otherwise
+static int redis_response_append(redis_client_t *client, void *payload, size_t length) {
+    redis_response_t *tail = client->responsetail;
+
+    if(!tail || tail->capacity == 0 || (char *) tail->reader + tail->length + length > (char *) tail->buffer + tail->capacity) {
+        if(!(tail = redis_response_chunk())) {
+            zdbd_warnp("redis_response_append: malloc");
+            return 1;
+        }
+
+        redis_response_push(client, tail);
+    }
+
+    memcpy((char *) tail->reader + tail->length, payload, length);
+    tail->length += length;
+    client->responsebytes += length;
+    client->produced += length;
+    client->responsememory += length;
+
+    return 0;
+}
+
+// send one chunk of a file response, using sendfile when available
+// to avoid copying the payload into userspace
+static ssize_t redis_send_file(redis_client_t *client, redis_response_t *response) {
+    #ifdef __linux__
+    return sendfile(client->fd, response->fd, &response->offset, response->length);
+    #else
+    char buffer[REDIS_BUFFER_SIZE];
+    size_t chunk = (response->length > sizeof(buffer)) ? sizeof(buffer) : response->length;
+    ssize_t length;
+    ssize_t sent;
+
+    if((length = pread(response->fd, buffer, chunk, response->offset)) <= 0)
+        return -1;
+
+    if((sent = send(client->fd, buffer, length, 0)) > 0)
+        response->offset += sent;
+
+    return sent;
+    #endif
+}
+
 // try to send a response to a client, if succeed returns NULL
 // otherwise update reader on the response and returns it (there are more stuff
 // to do, but later, now client is busy)
@@ -165,7 +394,12 @@ redis_response_t *redis_send_response(redis_client_t *client, redis_response_t *
     while(response->length > 0) {
         zdbd_debug("[+] redis: sending reply to %d (%ld bytes remains)\n", client->fd, response->length);
 
-        if((sent = send(client->fd, response->reader, response->length, 0)) < 0) {
+        if(response->fd > 0)
+            sent = redis_send_file(client, response);
+        else
+            sent = send(client->fd, response->reader, response->length, 0);
+
+        if(sent < 0) {
             if(errno == EPIPE) {
                 zdbd_verbose("[-] dropping send request, client went away\n");
                 response->reader += response->length;
@@ -195,9 +429,12 @@ redis_response_t *redis_send_response(redis_client_t *client, redis_response_t *
         }
 
         // updating statistics
-        zdbd_rootsettings.stats.networktx += sent;
+        __atomic_fetch_add(&zdbd_rootsettings.stats.networktx, sent, __ATOMIC_RELAXED);
+
+        // file offset is updated by the file sender
+        if(response->fd <= 0)
+            response->reader += sent;
 
-        response->reader += sent;
         response->length -= sent;
     }
 
@@ -205,97 +442,188 @@ redis_response_t *redis_send_response(redis_client_t *client, redis_response_t *
     return NULL;
 }
 
-// callback called when a socket becomes available in write
-// this mean the client was waiting something (in theory), so let's
-// start sending the buffer/queue attached to that client
-resp_status_t redis_delayed_write(int fd) {
-    redis_client_t *client = clients.list[fd];
-    redis_response_t *response;
+// send all the memory buffers on the head of the queue
+// in a single writev call, returns amount of bytes sent
+static ssize_t redis_send_vector(redis_client_t *client) {
+    struct iovec iov[REDIS_RESPONSE_IOV];
+    int count = 0;
+    ssize_t sent;
 
-    if(!client || client->responses == NULL) {
-        zdbd_debug("[+] redis: nothing to send to client (fd: %d)\n", fd);
+    for(redis_response_t *response = client->responses; response && count < REDIS_RESPONSE_IOV; response = response->next) {
+        // file response, needs to be sent on it's own
+        if(response->fd > 0)
+            break;
+
+        if(response->length == 0)
+            continue;
+
+        iov[count].iov_base = response->reader;
+        iov[count].iov_len = response->length;
+        count += 1;
+    }
+
+    if(count == 0)
         return 0;
+
+    zdbd_debug("[+] redis: sending %d buffers to %d\n", count, client->fd);
+
+    if((sent = writev(client->fd, iov, count)) < 0)
+        return -1;
+
+    __atomic_fetch_add(&zdbd_rootsettings.stats.networktx, sent, __ATOMIC_RELAXED);
+
+    // discard what was sent from the queue
+    size_t remain = sent;
+
+    while(client->responses && client->responses->fd <= 0) {
+        redis_response_t *response = client->responses;
+
+        if(remain < response->length) {
+            response->reader += remain;
+            response->length -= remain;
+            client->responsebytes -= remain;
+            client->responsememory -= remain;
+            break;
+        }
+
+        remain -= response->length;
+        redis_response_pop(client);
     }
 
-    response = client->responses;
+    return sent;
+}
 
-    zdbd_debug("[+] redis: sending available buffer to socket %d\n", fd);
-    while(response) {
-        // sending this response
-        // if the send_response returns us something, then it
-        // was not fully sent, let's try again later, we are done for now
-        if(redis_send_response(client, response) != NULL)
-            return 0;
+// send as much as possible of the client responses queue
+// this stops when everything was sent or when the socket
+// is not ready anymore (the polling system will notify us
+// when we can write again)
+int redis_client_flush(redis_client_t *client) {
+    // socket is owned by a network thread
+    if(client->remote)
+        return redis_remote_flush(client);
 
-        // this response was successfuly sent
-        // let's remove it from the list and keep going
+    while(client->responses) {
+        redis_response_t *response = client->responses;
 
-        // saving the next pointer
-        redis_response_t *next = response->next;
+        if(response->fd > 0) {
+            size_t length = response->length;
+            redis_response_t *pending = redis_send_response(client, response);
 
-        // freeing this response
-        redis_response_free(response);
-        response = next;
+            client->responsebytes -= length - response->length;
 
-        // updating list
-        client->responses = next;
+            // file was not fully sent, let's try again later
+            if(pending != NULL)
+                return 0;
 
-        // this was the last response, cleaning the tail
-        if(next == NULL)
-            client->responsetail = NULL;
+            redis_response_pop(client);
+            continue;
+        }
+
+        if(redis_send_vector(client) < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                zdbd_debug("[-] redis: send: client %d is not ready for the send\n", client->fd);
+                return 0;
+            }
+
+            if(errno == EPIPE) {
+                zdbd_verbose("[-] dropping send request, client went away\n");
+
+            } else {
+                zdbd_warnp("redis_client_flush: writev");
+            }
+
+            // the socket is not usable anymore, nothing
+            // pending can be sent, discarding everything
+            while(client->responses)
+                redis_response_pop(client);
+
+            return 1;
+        }
     }
 
+    zdbd_debug("[+] redis: send: queue sucessfully sent\n");
     return 0;
 }
 
+// flush the queue now, except if the client is corked
+// in which case this will be done when the request buffer
+// was fully processed
+static int redis_client_reply(redis_client_t *client) {
+    if(client->corked)
+        return 0;
+
+    // replies are shipped at the end of the event loop iteration
+    if(client->remote) {
+        redis_remote_defer(client);
+        return 0;
+    }
+
+    return redis_client_flush(client);
+}
+
 // entry point when you want to send data to the client, and the buffer
 // was allocated on the heap (malloc), this function will just take the payload
-// create a response based on that, and send it (pushing on the queue if needed)
+// create a response based on that, and queue it
+//
+// small payload are copied into the queue and released right away
 int redis_reply_heap(redis_client_t *client, void *payload, size_t length, void (*destructor)(void *)) {
     redis_response_t *response;
 
+    if(length <= REDIS_RESPONSE_COALESCE) {
+        int value = redis_response_append(client, payload, length);
+
+        if(destructor)
+            destructor(payload);
+
+        if(value)
+            return 1;
+
+        return redis_client_reply(client);
+    }
+
     // create a response based on parameters
     if(!(response = redis_response_new(payload, length, destructor))) {
         zdbd_warnp("redis_reply_head: malloc");
-        return 1;
-    }
 
-    if(client->responses == NULL) {
-        // try to send this response a first time
-        if(redis_send_response(client, response) == NULL) {
-            pzdbd_debug("[+] redis: reply heap: send was made in single shot\n");
-            redis_response_free(response);
-            return 0;
-        }
+        if(destructor)
+            destructor(payload);
+
+        return 1;
     }
 
-    // we could not send that response this time, for some reason
-    // pushing this response to the client queue
     redis_response_push(client, response);
 
-    return 0;
+    return redis_client_reply(client);
 }
 
 // entry point when you want to send data to the client and the buffer
 // is stack allocated (hardcoded string, stack buffer, anything which can't be free'd
 // and can't be reached anymore when call is done)
 //
-// we first try to send it as it, and if this succeed, we're done, otherwise
-// we duplicate that data and push it to the client queue
+// small payload are copied into the queue, larger one are first sent as it
+// (if nothing is pending), and only duplicated if they could not be fully sent
 int redis_reply_stack(redis_client_t *client, void *payload, size_t length) {
     redis_response_t response;
 
+    if(length <= REDIS_RESPONSE_COALESCE) {
+        if(redis_response_append(client, payload, length))
+            return 1;
+
+        return redis_client_reply(client);
+    }
+
     response.buffer = payload;
     response.reader = payload;
     response.length = length;
     response.destructor = NULL;
+    response.capacity = 0;
+    response.fd = 0;
 
     // try to send this response a first time, without any extra allocation
-    // usually from the stack this will be enough
     //
     // this can only be done if nothing was pending, otherwise we will
     // break protocol serialization (some pending stuff needs to be sent before)
-    if(client->responses == NULL) {
+    if(!client->corked && !client->remote && client->responses == NULL) {
         if(redis_send_response(client, &response) == NULL) {
             pzdbd_debug("[+] redis: reply stack: no stack duplication needed\n");
             return 0;
@@ -308,30 +636,48 @@ int redis_reply_stack(redis_client_t *client, void *payload, size_t length) {
     redis_response_t *newresponse;
     void *copypayload;
 
-    // duplicate payload
-    if(!(copypayload = malloc(length)))
+    // duplicate payload (only what was not sent yet)
+    if(!(copypayload = malloc(response.length)))
         return 1;
 
-    memcpy(copypayload, payload, length);
+    memcpy(copypayload, response.reader, response.length);
 
-    if(!(newresponse = redis_response_new(copypayload, length, free)))
+    if(!(newresponse = redis_response_new(copypayload, response.length, free))) {
+        free(copypayload);
         return 1;
-
-    // maybe some part of the buffer was already sent
-    // but not everything, this means we need to reflect that change
-    // on the duplicated buffer we just made
-    if(response.reader != response.buffer) {
-        size_t difference = response.reader - response.buffer;
-        newresponse->reader += difference;
-        newresponse->length -= difference;
     }
 
     // pushing this response to the client queue
     redis_response_push(client, newresponse);
 
+    if(client->remote)
+        return redis_client_reply(client);
+
     return 0;
 }
 
+// entry point when you want to send a segment of a file to the client
+// (eg: a large payload from a datafile) without loading it in memory
+//
+// the file descriptor is owned by the response and will be closed
+// when the response is fully sent
+int redis_reply_file(redis_client_t *client, int fd, off_t offset, size_t length) {
+    redis_response_t *response;
+
+    if(!(response = redis_response_new(NULL, length, NULL))) {
+        zdbd_warnp("redis_reply_file: malloc");
+        close(fd);
+        return 1;
+    }
+
+    response->fd = fd;
+    response->offset = offset;
+
+    redis_response_push(client, response);
+
+    return redis_client_reply(client);
+}
+
 //
 // auto-bulk builder/responder
 //
@@ -387,29 +733,128 @@ static void resp_discard_real(redis_client_t *client, const char *message) {
 
 static void redis_free_request(resp_request_t *request) {
     for(int i = 0; i < request->argc; i++) {
-        // prematured end and argv was not yet allocated
-        if(!request->argv || !request->argv[i])
+        resp_object_t *argument = request->argv[i];
+
+        if(argument->spool > 0)
+            close(argument->spool);
+
+        if(argument->storage == RESP_STORAGE_HEAP)
+            free(argument->buffer);
+    }
+
+    // reset request, arguments objects and
+    // arena are kept for the next request
+    request->argc = 0;
+    request->arenaused = 0;
+}
+
+// ensure enough arguments objects are available for the request
+// and reset them, objects are only allocated when a request have more
+// arguments than any previous request of this client
+static int redis_request_prepare(resp_request_t *request, int argc) {
+    if(argc > request->capacity) {
+        int capacity = (request->capacity) ? request->capacity : REDIS_ARGUMENTS_INITIAL;
+        resp_object_t *objects;
+        resp_object_t **argv;
+
+        while(capacity < argc)
+            capacity *= 2;
+
+        zdbd_debug("[+] redis: resp: growing arguments list to %d\n", capacity);
+
+        if(!(objects = realloc(request->objects, sizeof(resp_object_t) * capacity)))
+            return 1;
+
+        request->objects = objects;
+
+        if(!(argv = realloc(request->argv, sizeof(resp_object_t *) * capacity)))
+            return 1;
+
+        request->argv = argv;
+        request->capacity = capacity;
+
+        for(int i = 0; i < capacity; i++)
+            request->argv[i] = &request->objects[i];
+    }
+
+    memset(request->objects, 0, sizeof(resp_object_t) * argc);
+    request->arenaused = 0;
+
+    return 0;
+}
+
+// allocate storage for an argument payload, small payload are
+// placed on the client arena, larger are allocated
+static int redis_argument_alloc(resp_request_t *request, resp_object_t *argument) {
+    // arena is only allocated when needed the first time
+    if(!request->arena)
+        request->arena = malloc(REDIS_ARENA_SIZE);
+
+    if(request->arena && request->arenaused + argument->size <= REDIS_ARENA_SIZE) {
+        argument->buffer = request->arena + request->arenaused;
+        argument->storage = RESP_STORAGE_ARENA;
+        request->arenaused += argument->size;
+
+        return 0;
+    }
+
+    if(!(argument->buffer = malloc(argument->size)))
+        return 1;
+
+    argument->storage = RESP_STORAGE_HEAP;
+
+    return 0;
+}
+
+// arguments pointing to the receive buffer needs to be moved
+// before the buffer is reused (new data received, buffer shifted)
+static int redis_request_pin(resp_request_t *request) {
+    if(request->state == RESP_EMPTY)
+        return 0;
+
+    for(int i = 0; i < request->fillin; i++) {
+        resp_object_t *argument = request->argv[i];
+        void *source = argument->buffer;
+
+        if(argument->storage != RESP_STORAGE_SLICE)
             continue;
 
-        free(request->argv[i]->buffer);
-        free(request->argv[i]);
+        if(redis_argument_alloc(request, argument)) {
+            zdbd_warnp("redis: argument pin");
+            return 1;
+        }
+
+        memcpy(argument->buffer, source, argument->size);
     }
 
-    free(request->argv);
+    return 0;
+}
 
-    // reset request
-    request->argc = 0;
-    request->argv = NULL;
+static int redis_buffer_shift(redis_client_t *client) {
+    if(redis_request_pin(client->request))
+        return 1;
+
+    buffer_shift(&client->buffer);
+
+    return 0;
+}
+
+// release memory used by the request arena, when client is closed
+static void redis_request_arena_free(resp_request_t *request) {
+    free(request->argv);
+    free(request->objects);
+    free(request->arena);
 }
 
 static resp_status_t redis_handle_resp_empty(redis_client_t *client) {
     resp_request_t *request = client->request;
     buffer_t *buffer = &client->buffer;
     char *match;
+    int argc;
 
     // checking if we have a new line character on the
     // request, if yes, we can parse this segment
-    if(!(match = memchr(buffer->reader, '\n', buffer->writer - buffer->reader))) {
+    if(!(match = resp_line_end(buffer->reader, buffer->writer))) {
         // the buffer seems full and we don't have
         // anything usable, let's try to shift the buffer
         // and hope next call will be usable
@@ -432,10 +877,10 @@ static resp_status_t redis_handle_resp_empty(redis_client_t *client) {
     }
 
     // reading the amount of arguments
-    request->argc = atoi(buffer->reader + 1);
-    zdbd_debug("[+] redis: resp: %d arguments\n", request->argc);
+    argc = resp_line_integer(buffer->reader, match);
+    zdbd_debug("[+] redis: resp: %d arguments\n", argc);
 
-    if(request->argc == 0) {
+    if(argc <= 0) {
         resp_discard(client, "Missing arguments");
         return RESP_STATUS_ABNORMAL;
     }
@@ -443,19 +888,21 @@ static resp_status_t redis_handle_resp_empty(redis_client_t *client) {
     // we don't have any command
     // with more than like 4 or 5 arguments
     // but let put a higher limit, just in case
-    if(request->argc > 1024) {
+    if(argc > 1024) {
         resp_discard(client, "Too many arguments");
         return RESP_STATUS_ABNORMAL;
     }
 
-    // allocating needed requests per arguments announced
+    // preparing arguments objects per arguments announced
     // (this is basicly why we limit the number or items)
-    if(!(request->argv = (resp_object_t **) calloc(sizeof(resp_type_t *), request->argc))) {
+    if(redis_request_prepare(request, argc)) {
         zdbd_warnp("request argv malloc");
         resp_discard(client, "Internal memory error");
         return RESP_STATUS_DISCARD;
     }
 
+    request->argc = argc;
+
     // next step if reading the first
     // header of the first argument
     request->state = RESP_FILLIN_HEADER;
@@ -465,6 +912,57 @@ static resp_status_t redis_handle_resp_empty(redis_client_t *client) {
     return RESP_STATUS_SUCCESS;
 }
 
+// payload larger than the maximum in-memory payload are only supported
+// for the value of a SET request, this value is then streamed to a spool
+// file while received, to keep memory usage constant
+static int redis_request_streamable(redis_client_t *client, resp_object_t *argument) {
+    resp_request_t *request = client->request;
+    resp_object_t *command = request->argv[0];
+    zdb_settings_t *settings = zdb_settings_get();
+
+    if(request->fillin != 2 || !client->ns)
+        return 0;
+
+    if(command->length != 3 || strncasecmp(command->buffer, "SET", 3) != 0)
+        return 0;
+
+    if(argument->length > ZDB_DATA_MAX_STREAM_PAYLOAD || (size_t) argument->length > settings->datasize)
+        return 0;
+
+    return 1;
+}
+
+// copy received data into the argument, either in memory
+// or into the spool file for streamed argument
+static int redis_argument_fill(resp_object_t *argument, char *source, size_t length) {
+    if(argument->spool <= 0) {
+        memcpy(argument->buffer + argument->filled, source, length);
+        argument->filled += length;
+        return 0;
+    }
+
+    // trailing \r\n is not part of the payload
+    size_t payload = 0;
+
+    if(argument->filled < argument->length) {
+        payload = argument->length - argument->filled;
+        payload = (payload > length) ? length : payload;
+    }
+
+    if(payload > 0) {
+        if(write(argument->spool, source, payload) != (ssize_t) payload) {
+            zdbd_warnp("redis: spool write");
+            return 1;
+        }
+
+        argument->crc = zdb_crc32_update(argument->crc, (uint8_t *) source, payload);
+    }
+
+    argument->filled += length;
+
+    return 0;
+}
+
 static resp_status_t redis_handle_resp_header(redis_client_t *client) {
     resp_request_t *request = client->request;
     buffer_t *buffer = &client->buffer;
@@ -478,12 +976,16 @@ static resp_status_t redis_handle_resp_header(redis_client_t *client) {
     }
 
     // waiting for a new line
-    if(!(match = memchr(buffer->reader, '\n', buffer->writer - buffer->reader))) {
+    if(!(match = resp_line_end(buffer->reader, buffer->writer))) {
         // the buffer seems full and we don't have
         // anything usable, let's try to shift the buffer
         // and hope next call will be usable
         if(buffer->remain == 0) {
-            buffer_shift(buffer);
+            if(redis_buffer_shift(client)) {
+                resp_discard(client, "Internal memory error");
+                return RESP_STATUS_DISCARD;
+            }
+
             return RESP_STATUS_RESET;
         }
 
@@ -497,31 +999,52 @@ static resp_status_t redis_handle_resp_header(redis_client_t *client) {
         return RESP_STATUS_ABNORMAL;
     }
 
-    if(!(request->argv[request->fillin] = calloc(sizeof(resp_object_t), 1))) {
-        zdbd_warnp("request argc calloc");
-        resp_discard(client, "Internal memory error");
-        return RESP_STATUS_DISCARD;
-    }
-
     resp_object_t *argument = request->argv[request->fillin];
+    size_t available = buffer->writer - (match + 1);
 
     // reading the length of the array
-    argument->length = atoi(buffer->reader + 1);
+    argument->length = resp_line_integer(buffer->reader, match);
     // real size is the length + 2 (\r\n)
     argument->size = argument->length + 2;
+    argument->type = STRING;
 
-    if(argument->length > REDIS_MAX_PAYLOAD) {
-        resp_discard(client, "Payload too big");
+    if(argument->length < 0) {
+        resp_discard(client, "Malformed query string");
         return RESP_STATUS_DISCARD;
     }
 
-    if(!(argument->buffer = (unsigned char *) malloc(argument->size))) {
-        zdbd_warnp("argument buffer malloc");
-        resp_discard(client, "Internal memory error");
-        return RESP_STATUS_DISCARD;
-    }
+    if(argument->length > REDIS_MAX_PAYLOAD) {
+        if(!redis_request_streamable(client, argument)) {
+            resp_discard(client, "Payload too big");
+            return RESP_STATUS_DISCARD;
+        }
 
-    argument->type = STRING;
+        zdbd_debug("[+] redis: resp: streaming %d bytes payload to spool\n", argument->length);
+
+        if((argument->spool = data_spool_open(client->ns->data)) < 0) {
+            argument->spool = 0;
+            resp_discard(client, "Internal spool error");
+            return RESP_STATUS_DISCARD;
+        }
+
+    } else if(available >= (size_t) argument->size) {
+        // the whole argument is already received, no need
+        // to copy it, argument points directly to the buffer
+        argument->buffer = match + 1;
+        argument->storage = RESP_STORAGE_SLICE;
+        argument->filled = argument->size;
+
+        buffer->reader = match + 1 + argument->size;
+        request->fillin += 1;
+        request->state = RESP_FILLIN_HEADER;
+
+        return RESP_STATUS_CONTINUE;
+
+    } else if(redis_argument_alloc(request, argument)) {
+        zdbd_warnp("argument buffer malloc");
+        resp_discard(client, "Internal memory error");
+        return RESP_STATUS_DISCARD;
+    }
 
     buffer->reader = match + 1; // set reader after the \n
     request->state = RESP_FILLIN_PAYLOAD;
@@ -542,7 +1065,11 @@ static resp_status_t redis_handle_resp_payload(redis_client_t *client) {
         // anything usable, let's try to shift the buffer
         // and hope next call will be usable
         if(buffer->remain == 0) {
-            buffer_shift(buffer);
+            if(redis_buffer_shift(client)) {
+                resp_discard(client, "Internal memory error");
+                return RESP_STATUS_DISCARD;
+            }
+
             return RESP_STATUS_RESET;
         }
 
@@ -561,11 +1088,12 @@ static resp_status_t redis_handle_resp_payload(redis_client_t *client) {
 
     if(available >= needed) {
         pzdbd_debug("[+] redis: more (or equals) available/needed, extracting needed\n");
-        void *argbuf = argument->buffer + argument->filled;
-        memcpy(argbuf, buffer->reader, needed);
+        if(redis_argument_fill(argument, buffer->reader, needed)) {
+            resp_discard(client, "Internal spool error");
+            return RESP_STATUS_DISCARD;
+        }
 
         // let update counters
-        argument->filled += needed;
         request->fillin += 1;
         request->state = RESP_FILLIN_HEADER;
         buffer->reader += needed;
@@ -588,8 +1116,10 @@ static resp_status_t redis_handle_resp_payload(redis_client_t *client) {
     // to fill the complete payload, let's take everything available
     // and place it on the request buffer, reseting source buffer
     // and waiting for more data to come (by the caller)
-    memcpy(argument->buffer + argument->filled, buffer->reader, available);
-    argument->filled += available;
+    if(redis_argument_fill(argument, buffer->reader, available)) {
+        resp_discard(client, "Internal spool error");
+        return RESP_STATUS_DISCARD;
+    }
 
     pzdbd_debug("[+] redis: resetting buffer\n");
     buffer_reset(&client->buffer);
@@ -613,6 +1143,14 @@ static inline int redis_handle_resp_ownerid(redis_client_t *client) {
     // this comes from a replication client
     // extracting the owner id (which is the last argument)
     // and checking if it's a replay of our own database
+    //
+    // a request without any argument besides the owner id
+    // can't be executed, dropping it
+    if(client->request->argc < 2) {
+        zdbd_debug("[-] redis: owner check: request without command, dropping\n");
+        return 1;
+    }
+
     resp_object_t *ownobj = client->request->argv[client->request->argc - 1];
     if(ownobj->length > 32) {
         zdbd_debug("[-] redis: owner check: malformed owner, id is too long, dropping\n");
@@ -637,8 +1175,12 @@ static inline int redis_handle_resp_ownerid(redis_client_t *client) {
     // okay, let's pop this request from original object
     // so this request will looks like an original request
     client->request->argc -= 1;
-    free(ownobj->buffer);
-    free(ownobj);
+
+    if(ownobj->storage == RESP_STORAGE_HEAP)
+        free(ownobj->buffer);
+
+    ownobj->buffer = NULL;
+    ownobj->storage = RESP_STORAGE_NONE;
 
     // this is a valid replication, let's proceed it and
     // propagate the ownerid
@@ -648,6 +1190,8 @@ static inline int redis_handle_resp_ownerid(redis_client_t *client) {
 
 static resp_status_t redis_handle_resp_finished(redis_client_t *client) {
     resp_request_t *request = client->request;
+    size_t produced = client->produced;
+    size_t received = 0;
     int value = 0;
 
     // setting the request ownerid
@@ -659,10 +1203,22 @@ static resp_status_t redis_handle_resp_finished(redis_client_t *client) {
         return 1;
     }
 
+    for(int i = 0; i < request->argc; i++)
+        received += request->argv[i]->length;
+
     zdbd_debug("[+] redis: request parsed, calling dispatcher\n");
     value = redis_dispatcher(client);
     zdbd_debug("[+] redis: dispatcher done, return code: %d\n", value);
 
+    // command handed to the worker owning the namespace, the request
+    // is kept until the worker is done (see redis_routed_done)
+    if(value == RESP_STATUS_ROUTED)
+        return value;
+
+    // command accounted on the client quantum and on the
+    // namespace (statistics and rate limits)
+    scheduler_charge(client, received + (client->produced - produced));
+
     zdbd_debug("[+] redis: calling posthandler\n");
     redis_posthandler_client(client);
 
@@ -676,60 +1232,80 @@ static resp_status_t redis_handle_resp_finished(redis_client_t *client) {
     return value;
 }
 
-// function called as soon as something is available on
-// one client socket
-resp_status_t redis_chunk_read(int fd) {
-    redis_client_t *client = clients.list[fd];
+// large payload still expected are received directly into the
+// argument, without going through the client buffer, this is only
+// possible when everything available on the buffer was consumed
+static resp_object_t *redis_request_direct(redis_client_t *client) {
     resp_request_t *request = client->request;
     buffer_t *buffer = &client->buffer;
-    ssize_t length;
+    resp_object_t *argument;
 
-    // default return value
-    int value = RESP_STATUS_SUCCESS;
+    if(request->state != RESP_FILLIN_PAYLOAD || buffer->reader != buffer->writer)
+        return NULL;
 
-go_again:
-    // buffer is full, this is probably a bug
-    if(buffer->remain == 0) {
-        zdbd_debug("[-] resp: new chunk requested and buffer full\n");
-        return RESP_STATUS_DISCARD;
-    }
+    argument = request->argv[request->fillin];
 
-    pzdbd_debug("[+] redis: perform read on the socket\n");
-    if((length = recv(fd, buffer->writer, buffer->remain, 0)) < 0) {
-        if(errno != EAGAIN && errno != EWOULDBLOCK) {
-            zdbd_warnp("client recv");
-            return RESP_STATUS_ABNORMAL;
-        }
+    // streamed argument are written to a spool file
+    if(argument->spool > 0)
+        return NULL;
 
-        // we hit a EGAIN or EWOULDBLOCK, nothing wrong here,
-        // this is probably because the request was done
-        // and nothing more is available on the socket, let's
-        // return the caller the value we received from the
-        // process (or success if nothing was done)
-        return value;
-    }
+    if((size_t) (argument->size - argument->filled) < REDIS_BUFFER_SIZE)
+        return NULL;
 
-    if(length == 0) {
-        // socket was empty
-        // this is probably a connection reset by peer
-        // let's disconnect this client
-        zdbd_debug("[+] resp: empty socket read, client disconnected\n");
-        return RESP_STATUS_DISCONNECTED;
+    return argument;
+}
+
+// data received directly into an argument
+static resp_status_t redis_handle_resp_direct(redis_client_t *client, resp_object_t *argument, size_t length) {
+    resp_request_t *request = client->request;
+
+    argument->filled += length;
+
+    if(argument->filled < argument->size)
+        return RESP_STATUS_CONTINUE;
+
+    request->fillin += 1;
+    request->state = RESP_FILLIN_HEADER;
+
+    if(request->fillin == request->argc) {
+        pzdbd_debug("[+] redis: request completed, executing\n");
+        return redis_handle_resp_finished(client);
     }
 
-    // updating statistics
-    zdbd_rootsettings.stats.networkrx += length;
+    return RESP_STATUS_CONTINUE;
+}
 
-    buffer->writer += length;
-    buffer->length += length;
-    buffer->remain -= length;
+// checking replies pending after each command executed, replies are
+// sent if possible and if too much is still pending, the client is not
+// read anymore until enough was sent (see redis_delayed_write)
+//
+// a client keeping too much replies in memory is disconnected
+static resp_status_t redis_client_output_check(redis_client_t *client) {
+    if(client->responsebytes < REDIS_OUTPUT_HIGHWATER)
+        return RESP_STATUS_SUCCESS;
 
-    #ifdef PROTOCOL_DEBUG
-    zdbd_fulldump((uint8_t *) buffer->buffer, buffer->length);
-    #endif
+    redis_client_flush(client);
 
-    // ensure string (needed for testing later)
-    // buffer->buffer[buffer->length] = '\0';
+    if(client->responsememory > REDIS_OUTPUT_HARDLIMIT) {
+        zdbd_log("[-] redis: client %d: output limit reached (%zu bytes), dropping it\n", client->fd, client->responsememory);
+        zdbd_rootsettings.stats.clientsdropped += 1;
+        return RESP_STATUS_DISCARD;
+    }
+
+    if(client->responsebytes >= REDIS_OUTPUT_HIGHWATER) {
+        zdbd_debug("[+] redis: client %d: %zu bytes pending, pausing\n", client->fd, client->responsebytes);
+        zdbd_rootsettings.stats.clientspaused += 1;
+        client->paused = 1;
+    }
+
+    return RESP_STATUS_SUCCESS;
+}
+
+// parse and execute everything available on the client buffer
+static resp_status_t redis_buffer_parse(redis_client_t *client) {
+    resp_request_t *request = client->request;
+    buffer_t *buffer = &client->buffer;
+    int value = RESP_STATUS_SUCCESS;
 
     // while we didn't parsed everything available
     // on the buffer
@@ -741,6 +1317,11 @@ go_again:
         // data are available to build the request and if
         // the data is well formated
         if(request->state == RESP_EMPTY) {
+            // quantum exhausted or namespace throttled, the client waits
+            // its turn, the rest of the buffer will be parsed when resumed
+            if(!scheduler_admit(client))
+                break;
+
             if((value = redis_handle_resp_empty(client)) != RESP_STATUS_SUCCESS) {
                 // it looks like we didn't had enough data
                 // or data was not correctly formated (unexpected data)
@@ -785,9 +1366,117 @@ go_again:
         if(request->fillin == request->argc) {
             pzdbd_debug("[+] redis: request completed, executing\n");
             value = redis_handle_resp_finished(client);
+
+            // command executed by a worker, the rest of the
+            // buffer will be parsed when it's done
+            if(client->routed)
+                break;
+
+            if(redis_client_output_check(client) != RESP_STATUS_SUCCESS)
+                return RESP_STATUS_DISCARD;
+
+            // too many replies pending, the rest of the
+            // buffer will be parsed when the client resumes
+            if(client->paused)
+                break;
+        }
+    }
+
+    return value;
+}
+
+static resp_status_t redis_chunk_process(int fd) {
+    redis_client_t *client = clients.list[fd];
+    resp_request_t *request = client->request;
+    buffer_t *buffer = &client->buffer;
+    resp_object_t *direct;
+    ssize_t length;
+    size_t requested;
+    char *target;
+
+    // default return value
+    int value = RESP_STATUS_SUCCESS;
+
+go_again:
+    // arguments of the current request pointing to the buffer
+    // needs to be moved before receiving new data
+    if(redis_request_pin(request)) {
+        resp_discard(client, "Internal memory error");
+        return RESP_STATUS_DISCARD;
+    }
+
+    // buffer memory is only allocated when needed
+    if(!buffer->buffer && buffer_acquire(buffer)) {
+        resp_discard(client, "Internal memory error");
+        return RESP_STATUS_DISCARD;
+    }
+
+    // a resumed client (paused or waiting its turn) could have
+    // parsed a full buffer, it can be reused from the beginning
+    if(buffer->reader == buffer->writer)
+        buffer_reset(buffer);
+
+    // buffer is full without a complete line, growing it
+    // if still possible, otherwise discarding this client
+    if(buffer->remain == 0 && buffer_grow(buffer)) {
+        zdbd_debug("[-] resp: new chunk requested and buffer full\n");
+        return RESP_STATUS_DISCARD;
+    }
+
+    pzdbd_debug("[+] redis: perform read on the socket\n");
+    target = buffer->writer;
+    requested = buffer->remain;
+
+    if((direct = redis_request_direct(client))) {
+        target = direct->buffer + direct->filled;
+        requested = direct->size - direct->filled;
+    }
+
+    if((length = recv(fd, target, requested, 0)) < 0) {
+        if(errno != EAGAIN && errno != EWOULDBLOCK) {
+            zdbd_warnp("client recv");
+            return RESP_STATUS_ABNORMAL;
         }
+
+        // we hit a EGAIN or EWOULDBLOCK, nothing wrong here,
+        // this is probably because the request was done
+        // and nothing more is available on the socket, let's
+        // return the caller the value we received from the
+        // process (or success if nothing was done)
+        return value;
+    }
+
+    if(length == 0) {
+        // socket was empty
+        // this is probably a connection reset by peer
+        // let's disconnect this client
+        zdbd_debug("[+] resp: empty socket read, client disconnected\n");
+        return RESP_STATUS_DISCONNECTED;
+    }
+
+    // updating statistics
+    __atomic_fetch_add(&zdbd_rootsettings.stats.networkrx, length, __ATOMIC_RELAXED);
+
+    if(direct) {
+        pzdbd_debug("[+] redis: %ld bytes received directly into argument\n", length);
+        value = redis_handle_resp_direct(client, direct, length);
+        goto received;
     }
 
+    buffer->writer += length;
+    buffer->length += length;
+    buffer->remain -= length;
+
+    #ifdef PROTOCOL_DEBUG
+    zdbd_fulldump((uint8_t *) buffer->buffer, buffer->length);
+    #endif
+
+    // ensure string (needed for testing later)
+    // buffer->buffer[buffer->length] = '\0';
+
+    value = redis_buffer_parse(client);
+
+received:
     // do not keep going on this request/client
     if(value == RESP_STATUS_DISCARD || value == RESP_STATUS_DISCONNECTED) {
         pzdbd_debug("[+] redis: discard or disconnected received\n");
@@ -800,304 +1489,1404 @@ go_again:
         return value;
     }
 
-    // not suceed, let's try again
-    if(value != RESP_STATUS_SUCCESS) {
-        pzdbd_debug("[+] redis: parsing didn't suceed, trying again\n");
-        goto go_again;
-    }
+    // command executed by a worker, arguments can point to the
+    // buffer, nothing is read until it's done (see worker.c)
+    if(client->routed) {
+        pzdbd_debug("[+] redis: client command routed\n");
+        return value;
+    }
+
+    // output backpressure, nothing more is read from this
+    // client until enough replies were sent
+    if(client->paused) {
+        pzdbd_debug("[+] redis: client paused\n");
+        return value;
+    }
+
+    // client is waiting its turn (see scheduler.c), nothing
+    // more is read until it's resumed by the scheduler
+    if(client->scheduler) {
+        pzdbd_debug("[+] redis: client waiting its turn\n");
+        return value;
+    }
+
+    // the socket returned less than what we asked, the socket
+    // receive queue was empty, there is no need to call recv again
+    // only to get an EAGAIN, any new data will trigger a new event
+    if((size_t) length < requested) {
+        pzdbd_debug("[+] redis: socket drained\n");
+        return value;
+    }
+
+    // the whole buffer was filled, more data are probably still
+    // pending on the socket, since events are edge-triggered, we
+    // won't be notified again for them, let's read again
+    //
+    // if everything was parsed, we can reuse the full buffer
+    //
+    // arguments still pointing to the buffer are moved first
+    if(redis_request_pin(request)) {
+        resp_discard(client, "Internal memory error");
+        return RESP_STATUS_DISCARD;
+    }
+
+    if(buffer->reader == buffer->writer)
+        buffer_reset(buffer);
+
+    // a single read was not enough, more data are pending, growing
+    // the buffer to read more in one shot (pipelining client)
+    if(!direct) {
+        buffer->busy = 1;
+        buffer_grow(buffer);
+    }
+
+    // sending replies already available, to not keep
+    // the whole pipeline responses in memory
+    redis_client_flush(client);
+
+    pzdbd_debug("[+] redis: buffer filled, reading again\n");
+    goto go_again;
+}
+
+// function called as soon as something is available on
+// one client socket
+//
+// the client is corked while processing what's available, all
+// the replies are sent at once when everything was executed
+resp_status_t redis_chunk_read(int fd) {
+    redis_client_t *client = clients.list[fd];
+    resp_status_t value;
+
+    // client released while handling another event of the
+    // same batch (a command done by a worker, see worker.c)
+    if(!client)
+        return RESP_STATUS_SUCCESS;
+
+    // output backpressure, data are kept on the socket until
+    // the client is resumed (see redis_delayed_write), same for a
+    // client waiting its turn (see redis_scheduler_process) or
+    // waiting for a worker (see redis_routed_resume)
+    if(client->paused || client->scheduler || client->routed)
+        return RESP_STATUS_SUCCESS;
+
+    // new quantum, except when resumed by the scheduler
+    // which already granted one
+    if(!client->granted)
+        scheduler_grant(client);
+
+    client->corked = 1;
+    value = redis_chunk_process(fd);
+    client->corked = 0;
+    client->granted = 0;
+
+    redis_client_flush(client);
+
+    // everything received was processed, the buffer is not needed
+    // anymore, except if it was filled (the client is probably still
+    // busy sending us data), it will be released next time
+    if(client->request->state == RESP_EMPTY && client->buffer.reader == client->buffer.writer) {
+        if(!client->buffer.busy)
+            buffer_free(&client->buffer);
+
+        client->buffer.busy = 0;
+    }
+
+    return value;
+}
+
+// continue a client which was not read for a while, commands already
+// received are executed first, then the socket is read again, data
+// pending on the socket won't trigger a new (edge-triggered) event
+static resp_status_t redis_client_continue(redis_client_t *client) {
+    resp_status_t value;
+
+    // commands were already received by the network thread
+    if(client->remote)
+        return redis_remote_read(client);
+
+    client->corked = 1;
+    value = redis_buffer_parse(client);
+    client->corked = 0;
+
+    redis_client_flush(client);
+
+    if(value == RESP_STATUS_DISCARD || value == RESP_STATUS_DISCONNECTED)
+        return value;
+
+    if(value == RESP_STATUS_DONE || value == RESP_STATUS_SHUTDOWN)
+        return value;
+
+    if(client->paused || client->routed)
+        return value;
+
+    return redis_chunk_read(client->fd);
+}
+
+// resume a client paused by output backpressure
+static resp_status_t redis_client_resume(redis_client_t *client) {
+    zdbd_debug("[+] redis: client %d: %zu bytes pending, resuming\n", client->fd, client->responsebytes);
+
+    client->paused = 0;
+
+    // the client continues when its command is done
+    if(client->routed)
+        return RESP_STATUS_SUCCESS;
+
+    return redis_client_continue(client);
+}
+
+// command executed by a worker (see worker.c), replies produced are
+// appended to the client queue and what's done after each command
+// (accounting, mirroring, watchers) is done here, on the main thread
+void redis_routed_done(redis_client_t *client, redis_client_t *shadow) {
+    resp_request_t *request = client->request;
+    size_t received = 0;
+
+    if(shadow->responses) {
+        if(client->responsetail)
+            client->responsetail->next = shadow->responses;
+        else
+            client->responses = shadow->responses;
+
+        client->responsetail = shadow->responsetail;
+    }
+
+    client->responsebytes += shadow->responsebytes;
+    client->responsememory += shadow->responsememory;
+    client->produced += shadow->produced;
+
+    for(int i = 0; i < request->argc; i++)
+        received += request->argv[i]->length;
+
+    scheduler_charge(client, received + shadow->produced);
+
+    zdbd_debug("[+] redis: routed command done, calling posthandler\n");
+    redis_posthandler_client(client);
+
+    redis_free_request(request);
+    request->state = RESP_EMPTY;
+}
+
+// continue a client after its command was executed by a worker, this
+// is the end of the command as if it was executed in place
+resp_status_t redis_routed_resume(redis_client_t *client, int value) {
+    client->routed = 0;
+
+    // client went away in the meantime, it can be released now
+    if(client->dropped)
+        return RESP_STATUS_DISCONNECTED;
+
+    if(value == RESP_STATUS_DISCARD || value == RESP_STATUS_DISCONNECTED)
+        return value;
+
+    if(redis_client_output_check(client) != RESP_STATUS_SUCCESS)
+        return RESP_STATUS_DISCARD;
+
+    if(client->paused) {
+        redis_client_flush(client);
+        return RESP_STATUS_SUCCESS;
+    }
+
+    return redis_client_continue(client);
+}
+
+// resume clients waiting their turn on their namespace queue, one
+// client per namespace is resumed, namespaces throttled are skipped
+//
+// timeout is set to the time (ms) needed before some clients can be
+// resumed again (0 if some are ready, -1 if nobody is waiting)
+resp_status_t redis_scheduler_process(int *timeout) {
+    redis_client_t *client;
+
+    scheduler_round();
+
+    while((client = scheduler_next())) {
+        int fd = client->fd;
+        resp_status_t value = redis_client_resume(client);
+
+        if(value == RESP_STATUS_DISCARD || value == RESP_STATUS_DISCONNECTED) {
+            socket_client_free(fd);
+            continue;
+        }
+
+        if(value == RESP_STATUS_SHUTDOWN)
+            return value;
+
+        // quantum not used on this turn is lost, the
+        // client is not granted anymore
+        clients.list[fd]->granted = 0;
+    }
+
+    *timeout = scheduler_timeout();
+
+    return RESP_STATUS_SUCCESS;
+}
+
+// callback called when a socket becomes available in write
+// this mean the client was waiting something (in theory), so let's
+// start sending the buffer/queue attached to that client
+//
+// a client paused by output backpressure is resumed from here, the
+// returned status needs to be handled like a read status
+resp_status_t redis_delayed_write(int fd) {
+    redis_client_t *client = clients.list[fd];
+
+    if(!client)
+        return 0;
+
+    if(client->responses == NULL) {
+        zdbd_debug("[+] redis: nothing to send to client (fd: %d)\n", fd);
+
+    } else {
+        zdbd_debug("[+] redis: sending available buffer to socket %d\n", fd);
+        redis_client_flush(client);
+    }
+
+    if(client->paused && client->responsebytes < REDIS_OUTPUT_LOWWATER)
+        return redis_client_resume(client);
+
+    return 0;
+}
+
+void socket_nonblock(int fd) {
+    int flags;
+
+    if((flags = fcntl(fd, F_GETFL, 0)) < 0)
+        zdbd_diep("fcntl");
+
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+void socket_keepalive(int fd) {
+    int optval = 1;
+
+    if(setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval)) < 0)
+        zdbd_warnp("setsockopt: keepalive");
+}
+
+// disable nagle algorithm, responses are already built to be sent
+// in a single call when possible, but some responses are sent in
+// multiple parts (eg: streamed payload, mget), without this, the last
+// small part could be delayed until the client acknowledge the previous one
+void socket_nodelay(int fd) {
+    int optval = 1;
+
+    if(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval)) < 0) {
+        // unix socket client, option doesn't apply
+        if(errno == EOPNOTSUPP || errno == ENOPROTOOPT)
+            return;
+
+        zdbd_warnp("setsockopt: nodelay");
+    }
+}
+
+// allocate a new client for a new file descriptor
+// used to keep session-live information about clients
+redis_client_t *socket_client_new(int fd) {
+    zdbd_debug("[+] new client (fd: %d)\n", fd);
+
+    if(fd >= (int) clients.length) {
+        redis_client_t **newlist = NULL;
+        size_t newlength = clients.length + fd;
+
+        // growing the list
+        if(!(newlist = (redis_client_t **) realloc(clients.list, sizeof(redis_client_t *) * newlength)))
+            return NULL;
+
+        // ensure new clients are not set
+        for(size_t i = clients.length; i < newlength; i++)
+            newlist[i] = NULL;
+
+        // increase client list
+        clients.list = newlist;
+        clients.length = newlength;
+    }
+
+    redis_client_t *client = NULL;
+
+    // not using calloc to ensure everything is set to
+    // default value by ourself and nothing is forget
+    if(!(client = malloc(sizeof(redis_client_t)))) {
+        zdbd_warnp("new client malloc");
+        return NULL;
+    }
+
+    client->fd = fd;
+    client->connected = time(NULL);
+    client->commands = 0;
+    client->executed = NULL;
+    client->watching = NULL;
+    client->watchdeadline = 0;
+    client->mirror = 0;
+    client->mirrorack = 0;
+    client->mirroracked = 0;
+    client->master = 0;
+    client->nonce = NULL;
+
+    // not linked on any list
+    memset(&client->watchlink, 0, sizeof(redis_link_t));
+    memset(&client->timerlink, 0, sizeof(redis_link_t));
+    memset(&client->mirrorlink, 0, sizeof(redis_link_t));
+    memset(&client->followlink, 0, sizeof(redis_link_t));
+
+    // not following any changes
+    memset(&client->follow, 0, sizeof(redis_follow_t));
+
+    // buffer memory is allocated on first read
+    client->buffer = buffer_new();
+
+    // allocate a single request object
+    if(!(client->request = (resp_request_t *) malloc(sizeof(resp_request_t)))) {
+        zdbd_warnp("new client request malloc");
+        free(client);
+        return NULL;
+    }
+
+    // no pending responses
+    client->responses = NULL;
+    client->responsebytes = 0;
+    client->responsememory = 0;
+    client->responsetail = NULL;
+    client->paused = 0;
+
+    // not waiting on any scheduler queue
+    client->scheduler = NULL;
+    client->schedlink.next = NULL;
+    client->schedlink.prev = NULL;
+    client->granted = 0;
+    client->grantops = 0;
+    client->grantbytes = 0;
+    client->produced = 0;
+
+    // socket owned by the main thread, this
+    // is set for network threads connections
+    client->remote = NULL;
+    client->inbox = NULL;
+    client->inboxtail = NULL;
+    client->shippedbytes = 0;
+    client->shippedmemory = 0;
+    memset(&client->shiplink, 0, sizeof(redis_link_t));
+    client->shipping = 0;
+
+    // replies are sent right away when possible
+    client->corked = 0;
+
+    // no command executed by a worker
+    client->job = NULL;
+    client->routed = 0;
+    client->dropped = 0;
+
+    client->request->state = RESP_EMPTY;
+    client->request->argc = 0;
+    client->request->argv = NULL;
+    client->request->objects = NULL;
+    client->request->capacity = 0;
+    client->request->arena = NULL;
+    client->request->arenaused = 0;
+
+    // attach default namespace to this client
+    client->ns = namespace_get_default();
+
+    // by default, the default namespace is writable
+    // except if protect mode is enabled
+    client->writable = (zdbd_rootsettings.protect) ? 0 : 1;
+
+    // set all users to admin if no password are set
+    client->admin = (zdbd_rootsettings.adminpwd) ? 0 : 1;
+
+    // set client to the list
+    clients.list[fd] = client;
+
+    // update statistics
+    zdbd_rootsettings.stats.clients += 1;
+
+    return client;
+}
+
+// free allocated client when disconnected
+void socket_client_free(int fd) {
+    redis_client_t *client = clients.list[fd];
+
+    // already released while handling another event
+    // of the same batch (see redis_chunk_read)
+    if(!client)
+        return;
+
+    // command still executed by a worker, its request is still used,
+    // the client is released when it's done (see redis_routed_resume)
+    if(client->routed) {
+        zdbd_debug("[+] client: closing (fd: %d), command pending\n", fd);
+        client->dropped = 1;
+        return;
+    }
+
+    zdbd_debug("[+] client: closing (fd: %d)\n", fd);
+
+    #ifndef RELEASE
+    double elapsed = difftime(time(NULL), client->connected);
+    zdbd_debug("[+] client: stayed %.f seconds, %lu commands\n", elapsed, client->commands);
+    #endif
+
+    // closing socket, a network thread socket is
+    // closed by the thread owning it
+    if(client->remote)
+        redis_remote_release(client);
+    else
+        close(client->fd);
+
+    // removing client from watchers, mirrors and followers lists
+    redis_client_unset_watcher(client);
+    redis_client_unset_mirror(client);
+    redis_client_unset_follower(client);
+    scheduler_cancel(client);
+
+    // discarding pending responses
+    while(client->responses) {
+        redis_response_t *next = client->responses->next;
+        redis_response_free(client->responses);
+        client->responses = next;
+    }
+
+    // cleaning client memory usage
+    redis_free_request(client->request);
+    redis_request_arena_free(client->request);
+    buffer_free(&client->buffer);
+
+    free(client->nonce);
+    free(client->request);
+    free(client->job);
+    free(client);
+
+    // allow new client on this spot
+    clients.list[fd] = NULL;
+
+    // maybe we could reduce the list usage now
+}
+
+// sum the output pending of all the clients, the largest
+// ones (up to count) are set on the largest list, ordered
+//
+// returns amount of clients connected
+size_t redis_clients_output(redis_output_t *total, redis_output_t *largest, size_t count) {
+    size_t connected = 0;
+    size_t found = 0;
+
+    memset(total, 0, sizeof(redis_output_t));
+    total->fd = -1;
+
+    for(size_t i = 0; i < clients.length; i++) {
+        redis_client_t *client;
+
+        if(!(client = clients.list[i]))
+            continue;
+
+        redis_output_t output = {
+            .fd = client->fd,
+            .bytes = client->responsebytes,
+            .memory = client->responsememory,
+            .paused = client->paused,
+        };
+
+        connected += 1;
+        total->bytes += output.bytes;
+        total->memory += output.memory;
+        total->paused += output.paused;
+
+        if(output.bytes == 0)
+            continue;
+
+        // insert sort, the list is small
+        size_t position = (found < count) ? found : count;
+
+        while(position > 0 && largest[position - 1].bytes < output.bytes) {
+            if(position < count)
+                largest[position] = largest[position - 1];
+
+            position -= 1;
+        }
+
+        if(position < count) {
+            largest[position] = output;
+
+            if(found < count)
+                found += 1;
+        }
+    }
+
+    // marking the end of the list
+    if(found < count)
+        largest[found].fd = -1;
+
+    return connected;
+}
+
+// walk over all clients and match them by provided namespace
+// if they matches, move them to a special state, waiting
+// for disconnection (with alert)
+int redis_detach_clients(namespace_t *namespace) {
+    for(size_t i = 0; i < clients.length; i++) {
+        if(!clients.list[i])
+            continue;
+
+        if(clients.list[i]->ns == namespace) {
+            zdbd_debug("[+] redis: client %d: waiting for disconnection\n", clients.list[i]->fd);
+            clients.list[i]->ns = NULL;
+        }
+    }
+
+    return 0;
+}
+
+
+//
+// clients lists
+//
+// after each command, only the clients interested by this command
+// are checked (mirrors and watchers), instead of all the clients
+//
+// lists are linked directly on the clients (each client have a link
+// per list), the offset of the link is provided to the helpers
+//
+#define redis_link(client, offset) ((redis_link_t *) ((char *) (client) + (offset)))
+
+static redis_client_t *watchers[REDIS_WATCHERS_BUCKETS];
+static redis_client_t *timers[REDIS_TIMERS_SLOTS];
+static uint64_t timerslast = 0;
+static redis_client_t *mirrors = NULL;
+static redis_client_t *followers = NULL;
+
+// replication stream position (amount of bytes forwarded in
+// acknowledged mode) after each sequence, to compute amount of
+// bytes not acknowledged by each mirror client
+static uint64_t mirrorstream = 0;
+static uint64_t mirrorlog[REDIS_MIRROR_LOG];
+
+static void redis_list_insert(redis_client_t **head, redis_client_t *client, size_t offset) {
+    redis_link_t *link = redis_link(client, offset);
+
+    link->prev = NULL;
+    link->next = *head;
+
+    if(*head)
+        redis_link(*head, offset)->prev = client;
+
+    *head = client;
+}
+
+static void redis_list_remove(redis_client_t **head, redis_client_t *client, size_t offset) {
+    redis_link_t *link = redis_link(client, offset);
+
+    if(link->prev)
+        redis_link(link->prev, offset)->next = link->next;
+    else
+        *head = link->next;
+
+    if(link->next)
+        redis_link(link->next, offset)->prev = link->prev;
+
+    link->next = NULL;
+    link->prev = NULL;
+}
+
+//
+// remote clients
+//
+// with network threads (see network.c), the client socket is owned by
+// a network thread, commands are received already parsed, one request
+// per thread iteration, and replies queued are shipped to the thread
+// instead of being sent, everything else (scheduler, backpressure,
+// watchers, mirrors, ...) works the same way
+//
+// shipped replies are still accounted as pending until the thread
+// reports them sent, backpressure is then handled the same way
+//
+
+// clients with replies queued and not shipped yet, everything
+// is shipped once per event loop iteration (see network_flush)
+static redis_client_t *shipping = NULL;
+
+redis_client_t *redis_remote_open(struct net_conn_t *conn) {
+    redis_client_t *client;
+
+    if(!(client = socket_client_new(conn->fd)))
+        return NULL;
+
+    client->remote = conn;
+
+    return client;
+}
+
+static int redis_remote_flush(redis_client_t *client) {
+    if(client->shipping) {
+        redis_list_remove(&shipping, client, offsetof(redis_client_t, shiplink));
+        client->shipping = 0;
+    }
+
+    if(!client->responses)
+        return 0;
+
+    size_t bytes = client->responsebytes - client->shippedbytes;
+    size_t memory = client->responsememory - client->shippedmemory;
+
+    network_reply(client->remote, client->responses, bytes, memory);
+
+    client->shippedbytes = client->responsebytes;
+    client->shippedmemory = client->responsememory;
+    client->responses = NULL;
+    client->responsetail = NULL;
+
+    return 0;
+}
+
+static void redis_remote_defer(redis_client_t *client) {
+    if(client->shipping)
+        return;
+
+    redis_list_insert(&shipping, client, offsetof(redis_client_t, shiplink));
+    client->shipping = 1;
+}
+
+void redis_remote_ship() {
+    while(shipping)
+        redis_remote_flush(shipping);
+}
+
+// requests not executed are dropped, replies already shipped
+// are released when the thread gives them back
+static void redis_remote_release(redis_client_t *client) {
+    if(client->shipping) {
+        redis_list_remove(&shipping, client, offsetof(redis_client_t, shiplink));
+        client->shipping = 0;
+    }
+
+    while(client->inbox) {
+        net_request_t *next = client->inbox->next;
+        network_request_free(client->inbox);
+        client->inbox = next;
+    }
+
+    client->inboxtail = NULL;
+
+    network_close(client->remote);
+    client->remote = NULL;
+}
+
+// execute the commands received, like redis_buffer_parse does with
+// the client buffer, a request is released (and the thread notified
+// it can receive more) when all its commands were executed
+static resp_status_t redis_remote_process(redis_client_t *client) {
+    resp_request_t *request = client->request;
+    resp_status_t value = RESP_STATUS_SUCCESS;
+    net_request_t *block;
+
+    while((block = client->inbox)) {
+        while(block->executed < block->count) {
+            net_command_t *command = &block->commands[block->executed];
+
+            // quantum exhausted or namespace throttled, the client
+            // waits its turn, execution continues when resumed
+            if(!scheduler_admit(client))
+                return value;
+
+            if(redis_request_prepare(request, command->argc)) {
+                resp_discard(client, "Internal memory error");
+                return RESP_STATUS_DISCARD;
+            }
+
+            request->argc = command->argc;
+            request->fillin = command->argc;
+
+            for(int i = 0; i < command->argc; i++) {
+                net_argument_t *source = &block->arguments[command->first + i];
+                resp_object_t *argument = request->argv[i];
+
+                argument->type = STRING;
+                argument->length = source->length;
+                argument->size = source->length + 2;
+                argument->filled = argument->size;
+                argument->spool = source->spool;
+                argument->crc = source->crc;
+
+                if(source->spool > 0) {
+                    argument->storage = RESP_STORAGE_NONE;
+
+                } else if(source->external) {
+                    argument->buffer = source->external;
+                    argument->storage = RESP_STORAGE_HEAP;
+
+                } else {
+                    argument->buffer = block->buffer + source->offset;
+                    argument->storage = RESP_STORAGE_SLICE;
+                }
+
+                // payload is owned by the client request now
+                source->external = NULL;
+                source->spool = 0;
+            }
+
+            block->executed += 1;
+            value = redis_handle_resp_finished(client);
+
+            // command executed by a worker, the rest of the
+            // request is executed when it's done
+            if(client->routed)
+                return value;
+
+            if(redis_client_output_check(client) != RESP_STATUS_SUCCESS)
+                return RESP_STATUS_DISCARD;
+
+            if(value == RESP_STATUS_DISCARD || value == RESP_STATUS_DISCONNECTED)
+                return value;
+
+            if(value == RESP_STATUS_DONE || value == RESP_STATUS_SHUTDOWN)
+                return value;
+
+            // too many replies pending, the rest of the
+            // request will be executed when the client resumes
+            if(client->paused)
+                return value;
+        }
+
+        // protocol error received after theses commands
+        if(block->error) {
+            resp_discard_real(client, block->error);
+            return RESP_STATUS_DISCARD;
+        }
+
+        if(!(client->inbox = block->next))
+            client->inboxtail = NULL;
+
+        network_consumed(client->remote, block->received);
+        network_request_free(block);
+    }
+
+    return value;
+}
+
+// same as redis_chunk_read, for commands received by a network thread
+static resp_status_t redis_remote_read(redis_client_t *client) {
+    resp_status_t value;
+
+    if(client->paused || client->scheduler || client->routed)
+        return RESP_STATUS_SUCCESS;
+
+    if(!client->granted)
+        scheduler_grant(client);
+
+    client->corked = 1;
+    value = redis_remote_process(client);
+    client->corked = 0;
+    client->granted = 0;
+
+    redis_client_flush(client);
+
+    return value;
+}
+
+resp_status_t redis_remote_request(redis_client_t *client, net_request_t *request) {
+    request->next = NULL;
+
+    if(client->inboxtail)
+        client->inboxtail->next = request;
+    else
+        client->inbox = request;
+
+    client->inboxtail = request;
+
+    return redis_remote_read(client);
+}
+
+// replies shipped were sent (or dropped) by the network thread, this
+// is where a remote client paused by backpressure is resumed
+resp_status_t redis_remote_sent(redis_client_t *client, size_t bytes, size_t memory) {
+    client->responsebytes -= bytes;
+    client->responsememory -= memory;
+    client->shippedbytes -= bytes;
+    client->shippedmemory -= memory;
+
+    if(client->paused && client->responsebytes < REDIS_OUTPUT_LOWWATER)
+        return redis_client_resume(client);
+
+    return RESP_STATUS_SUCCESS;
+}
+
+// watchers list of a namespace and a command, commands
+// sharing the same handler shares the same list
+static size_t redis_watchers_bucket(namespace_t *ns, int (*handler)(redis_client_t *)) {
+    uintptr_t key = ((uintptr_t) ns >> 4) * 31 + ((uintptr_t) handler >> 2);
+    return key % REDIS_WATCHERS_BUCKETS;
+}
+
+static uint64_t redis_time_ms() {
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return ((uint64_t) now.tv_sec * 1000) + (now.tv_usec / 1000);
+}
+
+// set needed flags to enable a client to wait on a command
+void redis_client_set_watcher(redis_client_t *client, command_t *handler, size_t timeoutms) {
+    zdbd_debug("[+] redis: set watcher: command %s, timeout: %lu ms\n", handler->command, timeoutms);
+
+    // already waiting on something else
+    redis_client_unset_watcher(client);
+
+    // nothing to send to client, he is waiting now
+    // we set the command pointer to that client waiting flag
+    // and as soon as someone else on the same namespace will
+    // request this command, this client will be notified
+    client->watching = handler;
+    client->watchdeadline = redis_time_ms() + timeoutms;
+
+    client->watchbucket = redis_watchers_bucket(client->ns, handler->handler);
+    redis_list_insert(&watchers[client->watchbucket], client, offsetof(redis_client_t, watchlink));
+
+    // first watcher, starting the timer wheel now, the current
+    // slot is not checked yet (a short timeout can be in this slot)
+    if(timerslast == 0)
+        timerslast = (redis_time_ms() / REDIS_TIMERS_TICK_MS) - 1;
+
+    client->timerslot = (client->watchdeadline / REDIS_TIMERS_TICK_MS) % REDIS_TIMERS_SLOTS;
+    redis_list_insert(&timers[client->timerslot], client, offsetof(redis_client_t, timerlink));
+}
+
+// unset needed flags to set client not watching command anymore
+void redis_client_unset_watcher(redis_client_t *client) {
+    if(!client->watching)
+        return;
+
+    redis_list_remove(&watchers[client->watchbucket], client, offsetof(redis_client_t, watchlink));
+    redis_list_remove(&timers[client->timerslot], client, offsetof(redis_client_t, timerlink));
+
+    // trigger done, discarding watcher
+    client->watching = NULL;
+
+    // reset timeout
+    client->watchdeadline = 0;
+}
+
+// flag client to receive a copy of all the commands executed
+void redis_client_set_mirror(redis_client_t *client, int acknowledge) {
+    client->mirrorack = acknowledge;
+
+    // nothing to acknowledge before the current sequence
+    client->mirroracked = zdbd_rootsettings.stats.mirrorsequence;
+
+    if(client->mirror)
+        return;
 
-    // success
-    pzdbd_debug("[+] redis: socket parsing succeed\n");
-    return RESP_STATUS_SUCCESS;
+    client->mirror = 1;
+    redis_list_insert(&mirrors, client, offsetof(redis_client_t, mirrorlink));
 }
 
-void socket_nonblock(int fd) {
-    int flags;
+void redis_client_unset_mirror(redis_client_t *client) {
+    if(!client->mirror)
+        return;
 
-    if((flags = fcntl(fd, F_GETFL, 0)) < 0)
-        zdbd_diep("fcntl");
+    redis_list_remove(&mirrors, client, offsetof(redis_client_t, mirrorlink));
+    client->mirror = 0;
+}
 
-    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+//
+// mirroring
+//
+// each command executed is forwarded to all the mirror clients, the
+// forwarded frame is built once and the same buffer is queued to all
+// the mirror clients, this buffer is reference counted and released
+// when the last client sent it (or dropped it)
+//
+// mirror clients can request acknowledged mode, in that case each frame
+// is prefixed by a sequence number, and the client acknowledges the
+// sequences it applied (MIRRORACK), the amount of bytes forwarded and
+// not acknowledged (or not sent in the default mode) is limited, a mirror
+// client going too far behind is dropped, instead of keeping everything
+// in memory, this client then needs to resync from scratch
+//
+typedef struct redis_shared_t {
+    size_t refcount;
+    char payload[];
+
+} redis_shared_t;
+
+// destructor of a shared payload, called by each response
+static void redis_shared_release(void *payload) {
+    redis_shared_t *shared = (redis_shared_t *) ((char *) payload - offsetof(redis_shared_t, payload));
+
+    if(--shared->refcount == 0)
+        free(shared);
 }
 
-void socket_keepalive(int fd) {
-    int optval = 1;
+// amount of characters needed to print a number
+static size_t redis_digits(size_t value) {
+    size_t digits = 1;
 
-    if(setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval)) < 0)
-        zdbd_warnp("setsockopt: keepalive");
+    while(value >= 10) {
+        value /= 10;
+        digits += 1;
+    }
+
+    return digits;
 }
 
-// allocate a new client for a new file descriptor
-// used to keep session-live information about clients
-redis_client_t *socket_client_new(int fd) {
-    zdbd_debug("[+] new client (fd: %d)\n", fd);
+// forwarded frame of a request, the frame is kept in memory, except
+// streamed payloads (see redis_handle_resp_header) which are sent from
+// their spool file, parts are memory and spool parts alternated
+typedef struct redis_frame_part_t {
+    redis_shared_t *shared;  // part kept in memory
+    int spool;               // or part sent from a spool file
+    size_t length;
 
-    if(fd >= (int) clients.length) {
-        redis_client_t **newlist = NULL;
-        size_t newlength = clients.length + fd;
+} redis_frame_part_t;
 
-        // growing the list
-        if(!(newlist = (redis_client_t **) realloc(clients.list, sizeof(redis_client_t *) * newlength)))
-            return NULL;
+typedef struct redis_frame_t {
+    size_t length;  // total frame length
+    size_t count;   // amount of parts
+    redis_frame_part_t parts[];
 
-        // ensure new clients are not set
-        for(size_t i = clients.length; i < newlength; i++)
-            newlist[i] = NULL;
+} redis_frame_t;
 
-        // increase client list
-        clients.list = newlist;
-        clients.length = newlength;
-    }
+// release a frame not forwarded, memory parts are
+// not referenced by any response yet
+static void redis_mirror_frame_free(redis_frame_t *frame) {
+    for(size_t i = 0; i < frame->count; i++)
+        free(frame->parts[i].shared);
 
-    redis_client_t *client = NULL;
+    free(frame);
+}
 
-    // not using calloc to ensure everything is set to
-    // default value by ourself and nothing is forget
-    if(!(client = malloc(sizeof(redis_client_t)))) {
-        zdbd_warnp("new client malloc");
+// build the forwarded frame of the request, without the array
+// header which depends of the mirror client mode
+static redis_frame_t *redis_mirror_frame(redis_client_t *source) {
+    resp_request_t *request = source->request;
+    redis_frame_part_t *part;
+    redis_frame_t *frame;
+    size_t spooled = 0;
+    char header[256];
+    char argheader[32];
+
+    // the forward query is the same as the input one
+    // but with more fields: the timestamp, the namespace in
+    // which the user is attached to and the owner id
+    int headerlen = snprintf(header, sizeof(header), ":%ld\r\n$%lu\r\n%s\r\n:%u\r\n",
+            time(NULL), strlen(source->ns->name), source->ns->name, request->owner);
+
+    if(headerlen < 0 || (size_t) headerlen >= sizeof(header))
         return NULL;
-    }
 
-    client->fd = fd;
-    client->connected = time(NULL);
-    client->commands = 0;
-    client->executed = NULL;
-    client->watching = NULL;
-    client->mirror = 0;
-    client->master = 0;
-    client->nonce = NULL;
+    for(int i = 0; i < request->argc; i++)
+        if(request->argv[i]->spool > 0)
+            spooled += 1;
 
-    // initialize wait timeout
-    memset(&client->watchtime, 0, sizeof(struct timespec));
+    // a memory part before and after each spooled payload
+    size_t count = (spooled * 2) + 1;
 
-    // allocate a fixed buffer
-    client->buffer = buffer_new();
-    if(!client->buffer.buffer) {
-        free(client);
+    if(!(frame = calloc(sizeof(redis_frame_t) + (sizeof(redis_frame_part_t) * count), 1)))
         return NULL;
-    }
 
-    // allocate a single request object
-    if(!(client->request = (resp_request_t *) malloc(sizeof(resp_request_t)))) {
-        zdbd_warnp("new client request malloc");
-        free(client);
-        return NULL;
-    }
+    frame->count = count;
 
-    // no pending responses
-    client->responses = NULL;
-    client->responsetail = NULL;
+    // first pass, length of each part, memory parts contains:
+    //  - header prefix (string length of the size with header)
+    //  - payload (buffer length), if not spooled
+    //  - final \r\n (length: 2)
+    part = frame->parts;
+    part->length = headerlen;
 
-    client->request->state = RESP_EMPTY;
-    client->request->argc = 0;
-    client->request->argv = NULL;
+    for(int i = 0; i < request->argc; i++) {
+        resp_object_t *argument = request->argv[i];
 
-    // attach default namespace to this client
-    client->ns = namespace_get_default();
+        part->length += 1 + redis_digits(argument->length) + 2;
 
-    // by default, the default namespace is writable
-    // except if protect mode is enabled
-    client->writable = (zdbd_rootsettings.protect) ? 0 : 1;
+        if(argument->spool > 0) {
+            part += 1;
+            part->spool = argument->spool;
+            part->length = argument->length;
+            part += 1;
 
-    // set all users to admin if no password are set
-    client->admin = (zdbd_rootsettings.adminpwd) ? 0 : 1;
+        } else {
+            part->length += argument->length;
+        }
 
-    // set client to the list
-    clients.list[fd] = client;
+        part->length += 2;
+    }
 
-    // update statistics
-    zdbd_rootsettings.stats.clients += 1;
+    for(size_t i = 0; i < count; i += 2) {
+        if(!(frame->parts[i].shared = malloc(sizeof(redis_shared_t) + frame->parts[i].length))) {
+            redis_mirror_frame_free(frame);
+            return NULL;
+        }
+    }
 
-    return client;
-}
+    // second pass, filling memory parts, a spooled
+    // payload moves to the next memory part
+    part = frame->parts;
 
-// free allocated client when disconnected
-void socket_client_free(int fd) {
-    redis_client_t *client = clients.list[fd];
+    char *buffer = part->shared->payload;
+    size_t offset = headerlen;
 
-    zdbd_debug("[+] client: closing (fd: %d)\n", fd);
+    memcpy(buffer, header, headerlen);
 
-    #ifndef RELEASE
-    double elapsed = difftime(time(NULL), client->connected);
-    zdbd_debug("[+] client: stayed %.f seconds, %lu commands\n", elapsed, client->commands);
-    #endif
+    for(int i = 0; i < request->argc; i++) {
+        resp_object_t *argument = request->argv[i];
+        int arglen = sprintf(argheader, "$%d\r\n", argument->length);
 
-    // closing socket
-    close(client->fd);
+        memcpy(buffer + offset, argheader, arglen);
+        offset += arglen;
 
-    // cleaning client memory usage
-    redis_free_request(client->request);
-    buffer_free(&client->buffer);
+        if(argument->spool > 0) {
+            part += 2;
+            buffer = part->shared->payload;
+            offset = 0;
 
-    free(client->nonce);
-    free(client->request);
-    free(client);
+        } else {
+            memcpy(buffer + offset, argument->buffer, argument->length);
+            offset += argument->length;
+        }
 
-    // allow new client on this spot
-    clients.list[fd] = NULL;
+        memcpy(buffer + offset, "\r\n", 2);
+        offset += 2;
+    }
 
-    // maybe we could reduce the list usage now
+    for(size_t i = 0; i < count; i++)
+        frame->length += frame->parts[i].length;
+
+    return frame;
 }
 
-// walk over all clients and match them by provided namespace
-// if they matches, move them to a special state, waiting
-// for disconnection (with alert)
-int redis_detach_clients(namespace_t *namespace) {
-    for(size_t i = 0; i < clients.length; i++) {
-        if(!clients.list[i])
+// queue the frame parts to a mirror client, spooled payloads are
+// sent from the spool file like any file response, each response
+// owns its own descriptor (the spool is closed with the request)
+static int redis_mirror_queue(redis_client_t *target, redis_frame_t *frame) {
+    for(size_t i = 0; i < frame->count; i++) {
+        redis_frame_part_t *part = &frame->parts[i];
+        int fd;
+
+        if(part->shared) {
+            redis_reply_heap(target, part->shared->payload, part->length, redis_shared_release);
             continue;
+        }
 
-        if(clients.list[i]->ns == namespace) {
-            zdbd_debug("[+] redis: client %d: waiting for disconnection\n", clients.list[i]->fd);
-            clients.list[i]->ns = NULL;
+        if((fd = dup(part->spool)) < 0) {
+            zdbd_warnp("redis: mirror: spool dup");
+
+            // releasing references of parts not queued, queued
+            // ones are released with the client responses
+            for(i += 1; i < frame->count; i++)
+                if(frame->parts[i].shared)
+                    redis_shared_release(frame->parts[i].shared->payload);
+
+            return 1;
         }
+
+        redis_reply_file(target, fd, 0, part->length);
     }
 
     return 0;
 }
 
+// amount of bytes forwarded to a mirror client and not yet
+// sent (or acknowledged in acknowledged mode)
+static uint64_t redis_mirror_pending(redis_client_t *client) {
+    uint64_t sequence = zdbd_rootsettings.stats.mirrorsequence;
 
-int redis_mirror_client(redis_client_t *source, redis_client_t *target) {
-    char temp[256];
-    char *buffer;
-    time_t timestamp = time(NULL);
+    if(!client->mirrorack)
+        return client->responsebytes;
 
-    // the forward query is the same as the input one
-    // but with two more fields: the socket id and the namespace in
-    // which the user is attached to
+    // acknowledged position not known anymore,
+    // this client is way behind
+    if(sequence - client->mirroracked >= REDIS_MIRROR_LOG)
+        return UINT64_MAX;
+
+    return mirrorstream - mirrorlog[client->mirroracked % REDIS_MIRROR_LOG];
+}
+
+// mirror client going too far behind, dropping everything pending
+// and closing the connection (the client will be freed by the
+// polling system), this client needs to resync from scratch
+static void redis_mirror_drop(redis_client_t *client) {
+    zdbd_log("[-] redis: mirror: client %d too far behind, dropping it\n", client->fd);
+
+    zdbd_rootsettings.stats.mirrordropped += 1;
+
+    redis_client_unset_mirror(client);
+
+    while(client->responses)
+        redis_response_pop(client);
+
+    shutdown(client->fd, SHUT_RDWR);
+}
+
+// forward the request to all the mirror clients
+static int redis_mirror_clients(redis_client_t *source) {
+    resp_request_t *request = source->request;
+    redis_client_t *target, *next;
+    redis_frame_t *frame;
+    char header[64], seqheader[64];
+    size_t targets = 0;
+    size_t length;
 
     // special owner id is zero, do not forward this
     // this is used for administrative query not made to be
     // replicated
-    if(source->request->owner == 0) {
+    if(request->owner == 0) {
         zdbd_debug("[-] redis: mirror: null-owner, not forwarding\n");
         return 0;
     }
 
-    // computing the buffer size
-    size_t length = 0;
-    size_t offset = 0;
+    for(target = mirrors; target; target = target->mirrorlink.next)
+        if(target != source)
+            targets += 1;
+
+    if(targets == 0)
+        return 0;
 
-    // computing length of the array (original one + the 2 fields we prepend)
-    length += sprintf(temp, "*%d\r\n", source->request->argc + 3);
+    if(!(frame = redis_mirror_frame(source)))
+        return 1;
 
-    // socket id
-    length += sprintf(temp, ":%ld\r\n", timestamp);
+    length = frame->length;
 
-    // namespace
-    length += snprintf(temp, sizeof(temp), "$%lu\r\n%s\r\n", strlen(source->ns->name), source->ns->name);
+    // default mode header, and acknowledged mode header
+    // which contains the sequence of this frame
+    uint64_t sequence = zdbd_rootsettings.stats.mirrorsequence + 1;
+    size_t headerlen = sprintf(header, "*%d\r\n", request->argc + 3);
+    size_t seqheaderlen = sprintf(seqheader, "*%d\r\n:%" PRIu64 "\r\n", request->argc + 4, sequence);
 
-    // instance (owner) id
-    length += sprintf(temp, ":%u\r\n", source->request->owner);
+    // dropping clients which would go too far behind with this frame
+    // queued, a frame larger than the backlog (large value) is still
+    // forwarded to clients having nothing pending
+    targets = 0;
 
-    // length contains:
-    //  - header prefix (string length of the size with header)
-    //  - payload (buffer length)
-    //  - final \r\n (length: 2)
-    for(int i = 0; i < source->request->argc; i++) {
-        length += sprintf(temp, "$%d\r\n", source->request->argv[i]->length);
-        length += source->request->argv[i]->length + 2;
+    for(target = mirrors; target; target = next) {
+        size_t framelen = length + (target->mirrorack ? seqheaderlen : headerlen);
+        uint64_t pending = redis_mirror_pending(target);
+
+        next = target->mirrorlink.next;
+
+        if(pending > REDIS_MIRROR_BACKLOG || (pending > 0 && pending + framelen > REDIS_MIRROR_BACKLOG)) {
+            redis_mirror_drop(target);
+            continue;
+        }
+
+        if(target != source)
+            targets += 1;
     }
 
-    zdbd_debug("[+] redis: mirroring %lu bytes from <%d> to <%d>\n", length, source->fd, target->fd);
+    if(targets == 0) {
+        redis_mirror_frame_free(frame);
+        return 0;
+    }
 
-    if(!(buffer = malloc(length)))
-        return 1;
+    zdbd_rootsettings.stats.mirrorsequence = sequence;
+    mirrorstream += seqheaderlen + length;
+    mirrorlog[sequence % REDIS_MIRROR_LOG] = mirrorstream;
 
-    // building buffer
-    offset += sprintf(buffer, "*%d\r\n", source->request->argc + 3);
-    offset += sprintf(buffer + offset, ":%ld\r\n", timestamp);
-    offset += sprintf(buffer + offset, "$%lu\r\n%s\r\n", strlen(source->ns->name), source->ns->name);
-    offset += sprintf(buffer + offset, ":%u\r\n", source->request->owner);
+    zdbd_debug("[+] redis: mirroring %lu bytes from <%d> to %lu clients\n", length, source->fd, targets);
 
-    for(int i = 0; i < source->request->argc; i++) {
-        offset += sprintf(buffer + offset, "$%d\r\n", source->request->argv[i]->length);
+    // each response owns one reference
+    for(size_t i = 0; i < frame->count; i++)
+        if(frame->parts[i].shared)
+            frame->parts[i].shared->refcount = targets;
 
-        memcpy(buffer + offset, source->request->argv[i]->buffer, source->request->argv[i]->length);
-        offset += source->request->argv[i]->length;
+    for(target = mirrors; target; target = next) {
+        next = target->mirrorlink.next;
 
-        memcpy(buffer + offset, "\r\n", 2);
-        offset += 2;
+        if(target == source)
+            continue;
+
+        if(target->mirrorack)
+            redis_reply_stack(target, seqheader, seqheaderlen);
+        else
+            redis_reply_stack(target, header, headerlen);
+
+        // frame could not be fully queued, the
+        // client would be out of sync from now
+        if(redis_mirror_queue(target, frame))
+            redis_mirror_drop(target);
     }
 
-    // redis_reply_delayed(target, buffer, length);
-    redis_reply_heap(target, buffer, length, free);
+    free(frame);
 
     return 0;
 }
 
-// set needed flags to enable a client to wait on a command
-void redis_client_set_watcher(redis_client_t *client, command_t *handler, size_t timeoutms) {
-    zdbd_debug("[+] redis: set watcher: command %s, timeout: %lu ms\n", handler->command, timeoutms);
+// mirror client acknowledged frames up to this sequence
+void redis_client_mirror_ack(redis_client_t *client, uint64_t sequence) {
+    // acknowledging something not sent yet
+    if(sequence > zdbd_rootsettings.stats.mirrorsequence)
+        return;
 
-    // nothing to send to client, he is waiting now
-    // we set the command pointer to that client waiting flag
-    // and as soon as someone else on the same namespace will
-    // request this command, this client will be notified
-    client->watching = handler;
+    if(sequence > client->mirroracked)
+        client->mirroracked = sequence;
+}
+
+//
+// changes followers
+//
+// followers receive the entries of their namespace in the index order,
+// they are not fed by the command handler, entries are produced between
+// network events, by small time slices and only while the amount of bytes
+// pending for the client is small, a follower catching up a large namespace
+// doesn't block other clients and doesn't buffer the whole namespace
+//
+// when the end of the index is reached, the follower waits until the index
+// position changes (new entry written), this is only a position comparison
+//
+void redis_client_set_follower(redis_client_t *client) {
+    if(client->follow.active)
+        return;
 
-    // set initial waiting time and timeout
-    gettimeofday(&client->watchtime, NULL);
-    client->watchtimeout = timeoutms;
+    client->follow.active = 1;
+    redis_list_insert(&followers, client, offsetof(redis_client_t, followlink));
 }
 
-// unset needed flags to set client not watching command anymore
-void redis_client_unset_watcher(redis_client_t *client) {
-    // trigger done, discarding watcher
-    client->watching = NULL;
+void redis_client_unset_follower(redis_client_t *client) {
+    if(!client->follow.active)
+        return;
 
-    // reset timeout
-    client->watchtimeout = 0;
-    memset(&client->watchtime, 0, sizeof(client->watchtime));
+    redis_list_remove(&followers, client, offsetof(redis_client_t, followlink));
+    client->follow.active = 0;
+}
+
+// does the follower have something to receive now
+static int redis_follower_ready(redis_client_t *client) {
+    redis_follow_t *follow = &client->follow;
+
+    // not enough room, the polling system will notify
+    // us when some pending data were sent
+    if(client->responsebytes >= REDIS_FOLLOW_BACKLOG)
+        return 0;
+
+    // frozen namespace, trying again later
+    if(namespace_is_frozen(client->ns))
+        return 0;
+
+    if(follow->tail) {
+        index_root_t *index = client->ns->index;
+
+        // nothing written since the tail was reached
+        if(index->indexid == follow->tailid && index->previous == follow->tailoffset)
+            return 0;
+
+        follow->tail = 0;
+    }
+
+    return 1;
 }
 
-uint64_t timeval_delta_ms(struct timeval *begin, struct timeval *end) {
-    uint64_t deltams = (end->tv_sec - begin->tv_sec) * 1000;
-    deltams += (end->tv_usec - begin->tv_usec) / 1000;
+// produce entries for followers having something to receive,
+// returns amount of followers still having entries to receive
+// after their time slice, polling should not wait for them
+int redis_followers_process() {
+    redis_client_t *client = followers;
+    int pending = 0;
+
+    while(client) {
+        redis_client_t *next = client->followlink.next;
+
+        // namespace removed or client changed namespace
+        if(client->ns == NULL || client->ns != client->follow.ns) {
+            redis_client_unset_follower(client);
+            client = next;
+            continue;
+        }
+
+        // the namespace index is read, commands routed to the
+        // worker owning it needs to be done (see worker.c)
+        worker_quiesce(client->ns);
+
+        if(!redis_follower_ready(client)) {
+            client = next;
+            continue;
+        }
+
+        client->corked = 1;
+        command_changes_produce(client);
+        client->corked = 0;
+
+        // client went away, it will be freed by the polling system
+        if(redis_client_flush(client)) {
+            redis_client_unset_follower(client);
+            client = next;
+            continue;
+        }
+
+        if(redis_follower_ready(client))
+            pending += 1;
 
-    return deltams;
+        client = next;
+    }
+
+    return pending;
 }
 
+// walk over the timer wheel slots elapsed since last call, only
+// watchers on theses slots can have their timeout reached
 static void redis_watch_timeout() {
-    struct timeval timecheck;
     char response[64];
+    uint64_t now = redis_time_ms();
+    uint64_t tick = now / REDIS_TIMERS_TICK_MS;
 
-    for(size_t i = 0; i < clients.length; i++) {
-        if(!clients.list[i])
-            continue;
+    // timer wheel not started (no watchers yet)
+    if(timerslast == 0)
+        return;
 
-        // shortcut
-        redis_client_t *checking = clients.list[i];
+    // current slot is not completed yet, it will
+    // be checked on next tick
+    uint64_t until = tick - 1;
+    uint64_t from = timerslast + 1;
 
-        // checking if watching timeout is reached
-        if(checking->watching) {
-            gettimeofday(&timecheck, NULL);
+    // more than a full rotation elapsed, every slot
+    // needs to be checked, but only once
+    if(until >= timerslast + REDIS_TIMERS_SLOTS)
+        from = until - REDIS_TIMERS_SLOTS + 1;
 
-            uint64_t deltams = timeval_delta_ms(&checking->watchtime, &timecheck);
-            if(deltams > checking->watchtimeout) {
-                zdbd_debug("[+] redis: trigger: client %d waiting timeout\n", checking->fd);
+    for(uint64_t current = from; current <= until; current++) {
+        redis_client_t *checking = timers[current % REDIS_TIMERS_SLOTS];
 
-                // not watching anymore
-                redis_client_unset_watcher(checking);
+        while(checking) {
+            redis_client_t *next = checking->timerlink.next;
 
-                // sending notification
-                snprintf(response, sizeof(response), "-Timeout\r\n");
-                redis_reply_stack(checking, response, strlen(response));
+            // timeout is more than a rotation later
+            if(checking->watchdeadline > now) {
+                checking = next;
+                continue;
             }
+
+            zdbd_debug("[+] redis: trigger: client %d waiting timeout\n", checking->fd);
+
+            // not watching anymore
+            redis_client_unset_watcher(checking);
+
+            // sending notification
+            snprintf(response, sizeof(response), "-Timeout\r\n");
+            redis_reply_stack(checking, response, strlen(response));
+
+            checking = next;
         }
     }
+
+    if(until > timerslast)
+        timerslast = until;
 }
 
 void redis_files_rotate() {
-    namespace_t *ns;
+    namespace_t *ns, *next;
 
     // file rotation disabled, nothing to do here
     if(zdbd_rootsettings.rotatesec == 0)
         return;
 
-    for(ns = namespace_iter(); ns; ns = namespace_iter_next(ns)) {
-        if(!ns->index->updated)
+    // only namespaces with current index file updated
+    // can be rotated, no need to walk over all of them
+    for(ns = namespace_changed_iter(); ns; ns = next) {
+        next = namespace_changed_next(ns);
+
+        // index file switched in the meantime (size rotation, reload, ...)
+        if(!ns->index->updated) {
+            namespace_changed_release(ns);
             continue;
+        }
 
         time_t diffsec = time(NULL) - ns->index->rotate;
 
@@ -1105,6 +2894,10 @@ void redis_files_rotate() {
             zdbd_log("[+] system: rotation requested (%s, %ld seconds)\n", ns->name, diffsec);
             size_t newid = index_jump_next(ns->index);
             data_jump_next(ns->data, newid);
+
+            // new index file not updated yet
+            if(!ns->index->updated)
+                namespace_changed_release(ns);
         }
     }
 }
@@ -1113,48 +2906,42 @@ void redis_files_rotate() {
 // when the server is in idle state (no clients action
 // for a certain amount of time)
 void redis_idle_process() {
+    // namespaces are touched below, workers needs to be idle
+    worker_quiesce(NULL);
+
     // watch commands timeout
     redis_watch_timeout();
 
     // rotate files if requested after some time
     redis_files_rotate();
 
+    // flush rotated files and prepare next ones
+    namespaces_idle_rotation();
+
+    // verify some sealed datafiles integrity
+    scrub_process();
+
     // discard any pending hook child
     libzdb_hooks_cleanup();
 }
 
-// handler executed after each command executed
-// basicly for now, walk over all the clients, if they are
-// on the same namespace as the current client, checking if
-// some waiting was set, if waiting was set on the same handler
-// we just called, we trigger (notify) it and unlock it
-int redis_posthandler_client(redis_client_t *client) {
+// walk over a watchers list, if they are on the same namespace
+// as the current client and waiting on the same handler we just
+// called, we trigger (notify) it and unlock it
+static void redis_posthandler_watchers(redis_client_t *client, size_t bucket) {
+    redis_client_t *checking = watchers[bucket];
     char response[64];
 
-    // the client didn't executed any
-    // valid command, nothing to check
-    if(!client->executed)
-        return 0;
-
-    for(size_t i = 0; i < clients.length; i++) {
-        redis_client_t *checking = clients.list[i];
-
-        // client doesn't exists anymore in the meantime
-        // or target is the current client
-        if(!checking || checking == client)
-            continue;
+    while(checking) {
+        redis_client_t *next = checking->watchlink.next;
 
-        if(checking->mirror) {
-            redis_mirror_client(client, checking);
+        // target is the current client, or another
+        // namespace/command sharing the same list
+        if(checking == client || checking->mirror || checking->ns != client->ns) {
+            checking = next;
             continue;
         }
 
-        // or this client is not waiting on commands
-        // or this client is not waiting on the same namespace
-        // ignoring
-        if(!checking || !checking->watching || checking->ns != client->ns)
-            continue;
-
         // matching on the exact command
         // or the wildcard command
         if(checking->watching == client->executed || checking->watching->handler == command_asterisk) {
@@ -1172,7 +2959,30 @@ int redis_posthandler_client(redis_client_t *client) {
             snprintf(response, sizeof(response), "+%s\r\n", matching);
             redis_reply_stack(checking, response, strlen(response));
         }
+
+        checking = next;
     }
+}
+
+// handler executed after each command executed, forward the
+// command to mirror clients and notify clients waiting on it
+int redis_posthandler_client(redis_client_t *client) {
+    // the client didn't executed any
+    // valid command, nothing to check
+    if(!client->executed)
+        return 0;
+
+    if(mirrors)
+        redis_mirror_clients(client);
+
+    // clients waiting on this command or on any command
+    size_t exact = redis_watchers_bucket(client->ns, client->executed->handler);
+    size_t wildcard = redis_watchers_bucket(client->ns, command_asterisk);
+
+    redis_posthandler_watchers(client, exact);
+
+    if(wildcard != exact)
+        redis_posthandler_watchers(client, wildcard);
 
     return 0;
 }
@@ -1203,6 +3013,14 @@ static int redis_tcp_listen(char *listenaddr, char *port) {
     if(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1)
         zdbd_diep("tcp setsockopt");
 
+    #ifdef SO_REUSEPORT
+    // each network thread binds its own socket on the
+    // same address (see network_listen_reuse)
+    if(zdbd_rootsettings.threads > 1)
+        if(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) == -1)
+            zdbd_diep("tcp setsockopt");
+    #endif
+
     if(bind(fd, sinfo->ai_addr, sinfo->ai_addrlen) == -1)
         zdbd_diep("tcp bind");
 
@@ -1367,6 +3185,9 @@ int redis_listen(char *listenaddr, char *port, char *socket) {
     // entering the worker loop
     int handler = socket_handler(&redis);
 
+    // commands still executed are finished first
+    worker_stop();
+
     // cleaning clients list
     for(size_t i = 0; i < clients.length; i++)
         if(clients.list[i])
@@ -1378,6 +3199,8 @@ int redis_listen(char *listenaddr, char *port, char *socket) {
     free(redis.mainfd);
     free(clients.list);
 
+    scheduler_destroy();
+
     // notifing source that we are done
     return handler;
 }
@@ -24,12 +24,29 @@
 
     } resp_type_t;
 
+    // where an argument payload is stored, most of the arguments
+    // are small and don't need any allocation (see resp_request_t)
+    typedef enum resp_storage_t {
+        RESP_STORAGE_NONE,   // no payload (yet)
+        RESP_STORAGE_SLICE,  // payload points to the client receive buffer
+        RESP_STORAGE_ARENA,  // payload is on the client request arena
+        RESP_STORAGE_HEAP,   // payload allocated for this argument only
+
+    } resp_storage_t;
+
     typedef struct resp_object_t {
         resp_type_t type;
         void *buffer;
         int length;
         int filled;
         int size;
+        resp_storage_t storage;
+
+        // large payload are not kept in memory but streamed
+        // into a spool file while receiving them, buffer is
+        // not allocated in that case
+        int spool;     // spool file descriptor (0 if not used)
+        uint32_t crc;  // crc32 of the streamed payload
 
     } resp_object_t;
 
@@ -48,6 +65,14 @@
         resp_object_t **argv;   // list of arguments
         uint32_t owner;         // source owner id
 
+        // arguments objects and small arguments payload are kept
+        // per client and reused from one request to the other, only
+        // large payload are allocated, per request
+        resp_object_t *objects; // arguments objects
+        int capacity;           // amount of arguments objects allocated
+        char *arena;            // small arguments payload storage
+        size_t arenaused;       // arena used by the current request
+
         // source owner id is used mainly for replication
         //
         // by default, the owner is the zdb id itself (the zdb
@@ -69,6 +94,7 @@
         RESP_STATUS_DONE,
         RESP_STATUS_SHUTDOWN,
         RESP_STATUS_RESET,
+        RESP_STATUS_ROUTED,
 
     } resp_status_t;
 
@@ -79,10 +105,12 @@
 
     typedef struct buffer_t {
         char *buffer;
+        size_t size;    // allocated size (0 if not allocated)
         size_t length;
         size_t remain;
         char *reader;
         char *writer;
+        int busy;       // buffer was filled by a single read
 
     } buffer_t;
 
@@ -96,6 +124,16 @@
         // the buffer
         void (*destructor)(void *target);
 
+        // response can be a file segment instead of a buffer,
+        // in that case, length bytes are sent from this file
+        // (starting at offset) and the file is closed when done
+        int fd;        // file descriptor (0 if not used)
+        off_t offset;  // current offset on the file
+
+        // chunk response owns it's buffer, small replies
+        // are appended to it (0 for regular response)
+        size_t capacity;
+
         struct redis_response_t *next;
 
     } redis_response_t;
@@ -103,10 +141,35 @@
     typedef struct command_t command_t;
     typedef struct redis_client_t redis_client_t;
 
-    // command name and associated handler
+    // link of a client on a list (watchers, mirrors, ...)
+    typedef struct redis_link_t {
+        redis_client_t *next;
+        redis_client_t *prev;
+
+    } redis_link_t;
+
+    // change-data-capture position of a client following
+    // a namespace (CHANGES), the cursor is the index position
+    // of the last entry sent
+    typedef struct redis_follow_t {
+        int active;          // client is following changes
+        int started;         // cursor is set (something was sent or requested)
+        int payload;         // payloads are sent with entries
+        int tail;            // end of index reached, waiting for new entries
+        namespace_t *ns;     // namespace followed
+        fileid_t indexid;    // cursor: index file id
+        size_t offset;       // cursor: offset on the index file
+        fileid_t tailid;     // index position when the tail was reached, new
+        size_t tailoffset;   // entries are expected when it changes
+
+    } redis_follow_t;
+
+    // command name and associated handler, flags tell where
+    // the command can be executed with namespaces workers
     struct command_t {
         char *command;
         int (*handler)(redis_client_t *client);
+        int flags;
 
     };
 
@@ -119,6 +182,8 @@
         int writable;     // can the client write to the namespace
         int admin;        // is the client is admin
         int mirror;       // does this client needs a mirroring
+        int mirrorack;    // mirror client acknowledges frames received
+        uint64_t mirroracked;   // last frame sequence acknowledged
         int master;       // does this client is a 'master' (forwarder)
         char *nonce;      // nonce challenge used by secure auth
         buffer_t buffer;  // per-client buffer
@@ -127,11 +192,25 @@
         // an event is basicly somebody else doing some command
         // we keep track if a client wants to monitor some event
         // and a pointer to the last command executed
-        size_t watchtimeout;          // watch command timeout
-        struct timeval watchtime;     // tracker for timeout
+        uint64_t watchdeadline;       // watch timeout (timestamp in ms)
         command_t *watching;
         command_t *executed;
 
+        // only interested clients are checked after a command,
+        // watching clients are linked on a list per namespace
+        // and command, and on a timer wheel slot for timeout,
+        // mirror clients are linked together
+        redis_link_t watchlink;
+        redis_link_t timerlink;
+        redis_link_t mirrorlink;
+        size_t watchbucket;
+        size_t timerslot;
+
+        // change-data-capture stream, followers are linked
+        // together and fed between network events
+        redis_follow_t follow;
+        redis_link_t followlink;
+
         // each client will be attached to a request
         // this request will contain one-per-one commands
         resp_request_t *request;
@@ -141,6 +220,43 @@
         // client
         redis_response_t *responses;
         redis_response_t *responsetail;
+        size_t responsebytes;  // amount of bytes queued and not sent yet
+        size_t responsememory; // part of these bytes kept in memory (not files)
+
+        // output backpressure, commands are not read anymore
+        // until enough pending replies were sent
+        int paused;
+
+        // when set, responses are only queued and will be
+        // flushed when the request buffer is fully processed
+        int corked;
+
+        // fair sharing between namespaces (see scheduler.c), a client
+        // executes a quantum of commands then waits its turn on its
+        // namespace queue, nothing is read from a waiting client
+        struct scheduler_t *scheduler;  // queue the client is waiting on
+        redis_link_t schedlink;
+        int granted;                    // resumed by the scheduler
+        size_t grantops;                // commands left on the quantum
+        size_t grantbytes;              // bytes left on the quantum
+        size_t produced;                // amount of reply bytes queued (total)
+
+        // socket owned by a network thread (see network.c), commands
+        // received are queued here and replies are shipped to it
+        struct net_conn_t *remote;
+        struct net_request_t *inbox;     // requests received, not fully executed
+        struct net_request_t *inboxtail;
+        size_t shippedbytes;             // part of responsebytes shipped, not sent yet
+        size_t shippedmemory;            // part of responsememory shipped, not sent yet
+        redis_link_t shiplink;           // linked on the clients with replies to ship
+        int shipping;
+
+        // command executed by the worker owning the namespace (see
+        // worker.c), nothing is parsed or read until it's done, a client
+        // disconnected in the meantime is released when it's done
+        struct worker_job_t *job;
+        int routed;
+        int dropped;
     };
 
     // represents all clients in memory
@@ -153,19 +269,98 @@
     // minimum (default) amount of clients pre-allocated
     #define REDIS_CLIENTS_INITIAL_LENGTH 32
 
-    // per-client buffer
+    // amount of watchers lists (namespace and command)
+    #define REDIS_WATCHERS_BUCKETS  256
+
+    // timer wheel used for watchers timeout, the wheel have
+    // slots of fixed duration (in ms), timeout longer than
+    // a wheel rotation stays on their slot until reached
+    #define REDIS_TIMERS_SLOTS    256
+    #define REDIS_TIMERS_TICK_MS  100
+
+    // maximum amount of bytes a mirror client can have pending
+    // (not sent, or not acknowledged), a slower client is dropped
+    // and needs to resync from scratch
+    #define REDIS_MIRROR_BACKLOG  64 * 1024 * 1024
+
+    // amount of frames positions kept to compute bytes
+    // not acknowledged by mirror clients
+    #define REDIS_MIRROR_LOG  65536
+
+    // amount of bytes pending on a change follower before
+    // the server stops producing entries for it
+    #define REDIS_FOLLOW_BACKLOG  1024 * 1024
+
+    // time spent producing entries for one follower, the
+    // production continue on the next event loop iteration
+    #define REDIS_FOLLOW_TIMESLICE_US  1000
+
+    // output backpressure: a client with more than highwater bytes
+    // pending is not read anymore (commands are not executed) until
+    // the queue goes below lowwater, a client with more than hardlimit
+    // bytes kept in memory is disconnected
+    #define REDIS_OUTPUT_HIGHWATER  16 * 1024 * 1024
+    #define REDIS_OUTPUT_LOWWATER   4 * 1024 * 1024
+    #define REDIS_OUTPUT_HARDLIMIT  1024 * 1024 * 1024
+
+    // amount of clients with the largest output pending
+    // reported by INFO
+    #define REDIS_OUTPUT_REPORT  8
+
+    // per-client buffer (initial size)
     #define REDIS_BUFFER_SIZE 8192
 
+    // per-client buffer maximum size, when growing
+    #define REDIS_BUFFER_MAX_SIZE  256 * 1024
+
+    // amount of free buffers kept for reuse
+    #define REDIS_BUFFER_POOL  128
+
+    // per-client small arguments storage
+    #define REDIS_ARENA_SIZE 8192
+
+    // default amount of arguments objects per client
+    #define REDIS_ARGUMENTS_INITIAL 8
+
     // maximum payload size
     #define REDIS_MAX_PAYLOAD 8 * 1024 * 1024
 
+    // payload larger than this are sent from the datafile
+    // directly (sendfile) and not loaded in memory
+    #define REDIS_STREAM_THRESHOLD  1024 * 1024
+
+    // replies smaller than this are copied into a shared
+    // response chunk instead of being queued on their own
+    #define REDIS_RESPONSE_COALESCE  4096
+
+    // size of a shared response chunk
+    #define REDIS_RESPONSE_CHUNK  16 * 1024
+
+    // maximum amount of buffers sent with one writev
+    #define REDIS_RESPONSE_IOV  64
+
+    // amount of responses (and chunks) objects kept for reuse
+    #define REDIS_RESPONSE_POOL  256
+    #define REDIS_RESPONSE_CHUNKS_POOL  32
+
     typedef struct redis_handler_t {
         int *mainfd;  // main sockets handler (support multiple sockets)
         int fdlen;    // amount of sockets on the list
         int evfd;     // event handler (epoll, kqueue, ...)
+        int timerfd;  // periodic background tasks timer (when needed)
 
     } redis_handler_t;
 
+    // output buffer usage of one client (or a sum of
+    // all the clients), used for statistics
+    typedef struct redis_output_t {
+        int fd;          // client socket (not set for a sum)
+        size_t bytes;    // amount of bytes pending
+        size_t memory;   // amount of these bytes kept in memory
+        size_t paused;   // client paused (or amount of clients paused)
+
+    } redis_output_t;
+
     typedef struct redis_bulk_t {
         size_t length;
         size_t writer;
@@ -176,14 +371,24 @@
     int redis_listen(char *listenaddr, char *port, char *socket);
     resp_status_t redis_chunk_read(int fd);
     resp_status_t redis_delayed_write(int fd);
+    int redis_client_flush(redis_client_t *client);
+    size_t redis_clients_output(redis_output_t *total, redis_output_t *largest, size_t count);
 
     void socket_nonblock(int fd);
     void socket_keepalive(int fd);
+    void socket_nodelay(int fd);
     void socket_block(int fd);
 
     // wait command helpers
     void redis_client_set_watcher(redis_client_t *client, command_t *handler, size_t timeoutms);
     void redis_client_unset_watcher(redis_client_t *client);
+    void redis_client_set_mirror(redis_client_t *client, int acknowledge);
+    void redis_client_mirror_ack(redis_client_t *client, uint64_t sequence);
+    void redis_client_unset_mirror(redis_client_t *client);
+    void redis_client_set_follower(redis_client_t *client);
+    void redis_client_unset_follower(redis_client_t *client);
+    int redis_followers_process();
+    resp_status_t redis_scheduler_process(int *timeout);
 
     void redis_bulk_append(redis_bulk_t *bulk, void *data, size_t length);
     redis_bulk_t redis_bulk(void *payload, size_t length);
@@ -201,7 +406,19 @@
     redis_response_t *redis_response_new(void *payload, size_t length, void (*destructor)(void *));
     int redis_reply_heap(redis_client_t *client, void *payload, size_t length, void (*destructor)(void *));
     int redis_reply_stack(redis_client_t *client, void *payload, size_t length);
+    int redis_reply_file(redis_client_t *client, int fd, off_t offset, size_t length);
 
     int redis_posthandler_client(redis_client_t *client);
     void redis_idle_process();
+
+    // clients handled by network threads
+    redis_client_t *redis_remote_open(struct net_conn_t *conn);
+    resp_status_t redis_remote_request(redis_client_t *client, struct net_request_t *request);
+    resp_status_t redis_remote_sent(redis_client_t *client, size_t bytes, size_t memory);
+    void redis_remote_ship();
+    void redis_response_free(redis_response_t *response);
+
+    // commands executed by namespaces workers
+    void redis_routed_done(redis_client_t *client, redis_client_t *shadow);
+    resp_status_t redis_routed_resume(redis_client_t *client, int value);
 #endif
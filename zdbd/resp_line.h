@@ -0,0 +1,62 @@
+#ifndef ZDBD_RESP_LINE_H
+    #define ZDBD_RESP_LINE_H
+
+    #include <string.h>
+    #include <limits.h>
+    #ifdef __SSE2__
+    #include <emmintrin.h>
+    #endif
+
+    //
+    // protocol framing
+    //
+    // each request is made of small header lines ('*3\r\n', '$3\r\n', ...)
+    // followed by the payloads, headers lines are short, finding the end
+    // of line is done by block of 16 bytes when simd is available (instead
+    // of calling memchr for few bytes), and the length is decoded without
+    // going through atoi (which needs to handle locale, spaces, signs, ...)
+    //
+    // only sse2 is needed (part of any x86_64 baseline), a wider scan (avx2)
+    // doesn't help, lines are shorter than a single 16 bytes block most of
+    // the time
+    //
+
+    // returns a pointer to the next '\n' (end of line), or NULL if
+    // the line is not fully received yet
+    static inline char *resp_line_end(char *reader, char *writer) {
+    #ifdef __SSE2__
+        const __m128i newline = _mm_set1_epi8('\n');
+
+        while(writer - reader >= 16) {
+            __m128i block = _mm_loadu_si128((const __m128i *) reader);
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+
+            if(mask)
+                return reader + __builtin_ctz(mask);
+
+            reader += 16;
+        }
+    #endif
+
+        return memchr(reader, '\n', writer - reader);
+    }
+
+    // decode the value of a header line (after the type character)
+    // returns -1 if the line doesn't start with a valid positive number
+    static inline int resp_line_integer(char *line, char *end) {
+        long value = 0;
+        char *digit = line + 1;
+
+        if(digit >= end || *digit < '0' || *digit > '9')
+            return -1;
+
+        for(; digit < end && *digit >= '0' && *digit <= '9'; digit++) {
+            value = (value * 10) + (*digit - '0');
+
+            if(value > INT_MAX)
+                return -1;
+        }
+
+        return (int) value;
+    }
+#endif
@@ -0,0 +1,501 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "libzdb.h"
+#include "zdbd.h"
+#include "redis.h"
+#include "scheduler.h"
+
+// namespaces scheduler
+//
+// clients are handled by a single thread (even when commands are executed
+// by namespaces workers, admission and accounting are done by the main thread),
+// one client sending a lot of pipelined commands can keep the event loop busy
+// and every other client (from any namespace) waits behind it
+//
+// each client gets a quantum of commands (and bytes) each time it's read,
+// when the quantum is exhausted, the client is queued on its namespace and
+// commands still on its buffer (or socket) are executed later, namespaces
+// with clients waiting are served in a round robin way, one client per
+// namespace per round, with a quantum multiplied by the namespace weight
+//
+// namespaces can be rate limited (operations per second and bytes per
+// second) with a token bucket, a namespace without tokens left is throttled
+// and its clients wait until the bucket is refilled, limits apply to any
+// client using the namespace (admin included, without password set every
+// client is admin), limits of a namespace can be changed from another one
+//
+// scheduler state is allocated the first time a namespace is used and
+// lives with the namespace, settings are not persistent (like lock or
+// freeze flags)
+
+// namespaces with clients waiting, in order of arrival
+static scheduler_t *active = NULL;
+static scheduler_t *activetail = NULL;
+
+// next namespace to serve on the current round
+static scheduler_t *cursor = NULL;
+static size_t round = 0;
+
+// clients waiting on a namespace which was removed
+static scheduler_t detached = {
+    .weight = SCHEDULER_WEIGHT_DEFAULT,
+};
+
+uint64_t scheduler_time() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t) now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+}
+
+scheduler_t *scheduler_get(namespace_t *namespace) {
+    scheduler_t *scheduler;
+
+    if(namespace->scheduler)
+        return namespace->scheduler;
+
+    if(!(scheduler = calloc(sizeof(scheduler_t), 1))) {
+        zdbd_warnp("scheduler: calloc");
+        return NULL;
+    }
+
+    scheduler->ns = namespace;
+    scheduler->weight = SCHEDULER_WEIGHT_DEFAULT;
+    scheduler->refilled = scheduler_time();
+
+    namespace->scheduler = scheduler;
+
+    return scheduler;
+}
+
+//
+// waiting namespaces list
+//
+static void scheduler_activate(scheduler_t *scheduler) {
+    if(scheduler->active)
+        return;
+
+    scheduler->next = NULL;
+    scheduler->prev = activetail;
+
+    if(activetail)
+        activetail->next = scheduler;
+
+    if(!active)
+        active = scheduler;
+
+    activetail = scheduler;
+    scheduler->active = 1;
+}
+
+static void scheduler_deactivate(scheduler_t *scheduler) {
+    if(!scheduler->active)
+        return;
+
+    if(cursor == scheduler)
+        cursor = scheduler->next;
+
+    if(scheduler->prev)
+        scheduler->prev->next = scheduler->next;
+
+    if(scheduler->next)
+        scheduler->next->prev = scheduler->prev;
+
+    if(active == scheduler)
+        active = scheduler->next;
+
+    if(activetail == scheduler)
+        activetail = scheduler->prev;
+
+    scheduler->next = NULL;
+    scheduler->prev = NULL;
+    scheduler->active = 0;
+}
+
+//
+// clients queue (fifo)
+//
+static void scheduler_enqueue(scheduler_t *scheduler, redis_client_t *client) {
+    client->scheduler = scheduler;
+    client->schedlink.next = NULL;
+    client->schedlink.prev = scheduler->tail;
+
+    if(scheduler->tail)
+        scheduler->tail->schedlink.next = client;
+
+    if(!scheduler->head)
+        scheduler->head = client;
+
+    scheduler->tail = client;
+    scheduler->depth += 1;
+
+    scheduler_activate(scheduler);
+}
+
+static void scheduler_unlink(scheduler_t *scheduler, redis_client_t *client) {
+    if(client->schedlink.prev)
+        client->schedlink.prev->schedlink.next = client->schedlink.next;
+
+    if(client->schedlink.next)
+        client->schedlink.next->schedlink.prev = client->schedlink.prev;
+
+    if(scheduler->head == client)
+        scheduler->head = client->schedlink.next;
+
+    if(scheduler->tail == client)
+        scheduler->tail = client->schedlink.prev;
+
+    client->schedlink.next = NULL;
+    client->schedlink.prev = NULL;
+    client->scheduler = NULL;
+
+    scheduler->depth -= 1;
+}
+
+static redis_client_t *scheduler_dequeue(scheduler_t *scheduler) {
+    redis_client_t *client;
+
+    if(!(client = scheduler->head))
+        return NULL;
+
+    scheduler_unlink(scheduler, client);
+
+    return client;
+}
+
+// client disconnected while waiting
+void scheduler_cancel(redis_client_t *client) {
+    if(!client->scheduler)
+        return;
+
+    scheduler_unlink(client->scheduler, client);
+}
+
+// namespace removed, clients still waiting are moved to the
+// detached queue, they will be served (and get an error) later
+void scheduler_release(namespace_t *namespace) {
+    scheduler_t *scheduler;
+    redis_client_t *client;
+
+    if(!(scheduler = namespace->scheduler))
+        return;
+
+    while((client = scheduler_dequeue(scheduler)))
+        scheduler_enqueue(&detached, client);
+
+    scheduler_deactivate(scheduler);
+
+    free(scheduler);
+    namespace->scheduler = NULL;
+}
+
+//
+// rate limits
+//
+static double scheduler_burst(size_t limit) {
+    double burst = (double) limit * SCHEDULER_BURST_MS / 1000;
+    return (burst < 1) ? 1 : burst;
+}
+
+static void scheduler_refill(scheduler_t *scheduler, uint64_t now) {
+    double elapsed = (double) (now - scheduler->refilled) / 1000000;
+    scheduler->refilled = now;
+
+    if(scheduler->maxops) {
+        double burst = scheduler_burst(scheduler->maxops);
+
+        scheduler->opstokens += elapsed * scheduler->maxops;
+        if(scheduler->opstokens > burst)
+            scheduler->opstokens = burst;
+    }
+
+    if(scheduler->maxbytes) {
+        double burst = scheduler_burst(scheduler->maxbytes);
+
+        scheduler->bytestokens += elapsed * scheduler->maxbytes;
+        if(scheduler->bytestokens > burst)
+            scheduler->bytestokens = burst;
+    }
+}
+
+// returns 1 if the namespace can execute a command right now, otherwise
+// the namespace is flagged throttled, until tokens are available again
+static int scheduler_ready(scheduler_t *scheduler, uint64_t now) {
+    if(!scheduler->maxops && !scheduler->maxbytes)
+        return 1;
+
+    scheduler_refill(scheduler, now);
+
+    if((!scheduler->maxops || scheduler->opstokens >= 1) && (!scheduler->maxbytes || scheduler->bytestokens > 0)) {
+        if(scheduler->throttled) {
+            scheduler->throttledus += now - scheduler->throttled;
+            scheduler->throttled = 0;
+        }
+
+        return 1;
+    }
+
+    if(!scheduler->throttled) {
+        scheduler->throttled = now;
+        scheduler->throttles += 1;
+    }
+
+    return 0;
+}
+
+// amount of time (us) before a throttled namespace gets tokens back
+static uint64_t scheduler_wait(scheduler_t *scheduler) {
+    uint64_t wait = 0;
+
+    if(scheduler->maxops && scheduler->opstokens < 1) {
+        uint64_t opswait = (1 - scheduler->opstokens) * 1000000 / scheduler->maxops;
+        wait = (opswait > wait) ? opswait : wait;
+    }
+
+    if(scheduler->maxbytes && scheduler->bytestokens <= 0) {
+        uint64_t byteswait = (1 - scheduler->bytestokens) * 1000000 / scheduler->maxbytes;
+        wait = (byteswait > wait) ? byteswait : wait;
+    }
+
+    return wait;
+}
+
+// throttled time, including the current throttling period
+uint64_t scheduler_throttled_us(scheduler_t *scheduler) {
+    if(!scheduler->throttled)
+        return scheduler->throttledus;
+
+    return scheduler->throttledus + (scheduler_time() - scheduler->throttled);
+}
+
+//
+// settings
+//
+int scheduler_set_weight(namespace_t *namespace, size_t weight) {
+    scheduler_t *scheduler;
+
+    if(!(scheduler = scheduler_get(namespace)))
+        return 1;
+
+    scheduler->weight = weight;
+
+    return 0;
+}
+
+int scheduler_set_maxops(namespace_t *namespace, size_t maxops) {
+    scheduler_t *scheduler;
+
+    if(!(scheduler = scheduler_get(namespace)))
+        return 1;
+
+    // starting with a full bucket
+    scheduler->maxops = maxops;
+    scheduler->opstokens = scheduler_burst(maxops);
+    scheduler->refilled = scheduler_time();
+
+    return 0;
+}
+
+int scheduler_set_maxbytes(namespace_t *namespace, size_t maxbytes) {
+    scheduler_t *scheduler;
+
+    if(!(scheduler = scheduler_get(namespace)))
+        return 1;
+
+    scheduler->maxbytes = maxbytes;
+    scheduler->bytestokens = scheduler_burst(maxbytes);
+    scheduler->refilled = scheduler_time();
+
+    return 0;
+}
+
+//
+// clients
+//
+
+// new quantum for a client, according to its namespace weight
+void scheduler_grant(redis_client_t *client) {
+    size_t weight = SCHEDULER_WEIGHT_DEFAULT;
+
+    if(client->ns && client->ns->scheduler)
+        weight = ((scheduler_t *) client->ns->scheduler)->weight;
+
+    client->grantops = SCHEDULER_QUANTUM_OPS * weight;
+    client->grantbytes = SCHEDULER_QUANTUM_BYTES * weight;
+}
+
+// called before parsing a new command, returns 1 if the command
+// can be executed right now, otherwise the client is queued on its
+// namespace and 0 is returned
+int scheduler_admit(redis_client_t *client) {
+    scheduler_t *scheduler;
+
+    // already waiting
+    if(client->scheduler)
+        return 0;
+
+    // namespace removed, nothing to schedule anymore
+    if(!client->ns)
+        return 1;
+
+    if(!(scheduler = scheduler_get(client->ns)))
+        return 1;
+
+    // other clients of this namespace are waiting their turn, this
+    // client was not resumed by the scheduler, it waits behind them
+    if(scheduler->depth > 0 && !client->granted) {
+        scheduler->yields += 1;
+        scheduler_enqueue(scheduler, client);
+        return 0;
+    }
+
+    if(!scheduler_ready(scheduler, scheduler_time())) {
+        scheduler_enqueue(scheduler, client);
+        return 0;
+    }
+
+    // quantum exhausted, let other clients run
+    if(client->grantops == 0 || client->grantbytes == 0) {
+        scheduler->yields += 1;
+        scheduler_enqueue(scheduler, client);
+        return 0;
+    }
+
+    return 1;
+}
+
+// account a command executed, bytes are received and sent bytes
+void scheduler_charge(redis_client_t *client, size_t bytes) {
+    scheduler_t *scheduler;
+
+    if(client->grantops > 0)
+        client->grantops -= 1;
+
+    client->grantbytes = (bytes < client->grantbytes) ? client->grantbytes - bytes : 0;
+
+    if(!client->ns || !(scheduler = client->ns->scheduler))
+        return;
+
+    scheduler->served += 1;
+    scheduler->servedbytes += bytes;
+
+    if(scheduler->maxops)
+        scheduler->opstokens -= 1;
+
+    if(scheduler->maxbytes)
+        scheduler->bytestokens -= bytes;
+}
+
+//
+// event loop
+//
+
+// start a new round, each namespace with clients waiting
+// will have one client served (if not throttled)
+void scheduler_round() {
+    round += 1;
+    cursor = active;
+}
+
+// next client to resume on this round, the client is removed
+// from the queue and gets a new quantum
+redis_client_t *scheduler_next() {
+    uint64_t now = scheduler_time();
+
+    while(cursor) {
+        scheduler_t *scheduler = cursor;
+        redis_client_t *client;
+
+        cursor = scheduler->next;
+
+        // namespace activated again during this round
+        if(scheduler->round == round)
+            continue;
+
+        scheduler->round = round;
+
+        if(scheduler->depth == 0) {
+            scheduler_deactivate(scheduler);
+            continue;
+        }
+
+        if(!scheduler_ready(scheduler, now))
+            continue;
+
+        client = scheduler_dequeue(scheduler);
+
+        scheduler_grant(client);
+        client->granted = 1;
+
+        return client;
+    }
+
+    // detached clients, their namespace doesn't exists anymore,
+    // they are resumed to get an error and a new namespace
+    if(detached.depth > 0) {
+        redis_client_t *client = scheduler_dequeue(&detached);
+
+        scheduler_grant(client);
+        client->granted = 1;
+
+        return client;
+    }
+
+    return NULL;
+}
+
+// event loop timeout (ms) needed to serve waiting clients, 0 if
+// some clients can be served right now, -1 if nothing is waiting
+int scheduler_timeout() {
+    uint64_t now = scheduler_time();
+    uint64_t wait = 0;
+    int waiting = 0;
+
+    for(scheduler_t *scheduler = active; scheduler; ) {
+        scheduler_t *next = scheduler->next;
+
+        if(scheduler->depth == 0) {
+            scheduler_deactivate(scheduler);
+            scheduler = next;
+            continue;
+        }
+
+        if(scheduler_ready(scheduler, now))
+            return 0;
+
+        uint64_t until = scheduler_wait(scheduler);
+
+        if(!waiting || until < wait)
+            wait = until;
+
+        waiting = 1;
+        scheduler = next;
+    }
+
+    if(detached.depth > 0)
+        return 0;
+
+    if(!waiting)
+        return -1;
+
+    // rounding up to not wake up too early
+    return (wait / 1000) + 1;
+}
+
+// namespaces are released before being destroyed
+void scheduler_destroy() {
+    namespace_t *namespace;
+
+    for(namespace = namespace_iter(); namespace; namespace = namespace_iter_next(namespace)) {
+        free(namespace->scheduler);
+        namespace->scheduler = NULL;
+    }
+
+    active = NULL;
+    activetail = NULL;
+    cursor = NULL;
+}
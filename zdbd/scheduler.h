@@ -0,0 +1,67 @@
+#ifndef ZDBD_SCHEDULER_H
+    #define ZDBD_SCHEDULER_H
+
+    // amount of commands (and bytes received and sent) a client can
+    // process in a row before letting other clients run, multiplied
+    // by the namespace weight
+    #define SCHEDULER_QUANTUM_OPS    64
+    #define SCHEDULER_QUANTUM_BYTES  1024 * 1024
+
+    #define SCHEDULER_WEIGHT_DEFAULT  1
+    #define SCHEDULER_WEIGHT_MAX      100
+
+    // rate limits burst, amount of time worth of operations (or bytes)
+    // which can be executed at once after being idle
+    #define SCHEDULER_BURST_MS  100
+
+    // scheduling state of one namespace, allocated the first time
+    // the namespace is used
+    typedef struct scheduler_t {
+        namespace_t *ns;          // namespace (NULL for detached clients)
+        size_t weight;            // share compared to other namespaces
+        size_t maxops;            // operations per second (0: unlimited)
+        size_t maxbytes;          // bytes per second (0: unlimited)
+
+        double opstokens;         // operations available right now
+        double bytestokens;       // bytes available right now (can be negative)
+        uint64_t refilled;        // last tokens refill (us)
+
+        redis_client_t *head;     // clients waiting for their turn
+        redis_client_t *tail;
+        size_t depth;             // amount of clients waiting
+
+        uint64_t throttled;       // throttled since (us), 0 when not throttled
+        uint64_t throttledus;     // time spent throttled with clients waiting
+        size_t throttles;         // amount of times the namespace was throttled
+        size_t yields;            // amount of times a client had to wait its turn
+        size_t served;            // amount of commands executed
+        size_t servedbytes;       // amount of bytes received and sent
+
+        struct scheduler_t *next; // namespaces with clients waiting
+        struct scheduler_t *prev;
+        int active;               // linked on the waiting list
+        size_t round;             // last round this namespace was served
+
+    } scheduler_t;
+
+    uint64_t scheduler_time();
+
+    scheduler_t *scheduler_get(namespace_t *namespace);
+    void scheduler_release(namespace_t *namespace);
+
+    int scheduler_set_weight(namespace_t *namespace, size_t weight);
+    int scheduler_set_maxops(namespace_t *namespace, size_t maxops);
+    int scheduler_set_maxbytes(namespace_t *namespace, size_t maxbytes);
+
+    void scheduler_grant(redis_client_t *client);
+    int scheduler_admit(redis_client_t *client);
+    void scheduler_charge(redis_client_t *client, size_t bytes);
+    void scheduler_cancel(redis_client_t *client);
+
+    void scheduler_round();
+    redis_client_t *scheduler_next();
+    int scheduler_timeout();
+
+    uint64_t scheduler_throttled_us(scheduler_t *scheduler);
+    void scheduler_destroy();
+#endif
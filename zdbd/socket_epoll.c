@@ -10,24 +10,40 @@
 #ifdef __linux__
 
 #include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <errno.h>
 #include "libzdb.h"
 #include "zdbd.h"
 #include "redis.h"
+#include "network.h"
+#include "worker.h"
 
-#define MAXEVENTS 64
-#define EVTIMEOUT 200
+// amount of events fetched per wakeup, this grows when
+// the server is busy (all the events slots were used) and
+// shrinks back when the load goes down
+#define MAXEVENTS_MIN 64
+#define MAXEVENTS_MAX 4096
 
-static int socket_client_accept(redis_handler_t *redis, int fd) {
-    int clientfd;
+// idle (background) processing interval, in milliseconds
+#define IDLE_INTERVAL 100
 
-    if((clientfd = accept(fd, NULL, NULL)) == -1) {
-        zdbd_verbosep("socket_event", "accept");
-        return 0;
-    }
+// maximum amount of connections accepted in a row, the
+// listening socket is level-triggered, remaining connections
+// are notified again on next wakeup
+#define ACCEPT_BATCH 256
+
+// namespaces workers completion notification (-1 without workers)
+static int workerfd = -1;
 
+static int socket_client_register(redis_handler_t *redis, int clientfd) {
     socket_nonblock(clientfd);
     socket_keepalive(clientfd);
-    socket_client_new(clientfd);
+    socket_nodelay(clientfd);
+
+    if(!socket_client_new(clientfd)) {
+        close(clientfd);
+        return 0;
+    }
 
     zdbd_verbose("[+] incoming connection (socket %d)\n", clientfd);
 
@@ -42,15 +58,81 @@ static int socket_client_accept(redis_handler_t *redis, int fd) {
     // we use edge-level because of how the
     // upload works (need to be notified when client
     // is ready to receive data, only one time)
+    //
+    // reads always drain the socket (until the receive
+    // queue is empty), nothing is left unnotified
 
     if(epoll_ctl(redis->evfd, EPOLL_CTL_ADD, clientfd, &event) < 0) {
         zdbd_verbosep("socket_event", "epoll_ctl");
+        socket_client_free(clientfd);
         return 0;
     }
 
     return 1;
 }
 
+// accept all the pending connections, one event is enough
+// for a burst of new connections
+static int socket_client_accept(redis_handler_t *redis, int fd) {
+    int accepted;
+
+    for(accepted = 0; accepted < ACCEPT_BATCH; accepted++) {
+        int clientfd;
+
+        if((clientfd = accept(fd, NULL, NULL)) == -1) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                zdbd_verbosep("socket_event", "accept");
+
+            break;
+        }
+
+        socket_client_register(redis, clientfd);
+    }
+
+    return accepted;
+}
+
+// the idle timer expired, running background tasks
+static void socket_idle_timer(int fd) {
+    uint64_t expirations;
+
+    if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+
+    redis_idle_process();
+}
+
+// initialize the periodic timer used to run background tasks,
+// this keeps them running at the same pace, busy server or not
+static int socket_idle_timer_init(redis_handler_t *handler) {
+    struct epoll_event event;
+    struct itimerspec interval = {
+        .it_interval = {
+            .tv_sec = 0,
+            .tv_nsec = IDLE_INTERVAL * 1000000
+        },
+        .it_value = {
+            .tv_sec = 0,
+            .tv_nsec = IDLE_INTERVAL * 1000000
+        },
+    };
+
+    if((handler->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) < 0)
+        zdbd_diep("timerfd_create");
+
+    if(timerfd_settime(handler->timerfd, 0, &interval, NULL) < 0)
+        zdbd_diep("timerfd_settime");
+
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.data.fd = handler->timerfd;
+    event.events = EPOLLIN;
+
+    if(epoll_ctl(handler->evfd, EPOLL_CTL_ADD, handler->timerfd, &event) < 0)
+        zdbd_diep("epoll_ctl");
+
+    return 0;
+}
+
 static int socket_event(struct epoll_event *events, int notified, redis_handler_t *redis) {
     struct epoll_event *ev;
 
@@ -58,6 +140,26 @@ static int socket_event(struct epoll_event *events, int notified, redis_handler_
         int newclient = 0;
         ev = events + i;
 
+        // background tasks timer
+        if(ev->data.fd == redis->timerfd) {
+            socket_idle_timer(ev->data.fd);
+            continue;
+        }
+
+        // commands done by the namespaces workers
+        if(ev->data.fd == workerfd) {
+            if(worker_process() == RESP_STATUS_SHUTDOWN) {
+                zdb_log("[+] stopping daemon\n");
+
+                for(int i = 0; i < redis->fdlen; i++)
+                    close(redis->mainfd[i]);
+
+                return 1;
+            }
+
+            continue;
+        }
+
         // epoll issue
         // discard this client
         if((ev->events & EPOLLERR) || (ev->events & EPOLLHUP)) {
@@ -80,34 +182,143 @@ static int socket_event(struct epoll_event *events, int notified, redis_handler_
         if(newclient)
             continue;
 
+        resp_status_t ctrl = RESP_STATUS_SUCCESS;
+
         // data available for reading
         // let's read what's available and check
         // the response code
         if(ev->events & EPOLLIN) {
             // call the redis chunk event handler
-            resp_status_t ctrl = redis_chunk_read(ev->data.fd);
+            ctrl = redis_chunk_read(ev->data.fd);
+        }
 
-            // client error, we discard it
-            if(ctrl == RESP_STATUS_DISCARD || ctrl == RESP_STATUS_DISCONNECTED) {
-                socket_client_free(ev->data.fd);
+        // client is ready for writing, let's check if any
+        // data still needs to be sent or not, a client paused
+        // (output backpressure) is resumed from here and commands
+        // are executed again, this is handled like a read
+        if((ev->events & EPOLLOUT) && ctrl != RESP_STATUS_DISCARD && ctrl != RESP_STATUS_DISCONNECTED && ctrl != RESP_STATUS_SHUTDOWN) {
+            ctrl = redis_delayed_write(ev->data.fd);
+        }
+
+        // client error, we discard it
+        if(ctrl == RESP_STATUS_DISCARD || ctrl == RESP_STATUS_DISCONNECTED) {
+            socket_client_free(ev->data.fd);
+            continue;
+        }
+
+        // (dirty) way the STOP event is handled
+        if(ctrl == RESP_STATUS_SHUTDOWN) {
+            zdb_log("[+] stopping daemon\n");
+
+            for(int i = 0; i < redis->fdlen; i++)
+                close(redis->mainfd[i]);
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// start the namespaces workers (if enabled), their completion
+// notification is handled like any other event
+static void socket_workers_init(redis_handler_t *handler) {
+    struct epoll_event event;
+
+    if((workerfd = worker_start()) < 0)
+        return;
+
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.data.fd = workerfd;
+    event.events = EPOLLIN;
+
+    if(epoll_ctl(handler->evfd, EPOLL_CTL_ADD, workerfd, &event) < 0)
+        zdbd_diep("epoll_ctl");
+}
+
+// stop network threads, then the listening sockets they were using
+static int socket_handler_stop(redis_handler_t *handler) {
+    zdb_log("[+] stopping daemon\n");
+
+    network_stop();
+
+    for(int i = 0; i < handler->fdlen; i++)
+        close(handler->mainfd[i]);
+
+    close(handler->timerfd);
+
+    return 1;
+}
+
+// network threads enabled (--threads), clients sockets are handled by the
+// network threads (see network.c), this loop only executes commands received
+// from them, and runs everything else which used to run between events
+// (followers, scheduler, idle tasks) exactly like the single thread mode
+static int socket_handler_threads(redis_handler_t *handler) {
+    struct epoll_event event;
+    struct epoll_event events[8];
+    int notifyfd;
+
+    if((handler->evfd = epoll_create1(0)) < 0)
+        zdbd_diep("epoll_create1");
+
+    socket_idle_timer_init(handler);
+    socket_workers_init(handler);
+    notifyfd = network_start(handler);
+
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.data.fd = notifyfd;
+    event.events = EPOLLIN;
+
+    if(epoll_ctl(handler->evfd, EPOLL_CTL_ADD, notifyfd, &event) < 0)
+        zdbd_diep("epoll_ctl");
+
+    while(1) {
+        if(worker_ready() && worker_process() == RESP_STATUS_SHUTDOWN)
+            return socket_handler_stop(handler);
+
+        int timeout = redis_followers_process() ? 0 : -1;
+        int scheduled;
+
+        if(redis_scheduler_process(&scheduled) == RESP_STATUS_SHUTDOWN)
+            return socket_handler_stop(handler);
+
+        if(scheduled >= 0 && (timeout < 0 || scheduled < timeout))
+            timeout = scheduled;
+
+        // clients continued above can wait for the workers too
+        if(worker_ready())
+            timeout = 0;
+
+        // replies produced during this iteration are
+        // shipped to the network threads at once
+        network_flush();
+
+        int n = epoll_wait(handler->evfd, events, sizeof(events) / sizeof(events[0]), timeout);
+        __atomic_fetch_add(&zdbd_rootsettings.stats.netevents, 1, __ATOMIC_RELAXED);
+
+        if(n < 0) {
+            if(errno != EINTR)
+                zdbd_warnp("epoll_wait");
+
+            continue;
+        }
+
+        for(int i = 0; i < n; i++) {
+            if(events[i].data.fd == handler->timerfd) {
+                socket_idle_timer(handler->timerfd);
                 continue;
             }
 
-            // (dirty) way the STOP event is handled
-            if(ctrl == RESP_STATUS_SHUTDOWN) {
-                zdb_log("[+] stopping daemon\n");
-
-                for(int i = 0; i < redis->fdlen; i++)
-                    close(redis->mainfd[i]);
+            if(events[i].data.fd == workerfd) {
+                if(worker_process() == RESP_STATUS_SHUTDOWN)
+                    return socket_handler_stop(handler);
 
-                return 1;
+                continue;
             }
-        }
 
-        // client is ready for writing, let's check if any
-        // data still needs to be sent or not
-        if(ev->events & EPOLLOUT) {
-            redis_delayed_write(ev->data.fd);
+            if(network_process() == RESP_STATUS_SHUTDOWN)
+                return socket_handler_stop(handler);
         }
     }
 
@@ -118,6 +329,10 @@ int socket_handler(redis_handler_t *handler) {
     struct epoll_event event;
     struct epoll_event *events = NULL;
     zdbd_stats_t *dstats = &zdbd_rootsettings.stats;
+    int maxevents = MAXEVENTS_MIN;
+
+    if(zdbd_rootsettings.threads > 0)
+        return socket_handler_threads(handler);
 
     // initialize empty struct
     memset(&event, 0, sizeof(struct epoll_event));
@@ -134,7 +349,13 @@ int socket_handler(redis_handler_t *handler) {
             zdbd_diep("epoll_ctl");
     }
 
-    events = calloc(MAXEVENTS, sizeof event);
+    socket_idle_timer_init(handler);
+    socket_workers_init(handler);
+
+    // allocating the maximum directly, only the
+    // amount of events fetched changes with the load
+    if(!(events = calloc(MAXEVENTS_MAX, sizeof event)))
+        zdbd_diep("events calloc");
 
     // wait for clients
     // this is how we support multi-client using a single thread
@@ -142,27 +363,69 @@ int socket_handler(redis_handler_t *handler) {
     // allows multiple clients to be connected
 
     while(1) {
-        int n = epoll_wait(handler->evfd, events, MAXEVENTS, EVTIMEOUT);
+        // clients whose commands were done by the workers while
+        // waiting for them (see worker_quiesce) are continued
+        if(worker_ready() && worker_process() == RESP_STATUS_SHUTDOWN) {
+            zdb_log("[+] stopping daemon\n");
+
+            for(int i = 0; i < handler->fdlen; i++)
+                close(handler->mainfd[i]);
+
+            close(handler->timerfd);
+            free(events);
+            return 1;
+        }
+
+        // changes followers still having entries to receive are
+        // fed between events, we don't wait for events in that case,
+        // otherwise, the idle timer ensure we wake up periodically
+        int timeout = redis_followers_process() ? 0 : -1;
+        int scheduled;
+
+        // clients waiting their turn (or throttled) are resumed
+        // between events too, we wake up when the next one is ready
+        if(redis_scheduler_process(&scheduled) == RESP_STATUS_SHUTDOWN) {
+            zdb_log("[+] stopping daemon\n");
+
+            for(int i = 0; i < handler->fdlen; i++)
+                close(handler->mainfd[i]);
+
+            close(handler->timerfd);
+            free(events);
+            return 1;
+        }
+
+        if(scheduled >= 0 && (timeout < 0 || scheduled < timeout))
+            timeout = scheduled;
+
+        if(worker_ready())
+            timeout = 0;
+
+        int n = epoll_wait(handler->evfd, events, maxevents, timeout);
         dstats->netevents += 1;
 
-        if(n == 0) {
-            // timeout reached, checking for background
-            // or pending recurring task to do
-            redis_idle_process();
+        if(n < 0) {
+            if(errno != EINTR)
+                zdbd_warnp("epoll_wait");
+
             continue;
         }
 
         if(socket_event(events, n, handler) == 1) {
+            close(handler->timerfd);
             free(events);
             return 1;
         }
 
-        // force idle process trigger after fixed amount
-        // of commands, otherwise spamming the server enough
-        // would never trigger it
-        if(dstats->netevents % 100 == 0) {
-            zdbd_debug("[+] sockets: forcing idle process [%lu]\n", dstats->netevents);
-            redis_idle_process();
+        // all the slots were used, more events are probably
+        // pending, fetching more of them next time, and going
+        // back slowly when the load decrease
+        if(n == maxevents && maxevents < MAXEVENTS_MAX) {
+            maxevents *= 2;
+            zdbd_debug("[+] sockets: events batch increased to %d\n", maxevents);
+
+        } else if(n < maxevents / 4 && maxevents > MAXEVENTS_MIN) {
+            maxevents /= 2;
         }
     }
 
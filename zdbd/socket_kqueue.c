@@ -10,25 +10,37 @@
 #ifdef __APPLE__
 
 #include <sys/event.h>
+#include <errno.h>
 #include "libzdb.h"
 #include "zdbd.h"
 #include "redis.h"
 
-#define MAXEVENTS 64
-#define EVTIMEOUT 150
-struct kevent evset;
+// amount of events fetched per wakeup, this grows when
+// the server is busy (all the events slots were used) and
+// shrinks back when the load goes down
+#define MAXEVENTS_MIN 64
+#define MAXEVENTS_MAX 4096
 
-static int socket_client_accept(redis_handler_t *redis, int fd) {
-    int clientfd;
+// idle (background) processing interval, in milliseconds
+#define IDLE_INTERVAL 100
 
-    if((clientfd = accept(fd, NULL, NULL)) == -1) {
-        zdbd_warnp("accept");
-        return 1;
-    }
+// identifier of the idle timer event
+#define IDLE_TIMER_ID 1
+
+// maximum amount of connections accepted in a row
+#define ACCEPT_BATCH 256
+
+struct kevent evset;
 
+static int socket_client_register(redis_handler_t *redis, int clientfd) {
     socket_nonblock(clientfd);
     socket_keepalive(clientfd);
-    socket_client_new(clientfd);
+    socket_nodelay(clientfd);
+
+    if(!socket_client_new(clientfd)) {
+        close(clientfd);
+        return 1;
+    }
 
     zdbd_verbose("[+] incoming connection (socket %d)\n", clientfd);
 
@@ -47,6 +59,27 @@ static int socket_client_accept(redis_handler_t *redis, int fd) {
     return 1;
 }
 
+// accept all the pending connections, one event is enough
+// for a burst of new connections
+static int socket_client_accept(redis_handler_t *redis, int fd) {
+    int accepted;
+
+    for(accepted = 0; accepted < ACCEPT_BATCH; accepted++) {
+        int clientfd;
+
+        if((clientfd = accept(fd, NULL, NULL)) == -1) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                zdbd_warnp("accept");
+
+            break;
+        }
+
+        socket_client_register(redis, clientfd);
+    }
+
+    return accepted;
+}
+
 static int socket_event(struct kevent *events, int notified, redis_handler_t *redis) {
     struct kevent *ev;
 
@@ -54,6 +87,12 @@ static int socket_event(struct kevent *events, int notified, redis_handler_t *re
         int newclient = 0;
         ev = events + i;
 
+        // background tasks timer
+        if(ev->filter == EVFILT_TIMER) {
+            redis_idle_process();
+            continue;
+        }
+
         if(ev->flags & EV_EOF) {
             EV_SET(&evset, ev->ident, EVFILT_READ, EV_DELETE, 0, 0, NULL);
 
@@ -79,29 +118,33 @@ static int socket_event(struct kevent *events, int notified, redis_handler_t *re
         if(newclient)
             continue;
 
+        resp_status_t ctrl = RESP_STATUS_SUCCESS;
+
         if(ev->filter == EVFILT_READ) {
             // call the redis chunk event handler
-            resp_status_t ctrl = redis_chunk_read(ev->ident);
+            ctrl = redis_chunk_read(ev->ident);
+        }
 
-            // client error, we discard it
-            if(ctrl == RESP_STATUS_DISCARD || ctrl == RESP_STATUS_DISCONNECTED) {
-                socket_client_free(ev->ident);
-                continue;
-            }
+        // a client paused (output backpressure) is resumed from
+        // here and commands are executed again, handled like a read
+        if(ev->filter == EVFILT_WRITE) {
+            ctrl = redis_delayed_write(ev->ident);
+        }
 
-            // (dirty) way the STOP event is handled
-            if(ctrl == RESP_STATUS_SHUTDOWN) {
-                zdb_log("[+] stopping daemon\n");
+        // client error, we discard it
+        if(ctrl == RESP_STATUS_DISCARD || ctrl == RESP_STATUS_DISCONNECTED) {
+            socket_client_free(ev->ident);
+            continue;
+        }
 
-                for(int i = 0; i < redis->fdlen; i++)
-                    close(redis->mainfd[i]);
+        // (dirty) way the STOP event is handled
+        if(ctrl == RESP_STATUS_SHUTDOWN) {
+            zdb_log("[+] stopping daemon\n");
 
-                return 1;
-            }
-        }
+            for(int i = 0; i < redis->fdlen; i++)
+                close(redis->mainfd[i]);
 
-        if(ev->filter == EVFILT_WRITE) {
-            redis_delayed_write(ev->ident);
+            return 1;
         }
     }
 
@@ -110,10 +153,11 @@ static int socket_event(struct kevent *events, int notified, redis_handler_t *re
 
 int socket_handler(redis_handler_t *handler) {
     zdbd_stats_t *dstats = &zdbd_rootsettings.stats;
-    struct kevent evlist[MAXEVENTS];
-    struct timespec timeout = {
+    struct kevent *evlist;
+    int maxevents = MAXEVENTS_MIN;
+    struct timespec immediate = {
         .tv_sec = 0,
-        .tv_nsec = EVTIMEOUT * 1000000
+        .tv_nsec = 0
     };
 
 
@@ -128,31 +172,78 @@ int socket_handler(redis_handler_t *handler) {
             zdbd_diep("kevent");
     }
 
+    // periodic timer used to run background tasks,
+    // this keeps them running at the same pace, busy server or not
+    EV_SET(&evset, IDLE_TIMER_ID, EVFILT_TIMER, EV_ADD, 0, IDLE_INTERVAL, NULL);
+
+    if(kevent(handler->evfd, &evset, 1, NULL, 0, NULL) == -1)
+        zdbd_diep("kevent: timer");
+
+    // allocating the maximum directly, only the
+    // amount of events fetched changes with the load
+    if(!(evlist = calloc(MAXEVENTS_MAX, sizeof(struct kevent))))
+        zdbd_diep("events calloc");
+
     // wait for clients
     // this is how we support multi-client using a single thread
     // note that, we will only handle one request at a time
     // allows multiple clients to be connected
 
     while(1) {
-        int n = kevent(handler->evfd, NULL, 0, evlist, MAXEVENTS, &timeout);
+        // changes followers still having entries to receive are
+        // fed between events, we don't wait for events in that case,
+        // otherwise, the idle timer ensure we wake up periodically
+        int pending = redis_followers_process();
+        int scheduled;
+
+        // clients waiting their turn (or throttled) are resumed
+        // between events too, we wake up when the next one is ready
+        if(redis_scheduler_process(&scheduled) == RESP_STATUS_SHUTDOWN) {
+            zdb_log("[+] stopping daemon\n");
+
+            for(int i = 0; i < handler->fdlen; i++)
+                close(handler->mainfd[i]);
+
+            free(evlist);
+            return 1;
+        }
+
+        struct timespec wait = {
+            .tv_sec = scheduled / 1000,
+            .tv_nsec = (scheduled % 1000) * 1000000
+        };
+
+        struct timespec *timeout = NULL;
+
+        if(scheduled >= 0)
+            timeout = &wait;
+
+        if(pending)
+            timeout = &immediate;
+
+        int n = kevent(handler->evfd, NULL, 0, evlist, maxevents, timeout);
         dstats->netevents += 1;
 
-        if(n == 0) {
-            // timeout reached, checking for background
-            // or pending recurring task to do
-            redis_idle_process();
+        if(n < 0) {
+            if(errno != EINTR)
+                zdbd_warnp("kevent");
+
             continue;
         }
 
-        if(socket_event(evlist, n, handler) == 1)
+        if(socket_event(evlist, n, handler) == 1) {
+            free(evlist);
             return 1;
+        }
 
-        // force idle process trigger after fixed amount
-        // of commands, otherwise spamming the server enough
-        // would never trigger it
-        if(dstats->netevents % 100 == 0) {
-            zdbd_debug("[+] sockets: forcing idle process [%llu]\n", dstats->netevents);
-            redis_idle_process();
+        // all the slots were used, more events are probably
+        // pending, fetching more of them next time, and going
+        // back slowly when the load decrease
+        if(n == maxevents && maxevents < MAXEVENTS_MAX) {
+            maxevents *= 2;
+
+        } else if(n < maxevents / 4 && maxevents > MAXEVENTS_MIN) {
+            maxevents /= 2;
         }
     }
 
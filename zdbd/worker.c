@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include "libzdb.h"
+#include "zdbd.h"
+#include "redis.h"
+#include "worker.h"
+
+// this implementation is only used on linux
+#ifdef __linux__
+
+#include <sys/eventfd.h>
+
+//
+// namespaces workers
+//
+// with --workers, namespaces are partitioned over worker threads, a namespace
+// is owned by one worker (by its slot on the namespaces list), only this worker
+// reads or writes the namespace index and data, namespaces owned by different
+// workers are served in parallel
+//
+// the main thread still handles clients (or receives them from the network
+// threads), parses requests and runs everything around a command: scheduler,
+// backpressure, mirroring, watchers, followers... a command on a namespace
+// (SET, GET, SCAN, ...) is routed to the worker owning the namespace of the
+// client, and the client is suspended until the worker is done: nothing else
+// is parsed or read from it, its request is kept as it is, which keeps the
+// replies in order without any ordering on the worker side
+//
+// the worker executes the handler with a copy of the client (the shadow), which
+// have its own replies queue, when done, the main thread appends these replies
+// to the client queue, runs the post handler (mirrors, watchers) then continue
+// with the next command of the client
+//
+// commands touching namespaces in another way (creation, removal, settings,
+// statistics, ...) are executed by the main thread with the workers paused:
+// the main thread waits until every command routed is done, nothing is routed
+// in the meantime since the main thread is busy, same for background tasks
+// (rotation, scrubbing, hooks) and for changes followers (only the worker
+// owning the followed namespace is waited)
+//
+// commands not touching any namespace (PING, SELECT, AUTH, WAIT, ...) are
+// executed by the main thread without waiting
+//
+
+static worker_t *workers = NULL;
+static int workerslen = 0;
+static size_t inflight = 0;
+
+// jobs done, from all the workers to the main thread
+static worker_queue_t completed = {
+    .head = NULL,
+    .notifyfd = -1,
+};
+
+// jobs taken from the completed queue while waiting for the workers,
+// clients are continued from the main loop (see worker_process)
+static worker_job_t *ready = NULL;
+static worker_job_t *readytail = NULL;
+
+//
+// jobs queues
+//
+
+// push one job, the consumer is notified only if the queue
+// was empty, otherwise it was already notified
+static void worker_queue_push(worker_queue_t *queue, worker_job_t *job) {
+    uint64_t notify = 1;
+    worker_job_t *head;
+
+    head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+
+    do {
+        job->next = head;
+    } while(!__atomic_compare_exchange_n(&queue->head, &head, job, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if(head == NULL && write(queue->notifyfd, &notify, sizeof(notify)) != sizeof(notify))
+        zdbd_warnp("worker: queue notify");
+}
+
+// take all the jobs of a queue, oldest first, the notification is
+// cleared before taking the jobs, a push done in the meantime will
+// notify again (the worker inbox notification is blocking)
+static worker_job_t *worker_queue_take(worker_queue_t *queue) {
+    worker_job_t *job, *next, *ordered = NULL;
+    uint64_t notified;
+
+    if(read(queue->notifyfd, &notified, sizeof(notified)) < 0 && errno != EAGAIN && errno != EINTR)
+        zdbd_warnp("worker: queue notification");
+
+    job = __atomic_exchange_n(&queue->head, NULL, __ATOMIC_ACQUIRE);
+
+    // stack is newest first, reversing it
+    for(; job; job = next) {
+        next = job->next;
+        job->next = ordered;
+        ordered = job;
+    }
+
+    return ordered;
+}
+
+//
+// worker side
+//
+static void *worker_thread(void *arg) {
+    worker_t *worker = (worker_t *) arg;
+    worker_job_t *job, *next;
+    sigset_t mask;
+
+    // signals are handled by the main thread
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    zdb_thread_attach();
+
+    while(!__atomic_load_n(&worker->stop, __ATOMIC_ACQUIRE)) {
+        // blocking until something is pushed
+        for(job = worker_queue_take(&worker->inbox); job; job = next) {
+            next = job->next;
+
+            job->value = job->command->handler(&job->shadow);
+
+            // each job is handed back right away, the client is
+            // waiting for it and nothing else is pending for it
+            worker_queue_push(&completed, job);
+        }
+    }
+
+    zdb_thread_detach();
+
+    return NULL;
+}
+
+//
+// main thread side
+//
+int worker_start() {
+    int count = zdbd_rootsettings.workers;
+
+    if(count == 0)
+        return -1;
+
+    if((completed.notifyfd = eventfd(0, EFD_NONBLOCK)) < 0)
+        zdbd_diep("worker: eventfd");
+
+    if(!(workers = calloc(sizeof(worker_t), count)))
+        zdbd_diep("worker: workers calloc");
+
+    for(int i = 0; i < count; i++) {
+        worker_t *worker = &workers[i];
+
+        worker->id = i;
+
+        // workers are blocking on their inbox notification
+        if((worker->inbox.notifyfd = eventfd(0, 0)) < 0)
+            zdbd_diep("worker: eventfd");
+
+        if((errno = pthread_create(&worker->thread, NULL, worker_thread, worker)))
+            zdbd_diep("worker: pthread_create");
+    }
+
+    workerslen = count;
+    zdb_log("[+] workers: %d namespaces workers started\n", count);
+
+    return completed.notifyfd;
+}
+
+int worker_enabled() {
+    return (workerslen > 0);
+}
+
+// some clients can be continued
+int worker_ready() {
+    return (ready != NULL);
+}
+
+int worker_owner(namespace_t *namespace) {
+    return (int) (namespace->idlist % workerslen);
+}
+
+resp_status_t worker_route(redis_client_t *client, command_t *command) {
+    worker_job_t *job = client->job;
+    worker_t *worker = &workers[worker_owner(client->ns)];
+
+    if(!job && !(job = client->job = malloc(sizeof(worker_job_t)))) {
+        zdbd_warnp("worker: job malloc");
+        return RESP_STATUS_DISCARD;
+    }
+
+    // replies are queued on the shadow only, they are
+    // appended to the client queue when the job is done
+    job->client = client;
+    job->command = command;
+    job->worker = worker;
+    job->value = 0;
+
+    job->shadow = *client;
+    job->shadow.responses = NULL;
+    job->shadow.responsetail = NULL;
+    job->shadow.responsebytes = 0;
+    job->shadow.responsememory = 0;
+    job->shadow.produced = 0;
+    job->shadow.corked = 1;
+    job->shadow.remote = NULL;
+
+    client->routed = 1;
+    worker->inflight += 1;
+    inflight += 1;
+
+    worker_queue_push(&worker->inbox, job);
+
+    return RESP_STATUS_ROUTED;
+}
+
+// job done, replies and everything done after a command are
+// applied on the client, it will be continued from the main loop
+// and stays suspended until then
+static void worker_complete(worker_job_t *job) {
+    job->worker->inflight -= 1;
+    inflight -= 1;
+
+    redis_routed_done(job->client, &job->shadow);
+
+    job->next = NULL;
+
+    if(readytail)
+        readytail->next = job;
+    else
+        ready = job;
+
+    readytail = job;
+}
+
+static void worker_complete_all() {
+    worker_job_t *job, *next;
+
+    for(job = worker_queue_take(&completed); job; job = next) {
+        next = job->next;
+        worker_complete(job);
+    }
+}
+
+// wait until everything routed to the worker owning this namespace
+// (or to any worker, without namespace) is done, jobs done are applied
+// in the order they were done
+void worker_quiesce(namespace_t *namespace) {
+    struct pollfd pfd = {
+        .fd = completed.notifyfd,
+        .events = POLLIN,
+    };
+
+    if(workerslen == 0)
+        return;
+
+    size_t *pending = (namespace) ? &workers[worker_owner(namespace)].inflight : &inflight;
+
+    while(*pending > 0) {
+        // the notification can be left from jobs already
+        // taken, it's cleared when taking the jobs
+        if(__atomic_load_n(&completed.head, __ATOMIC_ACQUIRE) == NULL)
+            if(poll(&pfd, 1, -1) < 0 && errno != EINTR)
+                zdbd_warnp("worker: poll");
+
+        worker_complete_all();
+    }
+}
+
+// jobs done by the workers, clients are continued: commands
+// received in the meantime are executed
+resp_status_t worker_process() {
+    resp_status_t status = RESP_STATUS_SUCCESS;
+    worker_job_t *job;
+
+    worker_complete_all();
+
+    // continuing a client can wait for the workers (exclusive
+    // command), more clients can be ready while processing
+    while((job = ready)) {
+        redis_client_t *client = job->client;
+        int fd = client->fd;
+
+        if(!(ready = job->next))
+            readytail = NULL;
+
+        resp_status_t value = redis_routed_resume(client, job->value);
+
+        if(value == RESP_STATUS_DISCARD || value == RESP_STATUS_DISCONNECTED) {
+            socket_client_free(fd);
+            continue;
+        }
+
+        // nothing is continued anymore, clients are
+        // released by the caller
+        if(value == RESP_STATUS_SHUTDOWN) {
+            status = RESP_STATUS_SHUTDOWN;
+            break;
+        }
+    }
+
+    return status;
+}
+
+void worker_stop() {
+    uint64_t notify = 1;
+
+    if(workerslen == 0)
+        return;
+
+    // commands routed are finished first, clients are not
+    // continued anymore, they can be released
+    worker_quiesce(NULL);
+
+    for(worker_job_t *job = ready; job; job = job->next)
+        job->client->routed = 0;
+
+    ready = NULL;
+    readytail = NULL;
+
+    for(int i = 0; i < workerslen; i++) {
+        __atomic_store_n(&workers[i].stop, 1, __ATOMIC_RELEASE);
+
+        if(write(workers[i].inbox.notifyfd, &notify, sizeof(notify)) != sizeof(notify))
+            zdbd_warnp("worker: stop notify");
+    }
+
+    for(int i = 0; i < workerslen; i++) {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].inbox.notifyfd);
+    }
+
+    close(completed.notifyfd);
+    free(workers);
+
+    workers = NULL;
+    workerslen = 0;
+}
+
+#else
+
+int worker_start() {
+    return -1;
+}
+
+int worker_enabled() {
+    return 0;
+}
+
+int worker_ready() {
+    return 0;
+}
+
+resp_status_t worker_process() {
+    return RESP_STATUS_SUCCESS;
+}
+
+void worker_stop() {
+}
+
+int worker_owner(namespace_t *namespace) {
+    (void) namespace;
+    return 0;
+}
+
+resp_status_t worker_route(redis_client_t *client, command_t *command) {
+    (void) client;
+    (void) command;
+    return RESP_STATUS_DISCARD;
+}
+
+void worker_quiesce(namespace_t *namespace) {
+    (void) namespace;
+}
+
+#endif // __linux__
@@ -0,0 +1,54 @@
+#ifndef ZDBD_WORKER_H
+    #define ZDBD_WORKER_H
+
+    #include <pthread.h>
+
+    // namespaces workers (--workers): namespaces are partitioned over
+    // worker threads, each worker owns the index and data of its
+    // namespaces, commands on a namespace are routed to the worker
+    // owning it (see worker.c)
+
+    // maximum amount of workers
+    #define WORKERS_MAX  64
+
+    // one command executed by a worker, each client have its own job
+    // (reused), a client have at most one command executed at a time
+    typedef struct worker_job_t {
+        redis_client_t *client;     // client which sent the command
+        redis_client_t shadow;      // copy of the client the handler is executed with
+        command_t *command;         // handler to execute
+        int value;                  // handler return value
+        struct worker_t *worker;    // worker executing it
+
+        struct worker_job_t *next;
+
+    } worker_job_t;
+
+    // multiple producers, single consumer queue (same as network.c), the
+    // eventfd is signaled when the queue becomes non-empty
+    typedef struct worker_queue_t {
+        worker_job_t *head;
+        int notifyfd;
+
+    } worker_queue_t;
+
+    typedef struct worker_t {
+        int id;
+        pthread_t thread;
+        worker_queue_t inbox;       // jobs to execute
+        int stop;                   // requested to stop
+
+        size_t inflight;            // main thread: jobs routed, not done yet
+
+    } worker_t;
+
+    int worker_start();
+    int worker_enabled();
+    int worker_ready();
+    resp_status_t worker_process();
+    void worker_stop();
+
+    int worker_owner(namespace_t *namespace);
+    resp_status_t worker_route(redis_client_t *client, command_t *command);
+    void worker_quiesce(namespace_t *namespace);
+#endif
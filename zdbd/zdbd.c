@@ -15,6 +15,8 @@
 #include "libzdb.h"
 #include "zdbd.h"
 #include "redis.h"
+#include "network.h"
+#include "worker.h"
 
 //
 // global system settings
@@ -30,6 +32,8 @@ zdbd_settings_t zdbd_rootsettings = {
     .protect = 0,
     .dualnet = 0,
     .rotatesec = 0,
+    .threads = 0,
+    .workers = 0,
 };
 
 static struct option long_options[] = {
@@ -39,6 +43,8 @@ static struct option long_options[] = {
     {"port",       required_argument, 0, 'p'},
     {"socket",     required_argument, 0, 'u'},
     {"dualnet",    no_argument,       0, 'N'},
+    {"threads",    required_argument, 0, 'T'},
+    {"workers",    required_argument, 0, 'W'},
     {"verbose",    no_argument,       0, 'v'},
     {"sync",       no_argument,       0, 's'},
     {"synctime",   required_argument, 0, 't'},
@@ -53,6 +59,7 @@ static struct option long_options[] = {
     {"protect",    no_argument,       0, 'P'},
     {"secure",     no_argument,       0, 'S'},
     {"rotate",     required_argument, 0, 'r'},
+    {"scrub",      required_argument, 0, 'c'},
     {"version",    no_argument,       0, 'V'},
     {"help",       no_argument,       0, 'h'},
     {0, 0, 0, 0}
@@ -283,13 +290,18 @@ void usage() {
     printf("  --listen <addr>     listen address (default " ZDBD_DEFAULT_LISTENADDR ")\n");
     printf("  --port   <port>     listen port (default %s)\n", ZDBD_DEFAULT_PORT);
     printf("  --socket <path>     unix socket path (override listen and port without --dualnet)\n");
-    printf("  --dualnet           listen on unix socket and tcp socket\n\n");
+    printf("  --dualnet           listen on unix socket and tcp socket\n");
+    printf("  --threads <n>       handle clients sockets on <n> network threads (linux only)\n");
+    printf("  --workers <n>       execute namespaces commands on <n> worker threads, each\n");
+    printf("                      namespace is owned by one worker (linux only)\n\n");
 
     printf(" Administrative:\n");
     printf("  --hook     <file>   execute external hook script\n");
     printf("  --admin    <pass>   set admin password\n");
     printf("  --maxsize  <size>   set default namespace maximum datasize (in bytes)\n");
-    printf("  --protect           set default namespace protected by admin password\n\n");
+    printf("  --protect           set default namespace protected by admin password\n");
+    printf("  --scrub    <size>   check datafiles integrity in background, at maximum\n");
+    printf("                      <size> bytes read per second (eg: 10M)\n\n");
 
     printf(" Useful tools:\n");
     printf("  --verbose           enable verbose (debug) information\n");
@@ -441,11 +453,53 @@ int main(int argc, char *argv[]) {
                 zdbd_settings->dualnet = 1;
                 break;
 
+            case 'T':
+                #ifndef __linux__
+                zdbd_danger("[-] network threads are only supported on linux");
+                exit(EXIT_FAILURE);
+                #endif
+
+                zdbd_settings->threads = atoi(optarg);
+
+                if(zdbd_settings->threads < 0 || zdbd_settings->threads > NETWORK_THREADS_MAX) {
+                    zdbd_danger("[-] network threads: expected between 0 and %d", NETWORK_THREADS_MAX);
+                    exit(EXIT_FAILURE);
+                }
+
+                zdbd_verbose("[+] system: network threads: %d\n", zdbd_settings->threads);
+                break;
+
+            case 'W':
+                #ifndef __linux__
+                zdbd_danger("[-] namespaces workers are only supported on linux");
+                exit(EXIT_FAILURE);
+                #endif
+
+                zdbd_settings->workers = atoi(optarg);
+
+                if(zdbd_settings->workers < 0 || zdbd_settings->workers > WORKERS_MAX) {
+                    zdbd_danger("[-] namespaces workers: expected between 0 and %d", WORKERS_MAX);
+                    exit(EXIT_FAILURE);
+                }
+
+                zdbd_verbose("[+] system: namespaces workers: %d\n", zdbd_settings->workers);
+                break;
+
             case 'r':
                 zdbd_settings->rotatesec = atoi(optarg);
                 zdbd_verbose("[+] system: file rotation time: %d seconds\n", zdbd_settings->rotatesec);
                 break;
 
+            case 'c':
+                if(!zdb_human_readable_parse(optarg, &size)) {
+                    zdbd_danger("[-] scrub rate invalid");
+                    exit(EXIT_FAILURE);
+                }
+
+                zdb_settings->scrubrate = size;
+                zdbd_verbose("[+] system: background scrubber rate: %.2f MB/s\n", MB(zdb_settings->scrubrate));
+                break;
+
             case 'D':
                 if(!zdb_human_readable_parse(optarg, &size)) {
                     zdbd_danger("[-] datasize invalid");
@@ -30,6 +30,8 @@
         // but we use the libzdb inittime for logs
         struct timeval boottime;  // timestamp when zdb started
         uint32_t clients;         // lifetime amount of clients connected
+        uint64_t clientspaused;   // amount of time a client was paused (output backpressure)
+        uint64_t clientsdropped;  // amount of clients dropped (output limit reached)
 
         // commands
         uint64_t cmdsvalid;       // amount of commands (found) executed
@@ -41,6 +43,10 @@
         uint64_t networktx;       // amount of bytes transmitted over the network
         uint64_t netevents;       // amount of socket events received
 
+        // replication
+        uint64_t mirrorsequence;  // sequence of the last frame forwarded to mirrors
+        uint64_t mirrordropped;   // amount of mirror clients dropped (too far behind)
+
     } zdbd_stats_t;
 
     typedef struct zdbd_settings_t {
@@ -54,6 +60,8 @@
         int protect;      // flag default namespace to use admin password (for writing)
         int dualnet;      // support for dual socket listening
         int rotatesec;    // amount of seconds before forcing rotation of index/data
+        int threads;      // amount of network threads (0: disabled, see network.c)
+        int workers;      // amount of namespaces workers (0: disabled, see worker.c)
 
         zdbd_stats_t stats;
 